@@ -30,10 +30,10 @@
 */ 
 
 
-#include "Mico.h"
+#include "MICO.h"
 #include "MicoPlatform.h"
 #include "platform.h"
-#include "platformInternal.h"
+#include "PlatformInternal.h"
 #include "platform_common_config.h"
 
 #define boot_log(M, ...) custom_log("BOOT", M, ##__VA_ARGS__)
@@ -41,6 +41,7 @@
 
 extern void Main_Menu(void);
 extern OSStatus update(void);
+extern void startApplicationSlot(void);
 
 #ifdef SIZE_OPTIMIZE
 char menu[] =
@@ -90,10 +91,10 @@ int main(void)
   
   /* BOOT_SEL = 1 => Normal start*/
   if(MicoShouldEnterBootloader() == false)
-    startApplication();
+    startApplicationSlot();
   /* BOOT_SEL = 0, MFG_SEL = 0 => Normal start, MICO will enter MFG mode when "MicoInit" is called*/
   else if(MicoShouldEnterMFGMode()==true)
-    startApplication();
+    startApplicationSlot();
 
   printf ( menu, MODEL, HARDWARE_REVISION );
 
@@ -30,8 +30,8 @@
 */ 
 
 #include <stdio.h>
-#include "common.h"                     /* global project definition file   */
-#include "Mico.h"
+#include "Common.h"                     /* global project definition file   */
+#include "MICO.h"
 #include "MicoPlatform.h"
 
 #define CNTLQ      0x11
@@ -31,7 +31,11 @@
 */
 
 #include "MicoPlatform.h"
-#include "debug.h"
+#include "PlatformInternal.h"
+#include "Debug.h"
+#include "LZUtils.h"
+#include "DeltaUtils.h"
+#include <stddef.h>
 
 typedef int Log_Status;					
 #define Log_NotExist				1
@@ -52,6 +56,20 @@ static uint8_t paraSaveInRam[PARA_FLASH_SIZE];
 
 static uint32_t destStartAddress, destEndAddress;
 static mico_flash_t destFlashType;
+static mico_flash_t writeFlashType;
+static uint32_t writeAddress;
+
+/* A compressed image is decoded while it is copied, matches reach back at most this far */
+static uint8_t lzWindow[1<<kLZDefaultWindowBits];
+static lz_decoder_t lzDecoder;
+
+/* A patch is applied a block at a time, the block is checked before it is written */
+static uint8_t deltaBlock[kDeltaDefaultBlockSize];
+static delta_patcher_t deltaPatcher;
+#endif
+
+#ifdef APPLICATION_B_START_ADDRESS
+static uint32_t activeSlotAddress = APPLICATION_START_ADDRESS;
 #endif
 
 /* Upgrade iamge should save this table to flash */
@@ -60,13 +78,32 @@ typedef struct  _boot_table_t {
   uint32_t length; // file real length
   uint8_t version[8];
   uint8_t type; // B:bootloader, P:boot_table, A:application, D: 8782 driver
-  uint8_t upgrade_type; //u:upgrade, 
-  uint8_t reserved[6];
+  uint8_t upgrade_type; //u:upgrade, S:start an application slot
+  uint8_t slot; // S: A or B, the application slot holding the image
+  uint8_t trial_boots; // S: a set bit for each trial boot left, 0: rolled back, 0xFF: confirmed
+  uint32_t crc; // S: CRC-32 of the image
 }boot_table_t;
 
+/* With application slots the boot table is appended to EX_PARA, PARA keeps a copy of the newest at its end */
+typedef struct  _boot_record_t {
+  boot_table_t table;
+  uint32_t seq; // 1 for the first record, 0xFFFFFFFF: erased
+  uint32_t crc; // CRC-32 of table and seq, trial_boots counted as 0xFF
+}boot_record_t;
+
 #define update_log(M, ...) custom_log("UPDATE", M, ##__VA_ARGS__)
 #define update_log_trace() custom_log_trace("UPDATE")
 
+/* Start the application slot chosen by update() */
+void startApplicationSlot(void)
+{
+#ifdef APPLICATION_B_START_ADDRESS
+  startApplicationFromAddress(activeSlotAddress);
+#else
+  startApplication();
+#endif
+}
+
 #ifndef MICO_FLASH_FOR_UPDATE
 OSStatus update(void)
 {
@@ -117,13 +154,238 @@ Log_Status updateLogCheck(boot_table_t *updateLog)
     return Log_UpdateTagNotExist;
 }
 
+/* Write at writeAddress and read it back, called with the output of the decoder and the patcher too */
+static OSStatus updateWrite(const uint8_t *buf, size_t len, void *context)
+{
+  OSStatus err = kNoErr;
+  uint32_t size, readAddress;
+
+  while(len > 0){
+    size = (len < SizePerRW)? len : SizePerRW;
+    readAddress = writeAddress;
+    err = MicoFlashInitialize( writeFlashType );
+    require_noerr(err, exit);
+    err = MicoFlashWrite(writeFlashType, &writeAddress, (uint8_t *)buf, size);
+    require_noerr(err, exit);
+    err = MicoFlashRead(writeFlashType, &readAddress, newData, size);
+    require_noerr(err, exit);
+    err = memcmp(buf, newData, size);
+    require_noerr_action(err, exit, err = kWriteErr);
+    buf += size;
+    len -= size;
+  }
+
+exit:
+  return err;
+}
+
+#ifdef UPDATE_SECTOR_SIZE
+static OSStatus updateReadApplication(uint32_t offset, uint8_t *buf, size_t len, void *context)
+{
+  uint32_t address = APPLICATION_START_ADDRESS + offset;
+  return MicoFlashRead(MICO_FLASH_FOR_APPLICATION, &address, buf, len);
+}
+
+static OSStatus updateReadRebuilt(uint32_t offset, uint8_t *buf, size_t len, void *context)
+{
+  uint32_t address = *(uint32_t *)context + offset;
+  return MicoFlashRead(MICO_FLASH_FOR_UPDATE, &address, buf, len);
+}
+
+/* A patch rebuilds the new application from the installed one, into the
+   sectors of the update area after the patch. The application is untouched
+   until the copy, so an interrupted rebuild starts again; a rebuilt image
+   that is complete is copied again without a rebuild. */
+static OSStatus updateRebuild(boot_table_t *updateLog, delta_patch_header_t *header, uint32_t *outAddress)
+{
+  OSStatus err = kNoErr;
+  delta_patch_header_t rebuilt;
+  uint32_t rebuildAddress, patchAddress, i, size;
+
+  rebuildAddress = UPDATE_START_ADDRESS + (updateLog->length + UPDATE_SECTOR_SIZE - 1) / UPDATE_SECTOR_SIZE * UPDATE_SECTOR_SIZE;
+  *outAddress = rebuildAddress;
+  require_action(updateLog->type == 'A', exit, err = kUnsupportedErr);
+  require_action(header->newLength <= destEndAddress - destStartAddress + 1, exit, err = kSizeErr);
+  require_action(rebuildAddress <= UPDATE_END_ADDRESS && header->newLength <= UPDATE_END_ADDRESS - rebuildAddress + 1, exit, err = kNoSpaceErr);
+
+  rebuilt.oldLength = header->newLength;
+  rebuilt.oldCrc = header->newCrc;
+  if(DeltaPatchCheckSource(&rebuilt, updateReadRebuilt, &rebuildAddress, data, SizePerRW) == kNoErr){
+    update_log("Rebuilt before, copy again");
+    goto exit;
+  }
+
+  err = DeltaPatchCheckSource(header, updateReadApplication, NULL, data, SizePerRW);
+  require_noerr_action(err, exit, update_log("The patch is not for the installed application"));
+  update_log("Apply the patch to 0x%x bytes at 0x%08x", header->newLength, rebuildAddress);
+
+  err = MicoFlashErase(MICO_FLASH_FOR_UPDATE, rebuildAddress, rebuildAddress + header->newLength - 1);
+  require_noerr(err, exit);
+  writeFlashType = MICO_FLASH_FOR_UPDATE;
+  writeAddress = rebuildAddress;
+  err = DeltaPatcherInit(&deltaPatcher, header, lzWindow, sizeof(lzWindow), deltaBlock, sizeof(deltaBlock),
+                         updateReadApplication, updateWrite, NULL);
+  require_noerr(err, exit);
+
+  patchAddress = UPDATE_START_ADDRESS + kDeltaPatchHeaderSize;
+  for(i = kDeltaPatchHeaderSize; i < updateLog->length; i += size){
+    size = (updateLog->length - i < SizePerRW)? updateLog->length - i : SizePerRW;
+    err = MicoFlashRead(MICO_FLASH_FOR_UPDATE, &patchAddress, data, size);
+    require_noerr(err, exit);
+    err = DeltaPatcherExecute(&deltaPatcher, data, size);
+    require_noerr(err, exit);
+  }
+  require_action(DeltaPatcherIsComplete(&deltaPatcher), exit, err = kUnderrunErr);
+
+exit:
+  return err;
+}
+#endif
+
+#ifdef APPLICATION_B_START_ADDRESS
+static void slotRange(uint8_t slot, mico_flash_t *flash, uint32_t *start, uint32_t *end)
+{
+  if(slot == 'B'){
+    *flash = MICO_FLASH_FOR_APPLICATION_B;
+    *start = APPLICATION_B_START_ADDRESS;
+    *end = APPLICATION_B_END_ADDRESS;
+  }else{
+    *flash = MICO_FLASH_FOR_APPLICATION;
+    *start = APPLICATION_START_ADDRESS;
+    *end = APPLICATION_END_ADDRESS;
+  }
+}
+
+/* The image fits the slot, its vector table points into the slot and its CRC matches */
+static bool slotImageIsValid(boot_table_t *updateLog, uint8_t slot)
+{
+  mico_flash_t flash;
+  uint32_t start, end, address, i, size;
+  uint32_t vectors[2];
+  uint32_t crc = 0xFFFFFFFF;
+
+  slotRange(slot, &flash, &start, &end);
+  if(updateLog->start_address != start || updateLog->length < sizeof(vectors) || updateLog->length > end - start + 1)
+    return false;
+
+  address = start;
+  for(i = 0; i < updateLog->length; i += size){
+    size = (updateLog->length - i < SizePerRW)? updateLog->length - i : SizePerRW;
+    if(MicoFlashRead(flash, &address, data, size) != kNoErr)
+      return false;
+    if(i == 0){
+      memcpy(vectors, data, sizeof(vectors));
+      if((vectors[0] & 0x2FFE0000) != 0x20000000 || vectors[1] < start || vectors[1] > end)
+        return false;
+    }
+    crc = LZCrc32Update(crc, data, size);
+  }
+  return (crc ^ 0xFFFFFFFF) == updateLog->crc;
+}
+
+static bool slotRecordIsValid(boot_record_t *record)
+{
+  boot_record_t counted = *record;
+
+  counted.table.trial_boots = 0xFF;
+  return record->seq != 0xFFFFFFFF &&
+         record->crc == (LZCrc32Update(0xFFFFFFFF, (uint8_t *)&counted, offsetof(boot_record_t, crc)) ^ 0xFFFFFFFF);
+}
+
+/* The newest valid boot record, and where its trial_boots is. A record in
+   EX_PARA wins over the copy in PARA with the same seq. */
+static bool slotReadRecord(boot_record_t *outRecord, mico_flash_t *outFlash, uint32_t *outTrialBootsAddress)
+{
+  boot_record_t record;
+  mico_flash_t flash;
+  uint32_t address, readAddress, i;
+  bool found = false;
+
+  for(i = 0; i <= EX_PARA_FLASH_SIZE / sizeof(boot_record_t); i++){
+    if(i < EX_PARA_FLASH_SIZE / sizeof(boot_record_t)){
+      flash = MICO_FLASH_FOR_EX_PARA;
+      address = EX_PARA_START_ADDRESS + i * sizeof(boot_record_t);
+    }else{
+      flash = MICO_FLASH_FOR_PARA;
+      address = PARA_END_ADDRESS + 1 - sizeof(boot_record_t);
+    }
+    readAddress = address;
+    if(MicoFlashRead(flash, &readAddress, (uint8_t *)&record, sizeof(boot_record_t)) != kNoErr)
+      continue;
+    if(slotRecordIsValid(&record) == false || (found && record.seq <= outRecord->seq))
+      continue;
+    *outRecord = record;
+    *outFlash = flash;
+    *outTrialBootsAddress = address + offsetof(boot_record_t, table) + offsetof(boot_table_t, trial_boots);
+    found = true;
+  }
+  return found;
+}
+
+/* trial_boots only loses bits, so it is programmed in place without an erase:
+   a power cut cannot lose the parameters or the boot table. */
+static OSStatus slotSetTrialBoots(mico_flash_t flash, uint32_t address, uint8_t trialBoots)
+{
+  OSStatus err = kNoErr;
+
+  err = MicoFlashInitialize(flash);
+  require_noerr(err, exit);
+  err = MicoFlashWrite(flash, &address, &trialBoots, 1);
+  require_noerr(err, exit);
+
+exit:
+  MicoFlashFinalize(flash);
+  return err;
+}
+
+/* Choose the slot to start, nothing is copied. A slot on trial is verified and
+   one of its trial bits is cleared before every boot; when it fails or has no
+   trial boot left, the other slot that ran before is started again. The trial
+   bits are at trialBootsAddress of flash. */
+OSStatus updateSlot(boot_table_t *updateLog, mico_flash_t flash, uint32_t trialBootsAddress)
+{
+  mico_flash_t slotFlash;
+  uint32_t start, end;
+  uint8_t slot = (updateLog->slot == 'B')? 'B' : 'A';
+  uint8_t trialBoots = updateLog->trial_boots;
+
+  if(trialBoots != 0xFF && trialBoots != 0){
+    trialBoots &= trialBoots - 1;
+    if(trialBoots == 0 || slotImageIsValid(updateLog, slot) == false){
+      update_log("Application slot %c failed, roll back", slot);
+      trialBoots = 0;
+    }
+    /* A boot that cannot be counted may loop forever, do not try the new slot.
+       The application knows the slot it runs in, it confirms that one. */
+    if(slotSetTrialBoots(flash, trialBootsAddress, trialBoots) != kNoErr && trialBoots != 0){
+      trialBoots = 0;
+      slotSetTrialBoots(flash, trialBootsAddress, trialBoots);
+    }
+  }
+
+  if(trialBoots == 0)
+    slot = (slot == 'B')? 'A' : 'B';
+  slotRange(slot, &slotFlash, &start, &end);
+  activeSlotAddress = start;
+  update_log("Start application slot %c at 0x%08x", slot, start);
+  return kNoErr;
+}
+#endif
+
 
 OSStatus update(void)
 {
   boot_table_t updateLog;
-  uint32_t i, j, size;
-  uint32_t updateStartAddress;
-  uint32_t destStartAddress_tmp;
+#ifdef APPLICATION_B_START_ADDRESS
+  boot_record_t record;
+  mico_flash_t recordFlash;
+  uint32_t trialBootsAddress;
+#endif
+  uint32_t i, size;
+  uint32_t updateStartAddress, copyLength, eraseEndAddress;
+  lz_image_header_t lzHeader;
+  delta_patch_header_t deltaHeader;
+  bool isCompressed = false;
   uint32_t paraStartAddress;
   OSStatus err = kNoErr;
  
@@ -138,8 +400,23 @@ OSStatus update(void)
   err = MicoFlashRead(MICO_FLASH_FOR_PARA, &paraStartAddress, (uint8_t *)&updateLog, sizeof(boot_table_t));
   require_noerr(err, exit);
 
+#ifdef APPLICATION_B_START_ADDRESS
+  if(slotReadRecord(&record, &recordFlash, &trialBootsAddress)){
+    err = updateSlot(&record.table, recordFlash, trialBootsAddress);
+    goto exit;
+  }
+  /* Written before the boot records */
+  if(updateLog.upgrade_type == 'S'){
+    err = updateSlot(&updateLog, MICO_FLASH_FOR_PARA, PARA_START_ADDRESS + offsetof(boot_table_t, trial_boots));
+    goto exit;
+  }
+#endif
+
   /*Not a correct record*/
   if(updateLogCheck(&updateLog) != Log_NeedUpdate){
+#ifndef APPLICATION_B_START_ADDRESS /* The update area is application slot B, its image is kept */
+    uint32_t j;
+
     size = UPDATE_FLASH_SIZE/SizePerRW;
     for(i = 0; i <= size; i++){
       if( i==size ){
@@ -164,47 +441,59 @@ OSStatus update(void)
         }
       }
     }
+#endif
     goto exit;
   }
   
   update_log("Write OTA data to destination, type:%d, from 0x%08x to 0x%08x, length 0x%x", destFlashType, destStartAddress, destEndAddress, updateLog.length);
   
-  destStartAddress_tmp = destStartAddress;
   updateStartAddress = UPDATE_START_ADDRESS;
+  err = MicoFlashRead(MICO_FLASH_FOR_UPDATE, &updateStartAddress, data, kDeltaPatchHeaderSize);
+  require_noerr(err, exit);
+  updateStartAddress = UPDATE_START_ADDRESS;
+  copyLength = updateLog.length;
+  eraseEndAddress = UPDATE_START_ADDRESS + updateLog.length - 1;
+  
+  /*Checked before the destination is erased*/
+  if(updateLog.length > kDeltaPatchHeaderSize && DeltaPatchGetHeader(data, kDeltaPatchHeaderSize, &deltaHeader) == kNoErr){
+#ifdef UPDATE_SECTOR_SIZE
+    err = updateRebuild(&updateLog, &deltaHeader, &updateStartAddress);
+    require_noerr(err, exit);
+    copyLength = deltaHeader.newLength;
+    eraseEndAddress = updateStartAddress + deltaHeader.newLength - 1;
+#else
+    err = kUnsupportedErr;
+    goto exit;
+#endif
+  }
+  else if(LZImageGetHeader(data, kLZImageHeaderSize, &lzHeader) == kNoErr){
+    update_log("Decompress to 0x%x bytes", lzHeader.rawLength);
+    require_action(lzHeader.rawLength <= destEndAddress - destStartAddress + 1, exit, err = kSizeErr);
+    err = LZDecoderInit(&lzDecoder, &lzHeader, lzWindow, sizeof(lzWindow), updateWrite, NULL);
+    require_noerr(err, exit);
+    isCompressed = true;
+    updateStartAddress += kLZImageHeaderSize;
+    copyLength -= kLZImageHeaderSize;
+  }
   
+  writeFlashType = destFlashType;
+  writeAddress = destStartAddress;
   err = MicoFlashInitialize( destFlashType );
   require_noerr(err, exit);
   err = MicoFlashErase( destFlashType, destStartAddress, destEndAddress );
   require_noerr(err, exit);
-  size = (updateLog.length)/SizePerRW;
-  for(i = 0; i <= size; i++){
-    if( i==size && (updateLog.length)%SizePerRW){
-      err = MicoFlashRead(MICO_FLASH_FOR_UPDATE, &updateStartAddress, data , (updateLog.length)%SizePerRW);
-      require_noerr(err, exit);
-      err = MicoFlashInitialize( destFlashType );
-      require_noerr(err, exit);
-      err = MicoFlashWrite(destFlashType, &destStartAddress_tmp, data, (updateLog.length)%SizePerRW);
-      require_noerr(err, exit);
-      destStartAddress_tmp -= (updateLog.length)%SizePerRW;
-      err = MicoFlashRead(destFlashType, &destStartAddress_tmp, newData , (updateLog.length)%SizePerRW);
-      require_noerr(err, exit);
-      err = memcmp(data, newData, (updateLog.length)%SizePerRW);
-      require_noerr_action(err, exit, err = kWriteErr);
-    }
-    else{
-      err = MicoFlashRead(MICO_FLASH_FOR_UPDATE, &updateStartAddress, data , SizePerRW);
-      require_noerr(err, exit);
-      err = MicoFlashInitialize( destFlashType );
-      require_noerr(err, exit);
-      err = MicoFlashWrite(destFlashType, &destStartAddress_tmp, data, SizePerRW);
-      require_noerr(err, exit);
-      destStartAddress_tmp -= SizePerRW;
-      err = MicoFlashRead(destFlashType, &destStartAddress_tmp, newData , SizePerRW);
-      require_noerr(err, exit);
-      err = memcmp(data, newData, SizePerRW);
-      require_noerr_action(err, exit, err = kWriteErr); 
-    }
-  } 
+  for(i = 0; i < copyLength; i += size){
+    size = (copyLength - i < SizePerRW)? copyLength - i : SizePerRW;
+    err = MicoFlashRead(MICO_FLASH_FOR_UPDATE, &updateStartAddress, data , size);
+    require_noerr(err, exit);
+    if(isCompressed)
+      err = LZDecoderExecute(&lzDecoder, data, size);
+    else
+      err = updateWrite(data, size, NULL);
+    require_noerr(err, exit);
+  }
+  if(isCompressed)
+    require_action(LZDecoderIsComplete(&lzDecoder), exit, err = kUnderrunErr);
   update_log("Update start to clear data...");
     
   paraStartAddress = PARA_START_ADDRESS;
@@ -219,7 +508,8 @@ OSStatus update(void)
   err = MicoFlashWrite(MICO_FLASH_FOR_PARA, &paraStartAddress, paraSaveInRam, PARA_FLASH_SIZE);
   require_noerr(err, exit);
   
-  err = MicoFlashErase(MICO_FLASH_FOR_UPDATE, UPDATE_START_ADDRESS, UPDATE_END_ADDRESS);
+  /*Only the sectors of the image and a rebuilt one, others are erased by the check at the next boot if needed*/
+  err = MicoFlashErase(MICO_FLASH_FOR_UPDATE, UPDATE_START_ADDRESS, eraseEndAddress);
   require_noerr(err, exit);
   update_log("Update success");
   
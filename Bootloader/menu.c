@@ -34,12 +34,12 @@
 */
 
 /* Includes ------------------------------------------------------------------*/
-#include "common.h"
+#include "Common.h"
 #include "ymodem.h"
 #include "platform_common_config.h"
-#include "platformInternal.h"
+#include "PlatformInternal.h"
 #include "StringUtils.h"
-#include "MicoRtos.h"
+#include "MICORTOS.h"
 #include "MicoPlatform.h"
 #include <ctype.h>                    
 
@@ -93,7 +93,7 @@ char ERROR_STR [] = "\n\r*** ERROR: %s\n\r";    /* ERROR message string in code
 
 extern char menu[];
 extern void getline (char *line, int n);          /* input line               */
-extern void startApplication(void);
+extern void startApplicationSlot(void);
 
 /* Private function prototypes -----------------------------------------------*/
 void SerialDownload(mico_flash_t flash, uint32_t flashdestination, int32_t maxRecvSize);
@@ -400,7 +400,7 @@ void Main_Menu(void)
     /***************** Command: Excute the application *************************/
     else if(strcmp(cmdname, "BOOT") == 0 || strcmp(cmdname, "6") == 0)	{
       printf ("\n\rBooting.......\n\r");
-      startApplication();
+      startApplicationSlot();
     }
 
    /***************** Command: Reboot *************************/
@@ -31,7 +31,7 @@
 */
 
 /* Includes ------------------------------------------------------------------*/
-#include "common.h"
+#include "Common.h"
 #include "ymodem.h"
 #include "string.h"
 #include "StringUtils.h"
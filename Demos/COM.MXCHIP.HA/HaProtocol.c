@@ -6,6 +6,7 @@
 #include "MicoPlatform.h"
 #include "platform_common_config.h"
 #include "MICONotificationCenter.h"
+#include "OTAUtils.h"
 #include <stdio.h>
 
 #define ha_log(M, ...) custom_log("HA Command", M, ##__VA_ARGS__)
@@ -169,6 +170,7 @@ OSStatus haWlanCommandProcess(unsigned char *inBuf, int *inBufLen, int inSocketF
         break;
 #ifdef MICO_FLASH_FOR_UPDATE
       case CMD_OTA:
+      case CMD_OTA_RESUME:
         err = _ota_process(inBuf+idx, cmdLen, &inSocketFd, inContext);
         break;
 #endif
@@ -198,74 +200,126 @@ OSStatus _ota_process(uint8_t *inBuf, int inBufLen, int *inSocketFd, mico_Contex
   OSStatus err = kNoErr;
   mxchip_cmd_head_t *p_control_cmd;
   ota_upgrate_t *p_upgrade;
+  ota_resume_t *p_resume;
   uint8_t * p_bin;
   int bin_len, total_len, head_len;
-  uint32_t flash_addr = UPDATE_START_ADDRESS;
-  uint8_t md5_ret[16];
   mxchip_cmd_head_t cmd_ack;
+  ota_resume_reply_t resume_ack;
+  bool is_resume;
   fd_set readfds;
   struct timeval_t t;
-  md5_context ctx;
+  ota_sink_t *sink = NULL;
+  ota_image_id_t image;
+  uint32_t first = 0, offset = 0, skip;
+  mico_flash_t flash;
+  uint32_t start, end;
 
   memset(&cmd_ack, 0, sizeof(cmd_ack));
   cmd_ack.cmd_status = CMD_FAIL;
   p_control_cmd = (mxchip_cmd_head_t *)inBuf;
   cmd_ack.flag = p_control_cmd->flag;
   cmd_ack.cmd = p_control_cmd->cmd | 0x8000;
-  head_len = sizeof(mxchip_cmd_head_t) + sizeof(ota_upgrate_t) - 2;
-  if (inBufLen < head_len){
-    goto CMD_REPLY;
+  is_resume = (p_control_cmd->cmd & 0x7FFF) == CMD_OTA_RESUME;
+  memset(&image, 0, sizeof(image));
+
+  if(is_resume){
+    head_len = sizeof(mxchip_cmd_head_t) + sizeof(ota_resume_t) - 2;
+    if (inBufLen < head_len){
+      goto CMD_REPLY;
+    }
+    p_resume = (ota_resume_t*)(p_control_cmd->data);
+    memcpy(image.md5, p_resume->md5, 16);
+    image.length = p_resume->len;
+    first = p_resume->offset;
+    p_bin = p_resume->data;
+  }else{
+    head_len = sizeof(mxchip_cmd_head_t) + sizeof(ota_upgrate_t) - 2;
+    if (inBufLen < head_len){
+      goto CMD_REPLY;
+    }
+    p_upgrade = (ota_upgrate_t*)(p_control_cmd->data);
+    memcpy(image.md5, p_upgrade->md5, 16);
+    image.length = p_upgrade->len;
+    p_bin = p_upgrade->data;
   }
-  MicoFlashInitialize( MICO_FLASH_FOR_UPDATE );
-  p_upgrade = (ota_upgrate_t*)(p_control_cmd->data);
 
-  p_bin = p_upgrade->data;
-  total_len = p_upgrade->len;
+  sink = calloc(1, sizeof(ota_sink_t));
+  require_action(sink, CMD_REPLY, err = kNoMemoryErr);
+  MICOGetOTATarget(inContext, &flash, &start, &end);
+  // Sectors are erased as the image reaches them, the MD5 is updated as it is written.
+  // The progress is saved, a transfer that stops can go on with CMD_OTA_RESUME
+  if(kOTAUpdateSectorSize > 0)
+    err = OTASinkOpenSession(sink, flash, start, end, kOTAUpdateSectorSize, kOTADigest_MD5, &image, &offset);
+  else
+    err = OTASinkOpen(sink, flash, start, end, kOTAUpdateSectorSize, kOTADigest_MD5);
+  require_noerr(err, CMD_REPLY);
+  require_action(first <= offset && first <= image.length, CMD_REPLY, err = kRangeErr);
+
+  // The bytes before offset are in flash already
+  skip = offset - first;
+  total_len = image.length - first;
   bin_len = inBufLen - head_len;
+  if (bin_len > total_len) bin_len = total_len;
   total_len -= bin_len;
 
-  if (bin_len>0)
-    MicoFlashWrite(MICO_FLASH_FOR_UPDATE, &flash_addr, p_bin, bin_len);
+  while (1) {
+    if ((uint32_t)bin_len > skip){
+      err = OTASinkWrite(sink, p_bin + skip, bin_len - skip);
+      require_noerr(err, CMD_REPLY);
+      skip = 0;
+    }else{
+      skip -= bin_len;
+    }
+    if (total_len <= 0) break;
 
-  while (total_len>0) {
     FD_ZERO(&readfds);
     t.tv_sec = 10;
     t.tv_usec = 0;
     FD_SET(*inSocketFd, &readfds);
-    select(1, &readfds, NULL, NULL, &t);
+    select(*inSocketFd + 1, &readfds, NULL, NULL, &t);
+    require_action(FD_ISSET(*inSocketFd, &readfds), exit, err = kTimeoutErr);
 
-    if (FD_ISSET(*inSocketFd, &readfds)) {
-      bin_len = recv(*inSocketFd, (char*)p_bin, 1024, 0);
-      require_action(bin_len >= 0, exit, err = kConnectionErr);
-      MicoFlashWrite(MICO_FLASH_FOR_UPDATE, &flash_addr, p_bin, bin_len);
-      total_len-=bin_len;
-    }
+    bin_len = recv(*inSocketFd, (char*)p_bin, total_len < 1024 ? total_len : 1024, 0);
+    require_action(bin_len > 0, exit, err = kConnectionErr);
+    total_len-=bin_len;
   }
 
+  // A corrupt image is rejected before the boot table points to it
+  err = OTASinkFinish(sink, image.md5, NULL);
+  require_noerr(err, CMD_REPLY);
+  offset = image.length;
 
-  InitMd5( &ctx );
-  Md5Update( &ctx, (uint8_t *)UPDATE_START_ADDRESS, flash_addr - UPDATE_START_ADDRESS);
-  Md5Final( &ctx, md5_ret );
-
-  if(memcmp(md5_ret, p_upgrade->md5, 16) != 0) {
-    MicoFlashFinalize(MICO_FLASH_FOR_UPDATE);
-    goto CMD_REPLY;
-  }
-
-  memset(&inContext->flashContentInRam.bootTable, 0, sizeof(boot_table_t));
-  inContext->flashContentInRam.bootTable.length = flash_addr - UPDATE_START_ADDRESS;
-  inContext->flashContentInRam.bootTable.start_address = UPDATE_START_ADDRESS;
-  inContext->flashContentInRam.bootTable.type = 'A';
-  inContext->flashContentInRam.bootTable.upgrade_type = 'U';
+  err = MICOSetOTABootTable(inContext, OTASinkLength(sink));
+  require_noerr(err, CMD_REPLY);
   MICOUpdateConfiguration(inContext);
   cmd_ack.cmd_status = CMD_OK;
   
 CMD_REPLY:
-  err =  SocketSend( *inSocketFd, (uint8_t *)&cmd_ack, sizeof(cmd_ack) + 1 + cmd_ack.datalen );
+  if(sink){
+    OTASinkAbort(sink);
+    free(sink);
+    sink = NULL;
+  }
+  if(is_resume){
+    if(cmd_ack.cmd_status != CMD_OK)
+      offset = OTASessionGetOffset(&image);
+    resume_ack.flag = cmd_ack.flag;
+    resume_ack.cmd = cmd_ack.cmd;
+    resume_ack.cmd_status = cmd_ack.cmd_status;
+    resume_ack.datalen = sizeof(uint32_t);
+    resume_ack.offset = offset;
+    resume_ack.cksum = _calc_sum(&resume_ack, sizeof(ota_resume_reply_t) - 2);
+    err = SocketSend( *inSocketFd, (uint8_t *)&resume_ack, sizeof(ota_resume_reply_t) );
+  }else
+    err =  SocketSend( *inSocketFd, (uint8_t *)&cmd_ack, sizeof(cmd_ack) + 1 + cmd_ack.datalen );
   require_noerr(err, exit);
   return kNoErr;
 
 exit:
+  if(sink){
+    OTASinkAbort(sink);
+    free(sink);
+  }
   SocketClose(inSocketFd);
   inContext->micoStatus.sys_state = eState_Software_Reset;
   mico_rtos_set_semaphore(&inContext->micoStatus.sys_state_change_sem);
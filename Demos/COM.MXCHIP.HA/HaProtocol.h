@@ -23,6 +23,7 @@ enum {
   CMD_GET_STATUS, 
   CMD_CONTROL,    
   CMD_SEARCH, 
+  CMD_OTA_RESUME,          //Continue an OTA image from an offset, see ota_resume_t
 };
 
 enum {
@@ -47,6 +48,27 @@ typedef struct _upgrade_t {
   uint8_t data[1];
 }ota_upgrate_t;
 
+/* The image from offset to len follows. The device keeps the progress of an
+ * image sent by CMD_OTA or CMD_OTA_RESUME, the reply always tells how many
+ * bytes of it are in flash. An offset after that is refused, so a client
+ * that does not know it sends 0xFFFFFFFF and no data.
+ */
+typedef struct _resume_t {
+  uint8_t md5[16];
+  uint32_t len;
+  uint32_t offset;
+  uint8_t data[1];
+}ota_resume_t;
+
+typedef struct _resume_reply_t {
+  uint16_t flag; 
+  uint16_t cmd; 
+  uint16_t cmd_status; 
+  uint16_t datalen; 
+  uint32_t offset;
+  uint16_t cksum;
+}ota_resume_reply_t;
+
 typedef struct _current_state_ {
   uint32_t uap_state;
   uint32_t sta_state;
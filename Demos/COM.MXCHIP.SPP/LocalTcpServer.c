@@ -4,8 +4,8 @@
   * @author  William Xu
   * @version V1.0.0
   * @date    05-May-2014
-  * @brief   This file create a TCP listener thread, accept every TCP client
-  *          connection and create thread for them.
+  * @brief   This file create a TCP server thread, it accepts every TCP client
+  *          connection and serves all of them.
   ******************************************************************************
   * @attention
   *
@@ -25,141 +25,106 @@
 #include "MICOAppDefine.h"
 
 #include "SppProtocol.h"
+#include "SppBroadcast.h"
 #include "SocketUtils.h"
+#include "TCPServerUtils.h"
 
 #define server_log(M, ...) custom_log("TCP SERVER", M, ##__VA_ARGS__)
 #define server_log_trace() custom_log_trace("TCP SERVER")
 
-const int loopBackPortTable[20] = { 1004, 1005, 1006, 1007, 1008, 1009, 1010, 1011, 1012, 1013, 
-                                    1014, 1015, 1016, 1017, 1018, 1019, 1020, 1021, 1022, 1023};
-
-static void localTcpClient_thread(void *inFd);
+static OSStatus localTcpClientAccepted(tcp_connection_t *connection, void *inContext);
+static OSStatus localTcpClientReadable(tcp_connection_t *connection, void *inContext);
+static void localTcpClientClosed(tcp_connection_t *connection, OSStatus reason, void *inContext);
 static mico_Context_t *Context;
 
-mico_thread_t   localTcpClient_thread_handler;
+/*Clients are served one at a time by the server thread, they share one receive buffer*/
+static uint8_t *inDataBuffer = NULL;
+/*Connection of each broadcast subscriber, only used by the server thread*/
+static tcp_connection_t *_clients[SPP_BROADCAST_SUBSCRIBER_NUM];
+
+static const tcp_listener_callbacks_t localTcpClientCallbacks = {
+  localTcpClientAccepted,
+  localTcpClientReadable,
+  localTcpClientClosed,
+};
 
 void localTcpServer_thread(void *inContext)
 {
   server_log_trace();
   OSStatus err = kUnknownErr;
-  int i, j;
+  tcp_server_t *server = NULL;
+  int i;
   Context = inContext;
-  struct sockaddr_t addr;
-  int sockaddr_t_size;
-  fd_set readfds;
-  char ip_address[16];
-  
-  int localTcpListener_fd = -1;
-
-  for(i=0; i < MAX_Local_Client_Num; i++) 
-    Context->appStatus.loopBack_PortList[i] = 0;
-
-  /*Establish a TCP server fd that accept the tcp clients connections*/ 
-  localTcpListener_fd = socket( AF_INET, SOCK_STREAM, IPPROTO_TCP );
-  require_action(IsValidSocket( localTcpListener_fd ), exit, err = kNoResourcesErr );
-  addr.s_ip = INADDR_ANY;
-  addr.s_port = Context->flashContentInRam.appConfig.localServerPort;
-  err = bind(localTcpListener_fd, &addr, sizeof(addr));
-  require_noerr( err, exit );
 
-  err = listen(localTcpListener_fd, 0);
+  inDataBuffer = malloc(wlanBufferLen);
+  require_action(inDataBuffer, exit, err = kNoMemoryErr);
+
+  server = TCPServerCreate();
+  require_action(server, exit, err = kNoMemoryErr);
+
+  /*SPP clients may stay silent while they receive UART data, they are never closed for being idle*/
+  err = TCPServerListen(server, Context->flashContentInRam.appConfig.localServerPort, MAX_Local_Client_Num, 0, &localTcpClientCallbacks, Context);
   require_noerr( err, exit );
 
-  server_log("Server established at port: %d, fd: %d", Context->flashContentInRam.appConfig.localServerPort, localTcpListener_fd);
-  
-  while(1){
-    FD_ZERO(&readfds);
-    FD_SET(localTcpListener_fd, &readfds);  
-    select(1, &readfds, NULL, NULL, NULL);
-
-    /*Check tcp connection requests */
-    if(FD_ISSET(localTcpListener_fd, &readfds)){
-      sockaddr_t_size = sizeof(struct sockaddr_t);
-      j = accept(localTcpListener_fd, &addr, &sockaddr_t_size);
-      if (j > 0) {
-        inet_ntoa(ip_address, addr.s_ip );
-        server_log("Client %s:%d connected, fd: %d", ip_address, addr.s_port, j);
-        if(kNoErr != mico_rtos_create_thread(NULL, MICO_APPLICATION_PRIORITY, "Local Clients", localTcpClient_thread, STACK_SIZE_LOCAL_TCP_CLIENT_THREAD, &j) ) 
-          SocketClose(&j);
-      }
+  server_log("Server established at port: %d", Context->flashContentInRam.appConfig.localServerPort);
+
+  /*A client that the UART receive thread gave up on is closed here, by the thread that owns its socket*/
+  do{
+    err = TCPServerRunOnce(server, kTCPServerMaxWait);
+    for(i=0; i < SPP_BROADCAST_SUBSCRIBER_NUM; i++){
+      if(_clients[i] && _clients[i]->state == eTCPConnection_Open && sppBroadcastIsClosed(i))
+        TCPConnectionClose(_clients[i], kConnectionErr);
     }
-   }
+  }while(err == kNoErr);
 
 exit:
     server_log("Exit: Local controller exit with err = %d", err);
+    TCPServerDelete(server);
+    if(inDataBuffer) free(inDataBuffer);
+    inDataBuffer = NULL;
     mico_rtos_delete_thread(NULL);
     return;
 }
 
-void localTcpClient_thread(void *inFd)
+static OSStatus localTcpClientAccepted(tcp_connection_t *connection, void *inContext)
 {
-  OSStatus err;
-  int i;
-  int indexForPortTable;
-  int clientFd = *(int *)inFd;
-  int clientLoopBackFd = -1;
-  uint8_t *inDataBuffer = NULL;
-  uint8_t *outDataBuffer = NULL;
-  int len;
-  struct sockaddr_t addr;
-  fd_set readfds;
-  struct timeval_t t;
+  int subscriber;
+  UNUSED_PARAMETER(inContext);
 
-  inDataBuffer = malloc(wlanBufferLen);
-  require_action(inDataBuffer, exit, err = kNoMemoryErr);
-  outDataBuffer = malloc(wlanBufferLen);
-  require_action(outDataBuffer, exit, err = kNoMemoryErr);
-
-  for(i=0; i < MAX_Local_Client_Num; i++) {
-    if( Context->appStatus.loopBack_PortList[i] == 0 ){
-      Context->appStatus.loopBack_PortList[i] = loopBackPortTable[clientFd];
-      indexForPortTable = i;
-      break;
-    }
-  }
-
-  /*Loopback fd, recv data from other thread */
-  clientLoopBackFd = socket( AF_INET, SOCK_DGRM, IPPROTO_UDP );
-  require_action(IsValidSocket( clientLoopBackFd ), exit, err = kNoResourcesErr );
-  addr.s_ip = IPADDR_LOOPBACK;
-  addr.s_port = Context->appStatus.loopBack_PortList[indexForPortTable];
-  err = bind( clientLoopBackFd, &addr, sizeof(addr) );
-  require_noerr( err, exit );
-
-  t.tv_sec = 4;
-  t.tv_usec = 0;
-  
-  while(1){
+  /*UART data is sent to this client by the UART receive thread*/
+  subscriber = sppBroadcastSubscribe(connection->fd);
+  if(subscriber == -1)
+    return kNoResourcesErr;
 
-    FD_ZERO(&readfds);
-    FD_SET(clientFd, &readfds); 
-    FD_SET(clientLoopBackFd, &readfds); 
-
-    select(1, &readfds, NULL, NULL, &t);
+  connection->userContext = (void *)(intptr_t)subscriber;
+  _clients[subscriber] = connection;
+  return kNoErr;
+}
 
-    /*recv UART data using loopback fd*/
-    if (FD_ISSET( clientLoopBackFd, &readfds )) {
-      len = recv( clientLoopBackFd, outDataBuffer, wlanBufferLen, 0 );
-      SocketSend( clientFd, outDataBuffer, len );
-    }
+static OSStatus localTcpClientReadable(tcp_connection_t *connection, void *inContext)
+{
+  OSStatus err = kNoErr;
+  int len;
+  UNUSED_PARAMETER(inContext);
 
-    /*Read data from tcp clients and process these data using HA protocol */ 
-    if (FD_ISSET(clientFd, &readfds)) {
-      len = recv(clientFd, inDataBuffer, wlanBufferLen, 0);
-      require_action_quiet(len>0, exit, err = kConnectionErr);
-      sppWlanCommandProcess(inDataBuffer, &len, clientFd, Context);
-    }
-  }
+  /*Read data from tcp clients and process these data using HA protocol */ 
+  len = recv(connection->fd, inDataBuffer, wlanBufferLen, 0);
+  require_action_quiet(len>0, exit, err = kConnectionErr);
+  sppWlanCommandProcess(inDataBuffer, &len, connection->fd, Context);
 
 exit:
-    server_log("Exit: Client exit with err = %d", err);
-    Context->appStatus.loopBack_PortList[indexForPortTable] = 0;
-    if(clientLoopBackFd != -1)
-      SocketClose(&clientLoopBackFd);
-    SocketClose(&clientFd);
-    if(inDataBuffer) free(inDataBuffer);
-    if(outDataBuffer) free(outDataBuffer);
-    mico_rtos_delete_thread(NULL);
-    return;
+  return err;
+}
+
+static void localTcpClientClosed(tcp_connection_t *connection, OSStatus reason, void *inContext)
+{
+  spp_subscriber_stats_t stats;
+  UNUSED_PARAMETER(inContext);
+
+  server_log("Exit: Client exit with err = %d", reason);
+  _clients[(int)(intptr_t)connection->userContext] = NULL;
+  sppBroadcastUnsubscribe((int)(intptr_t)connection->userContext, &stats);
+  server_log("Client fd: %d, %d packets delivered, %d dropped, %d blocked sends, broadcast err = %d", connection->fd,
+             stats.deliveredPackets, stats.droppedPackets, stats.blockedSends, stats.closeReason);
 }
 
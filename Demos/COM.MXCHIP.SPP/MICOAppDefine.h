@@ -43,26 +43,21 @@
 #define DEAFULT_REMOTE_SERVER               "192.168.2.254"
 #define DEFAULT_REMOTE_SERVER_PORT          8080
 #define UART_RECV_TIMEOUT                   500
+#define UART_FLUSH_INTERVAL                 20    /*UART receive timeout while a TCP client has data pending*/
 #define UART_ONE_PACKAGE_LENGTH             1024
 #define wlanBufferLen                       1024
 #define UART_BUFFER_LENGTH                  2048
 
-#define LOCAL_TCP_SERVER_LOOPBACK_PORT      1000
-#define REMOTE_TCP_CLIENT_LOOPBACK_PORT     1002
-#define RECVED_UART_DATA_LOOPBACK_PORT      1003
-
 #define BONJOUR_SERVICE                     "_easylink._tcp.local."
 
 /* Define thread stack size */
 #ifdef DEBUG
   #define STACK_SIZE_UART_RECV_THREAD           0x2A0
-  #define STACK_SIZE_LOCAL_TCP_SERVER_THREAD    0x300
-  #define STACK_SIZE_LOCAL_TCP_CLIENT_THREAD    0x350
+  #define STACK_SIZE_LOCAL_TCP_SERVER_THREAD    0x380
   #define STACK_SIZE_REMOTE_TCP_CLIENT_THREAD   0x500
 #else
   #define STACK_SIZE_UART_RECV_THREAD           0x150
-  #define STACK_SIZE_LOCAL_TCP_SERVER_THREAD    0x180
-  #define STACK_SIZE_LOCAL_TCP_CLIENT_THREAD    0x200
+  #define STACK_SIZE_LOCAL_TCP_SERVER_THREAD    0x220
   #define STACK_SIZE_REMOTE_TCP_CLIENT_THREAD   0x260
 #endif
 
@@ -84,8 +79,6 @@ typedef struct
 
 /*Running status*/
 typedef struct _current_app_status_t {
-  /*Local clients port list*/
-  uint32_t          loopBack_PortList[MAX_Local_Client_Num];
   /*Remote TCP client connecte*/
   bool              isRemoteConnected;
 } current_app_status_t;
@@ -19,7 +19,7 @@
   ******************************************************************************
   */ 
 
-#include "MicoDefine.h"
+#include "MICODefine.h"
 #include "platform.h"
 #include "MICONotificationCenter.h"
 
@@ -21,10 +21,10 @@
   */ 
 
 #include "Common.h"
-#include "debug.h"
+#include "Debug.h"
 #include "MicoPlatform.h"
-#include "Platform.h"
-#include "Platform_common_config.h"
+#include "platform.h"
+#include "platform_common_config.h"
 
 #include "EasyLink/EasyLink.h"
 #include "JSON-C/json.h"
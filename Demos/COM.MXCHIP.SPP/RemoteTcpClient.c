@@ -22,6 +22,7 @@
 #include "MICOAppDefine.h"
 #include "MICODefine.h"
 #include "SppProtocol.h"
+#include "SppBroadcast.h"
 #include "SocketUtils.h"
 #include "MICONotificationCenter.h"
 
@@ -61,10 +62,10 @@ void remoteTcpClient_thread(void *inContext)
   fd_set readfds;
   char ipstr[16];
   struct timeval_t t;
-  int remoteTcpClient_loopBack_fd = -1;
   int remoteTcpClient_fd = -1;
+  int subscriber = -1;
   uint8_t *inDataBuffer = NULL;
-  uint8_t *outDataBuffer = NULL;  
+  spp_subscriber_stats_t stats;
   
   mico_rtos_init_semaphore(&_wifiConnected_sem, 1);
   
@@ -74,16 +75,6 @@ void remoteTcpClient_thread(void *inContext)
   
   inDataBuffer = malloc(wlanBufferLen);
   require_action(inDataBuffer, exit, err = kNoMemoryErr);
-  outDataBuffer = malloc(wlanBufferLen);
-  require_action(inDataBuffer, exit, err = kNoMemoryErr);
-  
-  /*Loopback fd, recv data from other thread */
-  remoteTcpClient_loopBack_fd = socket( AF_INET, SOCK_DGRM, IPPROTO_UDP );
-  require_action(IsValidSocket( remoteTcpClient_loopBack_fd ), exit, err = kNoResourcesErr );
-  addr.s_ip = IPADDR_LOOPBACK;
-  addr.s_port = REMOTE_TCP_CLIENT_LOOPBACK_PORT;
-  err = bind( remoteTcpClient_loopBack_fd, &addr, sizeof(addr) );
-  require_noerr( err, exit );
   
   t.tv_sec = 4;
   t.tv_usec = 0;
@@ -103,22 +94,19 @@ void remoteTcpClient_thread(void *inContext)
       err = connect(remoteTcpClient_fd, &addr, sizeof(addr));
       require_noerr_quiet(err, ReConnWithDelay);
       
+      /*UART data is sent to the server by the UART receive thread*/
+      subscriber = sppBroadcastSubscribe(remoteTcpClient_fd);
+      require_action_quiet(subscriber != -1, ReConnWithDelay, err = kNoResourcesErr);
+      
       Context->appStatus.isRemoteConnected = true;
       client_log("Remote server connected at port: %d, fd: %d",  Context->flashContentInRam.appConfig.remoteServerPort,
                  remoteTcpClient_fd);
     }else{
       FD_ZERO(&readfds);
       FD_SET(remoteTcpClient_fd, &readfds);
-      FD_SET(remoteTcpClient_loopBack_fd, &readfds);
       
       select(1, &readfds, NULL, NULL, &t);
       
-      /*recv UART data using loopback fd*/
-      if (FD_ISSET( remoteTcpClient_loopBack_fd, &readfds) ) {
-        len = recv( remoteTcpClient_loopBack_fd, outDataBuffer, wlanBufferLen, 0 );
-        SocketSend( remoteTcpClient_fd, outDataBuffer, len );
-      }
-      
       /*recv wlan data using remote client fd*/
       if (FD_ISSET(remoteTcpClient_fd, &readfds)) {
         len = recv(remoteTcpClient_fd, inDataBuffer, wlanBufferLen, 0);
@@ -131,10 +119,23 @@ void remoteTcpClient_thread(void *inContext)
 
       }
 
+      /*The UART receive thread gave up on the server, its stream is broken*/
+      if(sppBroadcastIsClosed(subscriber)){
+        client_log("Remote server dropped by the UART broadcast, fd: %d", remoteTcpClient_fd);
+        Context->appStatus.isRemoteConnected = false;
+        goto ReConnWithDelay;
+      }
+
     Continue:    
       continue;
       
     ReConnWithDelay:
+      if(subscriber != -1){
+        sppBroadcastUnsubscribe(subscriber, &stats);
+        client_log("%d packets delivered, %d dropped, %d blocked sends, broadcast err = %d",
+                   stats.deliveredPackets, stats.droppedPackets, stats.blockedSends, stats.closeReason);
+        subscriber = -1;
+      }
       if(remoteTcpClient_fd != -1){
         SocketClose(&remoteTcpClient_fd);
       }
@@ -143,9 +144,6 @@ void remoteTcpClient_thread(void *inContext)
   }
 exit:
   if(inDataBuffer) free(inDataBuffer);
-  if(outDataBuffer) free(outDataBuffer);
-  if(remoteTcpClient_loopBack_fd != -1)
-    SocketClose(&remoteTcpClient_loopBack_fd);
   client_log("Exit: Remote TCP client exit with err = %d", err);
   mico_rtos_delete_thread(NULL);
   return;
@@ -0,0 +1,257 @@
+/**
+  ******************************************************************************
+  * @file    SppBroadcast.c
+  * @author  William Xu
+  * @version V1.0.0
+  * @date    16-Oct-2026
+  * @brief   Shared buffer that delivers every UART packet to all TCP clients.
+  * A packet is received once into a reference counted slot and sent from
+  * there to each subscriber, which keeps its own read cursor.
+  ******************************************************************************
+  * @attention
+  *
+  * THE PRESENT FIRMWARE WHICH IS FOR GUIDANCE ONLY AIMS AT PROVIDING CUSTOMERS
+  * WITH CODING INFORMATION REGARDING THEIR PRODUCTS IN ORDER FOR THEM TO SAVE
+  * TIME. AS A RESULT, MXCHIP Inc. SHALL NOT BE HELD LIABLE FOR ANY
+  * DIRECT, INDIRECT OR CONSEQUENTIAL DAMAGES WITH RESPECT TO ANY CLAIMS ARISING
+  * FROM THE CONTENT OF SUCH FIRMWARE AND/OR THE USE MADE BY CUSTOMERS OF THE
+  * CODING INFORMATION CONTAINED HEREIN IN CONNECTION WITH THEIR PRODUCTS.
+  *
+  * <h2><center>&copy; COPYRIGHT 2014 MXCHIP Inc.</center></h2>
+  ******************************************************************************
+  */ 
+
+#include "MICO.h"
+#include "SppBroadcast.h"
+
+#define broadcast_log(M, ...) custom_log("SPP BROADCAST", M, ##__VA_ARGS__)
+#define broadcast_log_trace() custom_log_trace("SPP BROADCAST")
+
+typedef struct _spp_packet_t {
+  uint8_t           *data;
+  int               len;
+  int               refs;             /*Subscribers that have not sent it yet*/
+} spp_packet_t;
+
+typedef struct _spp_subscriber_t {
+  int               fd;               /*-1 if the entry is free*/
+  uint32_t          cursor;           /*Sequence number of the next packet to send*/
+  int               offset;           /*Bytes of that packet already sent*/
+  bool              closed;           /*Given up on, it holds no packets*/
+  spp_subscriber_stats_t stats;
+} spp_subscriber_t;
+
+/* Packet n is stored in _packets[n % SPP_BROADCAST_PACKET_NUM], _head is the
+   sequence number of the next packet to publish */
+static spp_packet_t _packets[SPP_BROADCAST_PACKET_NUM];
+static spp_subscriber_t _subscribers[SPP_BROADCAST_SUBSCRIBER_NUM];
+static uint32_t _head = 0;
+static mico_mutex_t _broadcast_mutex = NULL;
+
+static spp_packet_t *_packet(uint32_t sequence)
+{
+  return &_packets[sequence % SPP_BROADCAST_PACKET_NUM];
+}
+
+static void _release(spp_subscriber_t *subscriber)
+{
+  _packet(subscriber->cursor)->refs--;
+  subscriber->cursor++;
+  subscriber->offset = 0;
+}
+
+static void _close(spp_subscriber_t *subscriber, OSStatus reason)
+{
+  while(subscriber->cursor != _head)
+    _release(subscriber);
+  subscriber->closed = true;
+  subscriber->stats.closeReason = reason;
+  broadcast_log("Subscriber fd: %d closed, err = %d", subscriber->fd, reason);
+}
+
+/* send() returned len, true if only the socket buffer is full */
+static bool _sendWouldBlock(int fd, int len)
+{
+  int err = 0;
+  socklen_t optlen = sizeof(err);
+
+  if(len == 0)
+    return false;
+  if(getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &optlen) != 0)
+    return false;
+  return err == EWOULDBLOCK;
+}
+
+OSStatus sppBroadcastInit(void)
+{
+  broadcast_log_trace();
+  OSStatus err = kNoErr;
+  int i;
+
+  for(i=0; i < SPP_BROADCAST_SUBSCRIBER_NUM; i++)
+    _subscribers[i].fd = -1;
+
+  for(i=0; i < SPP_BROADCAST_PACKET_NUM; i++){
+    _packets[i].data = malloc(UART_ONE_PACKAGE_LENGTH);
+    require_action(_packets[i].data, exit, err = kNoMemoryErr);
+    _packets[i].len = 0;
+    _packets[i].refs = 0;
+  }
+
+  err = mico_rtos_init_mutex(&_broadcast_mutex);
+
+exit:
+  return err;
+}
+
+int sppBroadcastSubscribe(int inSocketFd)
+{
+  int i, subscriber = -1;
+  int nonBlock = 1;
+
+  mico_rtos_lock_mutex(&_broadcast_mutex);
+  for(i=0; i < SPP_BROADCAST_SUBSCRIBER_NUM; i++){
+    if(_subscribers[i].fd == -1){
+      /*Only the packets published from now on are delivered*/
+      _subscribers[i].fd = inSocketFd;
+      _subscribers[i].cursor = _head;
+      _subscribers[i].offset = 0;
+      _subscribers[i].closed = false;
+      memset(&_subscribers[i].stats, 0x0, sizeof(spp_subscriber_stats_t));
+      subscriber = i;
+      break;
+    }
+  }
+  mico_rtos_unlock_mutex(&_broadcast_mutex);
+
+  if(subscriber != -1)
+    setsockopt(inSocketFd, SOL_SOCKET, SO_BLOCKMODE, &nonBlock, sizeof(nonBlock));
+  return subscriber;
+}
+
+void sppBroadcastUnsubscribe(int inSubscriber, spp_subscriber_stats_t *outStats)
+{
+  spp_subscriber_t *subscriber;
+
+  if(inSubscriber < 0 || inSubscriber >= SPP_BROADCAST_SUBSCRIBER_NUM)
+    return;
+  subscriber = &_subscribers[inSubscriber];
+
+  mico_rtos_lock_mutex(&_broadcast_mutex);
+  while(subscriber->closed == false && subscriber->cursor != _head)
+    _release(subscriber);
+  if(outStats)
+    *outStats = subscriber->stats;
+  subscriber->fd = -1;
+  mico_rtos_unlock_mutex(&_broadcast_mutex);
+}
+
+void sppBroadcastGetStats(int inSubscriber, spp_subscriber_stats_t *outStats)
+{
+  if(inSubscriber < 0 || inSubscriber >= SPP_BROADCAST_SUBSCRIBER_NUM)
+    return;
+
+  mico_rtos_lock_mutex(&_broadcast_mutex);
+  *outStats = _subscribers[inSubscriber].stats;
+  mico_rtos_unlock_mutex(&_broadcast_mutex);
+}
+
+bool sppBroadcastIsClosed(int inSubscriber)
+{
+  if(inSubscriber < 0 || inSubscriber >= SPP_BROADCAST_SUBSCRIBER_NUM)
+    return false;
+  return _subscribers[inSubscriber].closed;
+}
+
+uint8_t *sppBroadcastAcquire(void)
+{
+  spp_packet_t *packet;
+  int i;
+
+  mico_rtos_lock_mutex(&_broadcast_mutex);
+  packet = _packet(_head);
+
+  /*The slot still holds the oldest packet, the subscribers that did not send it lose it.
+    One that sent part of it cannot skip the rest, it is closed.*/
+  if(packet->refs > 0){
+    for(i=0; i < SPP_BROADCAST_SUBSCRIBER_NUM; i++){
+      if(_subscribers[i].fd != -1 && _subscribers[i].closed == false &&
+         _subscribers[i].cursor != _head && _packet(_subscribers[i].cursor) == packet){
+        if(_subscribers[i].offset > 0){
+          _close(&_subscribers[i], kOverrunErr);
+        }else{
+          _release(&_subscribers[i]);
+          _subscribers[i].stats.droppedPackets++;
+        }
+      }
+    }
+  }
+  mico_rtos_unlock_mutex(&_broadcast_mutex);
+
+  return packet->data;
+}
+
+void sppBroadcastPublish(const uint8_t *inBuf, int inLen)
+{
+  spp_packet_t *packet;
+  uint8_t *data;
+  int i;
+
+  if(inLen <= 0)
+    return;
+
+  /*Data received outside of the acquired buffer is copied into it*/
+  data = sppBroadcastAcquire();
+  inLen = MIN(inLen, UART_ONE_PACKAGE_LENGTH);
+  if(inBuf != data)
+    memcpy(data, inBuf, inLen);
+
+  mico_rtos_lock_mutex(&_broadcast_mutex);
+  packet = _packet(_head);
+  packet->len = inLen;
+  packet->refs = 0;
+  for(i=0; i < SPP_BROADCAST_SUBSCRIBER_NUM; i++){
+    if(_subscribers[i].fd != -1 && _subscribers[i].closed == false)
+      packet->refs++;
+  }
+  _head++;
+  mico_rtos_unlock_mutex(&_broadcast_mutex);
+}
+
+bool sppBroadcastFlush(void)
+{
+  spp_subscriber_t *subscriber;
+  spp_packet_t *packet;
+  bool pending = false;
+  int i, len;
+
+  mico_rtos_lock_mutex(&_broadcast_mutex);
+  for(i=0; i < SPP_BROADCAST_SUBSCRIBER_NUM; i++){
+    subscriber = &_subscribers[i];
+    if(subscriber->fd == -1 || subscriber->closed == true)
+      continue;
+
+    while(subscriber->cursor != _head){
+      packet = _packet(subscriber->cursor);
+      len = send(subscriber->fd, packet->data + subscriber->offset, packet->len - subscriber->offset, 0);
+      if(len <= 0){
+        if(_sendWouldBlock(subscriber->fd, len) == false){
+          _close(subscriber, kConnectionErr);
+          break;
+        }
+        /*Socket buffer full, the rest waits for the next flush*/
+        subscriber->stats.blockedSends++;
+        pending = true;
+        break;
+      }
+      subscriber->offset += len;
+      if(subscriber->offset == packet->len){
+        _release(subscriber);
+        subscriber->stats.deliveredPackets++;
+      }
+    }
+  }
+  mico_rtos_unlock_mutex(&_broadcast_mutex);
+
+  return pending;
+}
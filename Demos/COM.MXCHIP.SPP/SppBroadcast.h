@@ -0,0 +1,62 @@
+/**
+  ******************************************************************************
+  * @file    SppBroadcast.h
+  * @author  William Xu
+  * @version V1.0.0
+  * @date    16-Oct-2026
+  * @brief   Shared buffer that delivers every UART packet to all TCP clients.
+  ******************************************************************************
+  * @attention
+  *
+  * THE PRESENT FIRMWARE WHICH IS FOR GUIDANCE ONLY AIMS AT PROVIDING CUSTOMERS
+  * WITH CODING INFORMATION REGARDING THEIR PRODUCTS IN ORDER FOR THEM TO SAVE
+  * TIME. AS A RESULT, MXCHIP Inc. SHALL NOT BE HELD LIABLE FOR ANY
+  * DIRECT, INDIRECT OR CONSEQUENTIAL DAMAGES WITH RESPECT TO ANY CLAIMS ARISING
+  * FROM THE CONTENT OF SUCH FIRMWARE AND/OR THE USE MADE BY CUSTOMERS OF THE
+  * CODING INFORMATION CONTAINED HEREIN IN CONNECTION WITH THEIR PRODUCTS.
+  *
+  * <h2><center>&copy; COPYRIGHT 2014 MXCHIP Inc.</center></h2>
+  ******************************************************************************
+  */ 
+
+#ifndef __SPPBROADCAST_H
+#define __SPPBROADCAST_H
+
+#include "Common.h"
+#include "MICOAppDefine.h"
+
+/* Packets kept for the subscribers, a subscriber lagging further behind loses
+   its oldest packet so the UART and the other subscribers never wait for it.
+   A subscriber that has sent part of that packet is closed instead, the rest of
+   its stream would not follow on. */
+#define SPP_BROADCAST_PACKET_NUM        8
+#define SPP_BROADCAST_SUBSCRIBER_NUM    (MAX_Local_Client_Num + 1)
+
+typedef struct _spp_subscriber_stats_t {
+  uint32_t          deliveredPackets;
+  uint32_t          droppedPackets;   /*Packets overwritten before they were sent*/
+  uint32_t          blockedSends;     /*Sends stopped by a full socket buffer*/
+  OSStatus          closeReason;      /*Why the subscriber was closed, kNoErr while it is served*/
+} spp_subscriber_stats_t;
+
+OSStatus sppBroadcastInit(void);
+
+/* Subscribers are connected TCP sockets, they are switched to non-blocking mode */
+int sppBroadcastSubscribe(int inSocketFd);
+void sppBroadcastUnsubscribe(int inSubscriber, spp_subscriber_stats_t *outStats);
+void sppBroadcastGetStats(int inSubscriber, spp_subscriber_stats_t *outStats);
+
+/* A closed subscriber gets no more packets, its owner closes the socket and
+   unsubscribes it. The broadcast never closes the socket itself. */
+bool sppBroadcastIsClosed(int inSubscriber);
+
+/* Buffer of UART_ONE_PACKAGE_LENGTH bytes to receive the next packet into. It
+   stays the same until it is published. */
+uint8_t *sppBroadcastAcquire(void);
+void sppBroadcastPublish(const uint8_t *inBuf, int inLen);
+
+/* Sends the pending packets as far as the sockets accept them, returns true if
+   some are left */
+bool sppBroadcastFlush(void);
+
+#endif
@@ -22,8 +22,9 @@
 
 #include "MICOAppDefine.h"
 #include "SppProtocol.h"
+#include "SppBroadcast.h"
 #include "SocketUtils.h"
-#include "debug.h"
+#include "Debug.h"
 #include "MicoPlatform.h"
 #include "MICONotificationCenter.h"
 #include <stdio.h>
@@ -31,22 +32,17 @@
 #define spp_log(M, ...) custom_log("SPP", M, ##__VA_ARGS__)
 #define spp_log_trace() custom_log_trace("SPP")
 
-static int _recved_uart_loopback_fd = -1;
-
 OSStatus sppProtocolInit(mico_Context_t * const inContext)
 {
   spp_log_trace();
   OSStatus err = kUnknownErr;
-  (void)inContext;
-  struct sockaddr_t addr;
 
   inContext->appStatus.isRemoteConnected = false;
 
-  _recved_uart_loopback_fd = socket(AF_INET, SOCK_DGRM, IPPROTO_UDP);
-  addr.s_ip = IPADDR_LOOPBACK;
-  addr.s_port = RECVED_UART_DATA_LOOPBACK_PORT;
-  bind(_recved_uart_loopback_fd, &addr, sizeof(addr));
+  err = sppBroadcastInit();
+  require_noerr_action(err, exit, spp_log("ERROR: Unable to allocate the broadcast buffer."));
 
+exit:
   return err;
 }
 
@@ -63,27 +59,16 @@ OSStatus sppWlanCommandProcess(unsigned char *inBuf, int *inBufLen, int inSocket
   return err;
 }
 
+/* inBuf is normally the buffer from sppBroadcastAcquire(), the packet is then
+   queued for the local clients and the remote server without being copied.
+   sppBroadcastFlush() sends it. */
 OSStatus sppUartCommandProcess(uint8_t *inBuf, int inLen, mico_Context_t * const inContext)
 {
   spp_log_trace();
   OSStatus err = kNoErr;
-  int i;
-  struct sockaddr_t addr;
-
-  addr.s_ip = IPADDR_LOOPBACK;
-
-  for(i=0; i < MAX_Local_Client_Num; i++) {
-    if( inContext->appStatus.loopBack_PortList[i] != 0 ){
-      addr.s_port = inContext->appStatus.loopBack_PortList[i];
-      sendto(_recved_uart_loopback_fd, inBuf, inLen, 0, &addr, sizeof(addr));
-    }
-  }
+  (void)inContext;
 
-  if(inContext->appStatus.isRemoteConnected==true){
-    addr.s_ip = IPADDR_LOOPBACK;
-    addr.s_port = REMOTE_TCP_CLIENT_LOOPBACK_PORT;
-    sendto(_recved_uart_loopback_fd, inBuf, inLen, 0, &addr, sizeof(addr));
-  }        
+  sppBroadcastPublish(inBuf, inLen);
   return err;
 }
 
@@ -22,13 +22,14 @@
 #include "MICOAppDefine.h"
 #include "MICODefine.h"
 #include "SppProtocol.h"
+#include "SppBroadcast.h"
 #include "MicoPlatform.h"
 #include "MICONotificationCenter.h"
 
 #define uart_recv_log(M, ...) custom_log("UART RECV", M, ##__VA_ARGS__)
 #define uart_recv_log_trace() custom_log_trace("UART RECV")
 
-static size_t _uart_get_one_packet(uint8_t* buf, int maxlen);
+static size_t _uart_get_one_packet(uint8_t* buf, int maxlen, uint32_t timeout);
 
 void uartRecv_thread(void *inContext)
 {
@@ -36,44 +37,41 @@ void uartRecv_thread(void *inContext)
   mico_Context_t *Context = inContext;
   int recvlen;
   uint8_t *inDataBuffer;
-  
-  inDataBuffer = malloc(UART_ONE_PACKAGE_LENGTH);
-  require(inDataBuffer, exit);
+  bool pending = false;
   
   while(1) {
-    recvlen = _uart_get_one_packet(inDataBuffer, UART_ONE_PACKAGE_LENGTH);
-    if (recvlen <= 0)
-      continue; 
-    sppUartCommandProcess(inDataBuffer, recvlen, Context);
+    /*UART data is received straight into the buffer shared by all TCP clients*/
+    inDataBuffer = sppBroadcastAcquire();
+    recvlen = _uart_get_one_packet(inDataBuffer, UART_ONE_PACKAGE_LENGTH, pending ? UART_FLUSH_INTERVAL : UART_RECV_TIMEOUT);
+    if (recvlen > 0)
+      sppUartCommandProcess(inDataBuffer, recvlen, Context);
+
+    /*Retry the clients whose socket was full*/
+    pending = sppBroadcastFlush();
   }
-  
-exit:
-  if(inDataBuffer) free(inDataBuffer);
 }
 
 /* Packet format: BB 00 CMD(2B) Status(2B) datalen(2B) data(x) checksum(2B)
-* copy to buf, return len = datalen+10
+* copy to buf, return len = datalen+10, or 0 if nothing is received before timeout
 */
-size_t _uart_get_one_packet(uint8_t* inBuf, int inBufLen)
+size_t _uart_get_one_packet(uint8_t* inBuf, int inBufLen, uint32_t timeout)
 {
   uart_recv_log_trace();
 
   int datalen;
   
-  while(1) {
-    if( MicoUartRecv( UART_FOR_APP, inBuf, inBufLen, UART_RECV_TIMEOUT) == kNoErr){
-      return inBufLen;
+  if( MicoUartRecv( UART_FOR_APP, inBuf, inBufLen, timeout) == kNoErr){
+    return inBufLen;
+  }
+  else{
+    datalen = MicoUartGetLengthInBuffer( UART_FOR_APP );
+    if(datalen){
+      MicoUartRecv(UART_FOR_APP, inBuf, datalen, UART_RECV_TIMEOUT);
+      return datalen;
     }
-   else{
-     datalen = MicoUartGetLengthInBuffer( UART_FOR_APP );
-     if(datalen){
-       MicoUartRecv(UART_FOR_APP, inBuf, datalen, UART_RECV_TIMEOUT);
-       return datalen;
-     }
-   }
-    
   }
   
+  return 0;
 }
 
 
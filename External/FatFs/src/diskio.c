@@ -36,17 +36,169 @@
   */ 
 
 /* Includes ------------------------------------------------------------------*/
+#include <string.h>
 #include "diskio.h"
 #include "ff_gen_drv.h"
 
-/* Private typedef -----------------------------------------------------------*/
 /* Private define ------------------------------------------------------------*/
+#ifndef _DISK_CACHE_SETS
+#define _DISK_CACHE_SETS    0
+#endif
+
+#if _DISK_CACHE_SETS
+#define CACHE_VALID         0x01
+#define CACHE_DIRTY         0x02
+#define CACHE_FAT           0x04
+
+/* Sectors read ahead, and written back in one disk_write() */
+#define CACHE_RUN           ((_DISK_READ_AHEAD > 1) ? _DISK_READ_AHEAD : 1)
+#endif
+
+/* Private typedef -----------------------------------------------------------*/
+#if _DISK_CACHE_SETS
+typedef struct
+{
+  DWORD sector;
+  DWORD used;                           /* Clock of the last access, for LRU */
+  BYTE  flags;
+  BYTE  data[_MAX_SS];
+} CacheWay;
+
+/* The sector cache of a drive. A sector can be cached in the ways of set
+   (sector % _DISK_CACHE_SETS), the least recently used one is replaced, but a
+   sector of the FAT replaces another one of the FAT only when the FAT already
+   takes all ways but one. Single sector writes stay in the cache, all dirty
+   sectors are written back, consecutive ones together, by CTRL_SYNC or when a
+   dirty sector has to be replaced. A single sector read that follows the
+   previous one reads _DISK_READ_AHEAD sectors. */
+typedef struct
+{
+  CacheWay way[_DISK_CACHE_SETS][_DISK_CACHE_WAYS];
+  DWORD    clock;
+  DWORD    nextRead;                    /* Sector after the last read */
+  DWORD    sectorCount;                 /* Of the disk, 0: not known */
+  DWORD    fatFirst;                    /* CTRL_FAT_AREA */
+  DWORD    fatCount;
+  BYTE     disabled;                    /* CTRL_CACHE */
+  BYTE     run[CACHE_RUN * _MAX_SS];
+} DiskCache;
+#endif
+
 /* Private variables ---------------------------------------------------------*/
 extern Disk_drvTypeDef  disk;
 
+#if _DISK_CACHE_SETS
+static DiskCache cache[_VOLUMES];
+#endif
+
 /* Private function prototypes -----------------------------------------------*/
 /* Private functions ---------------------------------------------------------*/
 
+#if _DISK_CACHE_SETS
+static CacheWay *cache_find(DiskCache *dc, DWORD sector)
+{
+  CacheWay *set = dc->way[sector % _DISK_CACHE_SETS];
+  UINT i;
+
+  for (i = 0; i < _DISK_CACHE_WAYS; i++)
+  {
+    if ((set[i].flags & CACHE_VALID) && set[i].sector == sector) return &set[i];
+  }
+  return 0;
+}
+
+static BYTE cache_is_fat(DiskCache *dc, DWORD sector)
+{
+  return (sector - dc->fatFirst < dc->fatCount) ? CACHE_FAT : 0;
+}
+
+/* Write all dirty sectors back, the lowest first with the ones after it */
+static DRESULT cache_flush(BYTE pdrv)
+{
+  DiskCache *dc = &cache[pdrv];
+  CacheWay *first, *way;
+  UINT i, n;
+
+  while (1)
+  {
+    first = 0;
+    for (i = 0; i < _DISK_CACHE_SETS * _DISK_CACHE_WAYS; i++)
+    {
+      way = &dc->way[0][0] + i;
+      if ((way->flags & CACHE_DIRTY) && (!first || way->sector < first->sector)) first = way;
+    }
+    if (!first) return RES_OK;
+
+    for (n = 0, way = first; n < CACHE_RUN && way && (way->flags & CACHE_DIRTY); n++)
+    {
+      memcpy(&dc->run[n * _MAX_SS], way->data, _MAX_SS);
+      way = cache_find(dc, first->sector + n + 1);
+    }
+    if (disk.drv[pdrv]->disk_write(dc->run, first->sector, n) != RES_OK) return RES_ERROR;
+    for (i = 0; i < n; i++)
+    {
+      cache_find(dc, first->sector + i)->flags &= ~CACHE_DIRTY;
+    }
+  }
+}
+
+/* The way that sector replaces, 0 if it is dirty and clean_only is set */
+static CacheWay *cache_victim(DiskCache *dc, DWORD sector, BYTE clean_only)
+{
+  CacheWay *set = dc->way[sector % _DISK_CACHE_SETS];
+  CacheWay *lru = 0, *lru_other = 0, *lru_fat = 0;
+  UINT i, fat = 0;
+
+  for (i = 0; i < _DISK_CACHE_WAYS; i++)
+  {
+    if (!(set[i].flags & CACHE_VALID)) return &set[i];
+    if (!lru || set[i].used - lru->used > 0x80000000) lru = &set[i];
+    if (set[i].flags & CACHE_FAT)
+    {
+      fat++;
+      if (!lru_fat || set[i].used - lru_fat->used > 0x80000000) lru_fat = &set[i];
+    }
+    else if (!lru_other || set[i].used - lru_other->used > 0x80000000) lru_other = &set[i];
+  }
+  if (cache_is_fat(dc, sector) && lru_fat && fat >= _DISK_CACHE_WAYS - 1) lru = lru_fat;
+  else if (lru_other) lru = lru_other;
+
+  if (clean_only && (lru->flags & CACHE_DIRTY)) return 0;
+  return lru;
+}
+
+/* Put a sector in the cache, writing the dirty ones back if one is replaced */
+static DRESULT cache_store(BYTE pdrv, DWORD sector, const BYTE *data, BYTE dirty)
+{
+  DiskCache *dc = &cache[pdrv];
+  CacheWay *way = cache_find(dc, sector);
+
+  if (!way)
+  {
+    way = cache_victim(dc, sector, 0);
+    if ((way->flags & CACHE_DIRTY) && cache_flush(pdrv) != RES_OK) return RES_ERROR;
+  }
+  memcpy(way->data, data, _MAX_SS);
+  way->sector = sector;
+  way->flags = CACHE_VALID | cache_is_fat(dc, sector) | (dirty ? CACHE_DIRTY : (way->flags & CACHE_DIRTY));
+  way->used = ++dc->clock;
+  return RES_OK;
+}
+
+/* Drop the cached sectors from first to last, written back or not */
+static void cache_drop(DiskCache *dc, DWORD first, DWORD last)
+{
+  CacheWay *way;
+  UINT i;
+
+  for (i = 0; i < _DISK_CACHE_SETS * _DISK_CACHE_WAYS; i++)
+  {
+    way = &dc->way[0][0] + i;
+    if (way->sector >= first && way->sector <= last) way->flags = 0;
+  }
+}
+#endif /* _DISK_CACHE_SETS */
+
 /**
   * @brief  Initializes a Drive
   * @param  pdrv: Physical drive number (0..)
@@ -56,6 +208,11 @@ DSTATUS disk_initialize(BYTE pdrv)
 {
   DSTATUS stat;
   
+#if _DISK_CACHE_SETS
+  /* The medium may have been changed */
+  cache_drop(&cache[pdrv], 0, 0xFFFFFFFF);
+  cache[pdrv].sectorCount = 0;
+#endif
   stat = disk.drv[pdrv]->disk_initialize();
   return stat;
 }
@@ -84,9 +241,71 @@ DSTATUS disk_status(BYTE pdrv)
 DRESULT disk_read(BYTE pdrv, BYTE *buff, DWORD sector, BYTE count)
 {
   DRESULT res;
+#if _DISK_CACHE_SETS
+  DiskCache *dc = &cache[pdrv];
+  CacheWay *way;
+  UINT i, n = 1;
+
+  if (dc->disabled)
+  {
+    return disk.drv[pdrv]->disk_read(buff, sector, count);
+  }
+
+  if (count > 1)
+  {
+    /* Multiple sectors go to the buffer of the file, with what is not written back yet */
+    res = disk.drv[pdrv]->disk_read(buff, sector, count);
+    for (i = 0; i < count && res == RES_OK; i++)
+    {
+      way = cache_find(dc, sector + i);
+      if (way && (way->flags & CACHE_DIRTY)) memcpy(&buff[i * _MAX_SS], way->data, _MAX_SS);
+    }
+    dc->nextRead = sector + count;
+    return res;
+  }
+
+  way = cache_find(dc, sector);
+  if (way)
+  {
+    memcpy(buff, way->data, _MAX_SS);
+    way->used = ++dc->clock;
+    dc->nextRead = sector + 1;
+    return RES_OK;
+  }
+
+  /* Read ahead when the previous read ended here */
+  if (CACHE_RUN > 1 && sector == dc->nextRead)
+  {
+    if (!dc->sectorCount) disk.drv[pdrv]->disk_ioctl(GET_SECTOR_COUNT, &dc->sectorCount);
+    n = (sector + CACHE_RUN <= dc->sectorCount) ? CACHE_RUN : 1;
+  }
+  res = disk.drv[pdrv]->disk_read(dc->run, sector, n);
+  if (res != RES_OK && n > 1)
+  {
+    n = 1;
+    res = disk.drv[pdrv]->disk_read(dc->run, sector, n);
+  }
+  if (res != RES_OK) return res;
+  dc->nextRead = sector + 1;
+  memcpy(buff, dc->run, _MAX_SS);
+
+  /* The sectors read ahead do not make dirty ones written back, they would reuse run[] */
+  for (i = 1; i < n; i++)
+  {
+    if (cache_find(dc, sector + i)) continue;
+    way = cache_victim(dc, sector + i, 1);
+    if (!way) continue;
+    memcpy(way->data, &dc->run[i * _MAX_SS], _MAX_SS);
+    way->sector = sector + i;
+    way->flags = CACHE_VALID | cache_is_fat(dc, sector + i);
+    way->used = ++dc->clock;
+  }
+  return cache_store(pdrv, sector, buff, 0);
+#else
  
   res = disk.drv[pdrv]->disk_read(buff, sector, count);
   return res;
+#endif /* _DISK_CACHE_SETS */
 }
 
 /**
@@ -101,6 +320,29 @@ DRESULT disk_read(BYTE pdrv, BYTE *buff, DWORD sector, BYTE count)
 DRESULT disk_write(BYTE pdrv, const BYTE *buff, DWORD sector, BYTE count)
 {
   DRESULT res;
+#if _DISK_CACHE_SETS
+  DiskCache *dc = &cache[pdrv];
+  CacheWay *way;
+  UINT i;
+
+  if (!dc->disabled)
+  {
+    if (count == 1) return cache_store(pdrv, sector, buff, 1);
+
+    /* Multiple sectors are written through, the cached copies are updated */
+    res = disk.drv[pdrv]->disk_write(buff, sector, count);
+    for (i = 0; i < count && res == RES_OK; i++)
+    {
+      way = cache_find(dc, sector + i);
+      if (way)
+      {
+        memcpy(way->data, &buff[i * _MAX_SS], _MAX_SS);
+        way->flags &= ~CACHE_DIRTY;
+      }
+    }
+    return res;
+  }
+#endif /* _DISK_CACHE_SETS */
   
   res = disk.drv[pdrv]->disk_write(buff, sector, count);
   return res;
@@ -118,6 +360,38 @@ DRESULT disk_write(BYTE pdrv, const BYTE *buff, DWORD sector, BYTE count)
 DRESULT disk_ioctl(BYTE pdrv, BYTE cmd, void *buff)
 {
   DRESULT res;
+#if _DISK_CACHE_SETS
+  DiskCache *dc = &cache[pdrv];
+
+  switch (cmd)
+  {
+  case CTRL_SYNC :
+    if (cache_flush(pdrv) != RES_OK) return RES_ERROR;
+    break;
+
+  case CTRL_FAT_AREA :
+    dc->fatFirst = ((DWORD*)buff)[0];
+    dc->fatCount = ((DWORD*)buff)[1] - dc->fatFirst + 1;
+    return RES_OK;
+
+  case CTRL_CACHE :
+    if (cache_flush(pdrv) != RES_OK) return RES_ERROR;
+    cache_drop(dc, 0, 0xFFFFFFFF);
+    dc->disabled = !*(BYTE*)buff;
+    return RES_OK;
+
+  /* What is cached of these sectors is of no use any more */
+  case CTRL_ERASE_SECTOR :
+    cache_drop(dc, ((DWORD*)buff)[0], ((DWORD*)buff)[1]);
+    break;
+
+  case CTRL_FORMAT :
+    cache_drop(dc, 0, 0xFFFFFFFF);
+    break;
+  }
+#else
+  if (cmd == CTRL_FAT_AREA || cmd == CTRL_CACHE) return RES_OK;
+#endif /* _DISK_CACHE_SETS */
 
   res = disk.drv[pdrv]->disk_ioctl(cmd, buff);
   return res;
@@ -72,6 +72,10 @@ DRESULT disk_ioctl (BYTE pdrv, BYTE cmd, void* buff);
 #define ATA_GET_MODEL		21	/* Get model name */
 #define ATA_GET_SN			22	/* Get serial number */
 
+/* Sector cache of diskio.c, not passed to the drivers */
+#define CTRL_FAT_AREA		30	/* Sectors of the FAT that the cache keeps longer, DWORD[2] first and last */
+#define CTRL_CACHE			31	/* Write back and drop the cached sectors, then cache (BYTE 1) or not (BYTE 0) */
+
 
 /* MMC card type flags (MMC_GET_TYPE) */
 #define CT_MMC		0x01		/* MMC ver 3 */
@@ -0,0 +1,219 @@
+/**
+  ******************************************************************************
+  * @file    sflash_diskio.c
+  * @author  William Xu
+  * @version V1.0.0
+  * @date    17-Oct-2026
+  * @brief   SPI flash Disk I/O driver, on a flash translation layer
+  ******************************************************************************
+  * @attention
+  *
+  * THE PRESENT FIRMWARE WHICH IS FOR GUIDANCE ONLY AIMS AT PROVIDING CUSTOMERS
+  * WITH CODING INFORMATION REGARDING THEIR PRODUCTS IN ORDER FOR THEM TO SAVE
+  * TIME. AS A RESULT, MXCHIP Inc. SHALL NOT BE HELD LIABLE FOR ANY
+  * DIRECT, INDIRECT OR CONSEQUENTIAL DAMAGES WITH RESPECT TO ANY CLAIMS ARISING
+  * FROM THE CONTENT OF SUCH FIRMWARE AND/OR THE USE MADE BY CUSTOMERS OF THE
+  * CODING INFORMATION CONTAINED HEREIN IN CONNECTION WITH THEIR PRODUCTS.
+  *
+  * <h2><center>&copy; COPYRIGHT 2014 MXCHIP Inc.</center></h2>
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "ff_gen_drv.h"
+#include "sflash_diskio.h"
+#include "MicoPlatform.h"
+#include "platform_common_config.h"
+
+#ifndef FS_START_ADDRESS
+#error "The platform has no FS_START_ADDRESS area for the SPI flash disk"
+#endif
+
+/* Private typedef -----------------------------------------------------------*/
+/* Private define ------------------------------------------------------------*/
+#define BLOCK_COUNT               ((FS_END_ADDRESS - FS_START_ADDRESS + 1) / FS_BLOCK_SIZE)
+#define SECTOR_COUNT              FTLSectorCount(FS_BLOCK_SIZE, BLOCK_COUNT)
+
+/* Sectors kept in RAM, FatFs rewrites the FAT and directory sectors most */
+#ifndef SFLASHDISK_CACHE_ENTRIES
+#define SFLASHDISK_CACHE_ENTRIES  4
+#endif
+
+/* Private variables ---------------------------------------------------------*/
+/* Disk status */
+static volatile DSTATUS Stat = STA_NOINIT;
+
+static ftl_t Ftl;
+static ftl_block_t FtlBlocks[BLOCK_COUNT];
+static uint16_t FtlMap[SECTOR_COUNT];
+static ftl_cache_entry_t FtlCache[SFLASHDISK_CACHE_ENTRIES];
+
+/* Private function prototypes -----------------------------------------------*/
+DSTATUS SFLASHDISK_initialize (void);
+DSTATUS SFLASHDISK_status (void);
+DRESULT SFLASHDISK_read (BYTE*, DWORD, BYTE);
+#if _USE_WRITE == 1
+  DRESULT SFLASHDISK_write (const BYTE*, DWORD, BYTE);
+#endif /* _USE_WRITE == 1 */
+#if _USE_IOCTL == 1
+  DRESULT SFLASHDISK_ioctl (BYTE, void*);
+#endif /* _USE_IOCTL == 1 */
+
+Diskio_drvTypeDef  SFLASHDISK_Driver =
+{
+  SFLASHDISK_initialize,
+  SFLASHDISK_status,
+  SFLASHDISK_read,
+#if  _USE_WRITE == 1
+  SFLASHDISK_write,
+#endif /* _USE_WRITE == 1 */
+#if  _USE_IOCTL == 1
+  SFLASHDISK_ioctl,
+#endif /* _USE_IOCTL == 1 */
+};
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Initializes a Drive
+  * @note   The FTL is mounted once, later calls only return the status
+  * @param  None
+  * @retval DSTATUS: Operation status
+  */
+DSTATUS SFLASHDISK_initialize(void)
+{
+  if ((Stat & STA_NOINIT) == 0) return Stat;
+
+  if (MicoFlashInitialize(MICO_FLASH_FOR_FS) == kNoErr &&
+      FTLOpen(&Ftl, MICO_FLASH_FOR_FS, FS_START_ADDRESS, FS_BLOCK_SIZE, BLOCK_COUNT,
+              FtlBlocks, FtlMap, FtlCache, SFLASHDISK_CACHE_ENTRIES) == kNoErr)
+  {
+    Stat &= ~STA_NOINIT;
+  }
+  return Stat;
+}
+
+/**
+  * @brief  Gets Disk Status
+  * @param  None
+  * @retval DSTATUS: Operation status
+  */
+DSTATUS SFLASHDISK_status(void)
+{
+  return Stat;
+}
+
+/**
+  * @brief  Reads Sector(s)
+  * @param  *buff: Data buffer to store read data
+  * @param  sector: Sector address (LBA)
+  * @param  count: Number of sectors to read (1..128)
+  * @retval DRESULT: Operation result
+  */
+DRESULT SFLASHDISK_read(BYTE *buff, DWORD sector, BYTE count)
+{
+  if (Stat & STA_NOINIT) return RES_NOTRDY;
+
+  if (FTLRead(&Ftl, sector, buff, count) != kNoErr) return RES_ERROR;
+  return RES_OK;
+}
+
+/**
+  * @brief  Writes Sector(s)
+  * @param  *buff: Data to be written
+  * @param  sector: Sector address (LBA)
+  * @param  count: Number of sectors to write (1..128)
+  * @retval DRESULT: Operation result
+  */
+#if _USE_WRITE == 1
+DRESULT SFLASHDISK_write(const BYTE *buff, DWORD sector, BYTE count)
+{
+  if (Stat & STA_NOINIT) return RES_NOTRDY;
+
+  if (FTLWrite(&Ftl, sector, buff, count) != kNoErr) return RES_ERROR;
+  return RES_OK;
+}
+#endif /* _USE_WRITE == 1 */
+
+/**
+  * @brief  I/O control operation
+  * @param  cmd: Control code
+  * @param  *buff: Buffer to send/receive control data
+  * @retval DRESULT: Operation result
+  */
+#if _USE_IOCTL == 1
+DRESULT SFLASHDISK_ioctl(BYTE cmd, void *buff)
+{
+  DRESULT res = RES_ERROR;
+  DWORD *range;
+
+  if (Stat & STA_NOINIT) return RES_NOTRDY;
+
+  switch (cmd)
+  {
+  /* Write the cached sectors to flash */
+  case CTRL_SYNC :
+    if (FTLFlush(&Ftl) == kNoErr) res = RES_OK;
+    break;
+
+  /* Get number of sectors on the disk (DWORD) */
+  case GET_SECTOR_COUNT :
+    *(DWORD*)buff = Ftl.sectorCount;
+    res = RES_OK;
+    break;
+
+  /* Get R/W sector size (WORD) */
+  case GET_SECTOR_SIZE :
+    *(WORD*)buff = kFTLSectorSize;
+    res = RES_OK;
+    break;
+
+  /* Get erase block size in unit of sector (DWORD). The FTL remaps every
+     sector, aligning the data area to the erase blocks gains nothing. */
+  case GET_BLOCK_SIZE :
+    *(DWORD*)buff = 1;
+    res = RES_OK;
+    break;
+
+  /* The sectors from range[0] to range[1] are no longer used */
+  case CTRL_ERASE_SECTOR :
+    range = (DWORD*)buff;
+    if (range[0] <= range[1] && FTLTrim(&Ftl, range[0], range[1] - range[0] + 1) == kNoErr) res = RES_OK;
+    break;
+
+  /* Erase the whole disk, e.g. before f_mkfs() */
+  case CTRL_FORMAT :
+    if (FTLFormat(&Ftl) == kNoErr) res = RES_OK;
+    break;
+
+  default:
+    res = RES_PARERR;
+  }
+
+  return res;
+}
+#endif /* _USE_IOCTL == 1 */
+
+/**
+  * @brief  Erases retired blocks of the disk while it is idle
+  * @param  maxBlocks: Most blocks to erase
+  * @retval OSStatus: kNoErr, or the error of the flash driver
+  */
+OSStatus SFLASHDISK_BackgroundErase(uint32_t maxBlocks)
+{
+  if (Stat & STA_NOINIT) return kNotInitializedErr;
+
+  return FTLBackgroundErase(&Ftl, maxBlocks);
+}
+
+/**
+  * @brief  Gets the FTL statistics of the disk
+  * @param  *outStats: Filled with the statistics
+  * @retval None
+  */
+void SFLASHDISK_GetStats(ftl_stats_t *outStats)
+{
+  FTLGetStats(&Ftl, outStats);
+}
+
+/************************ (C) COPYRIGHT MXCHIP Inc. *****END OF FILE****/
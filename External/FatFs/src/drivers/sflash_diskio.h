@@ -0,0 +1,60 @@
+/**
+  ******************************************************************************
+  * @file    sflash_diskio.h
+  * @author  William Xu
+  * @version V1.0.0
+  * @date    17-Oct-2026
+  * @brief   Header for sflash_diskio.c module
+  ******************************************************************************
+  * @attention
+  *
+  * THE PRESENT FIRMWARE WHICH IS FOR GUIDANCE ONLY AIMS AT PROVIDING CUSTOMERS
+  * WITH CODING INFORMATION REGARDING THEIR PRODUCTS IN ORDER FOR THEM TO SAVE
+  * TIME. AS A RESULT, MXCHIP Inc. SHALL NOT BE HELD LIABLE FOR ANY
+  * DIRECT, INDIRECT OR CONSEQUENTIAL DAMAGES WITH RESPECT TO ANY CLAIMS ARISING
+  * FROM THE CONTENT OF SUCH FIRMWARE AND/OR THE USE MADE BY CUSTOMERS OF THE
+  * CODING INFORMATION CONTAINED HEREIN IN CONNECTION WITH THEIR PRODUCTS.
+  *
+  * <h2><center>&copy; COPYRIGHT 2014 MXCHIP Inc.</center></h2>
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __SFLASH_DISKIO_H
+#define __SFLASH_DISKIO_H
+
+/* Includes ------------------------------------------------------------------*/
+#include "ff_gen_drv.h"
+#include "FTLUtils.h"
+
+/* Exported types ------------------------------------------------------------*/
+/* Exported constants --------------------------------------------------------*/
+/* Exported functions ------------------------------------------------------- */
+
+/* The FS_START_ADDRESS..FS_END_ADDRESS area of MICO_FLASH_FOR_FS, in erase
+ * blocks of FS_BLOCK_SIZE, as a disk of 512 byte sectors. The sectors are
+ * remapped by FTLUtils, so a sector write does not erase a block, and
+ * SFLASHDISK_CACHE_ENTRIES sectors are cached in RAM until CTRL_SYNC, i.e.
+ * f_sync() or f_close(). With _USE_ERASE set in ffconf.h, the clusters that
+ * FatFs frees are trimmed and never copied again.
+ *
+ *   char path[4];
+ *   FATFS fs;
+ *
+ *   FATFS_LinkDriver( &SFLASHDISK_Driver, path );
+ *   if ( f_mount( &fs, path, 1 ) == FR_NO_FILESYSTEM )
+ *     f_mkfs( path, 1, 0 ), f_mount( &fs, path, 1 );
+ */
+extern Diskio_drvTypeDef  SFLASHDISK_Driver;
+
+/* Erase up to maxBlocks blocks that the FTL retired, so the next writes need
+ * not wait for an erase. Call it when the file system is idle.
+ */
+OSStatus SFLASHDISK_BackgroundErase(uint32_t maxBlocks);
+
+/* FTL statistics of the disk, e.g. to report wear */
+void SFLASHDISK_GetStats(ftl_stats_t *outStats);
+
+#endif /* __SFLASH_DISKIO_H */
+
+/************************ (C) COPYRIGHT MXCHIP Inc. *****END OF FILE****/
@@ -2240,6 +2240,13 @@ FRESULT find_volume (	/* FR_OK(0): successful, !=0: any error occurred */
 	if (fs->fsize < (szbfat + (SS(fs) - 1)) / SS(fs))	/* (BPB_FATSz must not be less than required) */
 		return FR_NO_FILESYSTEM;
 
+	{	/* Let the sector cache of the disk layer keep the FAT */
+		DWORD fa[2];
+
+		fa[0] = fs->fatbase; fa[1] = fs->fatbase + fasize - 1;
+		disk_ioctl(fs->drv, CTRL_FAT_AREA, fa);
+	}
+
 #if !_FS_READONLY
 	/* Initialize cluster allocation information */
 	fs->last_clust = fs->free_clust = 0xFFFFFFFF;
@@ -52,7 +52,7 @@
 #elif( AES_UTILS_USE_GLADMAN_AES )
     #include "External/GladmanAES/aes.h"
 #elif( AES_UTILS_USE_MICO_AES )
-    #include "MICOAES.h"
+    #include "MicoAES.h"
 #elif( !TARGET_NO_OPENSSL )
     #include <openssl/aes.h>
 #else
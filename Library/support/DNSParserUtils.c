@@ -0,0 +1,302 @@
+/**
+  ******************************************************************************
+  * @file    DNSParserUtils.c
+  * @author  William Xu
+  * @version V1.0.0
+  * @date    17-Oct-2026
+  * @brief   This file contains a DNS message parser that reads a packet in
+  *          place
+  ******************************************************************************
+  * @attention
+  *
+  * THE PRESENT FIRMWARE WHICH IS FOR GUIDANCE ONLY AIMS AT PROVIDING CUSTOMERS
+  * WITH CODING INFORMATION REGARDING THEIR PRODUCTS IN ORDER FOR THEM TO SAVE
+  * TIME. AS A RESULT, MXCHIP Inc. SHALL NOT BE HELD LIABLE FOR ANY
+  * DIRECT, INDIRECT OR CONSEQUENTIAL DAMAGES WITH RESPECT TO ANY CLAIMS ARISING
+  * FROM THE CONTENT OF SUCH FIRMWARE AND/OR THE USE MADE BY CUSTOMERS OF THE
+  * CODING INFORMATION CONTAINED HEREIN IN CONNECTION WITH THEIR PRODUCTS.
+  *
+  * <h2><center>&copy; COPYRIGHT 2014 MXCHIP Inc.</center></h2>
+  ******************************************************************************
+  */
+
+#include "DNSParserUtils.h"
+
+enum {
+  kSection_Question,
+  kSection_Answer,
+  kSection_Authority,
+  kSection_Additional,
+  kSection_Count,
+};
+
+/* Position in a name of the packet */
+typedef struct {
+  uint16_t  offset;             //! Of the next label or pointer.
+  uint16_t  limit;              //! A pointer has to point below it.
+  uint16_t  length;             //! Of the labels so far, in wire format.
+  uint16_t  end;                //! After the name in place, 0 until known.
+} name_walker_t;
+
+static uint16_t _read16( const uint8_t *p )
+{
+  return (uint16_t)( ( p[0] << 8 ) | p[1] );
+}
+
+static uint8_t _lower( uint8_t c )
+{
+  return ( c >= 'A' && c <= 'Z' ) ? c + ( 'a' - 'A' ) : c;
+}
+
+/* FNV-1a */
+#define kNameHashBasis        2166136261u
+#define kNameHashPrime        16777619u
+
+static uint32_t _hash_label( uint32_t hash, const uint8_t *label, int len )
+{
+  int i;
+
+  hash = ( hash ^ (uint8_t)len ) * kNameHashPrime;
+  for( i = 0; i < len; i++ )
+    hash = ( hash ^ _lower( label[i] ) ) * kNameHashPrime;
+  return hash;
+}
+
+static void _walk_init( name_walker_t *walker, uint16_t offset )
+{
+  walker->offset = offset;
+  walker->limit = offset;
+  walker->length = 0;
+  walker->end = 0;
+}
+
+/* Length of the next label, its characters start at *outLabel. 0 at the end
+ * of the name, -1 if it is malformed.
+ */
+static int _walk_label( const dns_parser_t *parser, name_walker_t *walker, uint16_t *outLabel )
+{
+  uint16_t target;
+  uint8_t len;
+
+  for( ;; ){
+    if( walker->offset >= parser->length ) return -1;
+    len = parser->packet[ walker->offset ];
+    if( ( len & 0xC0 ) == 0 ) break;
+
+    // 0x40 and 0x80 are extended label types, not used by DNS
+    if( ( len & 0xC0 ) != 0xC0 || walker->offset + 1 >= parser->length ) return -1;
+    target = _read16( parser->packet + walker->offset ) & 0x3FFF;
+    // Every pointer goes further back, so a name cannot loop
+    if( target >= walker->limit ) return -1;
+    if( walker->end == 0 ) walker->end = walker->offset + 2;
+    walker->limit = target;
+    walker->offset = target;
+  }
+
+  walker->length += len + 1;
+  if( walker->length > kDNSMaxNameLength ) return -1;
+  if( len == 0 ){
+    if( walker->end == 0 ) walker->end = walker->offset + 1;
+    return 0;
+  }
+  if( walker->offset + 1 + len > parser->length ) return -1;
+
+  *outLabel = walker->offset + 1;
+  walker->offset += len + 1;
+  return len;
+}
+
+OSStatus DNSParserInit( dns_parser_t *parser, const uint8_t *packet, size_t length )
+{
+  int i;
+
+  memset( parser, 0, sizeof( dns_parser_t ) );
+  if( length < kDNSHeaderLength || length > 0xFFFF ) return kMalformedErr;
+
+  parser->packet = packet;
+  parser->length = (uint16_t)length;
+  parser->offset = kDNSHeaderLength;
+  parser->id = _read16( packet );
+  parser->flags = _read16( packet + 2 );
+  for( i = 0; i < kSection_Count; i++ )
+    parser->counts[i] = _read16( packet + 4 + 2 * i );
+  return kNoErr;
+}
+
+uint16_t DNSParserSkipName( const dns_parser_t *parser, uint16_t offset )
+{
+  name_walker_t walker;
+  uint16_t label;
+  int len;
+
+  _walk_init( &walker, offset );
+  while( ( len = _walk_label( parser, &walker, &label ) ) > 0 );
+  return ( len == 0 ) ? walker.end : 0;
+}
+
+size_t DNSParserCopyName( const dns_parser_t *parser, uint16_t offset, uint8_t *name, size_t size )
+{
+  name_walker_t walker;
+  uint16_t label;
+  size_t n = 0;
+  int len;
+
+  _walk_init( &walker, offset );
+  for( ;; ){
+    len = _walk_label( parser, &walker, &label );
+    if( len < 0 || n + len + 1 > size ) return 0;
+    name[ n++ ] = (uint8_t)len;
+    if( len == 0 ) return n;
+    memcpy( name + n, parser->packet + label, len );
+    n += len;
+  }
+}
+
+OSStatus DNSParserNextQuestion( dns_parser_t *parser, dns_parser_question_t *outQuestion )
+{
+  uint16_t next, qclass;
+
+  if( parser->read[ kSection_Question ] >= parser->counts[ kSection_Question ] ) return kNotFoundErr;
+
+  next = DNSParserSkipName( parser, parser->offset );
+  if( next == 0 || next + 4 > parser->length ) return kMalformedErr;
+
+  qclass = _read16( parser->packet + next + 2 );
+  outQuestion->name = parser->offset;
+  outQuestion->type = _read16( parser->packet + next );
+  outQuestion->qclass = qclass & kDNSClassMask;
+  outQuestion->unicastResponse = ( qclass & kDNSQuestionUnicastResponse ) != 0;
+
+  parser->offset = next + 4;
+  parser->read[ kSection_Question ]++;
+  return kNoErr;
+}
+
+OSStatus DNSParserNextRecord( dns_parser_t *parser, dns_parser_record_t *outRecord )
+{
+  dns_parser_question_t question;
+  OSStatus err;
+  uint16_t next, rclass, rdataLength;
+  uint8_t section;
+
+  while( parser->read[ kSection_Question ] < parser->counts[ kSection_Question ] ){
+    err = DNSParserNextQuestion( parser, &question );
+    if( err != kNoErr ) return err;
+  }
+
+  for( section = kSection_Answer; section < kSection_Count; section++ )
+    if( parser->read[ section ] < parser->counts[ section ] ) break;
+  if( section == kSection_Count ) return kNotFoundErr;
+
+  next = DNSParserSkipName( parser, parser->offset );
+  if( next == 0 || next + 10 > parser->length ) return kMalformedErr;
+  rdataLength = _read16( parser->packet + next + 8 );
+  if( next + 10 + rdataLength > parser->length ) return kMalformedErr;
+
+  rclass = _read16( parser->packet + next + 2 );
+  outRecord->name = parser->offset;
+  outRecord->type = _read16( parser->packet + next );
+  outRecord->rclass = rclass & kDNSClassMask;
+  outRecord->cacheFlush = ( rclass & kDNSRecordCacheFlush ) != 0;
+  outRecord->ttl = ( (uint32_t)_read16( parser->packet + next + 4 ) << 16 ) | _read16( parser->packet + next + 6 );
+  outRecord->rdata = next + 10;
+  outRecord->rdataLength = rdataLength;
+  outRecord->section = section - kSection_Answer;
+
+  parser->offset = next + 10 + rdataLength;
+  parser->read[ section ]++;
+  return kNoErr;
+}
+
+bool DNSParserNameEquals( const dns_parser_t *parser, uint16_t offset, const uint8_t *name )
+{
+  name_walker_t walker;
+  uint16_t label;
+  int len, i;
+
+  _walk_init( &walker, offset );
+  for( ;; ){
+    len = _walk_label( parser, &walker, &label );
+    if( len < 0 || len != *name ) return false;
+    if( len == 0 ) return true;
+    for( i = 0; i < len; i++ )
+      if( _lower( parser->packet[ label + i ] ) != _lower( name[ 1 + i ] ) ) return false;
+    name += len + 1;
+  }
+}
+
+uint32_t DNSParserNameHash( const dns_parser_t *parser, uint16_t offset )
+{
+  name_walker_t walker;
+  uint16_t label = 0;
+  uint32_t hash = kNameHashBasis;
+  int len;
+
+  _walk_init( &walker, offset );
+  for( ;; ){
+    len = _walk_label( parser, &walker, &label );
+    if( len < 0 ) return 0;
+    hash = _hash_label( hash, parser->packet + label, len );
+    if( len == 0 ) return hash;
+  }
+}
+
+size_t DNSNameFromString( const char *string, uint8_t *name, size_t size )
+{
+  size_t n = 0, lengthAt;
+  uint8_t len;
+
+  if( size > kDNSMaxNameLength ) size = kDNSMaxNameLength;
+
+  while( *string ){
+    // Room for the length, a character and the final 0
+    if( n + 3 > size ) return 0;
+    lengthAt = n++;
+    len = 0;
+    while( *string && *string != '.' ){
+      if( *string == '/' && string[1] ) string++;
+      if( n + 2 > size || len == kDNSMaxLabelLength ) return 0;
+      name[ n++ ] = (uint8_t)*string++;
+      len++;
+    }
+    if( len == 0 ) return 0;
+    name[ lengthAt ] = len;
+    if( *string == '.' ) string++;
+  }
+
+  if( n + 1 > size ) return 0;
+  name[ n++ ] = 0;
+  return n;
+}
+
+size_t DNSNameLength( const uint8_t *name )
+{
+  const uint8_t *p = name;
+
+  while( *p ) p += *p + 1;
+  return p - name + 1;
+}
+
+uint32_t DNSNameHash( const uint8_t *name )
+{
+  uint32_t hash = kNameHashBasis;
+
+  for( ; *name; name += *name + 1 )
+    hash = _hash_label( hash, name + 1, *name );
+  return _hash_label( hash, name, 0 );
+}
+
+bool DNSNameEqual( const uint8_t *name1, const uint8_t *name2 )
+{
+  int i;
+
+  for( ;; ){
+    if( *name1 != *name2 ) return false;
+    if( *name1 == 0 ) return true;
+    for( i = 1; i <= *name1; i++ )
+      if( _lower( name1[i] ) != _lower( name2[i] ) ) return false;
+    name1 += *name1 + 1;
+    name2 += *name2 + 1;
+  }
+}
+
@@ -0,0 +1,123 @@
+/**
+  ******************************************************************************
+  * @file    DNSParserUtils.h
+  * @author  William Xu
+  * @version V1.0.0
+  * @date    17-Oct-2026
+  * @brief   This header contains function prototypes of a DNS message parser
+  *          that reads a packet in place
+  ******************************************************************************
+  * @attention
+  *
+  * THE PRESENT FIRMWARE WHICH IS FOR GUIDANCE ONLY AIMS AT PROVIDING CUSTOMERS
+  * WITH CODING INFORMATION REGARDING THEIR PRODUCTS IN ORDER FOR THEM TO SAVE
+  * TIME. AS A RESULT, MXCHIP Inc. SHALL NOT BE HELD LIABLE FOR ANY
+  * DIRECT, INDIRECT OR CONSEQUENTIAL DAMAGES WITH RESPECT TO ANY CLAIMS ARISING
+  * FROM THE CONTENT OF SUCH FIRMWARE AND/OR THE USE MADE BY CUSTOMERS OF THE
+  * CODING INFORMATION CONTAINED HEREIN IN CONNECTION WITH THEIR PRODUCTS.
+  *
+  * <h2><center>&copy; COPYRIGHT 2014 MXCHIP Inc.</center></h2>
+  ******************************************************************************
+  */
+
+#ifndef __DNSParserUtils_h__
+#define __DNSParserUtils_h__
+
+#include "Common.h"
+
+/* The parser walks the questions and then the records of a received packet,
+ * nothing is copied or allocated. A name is reported as its offset in the
+ * packet and compared there, label by label, following compression pointers,
+ * to a name in wire format: length prefixed labels ending with a 0 length.
+ * ASCII letters compare case-insensitively.
+ *
+ * Nothing is read outside the packet. A compression pointer has to point
+ * before itself, so a name cannot loop, and a name longer than
+ * kDNSMaxNameLength is malformed.
+ */
+
+#define kDNSHeaderLength              12
+#define kDNSMaxNameLength             255     /**< In wire format, with the final 0 */
+#define kDNSMaxLabelLength            63
+
+#define kDNSClassMask                 0x7FFF
+#define kDNSQuestionUnicastResponse   0x8000  /**< mDNS QU bit of a question class */
+#define kDNSRecordCacheFlush          0x8000  /**< mDNS cache flush bit of a record class */
+
+typedef struct {
+  uint16_t  name;               //! Offset in the packet.
+  uint16_t  type;
+  uint16_t  qclass;             //! Without kDNSQuestionUnicastResponse.
+  bool      unicastResponse;
+} dns_parser_question_t;
+
+typedef struct {
+  uint16_t  name;               //! Offset in the packet.
+  uint16_t  type;
+  uint16_t  rclass;             //! Without kDNSRecordCacheFlush.
+  bool      cacheFlush;
+  uint32_t  ttl;
+  uint16_t  rdata;              //! Offset in the packet.
+  uint16_t  rdataLength;
+  uint8_t   section;            //! 0: answer, 1: authority, 2: additional.
+} dns_parser_record_t;
+
+typedef struct {
+  const uint8_t *   packet;
+  uint16_t          length;
+  uint16_t          offset;             //! Of the next question or record.
+  uint16_t          id;
+  uint16_t          flags;
+  uint16_t          counts[ 4 ];        //! Questions, answers, authority and additional records.
+  uint16_t          read[ 4 ];          //! Of each section, so far.
+} dns_parser_t;
+
+/* kMalformedErr if the packet is shorter than a header */
+OSStatus DNSParserInit( dns_parser_t *parser, const uint8_t *packet, size_t length );
+
+/* The next question, kNotFoundErr after the last one, kMalformedErr if it
+ * does not fit in the packet. Once an error is returned, the parser stays at
+ * the same place.
+ */
+OSStatus DNSParserNextQuestion( dns_parser_t *parser, dns_parser_question_t *outQuestion );
+
+/* The next record, of the answer, authority and then additional sections.
+ * The questions that were not read are skipped.
+ */
+OSStatus DNSParserNextRecord( dns_parser_t *parser, dns_parser_record_t *outRecord );
+
+/* Compare the name at offset of the packet, e.g. a question, a record or the
+ * name in a PTR rdata, to the wire format name.
+ */
+bool DNSParserNameEquals( const dns_parser_t *parser, uint16_t offset, const uint8_t *name );
+
+/* Offset after the name at offset, 0 if it is malformed */
+uint16_t DNSParserSkipName( const dns_parser_t *parser, uint16_t offset );
+
+/* Copy the name at offset of the packet to name in wire format, without
+ * compression. Returns the length written, 0 if it is malformed or does not
+ * fit in size bytes.
+ */
+size_t DNSParserCopyName( const dns_parser_t *parser, uint16_t offset, uint8_t *name, size_t size );
+
+/* Hash of the name at offset of the packet, ignoring the case, 0 if it is
+ * malformed. It equals DNSNameHash() of the same name, so that names of many
+ * records can be told apart before they are compared.
+ */
+uint32_t DNSParserNameHash( const dns_parser_t *parser, uint16_t offset );
+
+/* Wire format of "label.label.local.", the final dot is optional. A "/" puts
+ * the next character, e.g. a dot, in the label. Returns the length written to
+ * name, 0 if it is malformed or does not fit in size bytes.
+ */
+size_t DNSNameFromString( const char *string, uint8_t *name, size_t size );
+
+/* Length of a wire format name, with the final 0 */
+size_t DNSNameLength( const uint8_t *name );
+
+bool DNSNameEqual( const uint8_t *name1, const uint8_t *name2 );
+
+uint32_t DNSNameHash( const uint8_t *name );
+
+#endif // __DNSParserUtils_h__
+
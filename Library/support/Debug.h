@@ -23,7 +23,7 @@
 #ifndef __Debug_h__
 #define __Debug_h__
 
-#include "MicoRTOS.h"
+#include "MICORTOS.h"
 #include "MicoDefaults.h"
 #include "platform.h"
 #include "platform_assert.h"
@@ -0,0 +1,533 @@
+/**
+  ******************************************************************************
+  * @file    DeltaUtils.c
+  * @author  William Xu
+  * @version V1.0.0
+  * @date    17-Oct-2026
+  * @brief   This file contains binary delta patches: a generator that matches
+  *          the new image against the old one and a streaming patcher that
+  *          rebuilds it block by block
+  ******************************************************************************
+  * @attention
+  *
+  * THE PRESENT FIRMWARE WHICH IS FOR GUIDANCE ONLY AIMS AT PROVIDING CUSTOMERS
+  * WITH CODING INFORMATION REGARDING THEIR PRODUCTS IN ORDER FOR THEM TO SAVE
+  * TIME. AS A RESULT, MXCHIP Inc. SHALL NOT BE HELD LIABLE FOR ANY
+  * DIRECT, INDIRECT OR CONSEQUENTIAL DAMAGES WITH RESPECT TO ANY CLAIMS ARISING
+  * FROM THE CONTENT OF SUCH FIRMWARE AND/OR THE USE MADE BY CUSTOMERS OF THE
+  * CODING INFORMATION CONTAINED HEREIN IN CONNECTION WITH THEIR PRODUCTS.
+  *
+  * <h2><center>&copy; COPYRIGHT 2014 MXCHIP Inc.</center></h2>
+  ******************************************************************************
+  */
+
+#include "DeltaUtils.h"
+#include "Debug.h"
+
+#define delta_log(M, ...) custom_log("Delta", M, ##__VA_ARGS__)
+#define delta_log_trace() custom_log_trace("Delta")
+
+#define kDeltaSeedLength              8       /**< Shortest match the generator looks up */
+#define kDeltaHashBits                16
+#define kDeltaMaxChain                64      /**< Candidates tried per position by the generator */
+#define kDeltaMinGain                 8       /**< A new match has to beat the current alignment by this much */
+
+enum {
+  eDeltaState_Op,
+  eDeltaState_Length,
+  eDeltaState_Source,
+  eDeltaState_Difference,
+  eDeltaState_Insert,
+  eDeltaState_Crc,
+  eDeltaState_Done,
+};
+
+typedef struct {
+  uint8_t *       buf;
+  size_t          len;
+  size_t          size;
+  bool            failed;
+  const uint8_t * oldData;
+  const uint8_t * newData;
+  size_t          newLen;
+  uint32_t        blockSize;
+  size_t          written;              //! New bytes covered by the operations so far.
+  size_t          source;               //! End of the previous copy.
+} delta_writer_t;
+
+static uint32_t _get_le32( const uint8_t *p )
+{
+  return (uint32_t)p[0] | ( (uint32_t)p[1] << 8 ) | ( (uint32_t)p[2] << 16 ) | ( (uint32_t)p[3] << 24 );
+}
+
+static void _put_le32( uint8_t *p, uint32_t value )
+{
+  p[0] = (uint8_t)value;
+  p[1] = (uint8_t)( value >> 8 );
+  p[2] = (uint8_t)( value >> 16 );
+  p[3] = (uint8_t)( value >> 24 );
+}
+
+static uint32_t _crc32( const uint8_t *data, size_t len )
+{
+  return LZCrc32Update( 0xFFFFFFFF, data, len ) ^ 0xFFFFFFFF;
+}
+
+OSStatus DeltaPatchGetHeader( const uint8_t *inBuf, size_t inLen, delta_patch_header_t *outHeader )
+{
+  OSStatus err = kNoErr;
+
+  require_action( inLen >= kDeltaPatchHeaderSize && _get_le32( inBuf ) == kDeltaPatchMagic, exit, err = kNotFoundErr );
+  require_action( _get_le32( inBuf + 28 ) == _crc32( inBuf, 28 ), exit, err = kMalformedErr );
+  outHeader->oldLength = _get_le32( inBuf + 4 );
+  outHeader->oldCrc = _get_le32( inBuf + 8 );
+  outHeader->newLength = _get_le32( inBuf + 12 );
+  outHeader->newCrc = _get_le32( inBuf + 16 );
+  outHeader->blockSize = _get_le32( inBuf + 20 );
+  outHeader->bodyLength = _get_le32( inBuf + 24 );
+  require_action( outHeader->oldLength > 0 && outHeader->newLength > 0, exit, err = kMalformedErr );
+  require_action( outHeader->blockSize > 0 && outHeader->bodyLength > kLZImageHeaderSize, exit, err = kMalformedErr );
+
+exit:
+  return err;
+}
+
+OSStatus DeltaPatchCheckSource( const delta_patch_header_t *header, delta_read_t read, void *context,
+                                uint8_t *buf, size_t bufSize )
+{
+  OSStatus err = kNoErr;
+  uint32_t crc = 0xFFFFFFFF, offset, len;
+
+  for( offset = 0; offset < header->oldLength; offset += len ){
+    len = header->oldLength - offset;
+    if( len > bufSize ) len = bufSize;
+    err = read( offset, buf, len, context );
+    require_noerr( err, exit );
+    crc = LZCrc32Update( crc, buf, len );
+  }
+  require_action( ( crc ^ 0xFFFFFFFF ) == header->oldCrc, exit, err = kChecksumErr );
+
+exit:
+  return err;
+}
+
+/* ------------------------------------------------------------------------- */
+/* Generator                                                                 */
+/* ------------------------------------------------------------------------- */
+
+static uint32_t _hash( const uint8_t *p )
+{
+  return ( ( _get_le32( p ) * 2654435761U ) ^ ( _get_le32( p + 4 ) * 2246822519U ) ) >> ( 32 - kDeltaHashBits );
+}
+
+/* Longest match of the new bytes at scan anywhere in the old image, 0 if none reaches kDeltaSeedLength */
+static size_t _search( const uint8_t *oldData, size_t oldLen, const uint8_t *newData, size_t newLen, size_t scan,
+                       const int32_t *head, const int32_t *prev, size_t *outPos )
+{
+  int32_t candidate;
+  size_t best = 0, len, limit;
+  int chain = kDeltaMaxChain;
+
+  if( newLen - scan < kDeltaSeedLength ) return 0;
+  candidate = head[ _hash( newData + scan ) ];
+  while( candidate >= 0 && chain-- > 0 ){
+    limit = oldLen - candidate;
+    if( limit > newLen - scan ) limit = newLen - scan;
+    for( len = 0; len < limit && oldData[ candidate + len ] == newData[ scan + len ]; len++ );
+    if( len > best ){
+      best = len;
+      *outPos = candidate;
+      if( len == limit ) break;
+    }
+    candidate = prev[ candidate ];
+  }
+  return ( best >= kDeltaSeedLength )? best : 0;
+}
+
+static void _put_byte( delta_writer_t *writer, uint8_t byte )
+{
+  uint8_t *buf;
+
+  if( writer->failed ) return;
+  if( writer->len == writer->size ){
+    buf = realloc( writer->buf, writer->size * 2 );
+    if( buf == NULL ){
+      writer->failed = true;
+      return;
+    }
+    writer->buf = buf;
+    writer->size *= 2;
+  }
+  writer->buf[ writer->len++ ] = byte;
+}
+
+static void _put_leb128( delta_writer_t *writer, uint32_t value )
+{
+  while( value >= 0x80 ){
+    _put_byte( writer, (uint8_t)( value | 0x80 ) );
+    value >>= 7;
+  }
+  _put_byte( writer, (uint8_t)value );
+}
+
+/* Operations for the next len new bytes, split at the block ends. source is
+ * the old offset of a copy, -1 for an insert.
+ */
+static void _put_ops( delta_writer_t *writer, long source, size_t len )
+{
+  size_t n, i, blockStart;
+  int32_t delta;
+  uint8_t crc[4];
+
+  while( len > 0 ){
+    n = writer->blockSize - writer->written % writer->blockSize;
+    if( n > len ) n = len;
+    if( source >= 0 ){
+      delta = (int32_t)( source - (long)writer->source );
+      _put_byte( writer, kDeltaOp_Copy );
+      _put_leb128( writer, (uint32_t)n );
+      _put_leb128( writer, ( (uint32_t)delta << 1 ) ^ (uint32_t)( delta >> 31 ) );
+      for( i = 0; i < n; i++ )
+        _put_byte( writer, (uint8_t)( writer->newData[ writer->written + i ] - writer->oldData[ source + i ] ) );
+      source += n;
+      writer->source = source;
+    }else{
+      _put_byte( writer, kDeltaOp_Insert );
+      _put_leb128( writer, (uint32_t)n );
+      for( i = 0; i < n; i++ )
+        _put_byte( writer, writer->newData[ writer->written + i ] );
+    }
+    writer->written += n;
+    len -= n;
+    if( writer->written % writer->blockSize == 0 || writer->written == writer->newLen ){
+      blockStart = ( writer->written - 1 ) / writer->blockSize * writer->blockSize;
+      _put_le32( crc, _crc32( writer->newData + blockStart, writer->written - blockStart ) );
+      for( i = 0; i < 4; i++ )
+        _put_byte( writer, crc[i] );
+    }
+  }
+}
+
+/* The matching of bsdiff without its suffix array: find an exact match, then
+ * extend the previous one forward and the new one backward for as long as
+ * most bytes still agree. The bytes in between are inserted.
+ */
+static void _diff( delta_writer_t *writer, const uint8_t *oldData, long oldLen, const uint8_t *newData, long newLen,
+                   const int32_t *head, const int32_t *prev )
+{
+  long scan = 0, pos = 0, len = 0, lastScan = 0, lastPos = 0, lastOffset = 0;
+  long oldScore, scsc, s, sf, lenf, sb, lenb, ss, lens, overlap, i;
+  size_t found;
+
+  while( scan < newLen ){
+    oldScore = 0;
+    for( scsc = scan += len; scan < newLen; scan++ ){
+      found = 0;
+      len = (long)_search( oldData, oldLen, newData, newLen, scan, head, prev, &found );
+      if( len > 0 ) pos = (long)found;
+      for( ; scsc < scan + len; scsc++ )
+        if( scsc + lastOffset >= 0 && scsc + lastOffset < oldLen && oldData[ scsc + lastOffset ] == newData[ scsc ] )
+          oldScore++;
+      if( ( len == oldScore && len != 0 ) || len > oldScore + kDeltaMinGain ) break;
+      if( scan + lastOffset >= 0 && scan + lastOffset < oldLen && oldData[ scan + lastOffset ] == newData[ scan ] )
+        oldScore--;
+    }
+
+    if( len != oldScore || scan == newLen ){
+      // Forward from the previous match
+      s = 0; sf = 0; lenf = 0;
+      for( i = 0; lastScan + i < scan && lastPos + i < oldLen; ){
+        if( oldData[ lastPos + i ] == newData[ lastScan + i ] ) s++;
+        i++;
+        if( s * 2 - i > sf * 2 - lenf ){ sf = s; lenf = i; }
+      }
+      // Backward from the new one
+      lenb = 0;
+      if( scan < newLen ){
+        s = 0; sb = 0;
+        for( i = 1; scan >= lastScan + i && pos >= i; i++ ){
+          if( oldData[ pos - i ] == newData[ scan - i ] ) s++;
+          if( s * 2 - i > sb * 2 - lenb ){ sb = s; lenb = i; }
+        }
+      }
+      if( lastScan + lenf > scan - lenb ){
+        overlap = ( lastScan + lenf ) - ( scan - lenb );
+        s = 0; ss = 0; lens = 0;
+        for( i = 0; i < overlap; i++ ){
+          if( newData[ lastScan + lenf - overlap + i ] == oldData[ lastPos + lenf - overlap + i ] ) s++;
+          if( newData[ scan - lenb + i ] == oldData[ pos - lenb + i ] ) s--;
+          if( s > ss ){ ss = s; lens = i + 1; }
+        }
+        lenf += lens - overlap;
+        lenb -= lens;
+      }
+
+      if( lenf > 0 )
+        _put_ops( writer, lastPos, lenf );
+      if( ( scan - lenb ) - ( lastScan + lenf ) > 0 )
+        _put_ops( writer, -1, ( scan - lenb ) - ( lastScan + lenf ) );
+
+      lastScan = scan - lenb;
+      lastPos = pos - lenb;
+      lastOffset = pos - scan;
+    }
+  }
+}
+
+OSStatus DeltaPatchCreate( const uint8_t *oldData, size_t oldLen, const uint8_t *newData, size_t newLen,
+                           uint32_t blockSize, uint8_t **outPatch, size_t *outLen )
+{
+  OSStatus err = kNoErr;
+  delta_writer_t writer;
+  int32_t *head = NULL, *prev = NULL;
+  uint8_t *patch = NULL;
+  size_t i, bodyLen;
+
+  memset( &writer, 0, sizeof(delta_writer_t) );
+  require_action( oldLen > 0 && newLen > 0 && blockSize > 0, exit, err = kParamErr );
+  require_action( oldLen <= 0x7FFFFFFF && newLen <= 0x7FFFFFFF, exit, err = kParamErr );
+
+  head = malloc( sizeof(int32_t) << kDeltaHashBits );
+  prev = malloc( sizeof(int32_t) * oldLen );
+  writer.size = newLen + newLen / 8 + 64;
+  writer.buf = malloc( writer.size );
+  require_action( head && prev && writer.buf, exit, err = kNoMemoryErr );
+  for( i = 0; i < ( 1UL << kDeltaHashBits ); i++ ) head[i] = -1;
+  // Chains run from the highest offset down
+  for( i = 0; i + kDeltaSeedLength <= oldLen; i++ ){
+    prev[i] = head[ _hash( oldData + i ) ];
+    head[ _hash( oldData + i ) ] = (int32_t)i;
+  }
+
+  writer.oldData = oldData;
+  writer.newData = newData;
+  writer.newLen = newLen;
+  writer.blockSize = blockSize;
+  _diff( &writer, oldData, (long)oldLen, newData, (long)newLen, head, prev );
+  require_action( writer.failed == false, exit, err = kNoMemoryErr );
+  require_action( writer.written == newLen, exit, err = kUnknownErr );
+
+  patch = malloc( kDeltaPatchHeaderSize + LZImageMaxSize( writer.len ) );
+  require_action( patch, exit, err = kNoMemoryErr );
+  err = LZImageCompress( writer.buf, writer.len, kLZDefaultWindowBits, patch + kDeltaPatchHeaderSize,
+                         LZImageMaxSize( writer.len ), &bodyLen );
+  require_noerr( err, exit );
+
+  _put_le32( patch, kDeltaPatchMagic );
+  _put_le32( patch + 4, (uint32_t)oldLen );
+  _put_le32( patch + 8, _crc32( oldData, oldLen ) );
+  _put_le32( patch + 12, (uint32_t)newLen );
+  _put_le32( patch + 16, _crc32( newData, newLen ) );
+  _put_le32( patch + 20, blockSize );
+  _put_le32( patch + 24, (uint32_t)bodyLen );
+  _put_le32( patch + 28, _crc32( patch, 28 ) );
+  *outPatch = patch;
+  *outLen = kDeltaPatchHeaderSize + bodyLen;
+  patch = NULL;
+
+exit:
+  if( head ) free( head );
+  if( prev ) free( prev );
+  if( writer.buf ) free( writer.buf );
+  if( patch ) free( patch );
+  return err;
+}
+
+/* ------------------------------------------------------------------------- */
+/* Patcher                                                                   */
+/* ------------------------------------------------------------------------- */
+
+OSStatus DeltaPatcherInit( delta_patcher_t *patcher, const delta_patch_header_t *header,
+                           uint8_t *window, size_t windowSize, uint8_t *block, size_t blockSize,
+                           delta_read_t read, delta_output_t output, void *context )
+{
+  OSStatus err = kNoErr;
+
+  require_action( window && block && read && output, exit, err = kParamErr );
+  require_action( blockSize >= header->blockSize, exit, err = kUnsupportedErr );
+
+  memset( patcher, 0, sizeof(delta_patcher_t) );
+  patcher->window = window;
+  patcher->windowSize = windowSize;
+  patcher->bodyLength = header->bodyLength;
+  patcher->block = block;
+  patcher->blockSize = header->blockSize;
+  patcher->blockLength = ( header->newLength < header->blockSize )? header->newLength : header->blockSize;
+  patcher->oldLength = header->oldLength;
+  patcher->newLength = header->newLength;
+  patcher->newCrc = header->newCrc;
+  patcher->crc = 0xFFFFFFFF;
+  patcher->state = eDeltaState_Op;
+  patcher->read = read;
+  patcher->output = output;
+  patcher->context = context;
+
+exit:
+  return err;
+}
+
+/* Add a byte to the LEB128 being read, true when it is complete */
+static bool _leb128( delta_patcher_t *patcher, uint8_t c, OSStatus *err )
+{
+  if( patcher->shift > 28 ){
+    *err = kMalformedErr;
+    return false;
+  }
+  patcher->value |= (uint32_t)( c & 0x7F ) << patcher->shift;
+  patcher->shift += 7;
+  return ( c & 0x80 ) == 0;
+}
+
+static void _next_value( delta_patcher_t *patcher, uint8_t state )
+{
+  patcher->value = 0;
+  patcher->shift = 0;
+  patcher->state = state;
+}
+
+/* The block is complete: check it, hand it out and start the next one */
+static OSStatus _block_done( delta_patcher_t *patcher )
+{
+  OSStatus err = kNoErr;
+
+  require_action( _crc32( patcher->block, patcher->blockLength ) == patcher->value, exit, err = kChecksumErr );
+  patcher->crc = LZCrc32Update( patcher->crc, patcher->block, patcher->blockLength );
+  patcher->produced += patcher->blockLength;
+  if( patcher->produced == patcher->newLength )
+    require_action( ( patcher->crc ^ 0xFFFFFFFF ) == patcher->newCrc, exit, err = kChecksumErr );
+  err = patcher->output( patcher->block, patcher->blockLength, patcher->context );
+  require_noerr( err, exit );
+
+  patcher->blockFill = 0;
+  patcher->blockLength = patcher->newLength - patcher->produced;
+  if( patcher->blockLength > patcher->blockSize ) patcher->blockLength = patcher->blockSize;
+  patcher->state = ( patcher->produced == patcher->newLength )? eDeltaState_Done : eDeltaState_Op;
+
+exit:
+  return err;
+}
+
+/* The output of the decompressor: the operations */
+static OSStatus _execute_ops( const uint8_t *data, size_t len, void *context )
+{
+  OSStatus err = kNoErr;
+  delta_patcher_t *patcher = context;
+  const uint8_t *end = data + len;
+  uint32_t source, n, i;
+  int32_t delta;
+  uint8_t c;
+
+  while( data < end ){
+    switch( patcher->state ){
+      case eDeltaState_Op:
+        patcher->op = *data++;
+        require_action( patcher->op == kDeltaOp_Copy || patcher->op == kDeltaOp_Insert, exit, err = kMalformedErr );
+        _next_value( patcher, eDeltaState_Length );
+        break;
+
+      case eDeltaState_Length:
+        if( _leb128( patcher, *data++, &err ) == false ){
+          require_noerr( err, exit );
+          break;
+        }
+        patcher->length = patcher->value;
+        require_action( patcher->length > 0 && patcher->length <= patcher->blockLength - patcher->blockFill, exit, err = kMalformedErr );
+        if( patcher->op == kDeltaOp_Copy )
+          _next_value( patcher, eDeltaState_Source );
+        else
+          patcher->state = eDeltaState_Insert;
+        break;
+
+      case eDeltaState_Source:
+        if( _leb128( patcher, *data++, &err ) == false ){
+          require_noerr( err, exit );
+          break;
+        }
+        delta = (int32_t)( patcher->value >> 1 ) ^ -(int32_t)( patcher->value & 1 );
+        source = patcher->source + (uint32_t)delta;
+        require_action( source < patcher->oldLength && patcher->length <= patcher->oldLength - source, exit, err = kMalformedErr );
+        err = patcher->read( source, patcher->block + patcher->blockFill, patcher->length, patcher->context );
+        require_noerr( err, exit );
+        patcher->source = source + patcher->length;
+        patcher->copyAt = patcher->blockFill;
+        patcher->state = eDeltaState_Difference;
+        break;
+
+      case eDeltaState_Difference:
+      case eDeltaState_Insert:
+        n = patcher->length;
+        if( n > (uint32_t)( end - data ) ) n = end - data;
+        if( patcher->state == eDeltaState_Insert )
+          memcpy( patcher->block + patcher->blockFill, data, n );
+        else
+          for( i = 0; i < n; i++ ) patcher->block[ patcher->blockFill + i ] += data[i];
+        data += n;
+        patcher->blockFill += n;
+        patcher->length -= n;
+        if( patcher->length == 0 ){
+          if( patcher->blockFill == patcher->blockLength )
+            _next_value( patcher, eDeltaState_Crc );
+          else
+            patcher->state = eDeltaState_Op;
+        }
+        break;
+
+      case eDeltaState_Crc:
+        c = *data++;
+        patcher->value |= (uint32_t)c << patcher->shift;
+        patcher->shift += 8;
+        if( patcher->shift == 32 ){
+          err = _block_done( patcher );
+          require_noerr( err, exit );
+        }
+        break;
+
+      case eDeltaState_Done:
+      default:
+        err = kMalformedErr;
+        goto exit;
+    }
+  }
+
+exit:
+  return err;
+}
+
+OSStatus DeltaPatcherExecute( delta_patcher_t *patcher, const uint8_t *inData, size_t inLen )
+{
+  OSStatus err = kNoErr;
+  lz_image_header_t lzHeader;
+  size_t n;
+
+  require_action( inLen <= patcher->bodyLength - patcher->bodyReceived, exit, err = kMalformedErr );
+
+  // The header of the compressed operations can arrive in pieces too
+  if( patcher->bodyReceived < kLZImageHeaderSize ){
+    n = kLZImageHeaderSize - patcher->bodyReceived;
+    if( n > inLen ) n = inLen;
+    memcpy( patcher->lzHeader + patcher->bodyReceived, inData, n );
+    patcher->bodyReceived += n;
+    inData += n;
+    inLen -= n;
+    if( patcher->bodyReceived < kLZImageHeaderSize ) goto exit;
+
+    err = LZImageGetHeader( patcher->lzHeader, kLZImageHeaderSize, &lzHeader );
+    require_noerr_action( err, exit, err = kMalformedErr );
+    err = LZDecoderInit( &patcher->lz, &lzHeader, patcher->window, patcher->windowSize, _execute_ops, patcher );
+    require_noerr( err, exit );
+  }
+
+  patcher->bodyReceived += inLen;
+  if( inLen > 0 )
+    err = LZDecoderExecute( &patcher->lz, inData, inLen );
+
+exit:
+  return err;
+}
+
+bool DeltaPatcherIsComplete( delta_patcher_t *patcher )
+{
+  return patcher->state == eDeltaState_Done && patcher->bodyReceived == patcher->bodyLength
+         && LZDecoderIsComplete( &patcher->lz );
+}
+
@@ -0,0 +1,137 @@
+/**
+  ******************************************************************************
+  * @file    DeltaUtils.h
+  * @author  William Xu
+  * @version V1.0.0
+  * @date    17-Oct-2026
+  * @brief   This header contains function prototypes of binary delta patches,
+  *          an OTA image that rebuilds the new application from the old one
+  ******************************************************************************
+  * @attention
+  *
+  * THE PRESENT FIRMWARE WHICH IS FOR GUIDANCE ONLY AIMS AT PROVIDING CUSTOMERS
+  * WITH CODING INFORMATION REGARDING THEIR PRODUCTS IN ORDER FOR THEM TO SAVE
+  * TIME. AS A RESULT, MXCHIP Inc. SHALL NOT BE HELD LIABLE FOR ANY
+  * DIRECT, INDIRECT OR CONSEQUENTIAL DAMAGES WITH RESPECT TO ANY CLAIMS ARISING
+  * FROM THE CONTENT OF SUCH FIRMWARE AND/OR THE USE MADE BY CUSTOMERS OF THE
+  * CODING INFORMATION CONTAINED HEREIN IN CONNECTION WITH THEIR PRODUCTS.
+  *
+  * <h2><center>&copy; COPYRIGHT 2014 MXCHIP Inc.</center></h2>
+  ******************************************************************************
+  */
+
+#ifndef __DeltaUtils_h__
+#define __DeltaUtils_h__
+
+#include "Common.h"
+#include "LZUtils.h"
+
+/* A patch is a kDeltaPatchHeaderSize header followed by a compressed image
+ * (LZUtils) of operations. They build the new image one block of blockSize
+ * bytes after the other, each block is followed by its CRC-32:
+ *
+ *   kDeltaOp_Copy     length, source, then length difference bytes: a new
+ *                     byte is the old byte at source plus the difference
+ *   kDeltaOp_Insert   length, then length new bytes
+ *
+ * Lengths are unsigned LEB128. The source is a signed LEB128, zigzag coded,
+ * relative to the end of the previous copy. An operation does not cross a
+ * block, so a block is complete in RAM and checked before it is handed to
+ * the output callback. Code that only moved gets difference bytes that are
+ * mostly zero, the compression removes them.
+ *
+ * The patch applies to one old image, named by its length and CRC-32.
+ * DeltaPatchCheckSource() tells whether the installed one is that image.
+ */
+
+#define kDeltaPatchMagic              0x3150444D  /**< "MDP1" */
+#define kDeltaPatchHeaderSize         32
+#define kDeltaDefaultBlockSize        4096
+
+enum {
+  kDeltaOp_Copy   = 0,
+  kDeltaOp_Insert = 1,
+};
+
+typedef struct {
+  uint32_t  oldLength;
+  uint32_t  oldCrc;             //! CRC-32 of the image the patch applies to.
+  uint32_t  newLength;
+  uint32_t  newCrc;             //! CRC-32 of the rebuilt image.
+  uint32_t  blockSize;
+  uint32_t  bodyLength;         //! Compressed operations after the header.
+} delta_patch_header_t;
+
+/* Read len bytes of the old image at offset */
+typedef OSStatus (*delta_read_t)( uint32_t offset, uint8_t *buf, size_t len, void *context );
+
+/* A block of the new image that matches its CRC. Return an error to stop
+ * DeltaPatcherExecute() with it.
+ */
+typedef OSStatus (*delta_output_t)( const uint8_t *data, size_t len, void *context );
+
+typedef struct {
+  lz_decoder_t            lz;
+  uint8_t *               window;
+  size_t                  windowSize;
+  uint8_t                 lzHeader[ kLZImageHeaderSize ];
+  uint32_t                bodyReceived;       //! Bytes of the body given to DeltaPatcherExecute().
+  uint32_t                bodyLength;
+
+  uint8_t *               block;              //! The block being built.
+  uint32_t                blockSize;
+  uint32_t                blockLength;        //! Of the current block, the last one can be shorter.
+  uint32_t                blockFill;
+
+  uint32_t                oldLength;
+  uint32_t                newLength;
+  uint32_t                newCrc;
+  uint32_t                crc;                //! Of the blocks handed to output.
+  uint32_t                produced;           //! Bytes handed to output.
+  uint32_t                source;             //! End of the previous copy in the old image.
+
+  uint8_t                 state;
+  uint8_t                 op;
+  uint8_t                 shift;              //! Of the LEB128 being read.
+  uint32_t                value;              //! LEB128 being read, or the CRC of the block.
+  uint32_t                length;             //! Left in the current operation.
+  uint32_t                copyAt;             //! Block offset of the current copy.
+
+  delta_read_t            read;
+  delta_output_t          output;
+  void *                  context;
+} delta_patcher_t;
+
+/* kNotFoundErr if inBuf does not start with a patch header */
+OSStatus DeltaPatchGetHeader( const uint8_t *inBuf, size_t inLen, delta_patch_header_t *outHeader );
+
+/* kChecksumErr if the old image is not the one the patch applies to. buf is
+ * a scratch buffer of any size.
+ */
+OSStatus DeltaPatchCheckSource( const delta_patch_header_t *header, delta_read_t read, void *context,
+                                uint8_t *buf, size_t bufSize );
+
+/* Create a patch that rebuilds newData from oldData, in memory from malloc()
+ * that the caller frees. It takes about 8 times oldLen plus 4 times newLen
+ * bytes of heap.
+ */
+OSStatus DeltaPatchCreate( const uint8_t *oldData, size_t oldLen, const uint8_t *newData, size_t newLen,
+                           uint32_t blockSize, uint8_t **outPatch, size_t *outLen );
+
+/* window is the window of the compressed operations, see LZDecoderInit(),
+ * block holds at least header->blockSize bytes.
+ */
+OSStatus DeltaPatcherInit( delta_patcher_t *patcher, const delta_patch_header_t *header,
+                           uint8_t *window, size_t windowSize, uint8_t *block, size_t blockSize,
+                           delta_read_t read, delta_output_t output, void *context );
+
+/* Apply the body after the header, in pieces of any size. kMalformedErr: not
+ * a valid operation, kChecksumErr: a block or the new image does not match.
+ */
+OSStatus DeltaPatcherExecute( delta_patcher_t *patcher, const uint8_t *inData, size_t inLen );
+
+/* true once every block is built, checked and handed to output */
+bool DeltaPatcherIsComplete( delta_patcher_t *patcher );
+
+#endif // __DeltaUtils_h__
+
@@ -0,0 +1,735 @@
+/**
+  ******************************************************************************
+  * @file    FTLUtils.c
+  * @author  William Xu
+  * @version V1.0.0
+  * @date    17-Oct-2026
+  * @brief   This file contains a flash translation layer: logical sectors are
+  *          written to the next free sector of a head block and remapped, a
+  *          RAM cache takes the small writes
+  ******************************************************************************
+  * @attention
+  *
+  * THE PRESENT FIRMWARE WHICH IS FOR GUIDANCE ONLY AIMS AT PROVIDING CUSTOMERS
+  * WITH CODING INFORMATION REGARDING THEIR PRODUCTS IN ORDER FOR THEM TO SAVE
+  * TIME. AS A RESULT, MXCHIP Inc. SHALL NOT BE HELD LIABLE FOR ANY
+  * DIRECT, INDIRECT OR CONSEQUENTIAL DAMAGES WITH RESPECT TO ANY CLAIMS ARISING
+  * FROM THE CONTENT OF SUCH FIRMWARE AND/OR THE USE MADE BY CUSTOMERS OF THE
+  * CODING INFORMATION CONTAINED HEREIN IN CONNECTION WITH THEIR PRODUCTS.
+  *
+  * <h2><center>&copy; COPYRIGHT 2014 MXCHIP Inc.</center></h2>
+  ******************************************************************************
+  */
+
+#include "FTLUtils.h"
+#include "Debug.h"
+#include <stddef.h>
+
+#define ftl_log(M, ...) custom_log("FTL", M, ##__VA_ARGS__)
+#define ftl_log_trace() custom_log_trace("FTL")
+
+#define kFTLBlockHeaderSize           32          /**< The tags follow it */
+#define kFTLTagFree                   0xFFFFFFFF
+#define kFTLUnknownEraseCount         0xFFFFFFFF
+#define kFTLBackgroundSpareBlocks     4           /**< FTLBackgroundErase() collects until so many blocks are spare */
+
+/* The erase count is written right after the erase, the sequence when the
+ * block becomes the head. Retiring a block clears the sequence, so its
+ * sectors do not come back after a reset.
+ */
+typedef struct {
+  uint32_t  magic;
+  uint32_t  eraseCount;
+  uint32_t  eraseCheck;         //! ~eraseCount.
+  uint32_t  sequence;
+  uint32_t  sequenceCheck;      //! ~sequence.
+} ftl_block_header_t;
+
+/* A tag holds the logical sector and its complement. It is written after the
+ * sector and cleared to 0 when the sector is replaced, a torn tag is not valid.
+ */
+static uint32_t _tag( uint16_t sector )
+{
+  return (uint32_t)sector | ( (uint32_t)(uint16_t)~sector << 16 );
+}
+
+static bool _tag_valid( uint32_t tag )
+{
+  return tag != kFTLTagFree && (uint16_t)( tag >> 16 ) == (uint16_t)~tag;
+}
+
+static uint32_t _block_address( ftl_t *ftl, int block )
+{
+  return ftl->startAddress + block * ftl->blockSize;
+}
+
+static uint32_t _sector_address( ftl_t *ftl, uint16_t physical )
+{
+  return _block_address( ftl, physical / ftl->sectorsPerBlock ) + ( physical % ftl->sectorsPerBlock + 1 ) * kFTLSectorSize;
+}
+
+static uint32_t _tag_address( ftl_t *ftl, uint16_t physical )
+{
+  return _block_address( ftl, physical / ftl->sectorsPerBlock ) + kFTLBlockHeaderSize + ( physical % ftl->sectorsPerBlock ) * 4;
+}
+
+static OSStatus _read( ftl_t *ftl, uint32_t address, void *buf, uint32_t len )
+{
+  volatile uint32_t flashAddress = address;
+  return MicoFlashRead( ftl->flash, &flashAddress, (uint8_t *)buf, len );
+}
+
+static OSStatus _write( ftl_t *ftl, uint32_t address, const void *buf, uint32_t len )
+{
+  volatile uint32_t flashAddress = address;
+  return MicoFlashWrite( ftl->flash, &flashAddress, (uint8_t *)buf, len );
+}
+
+static bool _is_blank( const void *buf, uint32_t len )
+{
+  const uint8_t *p = buf;
+  while( len-- )
+    if( *p++ != 0xFF ) return false;
+  return true;
+}
+
+/* The copy at physical is replaced or trimmed */
+static OSStatus _clear_tag( ftl_t *ftl, uint16_t physical )
+{
+  uint32_t zero = 0;
+
+  ftl->blocks[ physical / ftl->sectorsPerBlock ].validSectors--;
+  return _write( ftl, _tag_address( ftl, physical ), &zero, sizeof( zero ) );
+}
+
+static int _count_spare( ftl_t *ftl )
+{
+  int i, count = 0;
+
+  for( i = 0; i < ftl->blockCount; i++ )
+    if( ftl->blocks[i].state != eFTLBlock_Used ) count++;
+  return count;
+}
+
+/* The least worn block that is not used, an erased one if there is */
+static int _spare_block( ftl_t *ftl )
+{
+  int i, block = -1;
+  ftl_block_t *info;
+
+  for( i = 0; i < ftl->blockCount; i++ ){
+    info = &ftl->blocks[i];
+    if( info->state == eFTLBlock_Used ) continue;
+    if( block < 0 ||
+        ( info->state == eFTLBlock_Free && ftl->blocks[block].state == eFTLBlock_Dirty ) ||
+        ( info->state == ftl->blocks[block].state && info->eraseCount < ftl->blocks[block].eraseCount ) )
+      block = i;
+  }
+  return block;
+}
+
+/* The used block with the fewest current sectors, the least worn of them */
+static int _victim_block( ftl_t *ftl )
+{
+  int i, block = -1;
+  ftl_block_t *info;
+
+  for( i = 0; i < ftl->blockCount; i++ ){
+    info = &ftl->blocks[i];
+    if( info->state != eFTLBlock_Used || i == ftl->head ) continue;
+    if( block < 0 || info->validSectors < ftl->blocks[block].validSectors ||
+        ( info->validSectors == ftl->blocks[block].validSectors && info->eraseCount < ftl->blocks[block].eraseCount ) )
+      block = i;
+  }
+  return block;
+}
+
+static OSStatus _erase_block( ftl_t *ftl, int block, bool foreground )
+{
+  OSStatus err = kNoErr;
+  ftl_block_t *info = &ftl->blocks[block];
+  uint32_t address = _block_address( ftl, block );
+  ftl_block_header_t header;
+  int i;
+
+  if( info->eraseCount == kFTLUnknownEraseCount ){
+    /* The count was lost with the header, continue from the most worn block */
+    info->eraseCount = 0;
+    for( i = 0; i < ftl->blockCount; i++ )
+      if( ftl->blocks[i].eraseCount != kFTLUnknownEraseCount && ftl->blocks[i].eraseCount > info->eraseCount )
+        info->eraseCount = ftl->blocks[i].eraseCount;
+  }
+
+  info->state = eFTLBlock_Dirty;
+  info->validSectors = 0;
+  err = MicoFlashErase( ftl->flash, address, address + ftl->blockSize - 1 );
+  require_noerr( err, exit );
+  ftl->stats.erases++;
+  if( foreground ) ftl->stats.foregroundErases++;
+  info->eraseCount++;
+
+  header.magic = kFTLMagic;
+  header.eraseCount = info->eraseCount;
+  header.eraseCheck = ~info->eraseCount;
+  err = _write( ftl, address, &header, offsetof( ftl_block_header_t, sequence ) );
+  require_noerr( err, exit );
+  info->state = eFTLBlock_Free;
+
+exit:
+  return err;
+}
+
+static OSStatus _start_head( ftl_t *ftl, int block )
+{
+  OSStatus err = kNoErr;
+  uint32_t sequence[2];
+
+  if( ftl->blocks[block].state != eFTLBlock_Free ){
+    err = _erase_block( ftl, block, true );
+    require_noerr( err, exit );
+  }
+
+  sequence[0] = ftl->sequence;
+  sequence[1] = ~ftl->sequence;
+  err = _write( ftl, _block_address( ftl, block ) + offsetof( ftl_block_header_t, sequence ), sequence, sizeof( sequence ) );
+  require_noerr( err, exit );
+
+  ftl->blocks[block].state = eFTLBlock_Used;
+  ftl->blocks[block].sequence = ftl->sequence++;
+  ftl->blocks[block].validSectors = 0;
+  ftl->head = block;
+  ftl->headSector = 0;
+
+exit:
+  return err;
+}
+
+static OSStatus _retire_block( ftl_t *ftl, int block )
+{
+  uint32_t zero[2] = { 0, 0 };
+
+  ftl->blocks[block].state = eFTLBlock_Dirty;
+  ftl->blocks[block].validSectors = 0;
+  if( ftl->head == block ){
+    ftl->head = -1;
+    ftl->headSector = ftl->sectorsPerBlock;
+  }
+  return _write( ftl, _block_address( ftl, block ) + offsetof( ftl_block_header_t, sequence ), zero, sizeof( zero ) );
+}
+
+static OSStatus _program( ftl_t *ftl, uint16_t sector, const uint8_t *data, bool collecting );
+
+/* Copy the current sectors of the block to the head and retire it */
+static OSStatus _collect( ftl_t *ftl, int block )
+{
+  OSStatus err = kNoErr;
+  uint16_t i, physical;
+  uint32_t tag;
+
+  for( i = 0; i < ftl->sectorsPerBlock && ftl->blocks[block].validSectors > 0; i++ ){
+    physical = block * ftl->sectorsPerBlock + i;
+    err = _read( ftl, _tag_address( ftl, physical ), &tag, sizeof( tag ) );
+    require_noerr( err, exit );
+    if( !_tag_valid( tag ) || (uint16_t)tag >= ftl->sectorCount || ftl->map[ (uint16_t)tag ] != physical ) continue;
+
+    err = _read( ftl, _sector_address( ftl, physical ), ftl->buffer, kFTLSectorSize );
+    require_noerr( err, exit );
+    err = _program( ftl, (uint16_t)tag, ftl->buffer, true );
+    require_noerr( err, exit );
+  }
+
+  err = _retire_block( ftl, block );
+  require_noerr( err, exit );
+  ftl->stats.collections++;
+
+exit:
+  return err;
+}
+
+/* The next free sector of the head. When the head is full and one block is
+ * left spare, a block is collected first. A collection takes the last spare
+ * block if it has to, it gets one back when it is done.
+ */
+static OSStatus _allocate( ftl_t *ftl, bool collecting, uint16_t *outPhysical )
+{
+  OSStatus err = kNoErr;
+  int block;
+
+  if( ftl->head < 0 || ftl->headSector >= ftl->sectorsPerBlock ){
+    if( !collecting && _count_spare( ftl ) <= 1 && ( block = _victim_block( ftl ) ) >= 0 ){
+      err = _collect( ftl, block );
+      require_noerr( err, exit );
+    }
+    if( ftl->head < 0 || ftl->headSector >= ftl->sectorsPerBlock ){
+      block = _spare_block( ftl );
+      require_action( block >= 0, exit, err = kNoSpaceErr );
+      err = _start_head( ftl, block );
+      require_noerr( err, exit );
+    }
+  }
+  *outPhysical = ftl->head * ftl->sectorsPerBlock + ftl->headSector++;
+
+exit:
+  return err;
+}
+
+/* Write the sector to flash, a copy of a collected block keeps its old tag */
+static OSStatus _program( ftl_t *ftl, uint16_t sector, const uint8_t *data, bool collecting )
+{
+  OSStatus err = kNoErr;
+  uint16_t physical, old;
+  uint32_t tag = _tag( sector );
+
+  err = _allocate( ftl, collecting, &physical );
+  require_noerr( err, exit );
+  err = _write( ftl, _sector_address( ftl, physical ), data, kFTLSectorSize );
+  require_noerr( err, exit );
+  err = _write( ftl, _tag_address( ftl, physical ), &tag, sizeof( tag ) );
+  require_noerr( err, exit );
+  ftl->stats.sectorsProgrammed++;
+  if( collecting ) ftl->stats.sectorsCopied++;
+
+  old = ftl->map[sector];
+  ftl->map[sector] = physical;
+  ftl->blocks[ ftl->head ].validSectors++;
+  if( old != kFTLUnmapped ){
+    if( collecting )
+      ftl->blocks[ old / ftl->sectorsPerBlock ].validSectors--;
+    else
+      err = _clear_tag( ftl, old );
+  }
+
+exit:
+  return err;
+}
+
+/* Two copies of a sector are left by a reset between writing one and clearing the other */
+static bool _is_newer( ftl_t *ftl, uint16_t physical, uint16_t than )
+{
+  ftl_block_t *block = &ftl->blocks[ physical / ftl->sectorsPerBlock ];
+  ftl_block_t *thanBlock = &ftl->blocks[ than / ftl->sectorsPerBlock ];
+
+  if( block == thanBlock ) return physical > than;
+  return block->sequence > thanBlock->sequence;
+}
+
+static void _read_block_header( ftl_t *ftl, int block, const ftl_block_header_t *header )
+{
+  ftl_block_t *info = &ftl->blocks[block];
+
+  info->state = eFTLBlock_Dirty;
+  info->validSectors = 0;
+  info->sequence = 0;
+  info->eraseCount = kFTLUnknownEraseCount;
+  if( header->magic != kFTLMagic || header->eraseCheck != ~header->eraseCount )
+    return;
+
+  info->eraseCount = header->eraseCount;
+  if( header->sequence == 0xFFFFFFFF && header->sequenceCheck == 0xFFFFFFFF )
+    info->state = eFTLBlock_Free;
+  else if( header->sequenceCheck == ~header->sequence ){
+    info->state = eFTLBlock_Used;
+    info->sequence = header->sequence;
+  }
+}
+
+/* Build the map from the tags of the used blocks, and continue the newest one */
+static OSStatus _mount( ftl_t *ftl )
+{
+  OSStatus err = kNoErr;
+  const ftl_block_header_t *header = (const ftl_block_header_t *)ftl->buffer;
+  const uint32_t *tags = (const uint32_t *)( ftl->buffer + kFTLBlockHeaderSize );
+  uint16_t i, sector, physical, old;
+  int block, newest = -1;
+
+  for( i = 0; i < ftl->sectorCount; i++ )
+    ftl->map[i] = kFTLUnmapped;
+  ftl->head = -1;
+  ftl->headSector = ftl->sectorsPerBlock;
+  ftl->sequence = 1;
+
+  for( block = 0; block < ftl->blockCount; block++ ){
+    err = _read( ftl, _block_address( ftl, block ), ftl->buffer, kFTLBlockHeaderSize + 4 * ftl->sectorsPerBlock );
+    require_noerr( err, exit );
+    _read_block_header( ftl, block, header );
+    if( ftl->blocks[block].state != eFTLBlock_Used ) continue;
+    if( ftl->blocks[block].sequence >= ftl->sequence ) ftl->sequence = ftl->blocks[block].sequence + 1;
+    if( newest < 0 || ftl->blocks[block].sequence > ftl->blocks[newest].sequence ) newest = block;
+
+    for( i = 0; i < ftl->sectorsPerBlock; i++ ){
+      if( !_tag_valid( tags[i] ) || (uint16_t)tags[i] >= ftl->sectorCount ) continue;
+      sector = (uint16_t)tags[i];
+      physical = block * ftl->sectorsPerBlock + i;
+      old = ftl->map[sector];
+      ftl->blocks[block].validSectors++;
+      if( old == kFTLUnmapped || _is_newer( ftl, physical, old ) ){
+        ftl->map[sector] = physical;
+      }else{
+        old = physical;
+      }
+      if( old != kFTLUnmapped && old != ftl->map[sector] ){
+        err = _clear_tag( ftl, old );
+        require_noerr( err, exit );
+      }
+    }
+  }
+
+  if( newest >= 0 ){
+    err = _read( ftl, _block_address( ftl, newest ) + kFTLBlockHeaderSize, ftl->buffer, 4 * ftl->sectorsPerBlock );
+    require_noerr( err, exit );
+    for( i = ftl->sectorsPerBlock; i > 0 && ( (const uint32_t *)ftl->buffer )[i - 1] == kFTLTagFree; i-- );
+    if( i < ftl->sectorsPerBlock ){
+      /* A reset during a write can leave bits programmed in the sector after the last tag */
+      err = _read( ftl, _sector_address( ftl, newest * ftl->sectorsPerBlock + i ), ftl->buffer, kFTLSectorSize );
+      require_noerr( err, exit );
+      if( !_is_blank( ftl->buffer, kFTLSectorSize ) ) i++;
+    }
+    ftl->head = newest;
+    ftl->headSector = i;
+  }
+
+exit:
+  return err;
+}
+
+/* A reset during a collection that took the last spare block leaves none.
+ * The sectors that are left in the block fit into the head, as the ones that
+ * were copied already did.
+ */
+static OSStatus _recover( ftl_t *ftl )
+{
+  OSStatus err = kNoErr;
+  int block;
+
+  if( _count_spare( ftl ) > 0 )
+    return kNoErr;
+
+  block = _victim_block( ftl );
+  require_action( block >= 0 && ftl->head >= 0 &&
+                  ftl->blocks[block].validSectors <= ftl->sectorsPerBlock - ftl->headSector, exit, err = kNoSpaceErr );
+  ftl_log( "Interrupted collection of block %d, finished", block );
+  err = _collect( ftl, block );
+
+exit:
+  return err;
+}
+
+static ftl_cache_entry_t *_cache_find( ftl_t *ftl, uint16_t sector )
+{
+  uint8_t i;
+
+  for( i = 0; i < ftl->cacheCount; i++ )
+    if( ftl->cache[i].sector == sector ) return &ftl->cache[i];
+  return NULL;
+}
+
+/* An empty entry, the least recently used one is written back if it has to */
+static OSStatus _cache_evict( ftl_t *ftl, ftl_cache_entry_t **outEntry )
+{
+  OSStatus err = kNoErr;
+  ftl_cache_entry_t *entry = NULL;
+  uint8_t i;
+
+  for( i = 0; i < ftl->cacheCount; i++ ){
+    if( ftl->cache[i].sector == kFTLUnmapped ){
+      entry = &ftl->cache[i];
+      break;
+    }
+    if( entry == NULL || ftl->cache[i].lastUse < entry->lastUse )
+      entry = &ftl->cache[i];
+  }
+
+  if( entry->dirty ){
+    err = _program( ftl, entry->sector, entry->data, false );
+    require_noerr( err, exit );
+  }
+  entry->sector = kFTLUnmapped;
+  entry->dirty = false;
+  *outEntry = entry;
+
+exit:
+  return err;
+}
+
+static void _cache_drop( ftl_t *ftl, uint16_t sector )
+{
+  ftl_cache_entry_t *entry = _cache_find( ftl, sector );
+
+  if( entry ){
+    entry->sector = kFTLUnmapped;
+    entry->dirty = false;
+  }
+}
+
+static OSStatus _read_sector( ftl_t *ftl, uint16_t sector, uint8_t *buf )
+{
+  if( ftl->map[sector] == kFTLUnmapped ){
+    memset( buf, 0xFF, kFTLSectorSize );
+    return kNoErr;
+  }
+  return _read( ftl, _sector_address( ftl, ftl->map[sector] ), buf, kFTLSectorSize );
+}
+
+static OSStatus _flush( ftl_t *ftl )
+{
+  OSStatus err = kNoErr;
+  uint8_t i;
+
+  for( i = 0; i < ftl->cacheCount; i++ ){
+    if( !ftl->cache[i].dirty ) continue;
+    err = _program( ftl, ftl->cache[i].sector, ftl->cache[i].data, false );
+    require_noerr( err, exit );
+    ftl->cache[i].dirty = false;
+  }
+
+exit:
+  return err;
+}
+
+OSStatus FTLOpen( ftl_t *ftl, mico_flash_t flash, uint32_t startAddress, uint32_t blockSize, uint16_t blockCount,
+                  ftl_block_t *blocks, uint16_t *map, ftl_cache_entry_t *cache, uint8_t cacheCount )
+{
+  OSStatus err = kNoErr;
+  uint8_t i;
+
+  require_action( blockSize % kFTLSectorSize == 0 && blockSize >= 2 * kFTLSectorSize && blockSize <= kFTLMaxBlockSize &&
+                  blockCount > kFTLReservedBlocks && (uint32_t)blockCount * ( blockSize / kFTLSectorSize - 1 ) < kFTLUnmapped &&
+                  blocks && map && ( cache || cacheCount == 0 ), exit, err = kParamErr );
+
+  memset( ftl, 0, sizeof( ftl_t ) );
+  ftl->flash = flash;
+  ftl->startAddress = startAddress;
+  ftl->blockSize = blockSize;
+  ftl->blockCount = blockCount;
+  ftl->sectorsPerBlock = blockSize / kFTLSectorSize - 1;
+  ftl->sectorCount = FTLSectorCount( blockSize, blockCount );
+  ftl->blocks = blocks;
+  ftl->map = map;
+  ftl->cache = cache;
+  ftl->cacheCount = cacheCount;
+  for( i = 0; i < cacheCount; i++ ){
+    cache[i].sector = kFTLUnmapped;
+    cache[i].dirty = false;
+  }
+
+  err = mico_rtos_init_mutex( &ftl->mutex );
+  require_noerr( err, exit );
+  err = _mount( ftl );
+  require_noerr( err, exit );
+  err = _recover( ftl );
+  require_noerr( err, exit );
+
+exit:
+  return err;
+}
+
+OSStatus FTLClose( ftl_t *ftl )
+{
+  OSStatus err;
+
+  mico_rtos_lock_mutex( &ftl->mutex );
+  err = _flush( ftl );
+  mico_rtos_unlock_mutex( &ftl->mutex );
+  mico_rtos_deinit_mutex( &ftl->mutex );
+  return err;
+}
+
+OSStatus FTLFormat( ftl_t *ftl )
+{
+  OSStatus err = kNoErr;
+  uint16_t i;
+
+  mico_rtos_lock_mutex( &ftl->mutex );
+  for( i = 0; i < ftl->cacheCount; i++ ){
+    ftl->cache[i].sector = kFTLUnmapped;
+    ftl->cache[i].dirty = false;
+  }
+  for( i = 0; i < ftl->sectorCount; i++ )
+    ftl->map[i] = kFTLUnmapped;
+  ftl->head = -1;
+  ftl->headSector = ftl->sectorsPerBlock;
+  ftl->sequence = 1;
+
+  for( i = 0; i < ftl->blockCount; i++ ){
+    err = _erase_block( ftl, i, false );
+    require_noerr( err, exit );
+  }
+
+exit:
+  mico_rtos_unlock_mutex( &ftl->mutex );
+  return err;
+}
+
+OSStatus FTLRead( ftl_t *ftl, uint32_t sector, uint8_t *buf, uint32_t count )
+{
+  OSStatus err = kNoErr;
+  ftl_cache_entry_t *entry;
+
+  require_action( sector + count <= ftl->sectorCount, exit_unlocked, err = kParamErr );
+  mico_rtos_lock_mutex( &ftl->mutex );
+
+  for( ; count > 0; count--, sector++, buf += kFTLSectorSize ){
+    entry = _cache_find( ftl, (uint16_t)sector );
+    if( entry ){
+      ftl->stats.cacheHits++;
+      entry->lastUse = ++ftl->useClock;
+      memcpy( buf, entry->data, kFTLSectorSize );
+      continue;
+    }
+
+    /* Only single sectors are cached, long reads would push out the FAT and directories */
+    ftl->stats.cacheMisses++;
+    if( count > 1 || ftl->cacheCount == 0 ){
+      err = _read_sector( ftl, (uint16_t)sector, buf );
+      require_noerr( err, exit );
+      continue;
+    }
+    err = _cache_evict( ftl, &entry );
+    require_noerr( err, exit );
+    err = _read_sector( ftl, (uint16_t)sector, entry->data );
+    require_noerr( err, exit );
+    entry->sector = (uint16_t)sector;
+    entry->lastUse = ++ftl->useClock;
+    memcpy( buf, entry->data, kFTLSectorSize );
+  }
+
+exit:
+  mico_rtos_unlock_mutex( &ftl->mutex );
+exit_unlocked:
+  return err;
+}
+
+OSStatus FTLWrite( ftl_t *ftl, uint32_t sector, const uint8_t *buf, uint32_t count )
+{
+  OSStatus err = kNoErr;
+  ftl_cache_entry_t *entry;
+
+  require_action( sector + count <= ftl->sectorCount, exit_unlocked, err = kParamErr );
+  mico_rtos_lock_mutex( &ftl->mutex );
+
+  for( ; count > 0; count--, sector++, buf += kFTLSectorSize ){
+    ftl->stats.sectorsWritten++;
+    entry = _cache_find( ftl, (uint16_t)sector );
+    if( entry ) ftl->stats.cacheHits++;
+    else ftl->stats.cacheMisses++;
+    if( count > 1 || ftl->cacheCount == 0 ){
+      if( entry ) _cache_drop( ftl, (uint16_t)sector );
+      err = _program( ftl, (uint16_t)sector, buf, false );
+      require_noerr( err, exit );
+      continue;
+    }
+
+    if( entry == NULL ){
+      err = _cache_evict( ftl, &entry );
+      require_noerr( err, exit );
+      entry->sector = (uint16_t)sector;
+    }else if( memcmp( entry->data, buf, kFTLSectorSize ) == 0 ){
+      entry->lastUse = ++ftl->useClock;
+      continue;
+    }
+    memcpy( entry->data, buf, kFTLSectorSize );
+    entry->dirty = true;
+    entry->lastUse = ++ftl->useClock;
+  }
+
+exit:
+  mico_rtos_unlock_mutex( &ftl->mutex );
+exit_unlocked:
+  return err;
+}
+
+OSStatus FTLTrim( ftl_t *ftl, uint32_t sector, uint32_t count )
+{
+  OSStatus err = kNoErr;
+  uint16_t physical;
+
+  require_action( sector + count <= ftl->sectorCount, exit_unlocked, err = kParamErr );
+  mico_rtos_lock_mutex( &ftl->mutex );
+
+  for( ; count > 0; count--, sector++ ){
+    _cache_drop( ftl, (uint16_t)sector );
+    physical = ftl->map[sector];
+    if( physical == kFTLUnmapped ) continue;
+    ftl->map[sector] = kFTLUnmapped;
+    err = _clear_tag( ftl, physical );
+    require_noerr( err, exit );
+  }
+
+exit:
+  mico_rtos_unlock_mutex( &ftl->mutex );
+exit_unlocked:
+  return err;
+}
+
+OSStatus FTLFlush( ftl_t *ftl )
+{
+  OSStatus err;
+
+  mico_rtos_lock_mutex( &ftl->mutex );
+  err = _flush( ftl );
+  mico_rtos_unlock_mutex( &ftl->mutex );
+  return err;
+}
+
+OSStatus FTLBackgroundErase( ftl_t *ftl, uint32_t maxBlocks )
+{
+  OSStatus err = kNoErr;
+  uint32_t done, maxEraseCount = 0;
+  int i, block;
+
+  mico_rtos_lock_mutex( &ftl->mutex );
+
+  /* Static wear levelling: the least worn block holds data that does not
+   * change, move it so that the block takes its share of the writes.
+   */
+  block = -1;
+  for( i = 0; i < ftl->blockCount; i++ ){
+    if( ftl->blocks[i].eraseCount == kFTLUnknownEraseCount ) continue;
+    if( ftl->blocks[i].eraseCount > maxEraseCount ) maxEraseCount = ftl->blocks[i].eraseCount;
+    if( ftl->blocks[i].state == eFTLBlock_Used && i != ftl->head &&
+        ( block < 0 || ftl->blocks[i].eraseCount < ftl->blocks[block].eraseCount ) )
+      block = i;
+  }
+  if( block >= 0 && maxEraseCount - ftl->blocks[block].eraseCount > kFTLWearLevelDelta && _count_spare( ftl ) >= 2 ){
+    err = _collect( ftl, block );
+    require_noerr( err, exit );
+  }
+
+  for( done = 0; done < maxBlocks; done++ ){
+    /* Collect ahead, so that a write does not have to */
+    if( _count_spare( ftl ) < kFTLBackgroundSpareBlocks && ( block = _victim_block( ftl ) ) >= 0 &&
+        ftl->blocks[block].validSectors < ftl->sectorsPerBlock ){
+      err = _collect( ftl, block );
+      require_noerr( err, exit );
+    }
+    block = -1;
+    for( i = 0; i < ftl->blockCount; i++ )
+      if( ftl->blocks[i].state == eFTLBlock_Dirty &&
+          ( block < 0 || ftl->blocks[i].eraseCount < ftl->blocks[block].eraseCount ) )
+        block = i;
+    if( block < 0 ) break;
+    err = _erase_block( ftl, block, false );
+    require_noerr( err, exit );
+  }
+
+exit:
+  mico_rtos_unlock_mutex( &ftl->mutex );
+  return err;
+}
+
+void FTLGetStats( ftl_t *ftl, ftl_stats_t *outStats )
+{
+  int i;
+
+  mico_rtos_lock_mutex( &ftl->mutex );
+  *outStats = ftl->stats;
+  outStats->minEraseCount = 0xFFFFFFFF;
+  outStats->maxEraseCount = 0;
+  for( i = 0; i < ftl->blockCount; i++ ){
+    if( ftl->blocks[i].eraseCount == kFTLUnknownEraseCount ) continue;
+    if( ftl->blocks[i].eraseCount < outStats->minEraseCount ) outStats->minEraseCount = ftl->blocks[i].eraseCount;
+    if( ftl->blocks[i].eraseCount > outStats->maxEraseCount ) outStats->maxEraseCount = ftl->blocks[i].eraseCount;
+  }
+  if( outStats->minEraseCount > outStats->maxEraseCount ) outStats->minEraseCount = 0;
+  mico_rtos_unlock_mutex( &ftl->mutex );
+}
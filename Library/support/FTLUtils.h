@@ -0,0 +1,149 @@
+/**
+  ******************************************************************************
+  * @file    FTLUtils.h
+  * @author  William Xu
+  * @version V1.0.0
+  * @date    17-Oct-2026
+  * @brief   This header contains function prototypes of a flash translation
+  *          layer: 512 byte logical sectors remapped over erase blocks, with
+  *          a RAM sector cache
+  ******************************************************************************
+  * @attention
+  *
+  * THE PRESENT FIRMWARE WHICH IS FOR GUIDANCE ONLY AIMS AT PROVIDING CUSTOMERS
+  * WITH CODING INFORMATION REGARDING THEIR PRODUCTS IN ORDER FOR THEM TO SAVE
+  * TIME. AS A RESULT, MXCHIP Inc. SHALL NOT BE HELD LIABLE FOR ANY
+  * DIRECT, INDIRECT OR CONSEQUENTIAL DAMAGES WITH RESPECT TO ANY CLAIMS ARISING
+  * FROM THE CONTENT OF SUCH FIRMWARE AND/OR THE USE MADE BY CUSTOMERS OF THE
+  * CODING INFORMATION CONTAINED HEREIN IN CONNECTION WITH THEIR PRODUCTS.
+  *
+  * <h2><center>&copy; COPYRIGHT 2014 MXCHIP Inc.</center></h2>
+  ******************************************************************************
+  */
+
+#ifndef __FTLUtils_h__
+#define __FTLUtils_h__
+
+#include "Common.h"
+#include "MICORTOS.h"
+#include "MicoPlatform.h"
+
+/* The first sector of every erase block holds its header and a tag for each
+ * of the other sectors. A logical sector is written to the next free sector
+ * of the head block and its tag names it, the copy it replaces gets its tag
+ * cleared. Nothing is erased to rewrite a sector: when the head is full and
+ * one block is left spare, the block with the fewest current sectors is
+ * copied into the head and retired. Retired blocks are erased by
+ * FTLBackgroundErase(), or by the write that needs them when it was not run.
+ * The least worn erased block becomes the next head, and FTLBackgroundErase()
+ * moves the sectors of a block that is kFTLWearLevelDelta erases behind the
+ * most worn one, so blocks of data that never changes get their turn too.
+ *
+ * Only the newest copy of a sector counts, a reset during a write leaves the
+ * copy from before. The map is a RAM table of the sector of every logical
+ * sector. Single sector reads and writes go through the cache, a write
+ * stays in RAM until it is evicted or FTLFlush() is called.
+ */
+
+#define kFTLMagic                     0x314C5446  /**< "FTL1" */
+#define kFTLSectorSize                512
+#define kFTLMaxBlockSize              0x8000
+#define kFTLReservedBlocks            2           /**< Capacity left for the spare and the head block */
+#define kFTLSpareRatio                8           /**< And one block in 8, so collected blocks hold few current sectors */
+#define kFTLWearLevelDelta            32
+#define kFTLUnmapped                  0xFFFF
+
+/* Logical sectors of blockCount erase blocks of blockSize bytes */
+#define FTLSectorCount( blockSize, blockCount ) \
+        ( ( (blockCount) - kFTLReservedBlocks - (blockCount) / kFTLSpareRatio ) * ( (blockSize) / kFTLSectorSize - 1 ) )
+
+/* ftl_block_t.state */
+enum {
+  eFTLBlock_Dirty,              /**< Retired or not erased, its sectors do not count */
+  eFTLBlock_Free,               /**< Erased and counted, not used yet */
+  eFTLBlock_Used,               /**< Holds sectors, its sequence orders it */
+};
+
+typedef struct {
+  uint8_t   state;
+  uint16_t  validSectors;       //! Sectors that the map points to.
+  uint32_t  eraseCount;
+  uint32_t  sequence;           //! Used: the newest block has the highest.
+} ftl_block_t;
+
+typedef struct {
+  uint16_t  sector;             //! kFTLUnmapped: empty.
+  bool      dirty;              //! Not written to flash yet.
+  uint32_t  lastUse;
+  uint8_t   data[ kFTLSectorSize ];
+} ftl_cache_entry_t;
+
+typedef struct {
+  uint32_t  sectorsWritten;     //! By FTLWrite().
+  uint32_t  sectorsProgrammed;  //! To flash, including copies.
+  uint32_t  sectorsCopied;      //! Moved out of blocks that were collected.
+  uint32_t  cacheHits;          //! Reads and writes of a cached sector.
+  uint32_t  cacheMisses;
+  uint32_t  collections;
+  uint32_t  erases;
+  uint32_t  foregroundErases;   //! Erases that a write had to wait for.
+  uint32_t  minEraseCount;      //! Filled by FTLGetStats().
+  uint32_t  maxEraseCount;
+} ftl_stats_t;
+
+typedef struct {
+  mico_flash_t            flash;
+  uint32_t                startAddress;
+  uint32_t                blockSize;
+  uint16_t                blockCount;
+  uint16_t                sectorsPerBlock;    //! Data sectors, without the header sector.
+  uint16_t                sectorCount;        //! Logical sectors.
+  ftl_block_t *           blocks;
+  uint16_t *              map;                //! Block * sectorsPerBlock + sector, or kFTLUnmapped.
+
+  int16_t                 head;               //! Block taking new sectors, -1: none yet.
+  uint16_t                headSector;         //! Next free sector of the head.
+  uint32_t                sequence;           //! Of the next head.
+
+  ftl_cache_entry_t *     cache;
+  uint8_t                 cacheCount;
+  uint32_t                useClock;
+
+  mico_mutex_t            mutex;
+  uint8_t                 buffer[ kFTLSectorSize ];
+  ftl_stats_t             stats;
+} ftl_t;
+
+/* Mount blockCount blocks of blockSize bytes from startAddress. blocks has
+ * blockCount entries and map FTLSectorCount() entries, the cache can be
+ * empty. Blocks that hold no FTL are erased when they are needed.
+ */
+OSStatus FTLOpen( ftl_t *ftl, mico_flash_t flash, uint32_t startAddress, uint32_t blockSize, uint16_t blockCount,
+                  ftl_block_t *blocks, uint16_t *map, ftl_cache_entry_t *cache, uint8_t cacheCount );
+
+/* Write the cache back */
+OSStatus FTLClose( ftl_t *ftl );
+
+/* Erase every block, all sectors read as 0xFF */
+OSStatus FTLFormat( ftl_t *ftl );
+
+/* A sector that was never written or was trimmed reads as 0xFF */
+OSStatus FTLRead( ftl_t *ftl, uint32_t sector, uint8_t *buf, uint32_t count );
+
+OSStatus FTLWrite( ftl_t *ftl, uint32_t sector, const uint8_t *buf, uint32_t count );
+
+/* The sectors are no longer used, they need not be copied */
+OSStatus FTLTrim( ftl_t *ftl, uint32_t sector, uint32_t count );
+
+/* Write the cached sectors that changed to flash */
+OSStatus FTLFlush( ftl_t *ftl );
+
+/* Erase up to maxBlocks retired blocks, so writes find erased blocks. Run it
+ * when the flash is idle, from any thread.
+ */
+OSStatus FTLBackgroundErase( ftl_t *ftl, uint32_t maxBlocks );
+
+void FTLGetStats( ftl_t *ftl, ftl_stats_t *outStats );
+
+#endif // __FTLUtils_h__
+
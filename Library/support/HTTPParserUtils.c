@@ -0,0 +1,573 @@
+/**
+  ******************************************************************************
+  * @file    HTTPParserUtils.c
+  * @author  William Xu
+  * @version V1.0.0
+  * @date    17-Oct-2026
+  * @brief   This file contains an incremental HTTP/1.1 parser, the input is
+  *          looked at once and may be split anywhere
+  ******************************************************************************
+  * @attention
+  *
+  * THE PRESENT FIRMWARE WHICH IS FOR GUIDANCE ONLY AIMS AT PROVIDING CUSTOMERS
+  * WITH CODING INFORMATION REGARDING THEIR PRODUCTS IN ORDER FOR THEM TO SAVE
+  * TIME. AS A RESULT, MXCHIP Inc. SHALL NOT BE HELD LIABLE FOR ANY
+  * DIRECT, INDIRECT OR CONSEQUENTIAL DAMAGES WITH RESPECT TO ANY CLAIMS ARISING
+  * FROM THE CONTENT OF SUCH FIRMWARE AND/OR THE USE MADE BY CUSTOMERS OF THE
+  * CODING INFORMATION CONTAINED HEREIN IN CONNECTION WITH THEIR PRODUCTS.
+  *
+  * <h2><center>&copy; COPYRIGHT 2014 MXCHIP Inc.</center></h2>
+  ******************************************************************************
+  */
+
+#include "HTTPParserUtils.h"
+#include "StringUtils.h"
+#include "Debug.h"
+
+enum {
+  kState_StartLine,
+  kState_HeaderLine,
+  kState_Body,
+  kState_BodyUntilClose,
+  kState_ChunkSize,
+  kState_ChunkData,
+  kState_ChunkEnd,
+  kState_TrailerLine,
+  kState_Complete,
+  kState_Error,
+};
+
+/* lineState in kState_ChunkSize */
+enum {
+  kChunkLine_NoDigit,
+  kChunkLine_Digits,
+  kChunkLine_Space,         /* Whitespace after the size */
+  kChunkLine_Extension,
+  kChunkLine_CR,
+};
+
+static bool _is_tchar( char c )
+{
+  if( ( c >= 'a' && c <= 'z' ) || ( c >= 'A' && c <= 'Z' ) || ( c >= '0' && c <= '9' ) )
+    return true;
+  return ( c != 0 && strchr( "!#$%&'*+-.^_`|~", c ) != NULL );
+}
+
+static int _hex_value( char c )
+{
+  if( c >= '0' && c <= '9' ) return c - '0';
+  if( c >= 'a' && c <= 'f' ) return c - 'a' + 10;
+  if( c >= 'A' && c <= 'F' ) return c - 'A' + 10;
+  return -1;
+}
+
+static void _set_span( http_span_t *span, uint16_t offset, uint16_t len )
+{
+  span->offset = offset;
+  span->len = len;
+}
+
+static OSStatus _emit( http_parser_t *parser, http_parser_event_t event, const uint8_t *data, size_t len )
+{
+  if( parser->callback == NULL )
+    return kNoErr;
+  return parser->callback( parser, event, data, len, parser->userContext );
+}
+
+static OSStatus _complete( http_parser_t *parser )
+{
+  parser->state = kState_Complete;
+  return _emit( parser, kHTTPParserEvent_Complete, NULL, 0 );
+}
+
+/* true if the comma separated list value holds token */
+static bool _list_has_token( const char *value, size_t valueLen, const char *token )
+{
+  size_t start = 0, end;
+
+  while( start < valueLen ){
+    while( start < valueLen && ( value[start] == ' ' || value[start] == '\t' || value[start] == ',' ) ) start++;
+    for( end = start; end < valueLen && value[end] != ','; end++ ) {}
+    if( end > start ){
+      size_t tokenEnd = end;
+      while( tokenEnd > start && ( value[tokenEnd - 1] == ' ' || value[tokenEnd - 1] == '\t' ) ) tokenEnd--;
+      if( strnicmpx( value + start, tokenEnd - start, token ) == 0 )
+        return true;
+    }
+    start = end;
+  }
+  return false;
+}
+
+static OSStatus _parse_start_line( http_parser_t *parser, uint16_t start, uint16_t len )
+{
+  OSStatus err = kMalformedErr;
+  const char *line = parser->arena + start;
+  uint16_t i = 0, fieldStart;
+  int x;
+
+  if( len >= 5 && memcmp( line, "HTTP/", 5 ) == 0 ){
+    // Response: <protocol>/<majorVersion>.<minorVersion> <statusCode> <reasonPhrase>
+    parser->isResponse = true;
+    while( i < len && line[i] != ' ' ) i++;
+    _set_span( &parser->protocol, start, i );
+    require_quiet( i < len, exit );
+    i++;
+
+    for( x = 0, fieldStart = i; i < len && line[i] >= '0' && line[i] <= '9'; i++ )
+      x = x * 10 + ( line[i] - '0' );
+    require_quiet( i - fieldStart == 3, exit );
+    parser->statusCode = x;
+
+    if( i < len ){
+      require_quiet( line[i] == ' ', exit );
+      i++;
+    }
+    _set_span( &parser->reasonPhrase, start + i, len - i );
+  }else{
+    // Request: <method> <url> <protocol>/<majorVersion>.<minorVersion>
+    while( i < len && line[i] != ' ' ){
+      require_quiet( _is_tchar( line[i] ), exit );
+      i++;
+    }
+    require_quiet( i > 0 && i < len, exit );
+    _set_span( &parser->method, start, i );
+    i++;
+
+    fieldStart = i;
+    while( i < len && line[i] != ' ' ) i++;
+    require_quiet( i > fieldStart && i < len, exit );
+    _set_span( &parser->url, start + fieldStart, i - fieldStart );
+    i++;
+
+    require_quiet( len - i >= 5 && memcmp( line + i, "HTTP/", 5 ) == 0, exit );
+    _set_span( &parser->protocol, start + i, len - i );
+  }
+  err = kNoErr;
+
+exit:
+  return err;
+}
+
+static OSStatus _parse_field_line( http_parser_t *parser, uint16_t start, uint16_t len )
+{
+  OSStatus err = kMalformedErr;
+  const char *line = parser->arena + start;
+  http_field_t *field;
+  uint16_t i = 0, valueStart, valueEnd;
+
+  // Folded lines are obsolete (RFC 7230 section 3.2.4)
+  require_quiet( line[0] != ' ' && line[0] != '\t', exit );
+
+  while( i < len && line[i] != ':' ){
+    require_quiet( _is_tchar( line[i] ), exit );
+    i++;
+  }
+  require_quiet( i > 0 && i < len, exit );
+  require_action_quiet( parser->fieldCount < kHTTPParserMaxFields, exit, err = kNoSpaceErr );
+
+  field = &parser->fields[parser->fieldCount++];
+  _set_span( &field->name, start, i );
+
+  for( valueStart = i + 1; valueStart < len && ( line[valueStart] == ' ' || line[valueStart] == '\t' ); valueStart++ ) {}
+  for( valueEnd = len; valueEnd > valueStart && ( line[valueEnd - 1] == ' ' || line[valueEnd - 1] == '\t' ); valueEnd-- ) {}
+  _set_span( &field->value, start + valueStart, valueEnd - valueStart );
+  err = kNoErr;
+
+exit:
+  return err;
+}
+
+static OSStatus _parse_content_length( http_parser_t *parser )
+{
+  OSStatus err;
+  const char *value;
+  size_t valueLen, i;
+  uint64_t x = 0;
+
+  err = HTTPParserGetField( parser, "Content-Length", &value, &valueLen );
+  if( err != kNoErr )
+    return kNoErr;
+
+  err = kMalformedErr;
+  require_quiet( valueLen > 0 && valueLen <= 19, exit );
+  for( i = 0; i < valueLen; i++ ){
+    require_quiet( value[i] >= '0' && value[i] <= '9', exit );
+    x = x * 10 + (uint64_t)( value[i] - '0' );
+  }
+  parser->hasContentLength = true;
+  parser->contentLength = x;
+  err = kNoErr;
+
+exit:
+  return err;
+}
+
+/* The empty line after the header fields, decide how the body is framed */
+static OSStatus _header_done( http_parser_t *parser )
+{
+  OSStatus err;
+  const char *value;
+  size_t valueLen;
+
+  parser->headerFieldCount = parser->fieldCount;
+
+  // Note: HTTP 1.0 defaults to non-persistent if a Connection header field is not present.
+  if( HTTPParserGetField( parser, "Connection", &value, &valueLen ) == kNoErr &&
+      _list_has_token( value, valueLen, "close" ) )
+    parser->persistent = false;
+  else if( HTTPParserGetField( parser, "Connection", &value, &valueLen ) == kNoErr &&
+           _list_has_token( value, valueLen, "keep-alive" ) )
+    parser->persistent = true;
+  else
+    parser->persistent = ( strnicmpx( HTTPParserSpanPtr( parser, parser->protocol ), parser->protocol.len, "HTTP/1.0" ) != 0 );
+
+  if( HTTPParserGetField( parser, "Transfer-Encoding", &value, &valueLen ) == kNoErr )
+    parser->chunked = ( strnicmp_suffix( value, valueLen, "chunked" ) == 0 );
+
+  err = _parse_content_length( parser );
+  require_noerr_quiet( err, exit );
+
+  err = _emit( parser, kHTTPParserEvent_Header, NULL, 0 );
+  require_noerr_quiet( err, exit );
+
+  if( parser->isResponse && ( parser->statusCode / 100 == 1 || parser->statusCode == 204 || parser->statusCode == 304 ) ){
+    err = _complete( parser );
+  }else if( parser->chunked ){
+    parser->state = kState_ChunkSize;
+    parser->lineState = kChunkLine_NoDigit;
+    parser->chunkSize = 0;
+    parser->chunkLineLen = 0;
+  }else if( parser->hasContentLength ){
+    parser->remaining = parser->contentLength;
+    if( parser->remaining == 0 )
+      err = _complete( parser );
+    else
+      parser->state = kState_Body;
+  }else if( parser->isResponse ){
+    // Without a length the body of a response runs until the connection is closed
+    parser->bodyEndedByClose = true;
+    parser->persistent = false;
+    parser->state = kState_BodyUntilClose;
+  }else{
+    err = _complete( parser );
+  }
+
+exit:
+  return err;
+}
+
+/* Copy input up to and including the next LF into the arena */
+static OSStatus _collect_line( http_parser_t *parser, const uint8_t **ioSrc, const uint8_t *end, bool *outDone )
+{
+  const uint8_t *lf = memchr( *ioSrc, '\n', (size_t)( end - *ioSrc ) );
+  size_t len = (size_t)( ( lf ? lf + 1 : end ) - *ioSrc );
+
+  if( (size_t)parser->arenaLen + len > parser->arenaSize )
+    return kNoSpaceErr;
+
+  memcpy( parser->arena + parser->arenaLen, *ioSrc, len );
+  parser->arenaLen += (uint16_t)len;
+  *ioSrc += len;
+  *outDone = ( lf != NULL );
+  return kNoErr;
+}
+
+static OSStatus _line_done( http_parser_t *parser )
+{
+  OSStatus err = kNoErr;
+  uint16_t start = parser->lineStart;
+  uint16_t len = parser->arenaLen - start - 1;
+
+  if( len > 0 && parser->arena[start + len - 1] == '\r' )
+    len--;
+  // The line ending is not kept, the fields point into the line
+  parser->arenaLen = start + len;
+
+  switch( parser->state ){
+    case kState_StartLine:
+      // Empty lines before a request line are ignored (RFC 7230 section 3.5)
+      if( len > 0 ){
+        err = _parse_start_line( parser, start, len );
+        parser->state = kState_HeaderLine;
+      }
+      break;
+
+    case kState_HeaderLine:
+      if( len == 0 )
+        err = _header_done( parser );
+      else
+        err = _parse_field_line( parser, start, len );
+      break;
+
+    case kState_TrailerLine:
+      if( len == 0 ){
+        if( parser->fieldCount > parser->headerFieldCount )
+          err = _emit( parser, kHTTPParserEvent_Trailer, NULL, 0 );
+        if( err == kNoErr )
+          err = _complete( parser );
+      }else{
+        err = _parse_field_line( parser, start, len );
+      }
+      break;
+
+    default:
+      err = kStateErr;
+      break;
+  }
+
+  parser->lineStart = parser->arenaLen;
+  return err;
+}
+
+static OSStatus _chunk_size_char( http_parser_t *parser, char c )
+{
+  OSStatus err = kMalformedErr;
+  int digit;
+
+  require_quiet( ++parser->chunkLineLen <= kHTTPParserMaxChunkLine, exit );
+
+  if( c == '\n' ){
+    require_quiet( parser->lineState != kChunkLine_NoDigit, exit );
+    if( parser->chunkSize == 0 ){
+      parser->state = kState_TrailerLine;
+      parser->lineStart = parser->arenaLen;
+      err = kNoErr;
+      goto exit;
+    }
+    parser->remaining = parser->chunkSize;
+    parser->state = kState_ChunkData;
+    err = _emit( parser, kHTTPParserEvent_Chunk, NULL, 0 );
+    goto exit;
+  }
+
+  switch( parser->lineState ){
+    case kChunkLine_NoDigit:
+    case kChunkLine_Digits:
+      digit = _hex_value( c );
+      if( digit >= 0 ){
+        require_quiet( parser->chunkSize <= 0x07FFFFFF, exit );
+        parser->chunkSize = ( parser->chunkSize << 4 ) | (uint32_t)digit;
+        parser->lineState = kChunkLine_Digits;
+        break;
+      }
+      // Not a hex digit, the size must have at least one
+      if( parser->lineState != kChunkLine_Digits ) goto exit;
+      // Fall through
+    case kChunkLine_Space:
+      if( c == ' ' || c == '\t' )       parser->lineState = kChunkLine_Space;
+      else if( c == ';' )               parser->lineState = kChunkLine_Extension;
+      else if( c == '\r' )              parser->lineState = kChunkLine_CR;
+      else                              goto exit;
+      break;
+    case kChunkLine_Extension:
+      // Chunk extensions are not used, they are skipped
+      if( c == '\r' ) parser->lineState = kChunkLine_CR;
+      break;
+    case kChunkLine_CR:
+    default:
+      goto exit;
+  }
+  err = kNoErr;
+
+exit:
+  return err;
+}
+
+OSStatus HTTPParserInit( http_parser_t *parser, char *arena, size_t arenaSize,
+                         http_parser_callback_t callback, void *userContext )
+{
+  OSStatus err = kParamErr;
+
+  require( parser, exit );
+  require( arena, exit );
+  require( arenaSize > 0 && arenaSize <= 0xFFFF, exit );
+
+  memset( parser, 0, sizeof( http_parser_t ) );
+  parser->arena = arena;
+  parser->arenaSize = (uint16_t)arenaSize;
+  parser->callback = callback;
+  parser->userContext = userContext;
+  HTTPParserReset( parser );
+  err = kNoErr;
+
+exit:
+  return err;
+}
+
+void HTTPParserReset( http_parser_t *parser )
+{
+  parser->arenaLen = 0;
+  parser->lineStart = 0;
+  parser->state = kState_StartLine;
+  parser->lineState = 0;
+  parser->isResponse = false;
+  memset( &parser->method, 0, sizeof( http_span_t ) );
+  memset( &parser->url, 0, sizeof( http_span_t ) );
+  memset( &parser->protocol, 0, sizeof( http_span_t ) );
+  memset( &parser->reasonPhrase, 0, sizeof( http_span_t ) );
+  parser->statusCode = -1;
+  parser->fieldCount = 0;
+  parser->headerFieldCount = 0;
+  parser->persistent = false;
+  parser->chunked = false;
+  parser->hasContentLength = false;
+  parser->bodyEndedByClose = false;
+  parser->contentLength = 0;
+  parser->bodyLength = 0;
+  parser->remaining = 0;
+  parser->chunkSize = 0;
+  parser->chunkLineLen = 0;
+}
+
+OSStatus HTTPParserExecute( http_parser_t *parser, const uint8_t *inData, size_t inLen, size_t *outUsed )
+{
+  OSStatus err = kParamErr;
+  const uint8_t *src = inData;
+  const uint8_t *end = inData + inLen;
+  bool lineDone;
+  size_t len;
+
+  require( parser, exit );
+  require( inData || inLen == 0, exit );
+  require_action( parser->state != kState_Error, exit, err = kStateErr );
+
+  if( parser->state == kState_Complete )
+    HTTPParserReset( parser );
+
+  err = kNoErr;
+  while( src < end && parser->state != kState_Complete ){
+    switch( parser->state ){
+      case kState_StartLine:
+      case kState_HeaderLine:
+      case kState_TrailerLine:
+        err = _collect_line( parser, &src, end, &lineDone );
+        require_noerr_quiet( err, exit );
+        if( lineDone ){
+          err = _line_done( parser );
+          require_noerr_quiet( err, exit );
+        }
+        break;
+
+      case kState_Body:
+      case kState_BodyUntilClose:
+      case kState_ChunkData:
+        len = (size_t)( end - src );
+        if( parser->state != kState_BodyUntilClose && len > parser->remaining )
+          len = (size_t)parser->remaining;
+        parser->bodyLength += len;
+        if( parser->state != kState_BodyUntilClose )
+          parser->remaining -= len;
+        err = _emit( parser, kHTTPParserEvent_Body, src, len );
+        src += len;
+        require_noerr_quiet( err, exit );
+
+        if( parser->remaining == 0 && parser->state == kState_Body ){
+          err = _complete( parser );
+          require_noerr_quiet( err, exit );
+        }else if( parser->remaining == 0 && parser->state == kState_ChunkData ){
+          parser->state = kState_ChunkEnd;
+          parser->lineState = 0;
+        }
+        break;
+
+      case kState_ChunkSize:
+        err = _chunk_size_char( parser, (char)*src++ );
+        require_noerr_quiet( err, exit );
+        break;
+
+      case kState_ChunkEnd:
+        // CRLF after the chunk data, a bare LF is tolerated
+        if( parser->lineState == 0 && *src == '\r' ){
+          parser->lineState = 1;
+        }else{
+          require_action_quiet( *src == '\n', exit, err = kMalformedErr );
+          parser->state = kState_ChunkSize;
+          parser->lineState = kChunkLine_NoDigit;
+          parser->chunkSize = 0;
+          parser->chunkLineLen = 0;
+        }
+        src++;
+        break;
+
+      default:
+        err = kStateErr;
+        goto exit;
+    }
+  }
+
+exit:
+  // The stream cannot be resynchronized after an error
+  if( parser && err != kNoErr )
+    parser->state = kState_Error;
+  if( outUsed ) *outUsed = (size_t)( src - inData );
+  return err;
+}
+
+OSStatus HTTPParserFinish( http_parser_t *parser )
+{
+  if( parser == NULL )
+    return kParamErr;
+
+  if( parser->state == kState_BodyUntilClose )
+    return _complete( parser );
+  if( parser->state == kState_Complete || HTTPParserIsIdle( parser ) )
+    return kNoErr;
+  return kUnderrunErr;
+}
+
+bool HTTPParserIsComplete( http_parser_t *parser )
+{
+  return ( parser->state == kState_Complete );
+}
+
+bool HTTPParserIsIdle( http_parser_t *parser )
+{
+  return ( parser->state == kState_Complete || ( parser->state == kState_StartLine && parser->arenaLen == 0 ) );
+}
+
+OSStatus HTTPParserGetField( http_parser_t *parser, const char *name, const char **outValue, size_t *outValueLen )
+{
+  http_field_t *field;
+  uint8_t i;
+
+  for( i = 0; i < parser->fieldCount; i++ ){
+    field = &parser->fields[i];
+    if( strnicmpx( HTTPParserSpanPtr( parser, field->name ), field->name.len, name ) == 0 ){
+      if( outValue )    *outValue = HTTPParserSpanPtr( parser, field->value );
+      if( outValueLen ) *outValueLen = field->value.len;
+      return kNoErr;
+    }
+  }
+  return kNotFoundErr;
+}
+
+OSStatus HTTPParserMatchMethod( http_parser_t *parser, const char *method )
+{
+  if( strnicmpx( HTTPParserSpanPtr( parser, parser->method ), parser->method.len, method ) == 0 )
+    return kNoErr;
+
+  return kNotFoundErr;
+}
+
+OSStatus HTTPParserMatchURL( http_parser_t *parser, const char *url )
+{
+  const char *ptr = HTTPParserSpanPtr( parser, parser->url );
+  const char *end = ptr + parser->url.len;
+  const char *path;
+
+  // Skip the scheme and the authority of an absolute URL
+  for( path = ptr; path + 2 < end && !( path[0] == ':' && path[1] == '/' && path[2] == '/' ); path++ ) {}
+  if( path + 2 < end ){
+    for( path += 3; path < end && *path != '/'; path++ ) {}
+  }else{
+    path = ptr;
+  }
+
+  for( ptr = path; ptr < end && *ptr != '?' && *ptr != '#'; ptr++ ) {}
+  if( strnicmp_suffix( path, (size_t)( ptr - path ), url ) == 0 )
+    return kNoErr;
+
+  return kNotFoundErr;
+}
+
@@ -0,0 +1,134 @@
+/**
+  ******************************************************************************
+  * @file    HTTPParserUtils.h
+  * @author  William Xu
+  * @version V1.0.0
+  * @date    17-Oct-2026
+  * @brief   This header contains function prototypes of an incremental
+  *          HTTP/1.1 parser
+  ******************************************************************************
+  * @attention
+  *
+  * THE PRESENT FIRMWARE WHICH IS FOR GUIDANCE ONLY AIMS AT PROVIDING CUSTOMERS
+  * WITH CODING INFORMATION REGARDING THEIR PRODUCTS IN ORDER FOR THEM TO SAVE
+  * TIME. AS A RESULT, MXCHIP Inc. SHALL NOT BE HELD LIABLE FOR ANY
+  * DIRECT, INDIRECT OR CONSEQUENTIAL DAMAGES WITH RESPECT TO ANY CLAIMS ARISING
+  * FROM THE CONTENT OF SUCH FIRMWARE AND/OR THE USE MADE BY CUSTOMERS OF THE
+  * CODING INFORMATION CONTAINED HEREIN IN CONNECTION WITH THEIR PRODUCTS.
+  *
+  * <h2><center>&copy; COPYRIGHT 2014 MXCHIP Inc.</center></h2>
+  ******************************************************************************
+  */
+
+#ifndef __HTTPParserUtils_h__
+#define __HTTPParserUtils_h__
+
+#include "Common.h"
+
+/* HTTPParserExecute() takes the stream in pieces of any size, down to one
+ * byte, and looks at every byte once. The start line, header and trailer
+ * fields are copied into a caller supplied arena and indexed there when
+ * their line ends, so a lookup walks the index instead of the text. Body
+ * bytes are not copied: kHTTPParserEvent_Body points into the input buffer,
+ * chunked bodies are delivered without their framing.
+ *
+ * The parser stops after kHTTPParserEvent_Complete. The next call to
+ * HTTPParserExecute() starts a new message in the same arena, so everything
+ * from the previous message must be used by then.
+ */
+
+#define kHTTPParserMaxFields          24      /**< Header plus trailer fields of one message */
+#define kHTTPParserMaxChunkLine       256     /**< Longest chunk size line, extensions are skipped */
+
+typedef enum {
+  kHTTPParserEvent_Header,      /**< The start line and the header fields are indexed */
+  kHTTPParserEvent_Chunk,       /**< A chunk of parser->chunkSize bytes follows */
+  kHTTPParserEvent_Body,        /**< data and len are body bytes inside the input buffer */
+  kHTTPParserEvent_Trailer,     /**< The trailer fields after the last chunk are indexed */
+  kHTTPParserEvent_Complete,    /**< The message is complete */
+} http_parser_event_t;
+
+typedef struct {
+  uint16_t  offset;     /**< From the start of the arena */
+  uint16_t  len;
+} http_span_t;
+
+typedef struct {
+  http_span_t name;
+  http_span_t value;
+} http_field_t;
+
+typedef struct _http_parser_t http_parser_t;
+
+/* Return an error to stop HTTPParserExecute() with it */
+typedef OSStatus (*http_parser_callback_t)( http_parser_t *parser, http_parser_event_t event,
+                                            const uint8_t *data, size_t len, void *userContext );
+
+struct _http_parser_t {
+  char *                  arena;
+  uint16_t                arenaSize;
+  uint16_t                arenaLen;
+  uint16_t                lineStart;          //! Offset of the line being collected.
+  uint8_t                 state;
+  uint8_t                 lineState;          //! Progress through a chunk size line or a chunk's CRLF.
+
+  bool                    isResponse;
+  http_span_t             method;             //! Requests only.
+  http_span_t             url;                //! Requests only.
+  http_span_t             protocol;           //! e.g. "HTTP/1.1".
+  int                     statusCode;         //! Responses only, -1 for requests.
+  http_span_t             reasonPhrase;       //! Responses only.
+
+  http_field_t            fields[ kHTTPParserMaxFields ];
+  uint8_t                 fieldCount;
+  uint8_t                 headerFieldCount;   //! fields[] after this index are trailer fields.
+
+  bool                    persistent;         //! true=Do not close the connection after this message.
+  bool                    chunked;
+  bool                    hasContentLength;
+  bool                    bodyEndedByClose;   //! The body runs until HTTPParserFinish().
+  uint64_t                contentLength;
+  uint64_t                bodyLength;         //! Body bytes delivered so far, without chunk framing.
+  uint64_t                remaining;          //! Left in the body or in the current chunk.
+  uint32_t                chunkSize;
+  uint16_t                chunkLineLen;
+
+  http_parser_callback_t  callback;
+  void *                  userContext;
+};
+
+#define HTTPParserSpanPtr( parser, span )   ( (const char *)( (parser)->arena + (span).offset ) )
+
+/* The arena holds the start line and all fields of one message, at most 65535 bytes */
+OSStatus HTTPParserInit( http_parser_t *parser, char *arena, size_t arenaSize,
+                         http_parser_callback_t callback, void *userContext );
+
+/* Forget the current message */
+void HTTPParserReset( http_parser_t *parser );
+
+/* Parse up to inLen bytes, outUsed tells how many were taken. It is less than
+ * inLen when the message completed before the end of the input, or on error.
+ * kNoSpaceErr: a line or the field count does not fit, kMalformedErr: not HTTP.
+ */
+OSStatus HTTPParserExecute( http_parser_t *parser, const uint8_t *inData, size_t inLen, size_t *outUsed );
+
+/* The peer closed the connection, completes a body that is ended by close.
+ * kUnderrunErr if a message was cut short.
+ */
+OSStatus HTTPParserFinish( http_parser_t *parser );
+
+bool HTTPParserIsComplete( http_parser_t *parser );
+
+/* true if nothing of the next message has been received yet */
+bool HTTPParserIsIdle( http_parser_t *parser );
+
+/* Header or trailer field by case-insensitive name, kNotFoundErr if absent */
+OSStatus HTTPParserGetField( http_parser_t *parser, const char *name, const char **outValue, size_t *outValueLen );
+
+OSStatus HTTPParserMatchMethod( http_parser_t *parser, const char *method );
+
+/* Same rule as HTTPHeaderMatchURL(): the path of the URL ends with url */
+OSStatus HTTPParserMatchURL( http_parser_t *parser, const char *url );
+
+#endif // __HTTPParserUtils_h__
+
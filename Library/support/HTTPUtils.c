@@ -845,8 +845,14 @@ char * getStatusString(int status)
     return "Forbidden";
   else if(status == kStatusAuthenticationErr)
     return "Authentication Error";
+  else if(status == kStatusPayloadTooLarge)
+    return "Payload Too Large";
+  else if(status == kStatusRangeNotSatisfiable)
+    return "Range Not Satisfiable";
   else if(status == kStatusInternalServerErr)
     return "Internal Server Error";
+  else if(status == kStatusServiceUnavailable)
+    return "Service Unavailable";
   else
     return "OK";
 }
@@ -880,6 +886,36 @@ exit:
   return err;
 }
 
+OSStatus CreateHTTPRespondHeader( int status, const char *contentType, size_t inDataLen, bool persistent,
+                                  char *outBuf, size_t outBufSize, size_t *outLen )
+{
+  OSStatus err = kParamErr;
+  int len;
+
+  require( outBuf && outLen, exit );
+  require( contentType || inDataLen == 0, exit );
+
+  if( inDataLen )
+    len = snprintf( outBuf, outBufSize,
+                   "%s %d %s%s%s %s%s%s %d%s%s %s%s",
+                   "HTTP/1.1", status, getStatusString(status), kCRLFNewLine,
+                   "Content-Type:", contentType, kCRLFNewLine,
+                   "Content-Length:", (int)inDataLen, kCRLFNewLine,
+                   "Connection:", persistent ? "keep-alive" : "close", kCRLFLineEnding );
+  else
+    len = snprintf( outBuf, outBufSize,
+                   "%s %d %s%s%s %d%s%s %s%s",
+                   "HTTP/1.1", status, getStatusString(status), kCRLFNewLine,
+                   "Content-Length:", 0, kCRLFNewLine,
+                   "Connection:", persistent ? "keep-alive" : "close", kCRLFLineEnding );
+
+  require_action( len > 0 && (size_t)len < outBufSize, exit, err = kNoSpaceErr );
+  *outLen = (size_t)len;
+  err = kNoErr;
+
+exit:
+  return err;
+}
 
 OSStatus CreateHTTPMessage( const char *methold, const char *url, const char *contentType, uint8_t *inData, size_t inDataLen, uint8_t **outMessage, size_t *outMessageSize )
 {
@@ -67,7 +67,10 @@
 #define kStatusMethodNotAllowed     405
 #define kStatusForbidden            403  
 #define kStatusAuthenticationErr    470  
+#define kStatusPayloadTooLarge      413
+#define kStatusRangeNotSatisfiable  416
 #define kStatusInternalServerErr    500      
+#define kStatusServiceUnavailable   503
 
 #define kMIMEType_Binary                "application/octet-stream"
 #define kMIMEType_DMAP                  "application/x-dmap-tagged"
@@ -174,6 +177,13 @@ OSStatus CreateSimpleHTTPMessageNoCopy( const char *contentType, size_t inDataLe
 
 OSStatus CreateHTTPRespondMessageNoCopy( int status, const char *contentType, size_t inDataLen, uint8_t **outMessage, size_t *outMessageSize );
 
+/* Write a response header to outBuf, Content-Length and Connection are always present
+ * so the client can keep the connection for its next request. contentType can be NULL
+ * when inDataLen is 0.
+ */
+OSStatus CreateHTTPRespondHeader( int status, const char *contentType, size_t inDataLen, bool persistent,
+                                  char *outBuf, size_t outBufSize, size_t *outLen );
+
 
 OSStatus CreateHTTPMessage( const char *methold, const char *url, const char *contentType, uint8_t *inData, size_t inDataLen, uint8_t **outMessage, size_t *outMessageSize );
 
@@ -0,0 +1,694 @@
+/**
+  ******************************************************************************
+  * @file    KVStoreUtils.c
+  * @author  William Xu
+  * @version V1.0.0
+  * @date    17-Oct-2026
+  * @brief   This file contains a log structured key-value store: records with
+  *          a CRC-32 are appended to flash sectors that are erased in turn
+  ******************************************************************************
+  * @attention
+  *
+  * THE PRESENT FIRMWARE WHICH IS FOR GUIDANCE ONLY AIMS AT PROVIDING CUSTOMERS
+  * WITH CODING INFORMATION REGARDING THEIR PRODUCTS IN ORDER FOR THEM TO SAVE
+  * TIME. AS A RESULT, MXCHIP Inc. SHALL NOT BE HELD LIABLE FOR ANY
+  * DIRECT, INDIRECT OR CONSEQUENTIAL DAMAGES WITH RESPECT TO ANY CLAIMS ARISING
+  * FROM THE CONTENT OF SUCH FIRMWARE AND/OR THE USE MADE BY CUSTOMERS OF THE
+  * CODING INFORMATION CONTAINED HEREIN IN CONNECTION WITH THEIR PRODUCTS.
+  *
+  * <h2><center>&copy; COPYRIGHT 2014 MXCHIP Inc.</center></h2>
+  ******************************************************************************
+  */
+
+#include "KVStoreUtils.h"
+#include "LZUtils.h"
+#include "Debug.h"
+#include <stddef.h>
+
+#define kv_log(M, ...) custom_log("KVStore", M, ##__VA_ARGS__)
+#define kv_log_trace() custom_log_trace("KVStore")
+
+#define kKVKeyBlank                   0xFFFF
+#define kKVKeyCommit                  0xFFFE      /**< Ends the records of KVStoreSetMultiple() */
+#define kKVFlagBatch                  0x8000      /**< In len: counts only when a commit record follows */
+#define kKVLengthMask                 0x7FFF
+#define kKVUnknownEraseCount          0xFFFFFFFF
+#define kKVPiece                      32          /**< Bytes read from flash at once to check and copy values */
+
+/* The sequence is programmed when the sector becomes the head, after the
+ * erase count that is written right after the erase.
+ */
+typedef struct {
+  uint32_t  magic;
+  uint32_t  eraseCount;
+  uint32_t  headerCrc;          //! Of magic and eraseCount.
+  uint32_t  sequence;
+  uint32_t  sequenceCheck;      //! ~sequence.
+} kv_sector_header_t;
+
+typedef struct {
+  uint16_t  key;
+  uint16_t  len;
+  uint32_t  crc;                //! Of key, len and the value.
+} kv_record_header_t;
+
+static uint32_t _record_size( uint32_t len )
+{
+  return kKVStoreRecordHeaderSize + ( ( len + 3 ) & ~3UL );
+}
+
+static uint32_t _sector_address( kv_store_t *store, int sector )
+{
+  return store->startAddress + sector * store->sectorSize;
+}
+
+static OSStatus _read( kv_store_t *store, uint32_t address, void *buf, uint32_t len )
+{
+  volatile uint32_t flashAddress = address;
+  return MicoFlashRead( store->flash, &flashAddress, (uint8_t *)buf, len );
+}
+
+static OSStatus _write( kv_store_t *store, uint32_t address, const void *buf, uint32_t len )
+{
+  volatile uint32_t flashAddress = address;
+  store->stats.bytesWritten += len;
+  return MicoFlashWrite( store->flash, &flashAddress, (uint8_t *)buf, len );
+}
+
+static bool _is_blank( const void *buf, uint32_t len )
+{
+  const uint8_t *p = buf;
+  while( len-- )
+    if( *p++ != 0xFF ) return false;
+  return true;
+}
+
+/* CRC-32 of the value at address, continued from crc */
+static OSStatus _flash_crc( kv_store_t *store, uint32_t address, uint32_t len, uint32_t *crc )
+{
+  OSStatus err = kNoErr;
+  uint8_t piece[ kKVPiece ];
+  uint32_t n;
+
+  while( len ){
+    n = ( len > kKVPiece )? kKVPiece : len;
+    err = _read( store, address, piece, n );
+    require_noerr( err, exit );
+    *crc = LZCrc32Update( *crc, piece, n );
+    address += n;
+    len -= n;
+  }
+
+exit:
+  return err;
+}
+
+static kv_index_entry_t *_index_find( kv_store_t *store, uint16_t key )
+{
+  uint16_t i;
+
+  for( i = 0; i < store->indexCount; i++ )
+    if( store->index[i].key == key ) return &store->index[i];
+  return NULL;
+}
+
+/* A record became current for its key, len 0 deletes the key */
+static OSStatus _index_apply( kv_store_t *store, uint16_t key, uint16_t len, uint32_t address )
+{
+  kv_index_entry_t *entry = _index_find( store, key );
+
+  if( len == 0 ){
+    if( entry ) *entry = store->index[ --store->indexCount ];
+    return kNoErr;
+  }
+  if( !entry ){
+    if( store->indexCount == store->indexSize ) return kNoSpaceErr;
+    entry = &store->index[ store->indexCount++ ];
+    entry->key = key;
+  }
+  entry->len = len;
+  entry->address = address;
+  return kNoErr;
+}
+
+/* The records of one commit, from the first one to the commit record */
+static OSStatus _index_apply_batch( kv_store_t *store, uint32_t address, uint32_t commitAddress )
+{
+  OSStatus err = kNoErr;
+  kv_record_header_t record;
+
+  while( address < commitAddress ){
+    err = _read( store, address, &record, sizeof( record ) );
+    require_noerr( err, exit );
+    err = _index_apply( store, record.key, record.len & kKVLengthMask, address );
+    require_noerr( err, exit );
+    address += _record_size( record.len & kKVLengthMask );
+  }
+
+exit:
+  return err;
+}
+
+/* Index the records of a sector. outEnd is the offset after the last good
+ * record, outTorn tells that something that is not a committed record follows.
+ */
+static OSStatus _scan_sector( kv_store_t *store, int sector, uint32_t *outEnd, bool *outTorn )
+{
+  OSStatus err = kNoErr;
+  uint32_t base = _sector_address( store, sector );
+  uint32_t offset = kKVStoreSectorHeaderSize, batchStart = 0, len, crc;
+  kv_record_header_t record;
+
+  *outTorn = false;
+  while( offset + kKVStoreRecordHeaderSize <= store->sectorSize ){
+    err = _read( store, base + offset, &record, sizeof( record ) );
+    require_noerr( err, exit );
+    if( _is_blank( &record, sizeof( record ) ) ) break;
+
+    len = record.len & kKVLengthMask;
+    if( record.key == kKVKeyBlank || len > kKVStoreMaxValueSize || offset + _record_size( len ) > store->sectorSize ){
+      *outTorn = true;
+      break;
+    }
+    crc = LZCrc32Update( 0xFFFFFFFF, (const uint8_t *)&record, 4 );
+    err = _flash_crc( store, base + offset + kKVStoreRecordHeaderSize, len, &crc );
+    require_noerr( err, exit );
+    if( ( crc ^ 0xFFFFFFFF ) != record.crc ){
+      *outTorn = true;
+      break;
+    }
+
+    if( record.len & kKVFlagBatch ){
+      if( batchStart == 0 ) batchStart = offset;
+    }else if( record.key == kKVKeyCommit ){
+      if( batchStart ){
+        err = _index_apply_batch( store, base + batchStart, base + offset );
+        require_noerr( err, exit );
+      }
+      batchStart = 0;
+    }else{
+      batchStart = 0;
+      err = _index_apply( store, record.key, len, base + offset );
+      require_noerr( err, exit );
+    }
+    offset += _record_size( len );
+  }
+  if( batchStart ) *outTorn = true;
+  *outEnd = offset;
+
+exit:
+  return err;
+}
+
+static OSStatus _check_blank( kv_store_t *store, uint32_t address, uint32_t len, bool *outBlank )
+{
+  OSStatus err = kNoErr;
+  uint8_t piece[ kKVPiece ];
+  uint32_t n;
+
+  *outBlank = true;
+  while( len && *outBlank ){
+    n = ( len > kKVPiece )? kKVPiece : len;
+    err = _read( store, address, piece, n );
+    require_noerr( err, exit );
+    *outBlank = _is_blank( piece, n );
+    address += n;
+    len -= n;
+  }
+
+exit:
+  return err;
+}
+
+static int _oldest_sector( kv_store_t *store )
+{
+  int i, oldest = -1;
+
+  for( i = 0; i < store->sectorCount; i++ )
+    if( store->sectors[i].state == eKVSector_Active &&
+        ( oldest < 0 || store->sectors[i].sequence < store->sectors[oldest].sequence ) )
+      oldest = i;
+  return oldest;
+}
+
+static int _count_sectors( kv_store_t *store, uint8_t state )
+{
+  int i, count = 0;
+
+  for( i = 0; i < store->sectorCount; i++ )
+    if( store->sectors[i].state == state ) count++;
+  return count;
+}
+
+static void _read_sector_header( kv_store_t *store, int sector )
+{
+  kv_store_sector_t *info = &store->sectors[sector];
+  kv_sector_header_t header;
+
+  info->state = eKVSector_Dirty;
+  info->sequence = 0;
+  info->eraseCount = kKVUnknownEraseCount;
+  if( _read( store, _sector_address( store, sector ), &header, sizeof( header ) ) != kNoErr )
+    return;
+  if( header.magic != kKVStoreMagic ||
+      header.headerCrc != ( LZCrc32Update( 0xFFFFFFFF, (const uint8_t *)&header, 8 ) ^ 0xFFFFFFFF ) )
+    return;
+
+  info->eraseCount = header.eraseCount;
+  if( header.sequence == 0xFFFFFFFF && header.sequenceCheck == 0xFFFFFFFF )
+    info->state = eKVSector_Free;
+  else if( header.sequenceCheck == ~header.sequence ){
+    info->state = eKVSector_Active;
+    info->sequence = header.sequence;
+  }
+}
+
+/* Build the index from the active sectors, oldest first */
+static OSStatus _mount( kv_store_t *store )
+{
+  OSStatus err = kNoErr;
+  int i, sector, newest = -1;
+  uint32_t end = 0, last = 0;
+  bool torn = false, blank;
+
+  store->indexCount = 0;
+  store->head = -1;
+  store->headOffset = store->sectorSize;
+  for( i = 0; i < store->sectorCount; i++ )
+    _read_sector_header( store, i );
+
+  for( ; ; ){
+    sector = -1;
+    for( i = 0; i < store->sectorCount; i++ )
+      if( store->sectors[i].state == eKVSector_Active && ( newest < 0 || store->sectors[i].sequence > last ) &&
+          ( sector < 0 || store->sectors[i].sequence < store->sectors[sector].sequence ) )
+        sector = i;
+    if( sector < 0 ) break;
+    err = _scan_sector( store, sector, &end, &torn );
+    require_noerr( err, exit );
+    newest = sector;
+    last = store->sectors[sector].sequence;
+  }
+
+  if( newest >= 0 ){
+    store->head = newest;
+    /* A reset during a write can leave bits programmed after the last good record */
+    if( !torn ){
+      err = _check_blank( store, _sector_address( store, newest ) + end, store->sectorSize - end, &blank );
+      require_noerr( err, exit );
+      if( blank ) store->headOffset = end;
+    }
+  }
+
+exit:
+  return err;
+}
+
+static OSStatus _erase_sector( kv_store_t *store, int sector )
+{
+  OSStatus err = kNoErr;
+  kv_store_sector_t *info = &store->sectors[sector];
+  uint32_t address = _sector_address( store, sector );
+  kv_sector_header_t header;
+  int i;
+
+  if( info->eraseCount == kKVUnknownEraseCount ){
+    /* The count was lost with the header, continue from the most worn sector */
+    info->eraseCount = 0;
+    for( i = 0; i < store->sectorCount; i++ )
+      if( store->sectors[i].eraseCount != kKVUnknownEraseCount && store->sectors[i].eraseCount > info->eraseCount )
+        info->eraseCount = store->sectors[i].eraseCount;
+  }
+
+  info->state = eKVSector_Dirty;
+  if( store->head == sector ){
+    store->head = -1;
+    store->headOffset = store->sectorSize;
+  }
+  err = MicoFlashErase( store->flash, address, address + store->sectorSize - 1 );
+  require_noerr( err, exit );
+  store->stats.erases++;
+  info->eraseCount++;
+
+  header.magic = kKVStoreMagic;
+  header.eraseCount = info->eraseCount;
+  header.headerCrc = LZCrc32Update( 0xFFFFFFFF, (const uint8_t *)&header, 8 ) ^ 0xFFFFFFFF;
+  err = _write( store, address, &header, 12 );
+  require_noerr( err, exit );
+  info->state = eKVSector_Free;
+
+exit:
+  return err;
+}
+
+/* Make a free or dirty sector the head */
+static OSStatus _start_head( kv_store_t *store, int sector )
+{
+  OSStatus err = kNoErr;
+  uint32_t sequence[2];
+  int i;
+
+  if( store->sectors[sector].state != eKVSector_Free ){
+    err = _erase_sector( store, sector );
+    require_noerr( err, exit );
+  }
+
+  sequence[0] = 1;
+  for( i = 0; i < store->sectorCount; i++ )
+    if( store->sectors[i].state == eKVSector_Active && store->sectors[i].sequence >= sequence[0] )
+      sequence[0] = store->sectors[i].sequence + 1;
+  sequence[1] = ~sequence[0];
+  err = _write( store, _sector_address( store, sector ) + offsetof( kv_sector_header_t, sequence ), sequence, sizeof( sequence ) );
+  require_noerr( err, exit );
+
+  store->sectors[sector].state = eKVSector_Active;
+  store->sectors[sector].sequence = sequence[0];
+  store->head = sector;
+  store->headOffset = kKVStoreSectorHeaderSize;
+
+exit:
+  return err;
+}
+
+/* Write a record at the head, the value is in RAM or, if value is NULL, in
+ * flash at from.
+ */
+static OSStatus _append( kv_store_t *store, uint16_t key, uint16_t lenField, const void *value, uint32_t from )
+{
+  OSStatus err = kNoErr;
+  uint32_t address = _sector_address( store, store->head ) + store->headOffset;
+  uint32_t len = lenField & kKVLengthMask, n, done;
+  uint8_t piece[ kKVPiece ];
+  kv_record_header_t record;
+
+  require_action( store->headOffset + _record_size( len ) <= store->sectorSize, exit, err = kNoSpaceErr );
+
+  record.key = key;
+  record.len = lenField;
+  record.crc = LZCrc32Update( 0xFFFFFFFF, (const uint8_t *)&record, 4 );
+  if( value )
+    record.crc = LZCrc32Update( record.crc, value, len );
+  else{
+    err = _flash_crc( store, from, len, &record.crc );
+    require_noerr( err, exit );
+  }
+  record.crc ^= 0xFFFFFFFF;
+
+  store->headOffset += _record_size( len );
+  store->stats.recordsWritten++;
+  err = _write( store, address, &record, sizeof( record ) );
+  require_noerr( err, exit );
+  if( value ){
+    if( len ) err = _write( store, address + kKVStoreRecordHeaderSize, value, len );
+  }else{
+    for( done = 0; done < len && err == kNoErr; done += n ){
+      n = ( len - done > kKVPiece )? kKVPiece : len - done;
+      err = _read( store, from + done, piece, n );
+      if( err == kNoErr ) err = _write( store, address + kKVStoreRecordHeaderSize + done, piece, n );
+    }
+  }
+
+exit:
+  /* A scan stops at a bad record, nothing may follow it */
+  if( err != kNoErr ) store->headOffset = store->sectorSize;
+  return err;
+}
+
+/* Copy the current records of the oldest sector to the head, then erase it */
+static OSStatus _collect( kv_store_t *store, int oldest )
+{
+  OSStatus err = kNoErr;
+  uint32_t base = _sector_address( store, oldest );
+  uint32_t offset = kKVStoreSectorHeaderSize, len, address;
+  kv_record_header_t record;
+  kv_index_entry_t *entry;
+
+  while( offset + kKVStoreRecordHeaderSize <= store->sectorSize ){
+    err = _read( store, base + offset, &record, sizeof( record ) );
+    require_noerr( err, exit );
+    len = record.len & kKVLengthMask;
+    if( record.key == kKVKeyBlank || len > kKVStoreMaxValueSize ) break;
+
+    /* Records that are not in the index are replaced, deleted or uncommitted */
+    entry = _index_find( store, record.key );
+    if( entry && entry->address == base + offset ){
+      address = _sector_address( store, store->head ) + store->headOffset;
+      err = _append( store, record.key, len, NULL, base + offset + kKVStoreRecordHeaderSize );
+      require_noerr( err, exit );
+      entry->address = address;
+    }
+    offset += _record_size( len );
+  }
+
+  err = _erase_sector( store, oldest );
+  require_noerr( err, exit );
+  store->stats.collections++;
+
+exit:
+  return err;
+}
+
+/* The head is full: start the least worn erased sector, collecting the
+ * oldest one into it if it is the last.
+ */
+static OSStatus _next_head( kv_store_t *store )
+{
+  OSStatus err = kNoErr;
+  int i, sector = -1, oldest = _oldest_sector( store );
+  int spare = store->sectorCount - _count_sectors( store, eKVSector_Active );
+  uint32_t wear, best = 0;
+
+  require_action( spare > 0, exit, err = kNoSpaceErr );
+  for( i = 0; i < store->sectorCount; i++ ){
+    if( store->sectors[i].state == eKVSector_Active ) continue;
+    wear = store->sectors[i].eraseCount;
+    if( sector < 0 || wear < best ){
+      sector = i;
+      best = wear;
+    }
+  }
+
+  err = _start_head( store, sector );
+  require_noerr( err, exit );
+  if( spare == 1 && oldest >= 0 ){
+    err = _collect( store, oldest );
+    require_noerr( err, exit );
+  }
+
+exit:
+  return err;
+}
+
+/* Room for len bytes of records at the head */
+static OSStatus _reserve( kv_store_t *store, uint32_t len )
+{
+  OSStatus err = kNoErr;
+  int tries;
+
+  for( tries = 0; tries <= store->sectorCount; tries++ ){
+    if( store->head >= 0 && store->headOffset + len <= store->sectorSize )
+      return kNoErr;
+    err = _next_head( store );
+    require_noerr( err, exit );
+  }
+  err = kNoSpaceErr;
+
+exit:
+  return err;
+}
+
+/* A reset after the last sector was started and before the oldest one was
+ * erased leaves no sector spare. If records of the oldest one are still
+ * current, the copy did not finish and the head only holds copies.
+ */
+static OSStatus _recover( kv_store_t *store )
+{
+  OSStatus err = kNoErr;
+  int oldest = _oldest_sector( store );
+  uint32_t base = _sector_address( store, oldest );
+  uint16_t i;
+
+  if( _count_sectors( store, eKVSector_Active ) < store->sectorCount )
+    return kNoErr;
+
+  for( i = 0; i < store->indexCount; i++ )
+    if( store->index[i].address >= base && store->index[i].address < base + store->sectorSize ) break;
+
+  if( i == store->indexCount ){
+    err = _erase_sector( store, oldest );
+  }else{
+    kv_log( "Interrupted copy of sector %d, discarded", oldest );
+    err = _erase_sector( store, store->head );
+    require_noerr( err, exit );
+    err = _mount( store );
+  }
+
+exit:
+  return err;
+}
+
+OSStatus KVStoreOpen( kv_store_t *store, mico_flash_t flash, uint32_t startAddress, uint32_t sectorSize,
+                      uint8_t sectorCount, kv_index_entry_t *index, uint16_t indexSize )
+{
+  OSStatus err = kNoErr;
+
+  require_action( store && index && indexSize, exit, err = kParamErr );
+  require_action( sectorCount >= 2 && sectorCount <= kKVStoreMaxSectors, exit, err = kParamErr );
+  require_action( sectorSize % 4 == 0 && sectorSize > kKVStoreSectorHeaderSize + kKVStoreRecordHeaderSize, exit, err = kParamErr );
+
+  memset( store, 0, sizeof( kv_store_t ) );
+  store->flash = flash;
+  store->startAddress = startAddress;
+  store->sectorSize = sectorSize;
+  store->sectorCount = sectorCount;
+  store->index = index;
+  store->indexSize = indexSize;
+
+  err = MicoFlashInitialize( flash );
+  require_noerr( err, exit );
+  err = _mount( store );
+  require_noerr( err, exit );
+  err = _recover( store );
+  require_noerr( err, exit );
+  err = MicoFlashFinalize( flash );
+
+exit:
+  return err;
+}
+
+OSStatus KVStoreFormat( kv_store_t *store )
+{
+  OSStatus err = kNoErr;
+  int i;
+
+  err = MicoFlashInitialize( store->flash );
+  require_noerr( err, exit );
+  store->indexCount = 0;
+  for( i = 0; i < store->sectorCount; i++ ){
+    err = _erase_sector( store, i );
+    require_noerr( err, exit );
+  }
+  err = MicoFlashFinalize( store->flash );
+
+exit:
+  return err;
+}
+
+OSStatus KVStoreGet( kv_store_t *store, uint16_t key, void *buf, size_t bufSize, size_t *outLen )
+{
+  OSStatus err = kNoErr;
+  kv_index_entry_t *entry = _index_find( store, key );
+
+  require_action_quiet( entry, exit, err = kNotFoundErr );
+  require_action( entry->len <= bufSize, exit, err = kSizeErr );
+  err = MicoFlashInitialize( store->flash );
+  require_noerr( err, exit );
+  err = _read( store, entry->address + kKVStoreRecordHeaderSize, buf, entry->len );
+  require_noerr( err, exit );
+  if( outLen ) *outLen = entry->len;
+  err = MicoFlashFinalize( store->flash );
+
+exit:
+  return err;
+}
+
+/* The item needs no record: flash holds the same value */
+static OSStatus _item_unchanged( kv_store_t *store, const kv_item_t *item, bool *outUnchanged )
+{
+  OSStatus err = kNoErr;
+  kv_index_entry_t *entry = _index_find( store, item->key );
+  uint8_t piece[ kKVPiece ];
+  uint32_t done, n;
+
+  *outUnchanged = false;
+  if( entry == NULL || item->len == 0 ){
+    *outUnchanged = ( entry == NULL && item->len == 0 );
+    goto exit;
+  }
+  if( entry->len != item->len ) goto exit;
+
+  for( done = 0; done < item->len; done += n ){
+    n = ( item->len - done > kKVPiece )? kKVPiece : item->len - done;
+    err = _read( store, entry->address + kKVStoreRecordHeaderSize + done, piece, n );
+    require_noerr( err, exit );
+    if( memcmp( piece, (const uint8_t *)item->value + done, n ) ) goto exit;
+  }
+  *outUnchanged = true;
+
+exit:
+  return err;
+}
+
+OSStatus KVStoreSetMultiple( kv_store_t *store, const kv_item_t *items, int count )
+{
+  OSStatus err = kNoErr;
+  uint32_t size = 0, first = 0, commit;
+  int i, changed = 0, newKeys = 0, last = 0;
+  bool unchanged;
+
+  for( i = 0; i < count; i++ )
+    require_action( items[i].key <= kKVStoreMaxKey && items[i].len <= kKVStoreMaxValueSize, exit, err = kParamErr );
+
+  err = MicoFlashInitialize( store->flash );
+  require_noerr( err, exit );
+
+  for( i = 0; i < count; i++ ){
+    err = _item_unchanged( store, &items[i], &unchanged );
+    require_noerr( err, exit );
+    if( unchanged ) continue;
+    changed++;
+    last = i;
+    size += _record_size( items[i].len );
+    if( items[i].len && _index_find( store, items[i].key ) == NULL ) newKeys++;
+  }
+  store->stats.itemsUnchanged += count - changed;
+  require_quiet( changed, exit );
+
+  if( changed > 1 ) size += kKVStoreRecordHeaderSize;
+  require_action( size <= store->sectorSize - kKVStoreSectorHeaderSize, exit, err = kNoSpaceErr );
+  require_action( store->indexCount + newKeys <= store->indexSize, exit, err = kNoSpaceErr );
+  err = _reserve( store, size );
+  require_noerr( err, exit );
+
+  /* Collecting moves records but does not change values, the items that
+     differ are the same as above */
+  first = _sector_address( store, store->head ) + store->headOffset;
+  for( i = 0; i < count; i++ ){
+    err = _item_unchanged( store, &items[i], &unchanged );
+    require_noerr( err, exit );
+    if( unchanged ) continue;
+    err = _append( store, items[i].key, items[i].len | ( ( changed > 1 )? kKVFlagBatch : 0 ), items[i].value, 0 );
+    require_noerr( err, exit );
+  }
+
+  if( changed > 1 ){
+    commit = _sector_address( store, store->head ) + store->headOffset;
+    err = _append( store, kKVKeyCommit, 0, "", 0 );
+    require_noerr( err, exit );
+    err = _index_apply_batch( store, first, commit );
+  }else{
+    err = _index_apply( store, items[last].key, items[last].len, first );
+  }
+  require_noerr( err, exit );
+  err = MicoFlashFinalize( store->flash );
+
+exit:
+  return err;
+}
+
+OSStatus KVStoreSet( kv_store_t *store, uint16_t key, const void *value, size_t len )
+{
+  kv_item_t item;
+
+  if( len > kKVStoreMaxValueSize || ( len && value == NULL ) ) return kParamErr;
+  item.key = key;
+  item.len = (uint16_t)len;
+  item.value = value;
+  return KVStoreSetMultiple( store, &item, 1 );
+}
+
+OSStatus KVStoreDelete( kv_store_t *store, uint16_t key )
+{
+  return KVStoreSet( store, key, NULL, 0 );
+}
+
@@ -0,0 +1,126 @@
+/**
+  ******************************************************************************
+  * @file    KVStoreUtils.h
+  * @author  William Xu
+  * @version V1.0.0
+  * @date    17-Oct-2026
+  * @brief   This header contains function prototypes of a log structured
+  *          key-value store on two or more flash sectors
+  ******************************************************************************
+  * @attention
+  *
+  * THE PRESENT FIRMWARE WHICH IS FOR GUIDANCE ONLY AIMS AT PROVIDING CUSTOMERS
+  * WITH CODING INFORMATION REGARDING THEIR PRODUCTS IN ORDER FOR THEM TO SAVE
+  * TIME. AS A RESULT, MXCHIP Inc. SHALL NOT BE HELD LIABLE FOR ANY
+  * DIRECT, INDIRECT OR CONSEQUENTIAL DAMAGES WITH RESPECT TO ANY CLAIMS ARISING
+  * FROM THE CONTENT OF SUCH FIRMWARE AND/OR THE USE MADE BY CUSTOMERS OF THE
+  * CODING INFORMATION CONTAINED HEREIN IN CONNECTION WITH THEIR PRODUCTS.
+  *
+  * <h2><center>&copy; COPYRIGHT 2014 MXCHIP Inc.</center></h2>
+  ******************************************************************************
+  */
+
+#ifndef __KVStoreUtils_h__
+#define __KVStoreUtils_h__
+
+#include "Common.h"
+#include "MicoPlatform.h"
+
+/* A new value is appended to the head sector as a record with its own CRC-32,
+ * nothing is erased to change it. When the head is full the next sector with
+ * the fewest erases becomes the head. One sector is always kept erased: when
+ * it is the last one, the values still current in the oldest sector are
+ * copied to it and the oldest sector is erased. So every sector is erased in
+ * turn, and the header of a sector counts its erases.
+ *
+ * A record counts once its CRC matches. KVStoreSetMultiple() writes several
+ * records and a commit record after them, they count together or not at all.
+ * When a reset tears a record, or leaves records without their commit, the
+ * sector gets no more records and the values from before are still there.
+ * A reset during the copy to the erased sector is undone by KVStoreOpen().
+ *
+ * The index is a RAM table of the current record of every key, one entry
+ * per key, so a lookup reads no flash except the value.
+ */
+
+#define kKVStoreMagic                 0x31564B4D  /**< "MKV1" */
+#define kKVStoreMaxSectors            8
+#define kKVStoreMaxValueSize          1024
+#define kKVStoreSectorHeaderSize      32
+#define kKVStoreRecordHeaderSize      8
+#define kKVStoreMaxKey                0xFFFD
+
+/* kv_store_sector_t.state */
+enum {
+  eKVSector_Dirty,              /**< Not erased, or a reset stopped its erase */
+  eKVSector_Free,               /**< Erased and counted, not used yet */
+  eKVSector_Active,             /**< Holds records, its sequence orders it */
+};
+
+typedef struct {
+  uint16_t  key;
+  uint16_t  len;
+  uint32_t  address;            //! Of the current record.
+} kv_index_entry_t;
+
+typedef struct {
+  uint16_t      key;
+  uint16_t      len;            //! 0 deletes the key.
+  const void *  value;
+} kv_item_t;
+
+typedef struct {
+  uint8_t   state;
+  uint32_t  sequence;           //! Active: the newest sector has the highest.
+  uint32_t  eraseCount;
+} kv_store_sector_t;
+
+typedef struct {
+  uint32_t  erases;
+  uint32_t  collections;        //! Oldest sectors copied and erased.
+  uint32_t  recordsWritten;     //! Including copies and commit records.
+  uint32_t  bytesWritten;
+  uint32_t  itemsUnchanged;     //! Items not written because flash held the same value.
+} kv_store_stats_t;
+
+typedef struct {
+  mico_flash_t            flash;
+  uint32_t                startAddress;
+  uint32_t                sectorSize;
+  uint8_t                 sectorCount;
+  kv_store_sector_t       sectors[ kKVStoreMaxSectors ];
+  int8_t                  head;               //! Sector taking new records, -1: none yet.
+  uint32_t                headOffset;         //! Where the next record goes, sectorSize: full.
+
+  kv_index_entry_t *      index;
+  uint16_t                indexSize;
+  uint16_t                indexCount;
+
+  kv_store_stats_t        stats;
+} kv_store_t;
+
+/* Mount sectorCount sectors of sectorSize bytes from startAddress. Sectors
+ * that hold no store are erased when they are needed. kNoSpaceErr: the
+ * store has more keys than index entries.
+ */
+OSStatus KVStoreOpen( kv_store_t *store, mico_flash_t flash, uint32_t startAddress, uint32_t sectorSize,
+                      uint8_t sectorCount, kv_index_entry_t *index, uint16_t indexSize );
+
+/* Erase every sector, all keys are gone */
+OSStatus KVStoreFormat( kv_store_t *store );
+
+/* kNotFoundErr if the key has no value, kSizeErr if it is longer than bufSize */
+OSStatus KVStoreGet( kv_store_t *store, uint16_t key, void *buf, size_t bufSize, size_t *outLen );
+
+OSStatus KVStoreSet( kv_store_t *store, uint16_t key, const void *value, size_t len );
+
+OSStatus KVStoreDelete( kv_store_t *store, uint16_t key );
+
+/* Write the items that differ from flash, as one commit. The changed records
+ * have to fit into one sector, kNoSpaceErr if they or all current values do
+ * not.
+ */
+OSStatus KVStoreSetMultiple( kv_store_t *store, const kv_item_t *items, int count );
+
+#endif // __KVStoreUtils_h__
+
@@ -0,0 +1,393 @@
+/**
+  ******************************************************************************
+  * @file    LZUtils.c
+  * @author  William Xu
+  * @version V1.0.0
+  * @date    17-Oct-2026
+  * @brief   This file contains a compressed image container: an LZ compressor
+  *          and a streaming decoder with a caller supplied window
+  ******************************************************************************
+  * @attention
+  *
+  * THE PRESENT FIRMWARE WHICH IS FOR GUIDANCE ONLY AIMS AT PROVIDING CUSTOMERS
+  * WITH CODING INFORMATION REGARDING THEIR PRODUCTS IN ORDER FOR THEM TO SAVE
+  * TIME. AS A RESULT, MXCHIP Inc. SHALL NOT BE HELD LIABLE FOR ANY
+  * DIRECT, INDIRECT OR CONSEQUENTIAL DAMAGES WITH RESPECT TO ANY CLAIMS ARISING
+  * FROM THE CONTENT OF SUCH FIRMWARE AND/OR THE USE MADE BY CUSTOMERS OF THE
+  * CODING INFORMATION CONTAINED HEREIN IN CONNECTION WITH THEIR PRODUCTS.
+  *
+  * <h2><center>&copy; COPYRIGHT 2014 MXCHIP Inc.</center></h2>
+  ******************************************************************************
+  */
+
+#include "LZUtils.h"
+#include "Debug.h"
+
+#define lz_log(M, ...) custom_log("LZ", M, ##__VA_ARGS__)
+#define lz_log_trace() custom_log_trace("LZ")
+
+#define kLZHashBits                   14
+#define kLZMaxChain                   64      /**< Candidates tried per position by the compressor */
+
+enum {
+  eLZState_Token,
+  eLZState_LiteralLength,
+  eLZState_Literals,
+  eLZState_OffsetLow,
+  eLZState_OffsetHigh,
+  eLZState_MatchLength,
+  eLZState_Match,
+  eLZState_Done,
+};
+
+/* Four bits at a time to keep the table small */
+uint32_t LZCrc32Update( uint32_t crc, const uint8_t *data, size_t len )
+{
+  static const uint32_t table[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C };
+
+  while( len-- ){
+    crc ^= *data++;
+    crc = ( crc >> 4 ) ^ table[ crc & 0x0F ];
+    crc = ( crc >> 4 ) ^ table[ crc & 0x0F ];
+  }
+  return crc;
+}
+
+static uint32_t _get_le32( const uint8_t *p )
+{
+  return (uint32_t)p[0] | ( (uint32_t)p[1] << 8 ) | ( (uint32_t)p[2] << 16 ) | ( (uint32_t)p[3] << 24 );
+}
+
+static void _put_le32( uint8_t *p, uint32_t value )
+{
+  p[0] = (uint8_t)value;
+  p[1] = (uint8_t)( value >> 8 );
+  p[2] = (uint8_t)( value >> 16 );
+  p[3] = (uint8_t)( value >> 24 );
+}
+
+OSStatus LZImageGetHeader( const uint8_t *inBuf, size_t inLen, lz_image_header_t *outHeader )
+{
+  OSStatus err = kNoErr;
+
+  require_action( inLen >= kLZImageHeaderSize && _get_le32( inBuf ) == kLZImageMagic, exit, err = kNotFoundErr );
+  outHeader->rawLength = _get_le32( inBuf + 4 );
+  outHeader->rawCrc = _get_le32( inBuf + 8 );
+  outHeader->windowBits = inBuf[12];
+  require_action( outHeader->rawLength > 0, exit, err = kMalformedErr );
+  require_action( outHeader->windowBits >= kLZMinWindowBits && outHeader->windowBits <= kLZMaxWindowBits, exit, err = kMalformedErr );
+
+exit:
+  return err;
+}
+
+/* ------------------------------------------------------------------------- */
+/* Compressor                                                                */
+/* ------------------------------------------------------------------------- */
+
+size_t LZImageMaxSize( size_t inLen )
+{
+  return kLZImageHeaderSize + 1 + inLen + inLen / 255 + 1;
+}
+
+static uint32_t _hash( const uint8_t *p )
+{
+  return ( _get_le32( p ) * 2654435761U ) >> ( 32 - kLZHashBits );
+}
+
+/* Longest match for position pos, 0 if none reaches kLZMinMatch */
+static size_t _find_match( const uint8_t *in, size_t inLen, size_t pos, const int32_t *head, const int32_t *prev,
+                           uint32_t windowSize, uint32_t *outOffset )
+{
+  int32_t candidate = head[ _hash( in + pos ) ];
+  size_t best = 0, len, limit = inLen - pos;
+  int chain = kLZMaxChain;
+
+  while( candidate >= 0 && pos - (size_t)candidate <= windowSize && chain-- > 0 ){
+    if( in[ candidate + best ] == in[ pos + best ] ){
+      for( len = 0; len < limit && in[ candidate + len ] == in[ pos + len ]; len++ );
+      if( len > best ){
+        best = len;
+        *outOffset = (uint32_t)( pos - candidate );
+        if( len == limit ) break;
+      }
+    }
+    candidate = prev[ candidate & ( windowSize - 1 ) ];
+  }
+  return ( best >= kLZMinMatch )? best : 0;
+}
+
+static void _insert( const uint8_t *in, size_t inLen, size_t pos, int32_t *head, int32_t *prev, uint32_t windowSize )
+{
+  uint32_t h;
+
+  if( pos + kLZMinMatch > inLen ) return;
+  h = _hash( in + pos );
+  prev[ pos & ( windowSize - 1 ) ] = head[ h ];
+  head[ h ] = (int32_t)pos;
+}
+
+static uint8_t *_put_length( uint8_t *out, size_t value )
+{
+  for( value -= 15; value >= 255; value -= 255 )
+    *out++ = 255;
+  *out++ = (uint8_t)value;
+  return out;
+}
+
+/* One sequence: literals, then a match unless matchLength is 0 */
+static uint8_t *_put_sequence( uint8_t *out, const uint8_t *literals, size_t literalCount, uint32_t offset, size_t matchLength )
+{
+  uint8_t *token = out++;
+
+  *token = (uint8_t)( ( literalCount < 15 ? literalCount : 15 ) << 4 );
+  if( literalCount >= 15 )
+    out = _put_length( out, literalCount );
+  memcpy( out, literals, literalCount );
+  out += literalCount;
+  if( matchLength == 0 ) return out;
+
+  *token |= (uint8_t)( matchLength - kLZMinMatch < 15 ? matchLength - kLZMinMatch : 15 );
+  *out++ = (uint8_t)( offset - 1 );
+  *out++ = (uint8_t)( ( offset - 1 ) >> 8 );
+  if( matchLength - kLZMinMatch >= 15 )
+    out = _put_length( out, matchLength - kLZMinMatch );
+  return out;
+}
+
+OSStatus LZImageCompress( const uint8_t *inData, size_t inLen, uint8_t windowBits,
+                          uint8_t *outBuf, size_t outSize, size_t *outLen )
+{
+  OSStatus err = kNoErr;
+  uint32_t windowSize = 1UL << windowBits;
+  int32_t *head = NULL, *prev = NULL;
+  size_t pos = 0, anchor = 0, len, nextLen;
+  uint32_t offset = 0, nextOffset;
+  uint8_t *out;
+  size_t i;
+
+  require_action( inLen > 0 && inLen <= 0xFFFFFFFF, exit, err = kParamErr );
+  require_action( windowBits >= kLZMinWindowBits && windowBits <= kLZMaxWindowBits, exit, err = kParamErr );
+  require_action( outSize >= LZImageMaxSize( inLen ), exit, err = kNoSpaceErr );
+
+  head = malloc( sizeof(int32_t) << kLZHashBits );
+  prev = malloc( sizeof(int32_t) * windowSize );
+  require_action( head && prev, exit, err = kNoMemoryErr );
+  for( i = 0; i < ( 1UL << kLZHashBits ); i++ ) head[i] = -1;
+
+  out = outBuf + kLZImageHeaderSize;
+  while( pos + kLZMinMatch <= inLen ){
+    len = _find_match( inData, inLen, pos, head, prev, windowSize, &offset );
+    _insert( inData, inLen, pos, head, prev, windowSize );
+    if( len == 0 ){
+      pos++;
+      continue;
+    }
+    // One step lazy: a longer match at the next byte costs only a literal
+    if( pos + 1 + kLZMinMatch <= inLen ){
+      nextLen = _find_match( inData, inLen, pos + 1, head, prev, windowSize, &nextOffset );
+      if( nextLen > len + 1 ){
+        pos++;
+        continue;
+      }
+    }
+    out = _put_sequence( out, inData + anchor, pos - anchor, offset, len );
+    for( i = 1; i < len; i++ )
+      _insert( inData, inLen, pos + i, head, prev, windowSize );
+    pos += len;
+    anchor = pos;
+  }
+  out = _put_sequence( out, inData + anchor, inLen - anchor, 0, 0 );
+
+  _put_le32( outBuf, kLZImageMagic );
+  _put_le32( outBuf + 4, (uint32_t)inLen );
+  _put_le32( outBuf + 8, LZCrc32Update( 0xFFFFFFFF, inData, inLen ) ^ 0xFFFFFFFF );
+  memset( outBuf + 12, 0, 4 );
+  outBuf[12] = windowBits;
+  *outLen = out - outBuf;
+
+exit:
+  if( head ) free( head );
+  if( prev ) free( prev );
+  return err;
+}
+
+/* ------------------------------------------------------------------------- */
+/* Decoder                                                                   */
+/* ------------------------------------------------------------------------- */
+
+OSStatus LZDecoderInit( lz_decoder_t *decoder, const lz_image_header_t *header, uint8_t *window, size_t windowSize,
+                        lz_output_t output, void *context )
+{
+  OSStatus err = kNoErr;
+
+  require_action( window && output && windowSize > 0 && ( windowSize & ( windowSize - 1 ) ) == 0, exit, err = kParamErr );
+  require_action( windowSize >= ( 1UL << header->windowBits ), exit, err = kUnsupportedErr );
+
+  memset( decoder, 0, sizeof(lz_decoder_t) );
+  decoder->window = window;
+  decoder->windowMask = windowSize - 1;
+  decoder->rawLength = header->rawLength;
+  decoder->rawCrc = header->rawCrc;
+  decoder->crc = 0xFFFFFFFF;
+  decoder->state = eLZState_Token;
+  decoder->output = output;
+  decoder->context = context;
+
+exit:
+  return err;
+}
+
+/* Hand the decoded bytes that are not handed out yet to output. They are
+ * contiguous in the window, it is flushed every time it wraps.
+ */
+static OSStatus _flush( lz_decoder_t *decoder )
+{
+  OSStatus err = kNoErr;
+  const uint8_t *data = decoder->window + ( decoder->flushed & decoder->windowMask );
+  size_t len = decoder->produced - decoder->flushed;
+
+  if( len == 0 ) goto exit;
+  decoder->crc = LZCrc32Update( decoder->crc, data, len );
+  decoder->flushed = decoder->produced;
+  if( decoder->flushed == decoder->rawLength )
+    require_action( ( decoder->crc ^ 0xFFFFFFFF ) == decoder->rawCrc, exit, err = kChecksumErr );
+  err = decoder->output( data, len, decoder->context );
+  require_noerr( err, exit );
+
+exit:
+  return err;
+}
+
+/* Count n decoded bytes, flush when the window is full or the image is complete */
+static OSStatus _produced( lz_decoder_t *decoder, size_t n )
+{
+  decoder->produced += n;
+  if( ( decoder->produced & decoder->windowMask ) == 0 || decoder->produced == decoder->rawLength )
+    return _flush( decoder );
+  return kNoErr;
+}
+
+static OSStatus _copy_match( lz_decoder_t *decoder )
+{
+  OSStatus err = kNoErr;
+  uint32_t windowSize = decoder->windowMask + 1;
+  uint32_t dst, src, n, i;
+  uint8_t *window = decoder->window;
+
+  while( decoder->matchLength > 0 ){
+    dst = decoder->produced & decoder->windowMask;
+    src = ( decoder->produced - decoder->offset ) & decoder->windowMask;
+    n = decoder->matchLength;
+    if( n > windowSize - dst ) n = windowSize - dst;
+    if( n > windowSize - src ) n = windowSize - src;
+    if( decoder->offset >= n )
+      memmove( window + dst, window + src, n );  // Can overlap the oldest bytes of the ring, which are read first
+    else
+      for( i = 0; i < n; i++ ) window[ dst + i ] = window[ src + i ];  // Overlaps, repeats the last offset bytes
+    decoder->matchLength -= n;
+    err = _produced( decoder, n );
+    require_noerr( err, exit );
+  }
+
+exit:
+  return err;
+}
+
+/* The literals of a sequence are complete: the image ends here, or a match follows */
+static uint8_t _after_literals( lz_decoder_t *decoder )
+{
+  return ( decoder->produced == decoder->rawLength )? eLZState_Done : eLZState_OffsetLow;
+}
+
+OSStatus LZDecoderExecute( lz_decoder_t *decoder, const uint8_t *inData, size_t inLen )
+{
+  OSStatus err = kNoErr;
+  const uint8_t *end = inData + inLen;
+  uint32_t n, dst;
+  uint8_t c;
+
+  while( inData < end ){
+    switch( decoder->state ){
+      case eLZState_Token:
+        c = *inData++;
+        decoder->literals = c >> 4;
+        decoder->matchLength = ( c & 0x0F ) + kLZMinMatch;
+        if( decoder->literals == 15 )
+          decoder->state = eLZState_LiteralLength;
+        else if( decoder->literals > 0 )
+          decoder->state = eLZState_Literals;
+        else
+          decoder->state = _after_literals( decoder );
+        break;
+
+      case eLZState_LiteralLength:
+        c = *inData++;
+        decoder->literals += c;
+        require_action( decoder->literals <= decoder->rawLength - decoder->produced, exit, err = kMalformedErr );
+        if( c < 255 )
+          decoder->state = eLZState_Literals;
+        break;
+
+      case eLZState_Literals:
+        require_action( decoder->literals <= decoder->rawLength - decoder->produced, exit, err = kMalformedErr );
+        dst = decoder->produced & decoder->windowMask;
+        n = decoder->literals;
+        if( n > (uint32_t)( end - inData ) ) n = end - inData;
+        if( n > decoder->windowMask + 1 - dst ) n = decoder->windowMask + 1 - dst;
+        memcpy( decoder->window + dst, inData, n );
+        inData += n;
+        decoder->literals -= n;
+        err = _produced( decoder, n );
+        require_noerr( err, exit );
+        if( decoder->literals == 0 )
+          decoder->state = _after_literals( decoder );
+        break;
+
+      case eLZState_OffsetLow:
+        decoder->offset = *inData++;
+        decoder->state = eLZState_OffsetHigh;
+        break;
+
+      case eLZState_OffsetHigh:
+        decoder->offset = ( decoder->offset | ( (uint32_t)*inData++ << 8 ) ) + 1;
+        require_action( decoder->offset <= decoder->produced && decoder->offset <= decoder->windowMask + 1, exit, err = kMalformedErr );
+        decoder->state = ( decoder->matchLength == 15 + kLZMinMatch )? eLZState_MatchLength : eLZState_Match;
+        break;
+
+      case eLZState_MatchLength:
+        c = *inData++;
+        decoder->matchLength += c;
+        require_action( decoder->matchLength <= decoder->rawLength - decoder->produced, exit, err = kMalformedErr );
+        if( c < 255 )
+          decoder->state = eLZState_Match;
+        break;
+
+      case eLZState_Match:
+        break;
+
+      case eLZState_Done:
+      default:
+        err = kMalformedErr;
+        goto exit;
+    }
+
+    if( decoder->state == eLZState_Match ){
+      require_action( decoder->matchLength <= decoder->rawLength - decoder->produced, exit, err = kMalformedErr );
+      err = _copy_match( decoder );
+      require_noerr( err, exit );
+      decoder->state = eLZState_Token;
+    }
+  }
+
+exit:
+  return err;
+}
+
+bool LZDecoderIsComplete( lz_decoder_t *decoder )
+{
+  return decoder->state == eLZState_Done;
+}
+
@@ -0,0 +1,109 @@
+/**
+  ******************************************************************************
+  * @file    LZUtils.h
+  * @author  William Xu
+  * @version V1.0.0
+  * @date    17-Oct-2026
+  * @brief   This header contains function prototypes of a compressed image
+  *          container and its streaming LZ decoder
+  ******************************************************************************
+  * @attention
+  *
+  * THE PRESENT FIRMWARE WHICH IS FOR GUIDANCE ONLY AIMS AT PROVIDING CUSTOMERS
+  * WITH CODING INFORMATION REGARDING THEIR PRODUCTS IN ORDER FOR THEM TO SAVE
+  * TIME. AS A RESULT, MXCHIP Inc. SHALL NOT BE HELD LIABLE FOR ANY
+  * DIRECT, INDIRECT OR CONSEQUENTIAL DAMAGES WITH RESPECT TO ANY CLAIMS ARISING
+  * FROM THE CONTENT OF SUCH FIRMWARE AND/OR THE USE MADE BY CUSTOMERS OF THE
+  * CODING INFORMATION CONTAINED HEREIN IN CONNECTION WITH THEIR PRODUCTS.
+  *
+  * <h2><center>&copy; COPYRIGHT 2014 MXCHIP Inc.</center></h2>
+  ******************************************************************************
+  */
+
+#ifndef __LZUtils_h__
+#define __LZUtils_h__
+
+#include "Common.h"
+
+/* A compressed image is a kLZImageHeaderSize header followed by sequences:
+ *
+ *   token     literal count << 4 | ( match length - kLZMinMatch ), a nibble
+ *             of 15 is continued by bytes that are added up to the first one
+ *             below 255
+ *   literals
+ *   offset    2 bytes little endian, the match starts offset + 1 bytes back
+ *   match length bytes, if its nibble is 15
+ *
+ * The last sequence has no match, the image ends after its literals. A match
+ * only reaches back 1 << windowBits bytes, so the decoder keeps that many
+ * decoded bytes and needs no other memory. Decoded bytes are handed to the
+ * output callback in pieces of up to the window size, the CRC-32 of the
+ * whole decoded image is checked when its last byte is decoded.
+ */
+
+#define kLZImageMagic                 0x315A4C4D  /**< "MLZ1" */
+#define kLZImageHeaderSize            16
+#define kLZMinMatch                   4
+#define kLZMinWindowBits              8
+#define kLZMaxWindowBits              16
+#define kLZDefaultWindowBits          14          /**< 16k, the window of the bootloader */
+
+typedef struct {
+  uint32_t  rawLength;          //! Decoded length.
+  uint32_t  rawCrc;             //! CRC-32 of the decoded image.
+  uint8_t   windowBits;         //! A match reaches back at most 1 << windowBits bytes.
+} lz_image_header_t;
+
+/* Return an error to stop LZDecoderExecute() with it */
+typedef OSStatus (*lz_output_t)( const uint8_t *data, size_t len, void *context );
+
+typedef struct {
+  uint8_t *               window;             //! Decoded bytes, a ring of windowMask + 1 bytes.
+  uint32_t                windowMask;
+  uint32_t                rawLength;
+  uint32_t                rawCrc;
+  uint32_t                crc;                //! Of the bytes handed to output.
+  uint32_t                produced;           //! Bytes decoded.
+  uint32_t                flushed;            //! Bytes handed to output.
+  uint32_t                literals;           //! Left in the current sequence.
+  uint32_t                matchLength;
+  uint32_t                offset;
+  uint8_t                 state;
+  lz_output_t             output;
+  void *                  context;
+} lz_decoder_t;
+
+/* kNotFoundErr if inBuf does not start with a compressed image header */
+OSStatus LZImageGetHeader( const uint8_t *inBuf, size_t inLen, lz_image_header_t *outHeader );
+
+/* Largest container LZImageCompress() can produce for inLen bytes */
+size_t LZImageMaxSize( size_t inLen );
+
+/* Compress inLen bytes into a container, kNoSpaceErr if outSize is too small.
+ * The match finder takes about 4 * ( 1 << windowBits ) + 64k bytes of heap.
+ */
+OSStatus LZImageCompress( const uint8_t *inData, size_t inLen, uint8_t windowBits,
+                          uint8_t *outBuf, size_t outSize, size_t *outLen );
+
+/* windowSize is a power of two of at least 1 << header->windowBits bytes,
+ * kUnsupportedErr if the image needs a larger window.
+ */
+OSStatus LZDecoderInit( lz_decoder_t *decoder, const lz_image_header_t *header, uint8_t *window, size_t windowSize,
+                        lz_output_t output, void *context );
+
+/* Decode the compressed bytes after the header, in pieces of any size.
+ * kMalformedErr: not a valid sequence, or bytes after the end of the image,
+ * kChecksumErr: the decoded image does not match rawCrc.
+ */
+OSStatus LZDecoderExecute( lz_decoder_t *decoder, const uint8_t *inData, size_t inLen );
+
+/* true once every byte is decoded, handed to output and checked */
+bool LZDecoderIsComplete( lz_decoder_t *decoder );
+
+/* Reflected CRC-32 (0xEDB88320) of the images, start with 0xFFFFFFFF and
+ * invert the result.
+ */
+uint32_t LZCrc32Update( uint32_t crc, const uint8_t *data, size_t len );
+
+#endif // __LZUtils_h__
+
@@ -21,19 +21,66 @@
 */ 
 
 #include "MDNSUtils.h"
+#include "DNSParserUtils.h"
 
 static int mDNS_fd = -1;
 
+/* Answers of a service, serialized once in dns_sd_service_record_t.records */
+#define kServiceRecordEnum                 0  // _services._dns-sd._udp.local. PTR service
+#define kServiceRecordPTR                  1  // service PTR instance
+#define kServiceRecordTXT                  2
+#define kServiceRecordSRV                  3
+#define kServiceRecordSubtype              4  // subtype n PTR instance is record kServiceRecordSubtype + n
+#define kServiceRecordMax                  ( kServiceRecordSubtype + kBonjourMaxSubtypes )
+
+#if kServiceRecordMax > 16
+#error "kBonjourMaxSubtypes is too large for mdns_answers_t"
+#endif
+
 typedef struct
 {
-  char* hostname;
-  char* instance_name;
-  char* service_name;
+  uint8_t* instance_name;                     // Wire format of "name#xxxxxx._easylink._tcp.local."
+  uint8_t* service_name;
+  uint8_t* subtypes[kBonjourMaxSubtypes];     // "_printer._sub._ipp._tcp.local."
+  uint8_t subtype_count;
   char* txt_att;
   uint16_t	port;
-  char	instance_name_suffix[4]; // This variable should only be modified by the DNS-SD library
+  uint8_t* records;                           // Pre-serialized answers, NULL: to be built
+  uint16_t record_offset[kServiceRecordMax + 1];  // Record n spans record_offset[n] to record_offset[n+1]
+  uint8_t record_count;
+  uint32_t record_hash[kServiceRecordMax];    // DNSNameHash of the name of each record
+  uint16_t multicast_records;                 // Bit n: record n was multicast at multicast_time[n]
+  uint32_t multicast_time[kServiceRecordMax];
 } dns_sd_service_record_t;
 
+/* Records that answer the questions of a packet */
+typedef struct
+{
+  uint16_t service_records[kBonjourMaxServices];  // Bit n: record n of the service
+  uint16_t additional_records[kBonjourMaxServices]; // Sent only with the answer they complete
+  bool host_record;
+  bool host_additional;
+} mdns_answers_t;
+
+typedef enum
+{
+  kMDNSSendMulticast,
+  kMDNSSendGoodbye,                           // Multicast with a TTL of 0
+  kMDNSSendUnicast,                           // To the querier, for a question with the QU bit
+  kMDNSSendLegacyUnicast,                     // To a querier not on port 5353, RFC 6762 6.7
+} mdns_send_t;
+
+/* A response being composed */
+typedef struct
+{
+  dns_message_iterator_t message;
+  uint16_t answer_count;
+  uint16_t question_count;
+  mdns_send_t type;
+  struct sockaddr_t* to;                      // Unicast: the querier
+  dns_parser_t* query;                        // Legacy unicast: its id and questions are repeated
+} mdns_response_t;
+
 static WiFi_Interface _interface;
 
 
@@ -44,7 +91,25 @@ static WiFi_Interface _interface;
 #define Not_Configured_Offset              1
 
 
-#define MFi_SERVICE_QUERY_NAME             "_services._dns-sd._udp.local."
+#define MFi_SERVICE_QUERY_NAME             (const uint8_t*)"\x09_services\x07_dns-sd\x04_udp\x05local"
+
+#define kBonjourTTL                        1500
+#define kMDNSMessageSize                   1440   // Fits an Ethernet frame
+#define kBonjourIPCheckInterval            1000   // ms, the address is read at most this often
+#define kMDNSPort                          5353
+
+/* RFC 6762 5.4, 6 and 7 */
+#define kMDNSRateLimit                     1000   // ms, a record is multicast at most this often
+#define kMDNSUnicastRecent                 ( kBonjourTTL * 1000 / 4 ) // ms, a QU answer multicast before is sent unicast
+#define kMDNSResponseDelay                 20     // ms, shared answers wait 20 to 120 ms for more queries
+#define kMDNSResponseDelayRange            100
+#define kMDNSTruncatedDelay                400    // ms, or 400 to 500 ms for the known answers of a truncated query
+#define kMDNSTruncatedDelayRange           100
+#define kMDNSLegacyUnicastTTL              10
+#define kServiceRecordShared               ( ( 1 << kServiceRecordEnum ) | ( 1 << kServiceRecordPTR ) | ( 0xFFFF << kServiceRecordSubtype ) )
+
+/* Upper bound of the size of a TXT record written by dns_write_string() */
+#define DNS_TXT_SIZE( txt )                ( (txt) ? strlen(txt) + 2 : 1 )
 
 
 static bool _suspend_MFi_bonjour;
@@ -52,7 +117,7 @@ static int _bonjour_announce_time = 0;
 static int _bonjour_announce = 0;
 
 
-//#define  debug_out 
+//#define  debug_out
 
 //#ifdef debug_out
 //#define  _debug_out debug_out
@@ -63,24 +128,44 @@ static int _bonjour_announce = 0;
 #define mdns_utils_log_trace() custom_log_trace("mDNS Utils")
 //#endif
 
-static dns_sd_service_record_t*   available_services	= NULL;
+static dns_sd_service_record_t available_services[kBonjourMaxServices];
 static uint8_t	available_service_count;
+static uint8_t* _hostname = NULL;
+
+/* The A record of the host, rebuilt when the address changes */
+static uint32_t _bonjour_ip = 0;
+static uint32_t _bonjour_ip_check_time = 0;
+static uint8_t* _host_record = NULL;
+static uint16_t _host_record_length;
+static uint32_t _host_record_hash;
+static bool _host_multicast = false;          // The A record was multicast at _host_multicast_time
+static uint32_t _host_multicast_time;
+
+/* Responses are composed here, the responder lock is held */
+static uint32_t _message_buffer[kMDNSMessageSize / 4];
+
+/* Shared answers wait here for the queries that follow */
+static mdns_answers_t _pending_answers;
+static bool _pending = false;
+static uint32_t _pending_time;
+static uint32_t _bonjour_random;
+
+static bonjour_stats_t _bonjour_stats;
 
-static int dns_get_next_question( dns_message_iterator_t* iter, dns_question_t* q, dns_name_t* name );
-static int dns_compare_name_to_string( dns_name_t* name, const char* string, const char* fun, const int line );
-static int dns_create_message( dns_message_iterator_t* message, uint16_t size );
 static void dns_write_header( dns_message_iterator_t* iter, uint16_t id, uint16_t flags, uint16_t question_count, uint16_t answer_count, uint16_t authorative_count );
-static void dns_write_record( dns_message_iterator_t* iter, const char* name, uint16_t record_class, uint16_t record_type, uint32_t ttl, uint8_t* rdata );
-static void mdns_send_message(int fd, dns_message_iterator_t* message );
-static void dns_free_message( dns_message_iterator_t* message );
-static void mdns_process_query(int fd, dns_name_t* name, dns_question_t* question, dns_message_iterator_t* source );
-static void dns_write_record( dns_message_iterator_t* iter, const char* name, uint16_t record_class, uint16_t record_type, uint32_t ttl, uint8_t* rdata );
+static void dns_write_record( dns_message_iterator_t* iter, const uint8_t* name, uint16_t record_class, uint16_t record_type, uint32_t ttl, uint8_t* rdata );
+static void mdns_send_message(int fd, dns_message_iterator_t* message, struct sockaddr_t* to );
+static void mdns_send_answers( int fd, mdns_answers_t* answers, mdns_send_t type, struct sockaddr_t* to, dns_parser_t* query );
+static void mdns_send_multicast( int fd, mdns_answers_t* answers );
+static void mdns_build_answers( mdns_answers_t* answers );
+static uint32_t mdns_suppress_answers( dns_parser_t* parser, mdns_answers_t* answers, uint8_t sections );
+static void mdns_complete_answers( mdns_answers_t* answers );
+static void mdns_split_recent( mdns_answers_t* answers, mdns_answers_t* older, uint32_t interval );
+static void mdns_process_query( dns_parser_t* parser, dns_parser_question_t* question, mdns_answers_t* answers );
 static void dns_write_uint16( dns_message_iterator_t* iter, uint16_t data );
 static void dns_write_uint32( dns_message_iterator_t* iter, uint32_t data );
 static void dns_write_bytes( dns_message_iterator_t* iter, uint8_t* data, uint16_t length );
-static uint16_t dns_read_uint16( dns_message_iterator_t* iter );
-static void dns_skip_name( dns_message_iterator_t* iter );
-static void dns_write_name( dns_message_iterator_t* iter, const char* src );
+static void dns_write_name( dns_message_iterator_t* iter, const uint8_t* name );
 
 static mico_mutex_t bonjour_mutex = NULL;
 static mico_thread_t mfi_bonjour_thread_handler;
@@ -104,212 +189,623 @@ static char *__strdup(char *src)
   return dst;
 }
 
-void process_dns_questions(int fd, dns_message_iterator_t* iter )
+/* "label." followed by name */
+static char *__strdup_join(const char *label, const char *name)
 {
-  dns_name_t name;
-  dns_question_t question;
-  dns_message_iterator_t response;
-  IPStatusTypedef para;
-  int a = 0;
-  int question_processed;
-  uint32_t myip;
-  
-  micoWlanGetIPStatus(&para, _interface);
-  myip = htonl(inet_addr(para.ip));
-  if(myip == 0) {
+  int label_len = strlen(label);
+  int name_len = strlen(name) + 1;
+  char *dst;
+
+  dst = (char*)malloc(label_len + 1 + name_len);
+  if (dst) {
+    memcpy(dst, label, label_len);
+    dst[label_len] = '.';
+    memcpy(dst + label_len + 1, name, name_len);
+  }
+  return dst;
+}
+
+/* Wire format copy of a dotted name */
+static uint8_t *mdns_create_name(const char *string)
+{
+  uint8_t buffer[kDNSMaxNameLength];
+  size_t len;
+  uint8_t *name;
+
+  len = DNSNameFromString(string, buffer, sizeof(buffer));
+  if (len == 0)
+    return NULL;
+
+  name = (uint8_t*)malloc(len);
+  if (name)
+    memcpy(name, buffer, len);
+  return name;
+}
+
+/* Wire format copy of "label." followed by a dotted name */
+static uint8_t *mdns_create_name_join(const char *label, const char *string)
+{
+  char *joined = __strdup_join(label, string);
+  uint8_t *name;
+
+  if (joined == NULL)
+    return NULL;
+  name = mdns_create_name(joined);
+  free(joined);
+  return name;
+}
+
+static bool mdns_answers_empty( mdns_answers_t* answers )
+{
+  int b;
+
+  for ( b = 0; b < available_service_count; ++b ){
+    if ( answers->service_records[b] || answers->additional_records[b] )
+      return false;
+  }
+  return !answers->host_record && !answers->host_additional;
+}
+
+static void mdns_merge_answers( mdns_answers_t* answers, mdns_answers_t* more )
+{
+  int b;
+
+  for ( b = 0; b < available_service_count; ++b ){
+    answers->service_records[b] |= more->service_records[b];
+    answers->additional_records[b] |= more->additional_records[b];
+  }
+  answers->host_record |= more->host_record;
+  answers->host_additional |= more->host_additional;
+}
+
+static uint32_t mdns_random( uint32_t range )
+{
+  _bonjour_random = _bonjour_random * 1103515245 + 12345;
+  return ( _bonjour_random >> 16 ) % range;
+}
+
+/* Wait for the queries that follow, and for the known answers of a truncated
+   query, before the shared records are multicast. Unique records are sent at
+   once, no other responder has them. */
+static void mdns_schedule_answers( int fd, mdns_answers_t* answers, bool truncated )
+{
+  uint32_t now = mico_get_time();
+  uint32_t due;
+  bool shared = false;
+  int b;
+
+  for ( b = 0; b < available_service_count; ++b ){
+    if ( answers->service_records[b] & kServiceRecordShared )
+      shared = true;
+  }
+  if ( !shared && !truncated ){
+    mdns_send_multicast( fd, answers );
+    return;
+  }
+
+  if ( truncated )
+    due = now + kMDNSTruncatedDelay + mdns_random( kMDNSTruncatedDelayRange );
+  else
+    due = now + kMDNSResponseDelay + mdns_random( kMDNSResponseDelayRange );
+
+  if ( _pending ){
+    _bonjour_stats.aggregated++;
+    if ( (int32_t)( due - _pending_time ) > 0 && truncated )
+      _pending_time = due;
+  }else{
+    memset( &_pending_answers, 0, sizeof(mdns_answers_t) );
+    _pending_time = due;
+    _pending = true;
+  }
+  mdns_merge_answers( &_pending_answers, answers );
+}
+
+static void process_dns_questions(int fd, dns_parser_t* parser, struct sockaddr_t* from )
+{
+  dns_parser_question_t question;
+  mdns_answers_t answers, unicast;
+  bool legacy = ( from && from->s_port != kMDNSPort );
+
+  if(_bonjour_ip == 0) {
     _debug_out("UDP multicast test: IP error.\r\n");
     return;
   }
-  
-  memset( &response, 0, sizeof(dns_message_iterator_t) );
-  
-  for ( a = 0; a < htons(iter->header->question_count); ++a )
+
+  /* More known answers of a truncated query */
+  if ( parser->counts[0] == 0 ){
+    if ( _pending )
+      _bonjour_stats.known_answers += mdns_suppress_answers( parser, &_pending_answers, 1 << 0 );
+    return;
+  }
+
+  memset( &answers, 0, sizeof(mdns_answers_t) );
+  memset( &unicast, 0, sizeof(mdns_answers_t) );
+
+  /* Collect the answers of every question, they are sent together. A
+     malformed question ends the packet, the ones before it are answered. */
+  while ( DNSParserNextQuestion( parser, &question ) == kNoErr )
   {
-    if (iter->iter > iter->end)
-      break;
-    if(dns_get_next_question( iter, &question, &name )==0)
-      break;
-    question_processed = 0;
-    switch ( question.question_type ){
-    case RR_TYPE_PTR:
-      if ( available_services != NULL ){
-        // Check if its a query for all available services  
-        if ( dns_compare_name_to_string( &name, MFi_SERVICE_QUERY_NAME, __FUNCTION__, __LINE__ ) ){
-          int b = 0;
-          _debug_out("UDP multicast test: Recv a SERVICE QUERY request.\r\n");
-          if(dns_create_message( &response, 512 )) {
-            dns_write_header(&response, iter->header->id, 0x8400, 0, available_service_count, 0 );          
-            for ( b = 0; b < available_service_count; ++b ){
-              dns_write_record( &response, MFi_SERVICE_QUERY_NAME, RR_CLASS_IN, RR_TYPE_PTR, 1500, (uint8_t*) available_services[b].service_name );
-            }
-            mdns_send_message(fd, &response );
-            dns_free_message( &response );
-            question_processed = 1;
-          }
-        }
-        // else check if its one of our records
-        else {
-          int b = 0;
-          for ( b = 0; b < available_service_count; ++b ){
-            //printf("UDP multicast test: Recv a SERVICE Detail request: %s.\r\n", name);
-            if ( dns_compare_name_to_string( &name, available_services[b].service_name, __FUNCTION__, __LINE__ )){
-              // Send the PTR, TXT, SRV and A records
-              if(dns_create_message( &response, 512 )){
-                dns_write_header( &response, iter->header->id, 0x8400, 0, 4, 0 );
-                //dns_write_record( &response, MFi_SERVICE_QUERY_NAME, RR_CLASS_IN, RR_TYPE_PTR, 1500, (u8*) available_services[b].service_name );
-                dns_write_record( &response, available_services[b].service_name, RR_CLASS_IN, RR_TYPE_PTR, 1500, (uint8_t*) available_services[b].instance_name );
-                dns_write_record( &response, available_services[b].instance_name, RR_CACHE_FLUSH|RR_CLASS_IN, RR_TYPE_TXT, 1500, (uint8_t*) available_services[b].txt_att );
-                dns_write_record( &response, available_services[b].instance_name, RR_CACHE_FLUSH|RR_CLASS_IN, RR_TYPE_SRV, 1500, (uint8_t*) &available_services[b]);
-                dns_write_record( &response, available_services[b].hostname, RR_CACHE_FLUSH|RR_CLASS_IN, RR_TYPE_A, 1500, (uint8_t*) &myip);
-                mdns_send_message(fd, &response );
-                dns_free_message( &response );
-                question_processed = 1;
-              }
-              else{
-                _debug_out("UDP multicast test: Send error.\r\n");
-              }
-            }
-          }
+    _bonjour_stats.questions++;
+    mdns_process_query( parser, &question, ( question.unicastResponse && from && !legacy ) ? &unicast : &answers );
+  }
+  if ( mdns_answers_empty( &answers ) && mdns_answers_empty( &unicast ) )
+    return;
+
+  mdns_build_answers( &answers );
+  mdns_build_answers( &unicast );
+  if ( parser->counts[1] ){
+    _bonjour_stats.known_answers += mdns_suppress_answers( parser, &answers, 1 << 0 );
+    _bonjour_stats.known_answers += mdns_suppress_answers( parser, &unicast, 1 << 0 );
+  }
+
+  if ( legacy ){
+    mdns_complete_answers( &answers );
+    mdns_send_answers( fd, &answers, kMDNSSendLegacyUnicast, from, parser );
+    return;
+  }
+
+  /* A QU answer that was not multicast for a quarter of its TTL is multicast,
+     the caches of the other hosts are refreshed too, RFC 6762 5.4. The
+     additional records of multicast answers are kept apart until they are
+     sent, they go if their answer is suppressed meanwhile. */
+  mdns_complete_answers( &unicast );
+  mdns_split_recent( &unicast, &answers, kMDNSUnicastRecent );
+  if ( !mdns_answers_empty( &unicast ) )
+    mdns_send_answers( fd, &unicast, kMDNSSendUnicast, from, NULL );
+  if ( !mdns_answers_empty( &answers ) )
+    mdns_schedule_answers( fd, &answers, ( parser->flags & DNS_MESSAGE_TRUNCATION ) != 0 );
+}
+
+static void mdns_process_query( dns_parser_t* parser, dns_parser_question_t* question, mdns_answers_t* answers )
+{
+  dns_sd_service_record_t* service;
+  bool ptr = ( question->type == RR_TYPE_PTR || question->type == RR_QTYPE_ANY );
+  bool srv = ( question->type == RR_TYPE_SRV || question->type == RR_QTYPE_ANY );
+  bool txt = ( question->type == RR_TYPE_TXT || question->type == RR_QTYPE_ANY );
+  int b, n;
+
+  // Check if its a query for all available services
+  if ( ptr && DNSParserNameEquals( parser, question->name, MFi_SERVICE_QUERY_NAME ) ){
+    _debug_out("UDP multicast test: Recv a SERVICE QUERY request.\r\n");
+    for ( b = 0; b < available_service_count; ++b )
+      answers->service_records[b] |= 1 << kServiceRecordEnum;
+    return;
+  }
+
+  // else check if its one of our records
+  for ( b = 0; b < available_service_count; ++b ){
+    service = &available_services[b];
+    if ( ptr ){
+      if ( DNSParserNameEquals( parser, question->name, service->service_name ) ){
+        // Send the PTR, with the TXT, SRV and A records
+        answers->service_records[b] |= 1 << kServiceRecordPTR;
+        answers->additional_records[b] |= ( 1 << kServiceRecordTXT ) | ( 1 << kServiceRecordSRV );
+        answers->host_additional = true;
+        continue;
+      }
+      for ( n = 0; n < service->subtype_count; ++n ){
+        if ( DNSParserNameEquals( parser, question->name, service->subtypes[n] ) ){
+          answers->service_records[b] |= 1 << ( kServiceRecordSubtype + n );
+          answers->additional_records[b] |= ( 1 << kServiceRecordTXT ) | ( 1 << kServiceRecordSRV );
+          answers->host_additional = true;
         }
       }
-      break;
     }
-    if (!question_processed ){
-      _debug_out("UDP multicast test: Recv a mDNS request.\r\n");
-      mdns_process_query(fd, &name, &question, iter);
+    if ( ( srv || txt ) && DNSParserNameEquals( parser, question->name, service->instance_name ) ){
+      if ( srv ) answers->service_records[b] |= 1 << kServiceRecordSRV;
+      if ( txt ) answers->service_records[b] |= 1 << kServiceRecordTXT;
+      answers->host_additional = true;
+    }
+  }
+
+  switch ( question->type )
+  {
+  case RR_QTYPE_ANY:
+  case RR_TYPE_A:
+    if ( _hostname && DNSParserNameEquals( parser, question->name, _hostname ) ){
+      _debug_out("UDP multicast test: Recv RR_TYPE_A.\r\n");
+      answers->host_record = true;
     }
+    break;
+  default:
+    _debug_out("UDP multicast test: Request not support type: %d.---------------------\r\n", question->type);
   }
 }
 
-static void mdns_process_query(int fd, dns_name_t* name, 
-                               dns_question_t* question, dns_message_iterator_t* source )
+
+static OSStatus mdns_build_service_records( dns_sd_service_record_t* service )
+{
+  OSStatus err = kNoErr;
+  dns_message_iterator_t iter;
+  uint32_t size;
+  int n;
+
+  size = DNSNameLength(MFi_SERVICE_QUERY_NAME) + 10 + DNSNameLength(service->service_name)
+       + DNSNameLength(service->service_name) + 10 + DNSNameLength(service->instance_name)
+       + DNSNameLength(service->instance_name) + 10 + DNS_TXT_SIZE(service->txt_att)
+       + DNSNameLength(service->instance_name) + 10 + 6 + DNSNameLength(_hostname);
+  for ( n = 0; n < service->subtype_count; ++n )
+    size += DNSNameLength(service->subtypes[n]) + 10 + DNSNameLength(service->instance_name);
+  /* Every record has to fit in a message */
+  require_action( size <= kMDNSMessageSize - sizeof(dns_message_header_t), exit, err = kSizeErr );
+
+  service->records = malloc( size );
+  require_action( service->records, exit, err = kNoMemoryErr );
+
+  iter.header = NULL;
+  iter.iter = service->records;
+  iter.end = service->records + size;
+
+  service->record_offset[kServiceRecordEnum] = iter.iter - service->records;
+  dns_write_record( &iter, MFi_SERVICE_QUERY_NAME, RR_CLASS_IN, RR_TYPE_PTR, kBonjourTTL, (uint8_t*) service->service_name );
+  service->record_offset[kServiceRecordPTR] = iter.iter - service->records;
+  dns_write_record( &iter, service->service_name, RR_CLASS_IN, RR_TYPE_PTR, kBonjourTTL, (uint8_t*) service->instance_name );
+  service->record_offset[kServiceRecordTXT] = iter.iter - service->records;
+  dns_write_record( &iter, service->instance_name, RR_CACHE_FLUSH|RR_CLASS_IN, RR_TYPE_TXT, kBonjourTTL, (uint8_t*) service->txt_att );
+  service->record_offset[kServiceRecordSRV] = iter.iter - service->records;
+  dns_write_record( &iter, service->instance_name, RR_CACHE_FLUSH|RR_CLASS_IN, RR_TYPE_SRV, kBonjourTTL, (uint8_t*) service );
+  for ( n = 0; n < service->subtype_count; ++n ){
+    service->record_offset[kServiceRecordSubtype + n] = iter.iter - service->records;
+    dns_write_record( &iter, service->subtypes[n], RR_CLASS_IN, RR_TYPE_PTR, kBonjourTTL, (uint8_t*) service->instance_name );
+  }
+  service->record_count = kServiceRecordSubtype + service->subtype_count;
+  service->record_offset[service->record_count] = iter.iter - service->records;
+  for ( n = 0; n < service->record_count; ++n )
+    service->record_hash[n] = DNSNameHash( service->records + service->record_offset[n] );
+
+exit:
+  return err;
+}
+
+static OSStatus mdns_build_host_record( void )
+{
+  OSStatus err = kNoErr;
+  dns_message_iterator_t iter;
+  uint32_t size;
+
+  require_action( _hostname, exit, err = kNotInitializedErr );
+  size = DNSNameLength(_hostname) + 10 + 4;
+  _host_record = malloc( size );
+  require_action( _host_record, exit, err = kNoMemoryErr );
+
+  iter.header = NULL;
+  iter.iter = _host_record;
+  iter.end = _host_record + size;
+  dns_write_record( &iter, _hostname, RR_CACHE_FLUSH|RR_CLASS_IN, RR_TYPE_A, kBonjourTTL, (uint8_t*) &_bonjour_ip );
+  _host_record_length = iter.iter - _host_record;
+  _host_record_hash = DNSNameHash( _host_record );
+
+exit:
+  return err;
+}
+
+static void mdns_free_records( dns_sd_service_record_t* service )
+{
+  if ( service->records ) free( service->records );
+  service->records = NULL;
+  service->record_count = 0;
+  service->multicast_records = 0;
+}
+
+static void mdns_free_host_record( void )
+{
+  if ( _host_record ) free( _host_record );
+  _host_record = NULL;
+  _host_multicast = false;
+}
+
+/* Read the address of the interface, the A record is rebuilt and announced when it changed */
+static void mdns_check_ip( void )
 {
-  dns_message_iterator_t response;
   IPStatusTypedef para;
   uint32_t myip;
-  
+
+  _bonjour_ip_check_time = mico_get_time();
   micoWlanGetIPStatus(&para, _interface);
   myip = htonl(inet_addr(para.ip));
-  
-  memset( &response, 0, sizeof(dns_message_iterator_t) );
-  
-  switch ( question->question_type )
+  if ( myip == _bonjour_ip )
+    return;
+
+  _bonjour_ip = myip;
+  _bonjour_random += myip ^ _bonjour_ip_check_time;
+  mdns_free_host_record();
+  if ( myip != 0 ){
+    _bonjour_announce = 1;
+    _bonjour_announce_time = 0;
+  }
+}
+
+/* Build what changed before the records are compared or sent */
+static void mdns_build_answers( mdns_answers_t* answers )
+{
+  int b;
+
+  for ( b = 0; b < available_service_count; ++b ){
+    if ( ( answers->service_records[b] || answers->additional_records[b] ) && available_services[b].records == NULL
+        && mdns_build_service_records( &available_services[b] ) != kNoErr ){
+      answers->service_records[b] = 0;
+      answers->additional_records[b] = 0;
+    }
+  }
+  if ( ( answers->host_record || answers->host_additional ) && _host_record == NULL && mdns_build_host_record() != kNoErr ){
+    answers->host_record = false;
+    answers->host_additional = false;
+  }
+}
+
+/* Whether the record of the packet is the serialized one, with the same rdata */
+static bool mdns_record_equals( dns_parser_t* parser, dns_parser_record_t* record, const uint8_t* serialized )
+{
+  const uint8_t* p = serialized + DNSNameLength( serialized );
+  const uint8_t* rdata = p + 10;
+  uint16_t length = ( p[8] << 8 ) | p[9];
+
+  if ( record->type != ( ( p[0] << 8 ) | p[1] ) || record->rclass != ( ( ( p[2] << 8 ) | p[3] ) & kDNSClassMask ) )
+    return false;
+  if ( !DNSParserNameEquals( parser, record->name, serialized ) )
+    return false;
+
+  switch ( record->type )
   {
-  case RR_QTYPE_ANY:
-  case RR_TYPE_A:
-    if ( dns_compare_name_to_string( name, available_services->hostname, __FUNCTION__, __LINE__) ){				
-      _debug_out("UDP multicast test: Recv RR_TYPE_A.\r\n");
-      if(dns_create_message( &response, 256 )){
-        dns_write_header( &response, source->header->id, 0x8400, 0, 1, 0 );
-        dns_write_record( &response, available_services->hostname, RR_CLASS_IN | RR_CACHE_FLUSH, RR_TYPE_A, 300, (uint8_t *)&myip);
-        mdns_send_message(fd, &response );
-        dns_free_message( &response );
-        return;
-      }
-    }    
+  case RR_TYPE_PTR:
+    return DNSParserNameEquals( parser, record->rdata, rdata );
+  case RR_TYPE_SRV:
+    return record->rdataLength > 6 && memcmp( parser->packet + record->rdata, rdata, 6 ) == 0
+        && DNSParserNameEquals( parser, record->rdata + 6, rdata + 6 );
   default:
-    _debug_out("UDP multicast test: Request not support type: %d.---------------------\r\n", question->question_type);
+    return record->rdataLength == length && memcmp( parser->packet + record->rdata, rdata, length ) == 0;
   }
 }
 
+/* Drop the answers that the records of the sections of the packet hold, with
+   at least half their TTL left: the known answers of a query (RFC 6762 7.1),
+   or the response of another responder (7.4). Returns the number dropped, the
+   parser stays where it is. */
+static uint32_t mdns_suppress_answers( dns_parser_t* parser, mdns_answers_t* answers, uint8_t sections )
+{
+  dns_parser_t walker = *parser;
+  dns_parser_record_t record;
+  dns_sd_service_record_t* service;
+  uint32_t dropped = 0, hash;
+  uint16_t records;
+  int b, n;
+
+  while ( DNSParserNextRecord( &walker, &record ) == kNoErr ){
+    if ( !( sections & ( 1 << record.section ) ) || record.ttl < kBonjourTTL / 2 )
+      continue;
+
+    /* Most records of a busy network are not ours, their names tell */
+    hash = DNSParserNameHash( parser, record.name );
+    for ( b = 0; b < available_service_count; ++b ){
+      service = &available_services[b];
+      records = answers->service_records[b] | answers->additional_records[b];
+      for ( n = 0; records && n < service->record_count; ++n ){
+        if ( ( records & ( 1 << n ) ) && service->record_hash[n] == hash
+            && mdns_record_equals( parser, &record, service->records + service->record_offset[n] ) ){
+          answers->service_records[b] &= ~( 1 << n );
+          answers->additional_records[b] &= ~( 1 << n );
+          dropped++;
+          break;
+        }
+      }
+    }
+    if ( ( answers->host_record || answers->host_additional ) && _host_record && _host_record_hash == hash
+        && mdns_record_equals( parser, &record, _host_record ) ){
+      answers->host_record = false;
+      answers->host_additional = false;
+      dropped++;
+    }
+  }
+  return dropped;
+}
 
-static int dns_get_next_question( dns_message_iterator_t* iter, dns_question_t* q, dns_name_t* name )
+/* The TXT and SRV records go with a PTR record of their service, the A record
+   with a SRV record, RFC 6763 12 */
+static void mdns_complete_answers( mdns_answers_t* answers )
 {
-  // Set the name pointers and then skip it
-  name->start_of_name   = (uint8_t*) iter->iter;
-  name->start_of_packet = (uint8_t*) iter->header;
-  dns_skip_name( iter );
-  if (iter->iter > iter->end)
-    return 0;
-  
-  // Read the type and class
-  q->question_type  = dns_read_uint16( iter );
-  q->question_class = dns_read_uint16( iter );
-  return 1;
+  bool srv = false;
+  int b;
+
+  for ( b = 0; b < available_service_count; ++b ){
+    if ( answers->service_records[b] & ( ( 1 << kServiceRecordPTR ) | ( 0xFFFF << kServiceRecordSubtype ) ) )
+      answers->service_records[b] |= answers->additional_records[b];
+    answers->additional_records[b] = 0;
+    if ( answers->service_records[b] & ( 1 << kServiceRecordSRV ) )
+      srv = true;
+  }
+  if ( answers->host_additional && srv )
+    answers->host_record = true;
+  answers->host_additional = false;
 }
 
-static int dns_compare_name_to_string( dns_name_t* name, const char* string, const char* fun, int line )
+/* Move the answers that were not multicast in the last interval ms to older */
+static void mdns_split_recent( mdns_answers_t* answers, mdns_answers_t* older, uint32_t interval )
 {
-  uint8_t section_length;
-  int finished = 0;
-  int result   = 1;
-  uint8_t* buffer 	  = name->start_of_name;
-  _debug_out("UDP multicast test: CMP called by %s@%d.\r\n", fun, line );
-  char *temp;
-  
-  while ( !finished )
-  {
-    // Check if the name is compressed. If so, find the uncompressed version
-    while ( *buffer & 0xC0 )
-    {
-      uint16_t offset = ( *buffer++ ) << 8;
-      offset += *buffer;
-      offset &= 0x3FFF;
-      buffer = name->start_of_packet + offset;
-      _debug_out("UDP multicast test: Recv a compressed name.\r\n");
-    }
-    
-    // Compare section
-    section_length = *( buffer++ );
-    temp = malloc(section_length+1);
-    temp[section_length] = 0;
-    memcpy(temp, buffer, section_length );
-    _debug_out("UDP multicast test: Recv a name: %s.\r\n", temp);
-    free(temp);
-    if ( strncmp( (char*) buffer, string, section_length ) )
-    {
-      result	 = 0;
-      finished = 1;
+  dns_sd_service_record_t* service;
+  uint32_t now = mico_get_time();
+  int b, n;
+
+  for ( b = 0; b < available_service_count; ++b ){
+    service = &available_services[b];
+    for ( n = 0; n < service->record_count; ++n ){
+      if ( ( answers->service_records[b] & ( 1 << n ) )
+          && !( ( service->multicast_records & ( 1 << n ) ) && now - service->multicast_time[n] < interval ) ){
+        answers->service_records[b] &= ~( 1 << n );
+        older->service_records[b] |= 1 << n;
+      }
     }
-    string += section_length + 1;
-    buffer += section_length;
-    
-    // Check if we've finished comparing
-    if ( *buffer == 0 || *string == 0 )
-    {
-      finished = 1;
-      // Check if one of the strings has more data
-      if ( *buffer != 0 || *string != 0 )
-      {
-        result = 0;
+  }
+  if ( answers->host_record && !( _host_multicast && now - _host_multicast_time < interval ) ){
+    answers->host_record = false;
+    older->host_record = true;
+  }
+}
+
+static uint32_t mdns_answers_count( mdns_answers_t* answers )
+{
+  uint32_t count = answers->host_record ? 1 : 0;
+  uint16_t records;
+  int b;
+
+  for ( b = 0; b < available_service_count; ++b ){
+    for ( records = answers->service_records[b]; records; records &= records - 1 )
+      count++;
+  }
+  return count;
+}
+
+/* A record is multicast at most once a second, RFC 6762 6 */
+static void mdns_rate_limit( mdns_answers_t* answers )
+{
+  mdns_answers_t allowed;
+
+  memset( &allowed, 0, sizeof(mdns_answers_t) );
+  mdns_split_recent( answers, &allowed, kMDNSRateLimit );
+  _bonjour_stats.rate_limited += mdns_answers_count( answers );
+  *answers = allowed;
+}
+
+static void mdns_mark_multicast( mdns_answers_t* answers )
+{
+  uint32_t now = mico_get_time();
+  int b, n;
+
+  for ( b = 0; b < available_service_count; ++b ){
+    for ( n = 0; n < available_services[b].record_count; ++n ){
+      if ( answers->service_records[b] & ( 1 << n ) ){
+        available_services[b].multicast_records |= 1 << n;
+        available_services[b].multicast_time[n] = now;
       }
     }
   }
-  
-  return result;
+  if ( answers->host_record ){
+    _host_multicast = true;
+    _host_multicast_time = now;
+  }
 }
 
-static int dns_create_message( dns_message_iterator_t* message, uint16_t size )
+/* Legacy unicast responses repeat the questions of the query */
+static void mdns_begin_message( mdns_response_t* response )
 {
-  message->header = (dns_message_header_t*) malloc( size );
-  if ( message->header == NULL )
-  {
-    return 0;
+  dns_parser_t query;
+  dns_parser_question_t question;
+  dns_message_iterator_t* message = &response->message;
+  size_t len;
+
+  message->header = (dns_message_header_t*) _message_buffer;
+  message->iter   = (uint8_t *) message->header + sizeof(dns_message_header_t);
+  message->end    = (uint8_t *) message->header + kMDNSMessageSize;
+  response->answer_count = 0;
+  response->question_count = 0;
+
+  if ( response->query == NULL )
+    return;
+  DNSParserInit( &query, response->query->packet, response->query->length );
+  while ( DNSParserNextQuestion( &query, &question ) == kNoErr ){
+    len = DNSParserCopyName( &query, question.name, message->iter, message->end - message->iter - 4 );
+    if ( len == 0 )
+      break;
+    message->iter += len;
+    dns_write_uint16( message, question.type );
+    dns_write_uint16( message, question.qclass );
+    response->question_count++;
   }
-  
-  message->iter = (uint8_t *) message->header + sizeof(dns_message_header_t);
-  return 1;
 }
 
-static void dns_free_message( dns_message_iterator_t* message )
+static void mdns_flush_message( int fd, mdns_response_t* response )
+{
+  dns_message_iterator_t* message = &response->message;
+
+  dns_write_header( message, response->query ? response->query->id : 0x0, 0x8400, response->question_count, response->answer_count, 0 );
+  mdns_send_message( fd, message, response->to );
+  _bonjour_stats.responses++;
+  _bonjour_stats.answers += response->answer_count;
+  if ( response->to )
+    _bonjour_stats.unicast_answers += response->answer_count;
+  if ( response->type == kMDNSSendGoodbye ){
+    mico_thread_msleep(20);
+    mdns_send_message( fd, message, NULL );
+  }
+
+  mdns_begin_message( response );
+}
+
+/* Copy a serialized record, a goodbye record has a TTL of 0, a legacy unicast
+   record a short TTL and no cache flush bit */
+static void mdns_append_record( int fd, mdns_response_t* response, const uint8_t* record, uint16_t length )
+{
+  dns_message_iterator_t* message = &response->message;
+  uint8_t* type;
+
+  if ( message->iter + length > message->end )
+    mdns_flush_message( fd, response );
+
+  memcpy( message->iter, record, length );
+  // The names of serialized records are not compressed
+  type = message->iter + DNSNameLength( message->iter );
+  if ( response->type == kMDNSSendGoodbye )
+    memset( type + 4, 0, 4 );
+  else if ( response->type == kMDNSSendLegacyUnicast ){
+    type[2] &= ~( kDNSRecordCacheFlush >> 8 );
+    type[4] = type[5] = type[6] = 0;
+    type[7] = kMDNSLegacyUnicastTTL;
+  }
+  message->iter += length;
+  ++response->answer_count;
+}
+
+/* Send the records of answers in as few messages as they fit in */
+static void mdns_send_answers( int fd, mdns_answers_t* answers, mdns_send_t type, struct sockaddr_t* to, dns_parser_t* query )
+{
+  mdns_response_t response;
+  dns_sd_service_record_t* service;
+  int b, n;
+
+  mdns_build_answers( answers );
+  if ( type == kMDNSSendMulticast )
+    mdns_mark_multicast( answers );
+
+  response.type = type;
+  response.to = to;
+  response.query = query;
+  mdns_begin_message( &response );
+  for ( b = 0; b < available_service_count; ++b ){
+    service = &available_services[b];
+    for ( n = 0; n < service->record_count; ++n ){
+      if ( answers->service_records[b] & ( 1 << n ) )
+        mdns_append_record( fd, &response, service->records + service->record_offset[n],
+                            service->record_offset[n + 1] - service->record_offset[n] );
+    }
+  }
+  if ( answers->host_record )
+    mdns_append_record( fd, &response, _host_record, _host_record_length );
+
+  if ( response.answer_count )
+    mdns_flush_message( fd, &response );
+}
+
+static void mdns_send_multicast( int fd, mdns_answers_t* answers )
 {
-  free(message->header);
-  message->header = NULL;
+  mdns_complete_answers( answers );
+  mdns_rate_limit( answers );
+  if ( !mdns_answers_empty( answers ) )
+    mdns_send_answers( fd, answers, kMDNSSendMulticast, NULL, NULL );
 }
 
+/* "key=value.key=value." as the strings of a TXT record, "/" puts the next character in the string */
 static void dns_write_string( dns_message_iterator_t* iter, const char* src )
 {
   uint8_t* segment_length_pointer;
   uint8_t  segment_length;
   
-  while ( *src != 0 && *src != 0xC0)
+  while ( *src != 0 )
   {
     /* Remember where we need to store the segment length and reset the counter*/
     segment_length_pointer = iter->iter++;
     segment_length = 0;
     
     /* Copy bytes until '.' or end of string*/
-    while ( *src != '.' && *src != 0 && *src != 0xC0)
+    while ( *src != '.' && *src != 0 )
     {
       if (*src == '/')
         src++; // skip '/'
@@ -329,13 +825,8 @@ static void dns_write_string( dns_message_iterator_t* iter, const char* src )
     
   }
   
-  if (*src == 0xC0) { // compress name
-    *iter->iter++ = *src++;
-    *iter->iter++ = *src++;
-  } else {
-    /* Add the ending null */
-    *iter->iter++ = 0;
-  }
+  /* Add the ending null */
+  *iter->iter++ = 0;
 }
 
 
@@ -350,7 +841,7 @@ static void dns_write_header( dns_message_iterator_t* iter, uint16_t id, uint16_
 }
 
 
-static void dns_write_record( dns_message_iterator_t* iter, const char* name, uint16_t record_class, uint16_t record_type, uint32_t ttl, uint8_t* rdata )
+static void dns_write_record( dns_message_iterator_t* iter, const uint8_t* name, uint16_t record_class, uint16_t record_type, uint32_t ttl, uint8_t* rdata )
 {
   uint8_t* rd_length;
   uint8_t* temp_ptr;
@@ -373,8 +864,15 @@ static void dns_write_record( dns_message_iterator_t* iter, const char* name, ui
     break;
     
   case RR_TYPE_PTR:
+    dns_write_name( iter, rdata );
+    break;
+
   case RR_TYPE_TXT:
-    dns_write_name( iter, (const char*) rdata );
+    /* An empty TXT record holds an empty string */
+    if ( rdata == NULL )
+      *iter->iter++ = 0;
+    else
+      dns_write_string( iter, (const char*) rdata );
     break;
     
   case RR_TYPE_SRV:
@@ -386,7 +884,7 @@ static void dns_write_record( dns_message_iterator_t* iter, const char* name, ui
     dns_write_uint16( iter, ( (dns_sd_service_record_t*) rdata )->port );
     
     /* Write the hostname*/
-    dns_write_string( iter, ( (dns_sd_service_record_t*) rdata )->hostname );
+    dns_write_name( iter, _hostname );
     break;
   default:
     break;
@@ -396,12 +894,17 @@ static void dns_write_record( dns_message_iterator_t* iter, const char* name, ui
   rd_length[1] = ( iter->iter - temp_ptr ) & 0xFF;
 }
 
-static void mdns_send_message(int fd, dns_message_iterator_t* message )
+static void mdns_send_message(int fd, dns_message_iterator_t* message, struct sockaddr_t* to )
 {
   struct sockaddr_t addr;
   if(_suspend_MFi_bonjour == true)
     return;
-  
+
+  if ( to ){
+    sendto(fd, message->header, message->iter - (uint8_t*)message->header, 0, to, sizeof(struct sockaddr_t));
+    return;
+  }
+
   addr.s_ip = inet_addr("224.0.0.251");
   addr.s_port = 5353;
   _debug_out("UDP multicast test: Send a mDNS respond!+++++++++++++++++++++++++++\r\n");
@@ -439,171 +942,245 @@ static void dns_write_bytes( dns_message_iterator_t* iter, uint8_t* data, uint16
   iter->iter += length;
 }
 
-static uint16_t dns_read_uint16( dns_message_iterator_t* iter )
+static void dns_write_name( dns_message_iterator_t* iter, const uint8_t* name )
 {
-  uint16_t temp = (uint16_t) ( *iter->iter++ ) << 8;
-  temp += (uint16_t) ( *iter->iter++ );
-  return temp;
+  dns_write_bytes( iter, (uint8_t*) name, DNSNameLength( name ) );
 }
 
-static void dns_skip_name( dns_message_iterator_t* iter )
+
+static void mdns_free_service( dns_sd_service_record_t* service )
 {
-  while ( *iter->iter != 0 )
-  {
-    // Check if the name is compressed
-    if ( *iter->iter & 0xC0 )
-    {
-      iter->iter += 1; // Normally this should be 2, but we have a ++ outside the while loop
-      break;
-    }
-    else
-    {
-      iter->iter += (uint32_t) *iter->iter + 1;
-    }
-    if (iter->iter > iter->end)
-      break;
-  }
-  // Skip the null u8
-  ++iter->iter;
+  int n;
+
+  if(service->service_name)  free(service->service_name);
+  if(service->instance_name)  free(service->instance_name);
+  if(service->txt_att)  free(service->txt_att);
+  for ( n = 0; n < service->subtype_count; ++n )
+    free(service->subtypes[n]);
+  mdns_free_records( service );
+  memset(service, 0x0, sizeof(dns_sd_service_record_t));
 }
 
-static void dns_write_name( dns_message_iterator_t* iter, const char* src )
+static dns_sd_service_record_t* mdns_find_service( char* service_name )
 {
-  dns_write_string( iter, src );
+  uint8_t name[kDNSMaxNameLength];
+  int b;
+
+  if ( DNSNameFromString( service_name, name, sizeof(name) ) == 0 )
+    return NULL;
+
+  for ( b = 0; b < available_service_count; ++b ){
+    if ( DNSNameEqual( available_services[b].service_name, name ) )
+      return &available_services[b];
+  }
+  return NULL;
 }
 
+static OSStatus mdns_add_service( bonjour_init_t* init )
+{
+  OSStatus err = kNoErr;
+  dns_sd_service_record_t* service = NULL;
+
+  require_action( init->service_name && init->instance_name, exit, err = kParamErr );
+  require_action( available_service_count < kBonjourMaxServices, exit, err = kNoResourcesErr );
+
+  service = &available_services[available_service_count];
+  memset(service, 0x0, sizeof(dns_sd_service_record_t));
+
+  service->service_name = mdns_create_name(init->service_name);
+  service->instance_name = mdns_create_name_join(init->instance_name, init->service_name);
+  service->txt_att = (char*)__strdup(init->txt_record);
+  service->port = init->service_port;
+  require_action( service->service_name && service->instance_name, exit, err = kNoMemoryErr );
+
+  available_service_count++;
+  _bonjour_announce = 1;
+  _bonjour_announce_time = 0;
+
+exit:
+  if ( err != kNoErr && service )
+    mdns_free_service( service );
+  return err;
+}
 
 void bonjour_service_init(bonjour_init_t init)
 {
-  int len;
-  IPStatusTypedef para;
-
   _interface = init.interface;
 
   if(bonjour_mutex == NULL)
     mico_rtos_init_mutex( &bonjour_mutex );
 
-
   mico_rtos_lock_mutex( &bonjour_mutex );
-  if(available_services) {
-    //suspend_bonjour_service(ENABLE);
-    if(available_services->service_name)  free(available_services->service_name);
-    if(available_services->hostname)  free(available_services->hostname);
-    if(available_services->instance_name)  free(available_services->instance_name);
-    if(available_services->txt_att)  free(available_services->txt_att);
-    free(available_services);
-  }
+  _pending = false;
+  while(available_service_count)
+    mdns_free_service( &available_services[--available_service_count] );
 
-  micoWlanGetIPStatus(&para, _interface);
+  if(_hostname)  free(_hostname);
+  _hostname = init.host_name ? mdns_create_name(init.host_name) : NULL;
+
+  _bonjour_ip = 0;
+  mdns_check_ip();
+  mdns_free_host_record();
+
+  mdns_add_service( &init );
+  mico_rtos_unlock_mutex( &bonjour_mutex );
+}
 
-  available_service_count = 1;
-  available_services = (void *)malloc(sizeof(dns_sd_service_record_t) * 1);
-  memset(available_services, 0x0, sizeof(dns_sd_service_record_t) * 1);
+OSStatus bonjour_add_service(bonjour_init_t init)
+{
+  OSStatus err;
 
-  available_services->service_name = (char*)__strdup(init.service_name);
+  require_action( bonjour_mutex, exit, err = kNotInitializedErr );
 
-  available_services->hostname = (char*)__strdup(init.host_name);
+  mico_rtos_lock_mutex( &bonjour_mutex );
+  err = mdns_add_service( &init );
+  mico_rtos_unlock_mutex( &bonjour_mutex );
 
-  len = strlen(init.instance_name);
-  available_services->instance_name = (char*)malloc(len+3);//// 0xc00c+\0
-  memcpy(available_services->instance_name, init.instance_name, len);
-  available_services->instance_name[len]= 0xc0;
-  available_services->instance_name[len+1]= 0x0c;
-  available_services->instance_name[len+2]= 0;
-  
-  available_services->txt_att = (char*)__strdup(init.txt_record);
+exit:
+  return err;
+}
+
+OSStatus bonjour_add_service_subtype(char *service_name, char *subtype)
+{
+  OSStatus err = kNoErr;
+  dns_sd_service_record_t* service;
+  char *sub_name;
+
+  require_action( bonjour_mutex, exit, err = kNotInitializedErr );
+  require_action( service_name && subtype, exit, err = kParamErr );
 
-  available_services->port = init.service_port;
+  mico_rtos_lock_mutex( &bonjour_mutex );
+  service = mdns_find_service( service_name );
+  require_action( service, unlock, err = kNotFoundErr );
+  require_action( service->subtype_count < kBonjourMaxSubtypes, unlock, err = kNoResourcesErr );
+
+  sub_name = __strdup_join( "_sub", service_name );
+  require_action( sub_name, unlock, err = kNoMemoryErr );
+  service->subtypes[service->subtype_count] = mdns_create_name_join( subtype, sub_name );
+  free( sub_name );
+  require_action( service->subtypes[service->subtype_count], unlock, err = kNoMemoryErr );
+  service->subtype_count++;
+
+  mdns_free_records( service );
+  _bonjour_announce = 1;
+  _bonjour_announce_time = 0;
+
+unlock:
   mico_rtos_unlock_mutex( &bonjour_mutex );
+exit:
+  return err;
+}
+
+static OSStatus mdns_update_txt_record( dns_sd_service_record_t* service, char *txt_record )
+{
+  if(service == NULL)
+    return kNotFoundErr;
+
+  if(service->txt_att)  free(service->txt_att);
+
+  service->txt_att = (char*)__strdup(txt_record);
+  mdns_free_records( service );
+
+  _bonjour_announce = 1;
+  return kNoErr;
 }
 
 void bonjour_update_txt_record(char *txt_record)
 {
-  
+
   mico_rtos_lock_mutex( &bonjour_mutex );
-  if(available_services->txt_att)  free(available_services->txt_att);
-  
-  available_services->txt_att = (char*)__strdup(txt_record);
+  if(available_service_count)
+    mdns_update_txt_record( &available_services[0], txt_record );
+  mico_rtos_unlock_mutex( &bonjour_mutex );
 
-  _bonjour_announce = 1;
+}
+
+OSStatus bonjour_update_service_txt_record(char *service_name, char *txt_record)
+{
+  OSStatus err;
+
+  require_action( bonjour_mutex, exit, err = kNotInitializedErr );
+  require_action( service_name, exit, err = kParamErr );
+
+  mico_rtos_lock_mutex( &bonjour_mutex );
+  err = mdns_update_txt_record( mdns_find_service( service_name ), txt_record );
   mico_rtos_unlock_mutex( &bonjour_mutex );
 
+exit:
+  return err;
 }
 
-void mfi_mdns_handler(int fd, uint8_t* pkt, int pkt_len)
+void bonjour_get_stats(bonjour_stats_t *stats)
 {
+  *stats = _bonjour_stats;
+}
+
+void mfi_mdns_handler(int fd, uint8_t* pkt, int pkt_len, struct sockaddr_t* from)
+{
+
+  dns_parser_t parser;
+
+  if ( pkt_len < 0 || DNSParserInit( &parser, pkt, pkt_len ) != kNoErr )
+    return;
+  _bonjour_stats.packets++;
 
-  dns_message_iterator_t iter;
-  
-  iter.header = (dns_message_header_t*) pkt;
-  iter.iter   = (uint8_t*) iter.header + sizeof(dns_message_header_t);
-  iter.end = pkt+pkt_len;
-  
   // Check if the message is a response (otherwise its a query)
-  if ( ntohs(iter.header->flags) & DNS_MESSAGE_IS_A_RESPONSE )
+  if ( parser.flags & DNS_MESSAGE_IS_A_RESPONSE )
   {
+    // Another responder answered first
+    if ( _pending )
+      _bonjour_stats.duplicate_answers += mdns_suppress_answers( &parser, &_pending_answers, ( 1 << 0 ) | ( 1 << 2 ) );
   }
   else
   {
-    process_dns_questions(fd, &iter );
+    process_dns_questions(fd, &parser, from );
   }
 }
 
+uint32_t mfi_bonjour_send_pending(int fd)
+{
+  int32_t wait;
+
+  if ( !_pending )
+    return MICO_WAIT_FOREVER;
+
+  wait = (int32_t)( _pending_time - mico_get_time() );
+  if ( wait > 0 )
+    return wait;
+
+  _pending = false;
+  if ( _bonjour_ip != 0 )
+    mdns_send_multicast( fd, &_pending_answers );
+  return MICO_WAIT_FOREVER;
+}
+
+/* Announcements are not rate limited */
 void mfi_bonjour_send(int fd)
 {
-  dns_message_iterator_t response;
-  uint32_t myip;
-  IPStatusTypedef para;
-  micoWlanGetIPStatus(&para, _interface);
-  myip = htonl(inet_addr(para.ip));
-  if(myip == 0) return;
+  mdns_answers_t answers;
   int b = 0;
-    
-  if(dns_create_message( &response, 512 )) {
-    dns_write_header(&response, 0x0, 0x8400, 0, available_service_count, 0 );          
-    for ( b = 0; b < available_service_count; ++b ){
-      dns_write_record( &response, MFi_SERVICE_QUERY_NAME, RR_CLASS_IN, RR_TYPE_PTR, 1500, (uint8_t*) available_services[b].service_name );
-    }
-    mdns_send_message(fd, &response );
-    dns_free_message( &response );
-  }
 
-  for ( b = 0; b < available_service_count; ++b ){
-      if(dns_create_message( &response, 512 )){
-        dns_write_header( &response, 0x0, 0x8400, 0, 4, 0 );
-        dns_write_record( &response, available_services[b].service_name, RR_CLASS_IN, RR_TYPE_PTR, 1500, (uint8_t*) available_services[b].instance_name );
-        dns_write_record( &response, available_services[b].instance_name, RR_CACHE_FLUSH|RR_CLASS_IN, RR_TYPE_TXT, 1500, (uint8_t*) available_services[b].txt_att );
-        dns_write_record( &response, available_services[b].instance_name, RR_CACHE_FLUSH|RR_CLASS_IN, RR_TYPE_SRV, 1500, (uint8_t*) &available_services[b]);
-        dns_write_record( &response, available_services[b].hostname, RR_CACHE_FLUSH|RR_CLASS_IN, RR_TYPE_A, 1500, (uint8_t*) &myip);
-        mdns_send_message(fd, &response );
-        dns_free_message( &response );
-      }
-  }
+  if(_bonjour_ip == 0) return;
+
+  memset( &answers, 0, sizeof(mdns_answers_t) );
+  for ( b = 0; b < available_service_count; ++b )
+    answers.service_records[b] = 0xFFFF;
+  answers.host_record = true;
+  mdns_send_answers( fd, &answers, kMDNSSendMulticast, NULL, NULL );
 }
 
 
 void mfi_bonjour_remove_record(int fd)
 {
-  dns_message_iterator_t response;
-  uint32_t myip;
-  IPStatusTypedef para;
-  micoWlanGetIPStatus(&para, _interface);
-  myip = htonl(inet_addr(para.ip));
+  mdns_answers_t answers;
   int b = 0;
 
-  for ( b = 0; b < available_service_count; ++b ){
-    if(dns_create_message( &response, 512 )){
-      dns_write_header( &response, 0x0, 0x8400, 0, 4, 0 );
-      dns_write_record( &response, available_services[b].service_name, RR_CLASS_IN, RR_TYPE_PTR, 0, (uint8_t*) available_services[b].instance_name );
-      dns_write_record( &response, available_services[b].instance_name, RR_CACHE_FLUSH|RR_CLASS_IN, RR_TYPE_TXT, 0, (uint8_t*) available_services[b].txt_att );
-      dns_write_record( &response, available_services[b].instance_name, RR_CACHE_FLUSH|RR_CLASS_IN, RR_TYPE_SRV, 0, (uint8_t*) &available_services[b]);
-      dns_write_record( &response, available_services[b].hostname, RR_CACHE_FLUSH|RR_CLASS_IN, RR_TYPE_A, 0, (uint8_t*) &myip);
-      mdns_send_message(fd, &response );
-      mico_thread_msleep(20);
-      mdns_send_message(fd, &response );
-      dns_free_message( &response );
-    }
-  }
+  _pending = false;
+  memset( &answers, 0, sizeof(mdns_answers_t) );
+  for ( b = 0; b < available_service_count; ++b )
+    answers.service_records[b] = 0xFFFF & ~( 1 << kServiceRecordEnum );
+  answers.host_record = ( _bonjour_ip != 0 );
+  mdns_send_answers( fd, &answers, kMDNSSendGoodbye, NULL, NULL );
 }
 
 int start_bonjour_service(void)
@@ -619,6 +1196,7 @@ void suspend_bonjour_service(bool state)
     mfi_bonjour_remove_record(mDNS_fd);
   }
   else{
+    mdns_check_ip();
     _bonjour_announce = 1;
     _bonjour_announce_time = 0;
   }
@@ -633,15 +1211,12 @@ void _bonjour_thread(void *arg)
   struct timeval_t t;
   struct sockaddr_t addr;
   socklen_t addrLen;
-  uint32_t opt;
+  uint32_t opt, wait, announced = 0;
   (void)arg;
   OSStatus err;
-  
+
   buf = malloc(1500);
-  
-  t.tv_sec = 1;
-  t.tv_usec = 0;
-  
+
   mDNS_fd = socket(AF_INET, SOCK_DGRM, IPPROTO_UDP);
   require_action(IsValidSocket( mDNS_fd ), exit, err = kNoResourcesErr );
   opt = 0xE00000FB; //"224.0.0.251"
@@ -652,31 +1227,43 @@ void _bonjour_thread(void *arg)
   require_noerr(err, exit);
 
   _bonjour_announce = 1;
-  
+
   while(1) {
-    /*Send bonjour info when wifi is connected */
-    if(_bonjour_announce){
-      mico_rtos_lock_mutex( &bonjour_mutex );
+    mico_rtos_lock_mutex( &bonjour_mutex );
+    /* The address is cached, a new one is announced */
+    if(mico_get_time() - _bonjour_ip_check_time >= kBonjourIPCheckInterval)
+      mdns_check_ip();
+
+    /*Send bonjour info when wifi is connected, a second apart */
+    if(_bonjour_announce && (_bonjour_announce_time == 0 || mico_get_time() - announced >= 1000)){
       mfi_bonjour_send(mDNS_fd);
-     
+      announced = mico_get_time();
+
       _bonjour_announce_time ++;
       if(_bonjour_announce_time > 1){
         _bonjour_announce_time = 0;
         _bonjour_announce = 0;
       }
-      mico_rtos_unlock_mutex( &bonjour_mutex );
     }
 
+    /* Wake up for the delayed answers */
+    wait = mfi_bonjour_send_pending(mDNS_fd);
+    mico_rtos_unlock_mutex( &bonjour_mutex );
+    if ( wait > 1000 ) wait = 1000;
+    t.tv_sec = wait / 1000;
+    t.tv_usec = ( wait % 1000 ) * 1000;
+
     /*Check status on erery sockets on bonjour query */
     FD_ZERO(&readfds);
     FD_SET(mDNS_fd, &readfds);
     select(mDNS_fd+1, &readfds, NULL, NULL, &t);
-    
-    /*Read data from udp and send data back */ 
+
+    /*Read data from udp and send data back */
     if (FD_ISSET(mDNS_fd, &readfds)) {
-      con = recvfrom(mDNS_fd, buf, 1500, 0, &addr, &addrLen); 
+      addrLen = sizeof(addr);
+      con = recvfrom(mDNS_fd, buf, 1500, 0, &addr, &addrLen);
       mico_rtos_lock_mutex( &bonjour_mutex );
-      mfi_mdns_handler(mDNS_fd, (uint8_t *)buf, con);
+      mfi_mdns_handler(mDNS_fd, (uint8_t *)buf, con, &addr);
       mico_rtos_unlock_mutex( &bonjour_mutex );
     }
   }
@@ -685,6 +1272,3 @@ exit:
   if(buf) free(buf);
   mico_rtos_delete_thread(NULL);
 }
-
-
-
@@ -85,6 +85,16 @@ typedef enum
 
 #define RR_CACHE_FLUSH   0x8000
 
+/* Services that bonjour_service_init() and bonjour_add_service() register */
+#ifndef kBonjourMaxServices
+#define kBonjourMaxServices     4
+#endif
+
+/* Subtypes of each service, bonjour_add_service_subtype() */
+#ifndef kBonjourMaxSubtypes
+#define kBonjourMaxSubtypes     4
+#endif
+
 /**************************************************************************************************************
  * STRUCTURES
  **************************************************************************************************************/
@@ -139,10 +149,56 @@ typedef struct
   WiFi_Interface interface;
 } bonjour_init_t;
 
+typedef struct
+{
+  uint32_t packets;         //! mDNS packets received
+  uint32_t questions;       //! Questions of the queries
+  uint32_t answers;         //! Records sent
+  uint32_t responses;       //! Messages sent, a message holds every answer that fits
+  uint32_t unicast_answers; //! Records sent to the querier only, part of answers
+  uint32_t known_answers;   //! Answers not sent, the querier listed them as known
+  uint32_t duplicate_answers; //! Answers not sent, another responder sent them first
+  uint32_t rate_limited;    //! Answers not sent, they were multicast less than a second ago
+  uint32_t aggregated;      //! Queries answered by the delayed response of an earlier one
+} bonjour_stats_t;
+
+/* Register the service init.service_name of the host init.host_name, and drop
+ * the services registered before.
+ */
 void bonjour_service_init(bonjour_init_t init);
 
+/* Register one more service of the host named by bonjour_service_init(), the
+ * host_name and interface of init are not used.
+ */
+OSStatus bonjour_add_service(bonjour_init_t init);
+
+/* Register the subtype "_printer" of service_name "_ipp._tcp.local." as
+ * "_printer._sub._ipp._tcp.local.".
+ */
+OSStatus bonjour_add_service_subtype(char *service_name, char *subtype);
+
+/* TXT record of the service registered by bonjour_service_init() */
 void bonjour_update_txt_record(char *txt_record);
 
+OSStatus bonjour_update_service_txt_record(char *service_name, char *txt_record);
+
+/* Answer the mDNS packet pkt received on the socket fd from the address from,
+ * NULL for a multicast querier, the bonjour thread calls it with the responder
+ * locked. Answers that the querier knows, or that were multicast less than a
+ * second ago, are not sent. Records of more than one host, such as the PTR
+ * records, are sent 20 to 120 ms later with those of the queries received in
+ * between, see mfi_bonjour_send_pending(). A question asking for a unicast
+ * response, or a query that is not from port 5353, is answered to its source.
+ */
+void mfi_mdns_handler(int fd, uint8_t* pkt, int pkt_len, struct sockaddr_t* from);
+
+/* Send the delayed answers once they are due. Returns the ms until they are,
+ * MICO_WAIT_FOREVER if there are none.
+ */
+uint32_t mfi_bonjour_send_pending(int fd);
+
+void bonjour_get_stats(bonjour_stats_t *stats);
+
 int start_bonjour_service(void);
 
 void suspend_bonjour_service(bool state);
@@ -0,0 +1,430 @@
+/**
+  ******************************************************************************
+  * @file    OTAUtils.c
+  * @author  William Xu
+  * @version V1.0.0
+  * @date    17-Oct-2026
+  * @brief   This file contains a streaming OTA sink: lazy sector erase and
+  *          incremental MD5/SHA-256 of the received image
+  ******************************************************************************
+  * @attention
+  *
+  * THE PRESENT FIRMWARE WHICH IS FOR GUIDANCE ONLY AIMS AT PROVIDING CUSTOMERS
+  * WITH CODING INFORMATION REGARDING THEIR PRODUCTS IN ORDER FOR THEM TO SAVE
+  * TIME. AS A RESULT, MXCHIP Inc. SHALL NOT BE HELD LIABLE FOR ANY
+  * DIRECT, INDIRECT OR CONSEQUENTIAL DAMAGES WITH RESPECT TO ANY CLAIMS ARISING
+  * FROM THE CONTENT OF SUCH FIRMWARE AND/OR THE USE MADE BY CUSTOMERS OF THE
+  * CODING INFORMATION CONTAINED HEREIN IN CONNECTION WITH THEIR PRODUCTS.
+  *
+  * <h2><center>&copy; COPYRIGHT 2014 MXCHIP Inc.</center></h2>
+  ******************************************************************************
+  */
+
+#include "OTAUtils.h"
+#include "Debug.h"
+#include <stddef.h>
+
+#define ota_log(M, ...) custom_log("OTA", M, ##__VA_ARGS__)
+#define ota_log_trace() custom_log_trace("OTA")
+
+#define kOTASessionSlotSize           ( ( sizeof( ota_session_t ) + 3 ) & ~3 )
+
+#ifdef OTA_SESSION_START_ADDRESS
+/* The area is used as two halves: records are appended to one, when it is
+ * full the other is erased and takes the next record, so the current record
+ * survives a reset during the erase.
+ */
+#define kOTASessionHalfSize           ( ( OTA_SESSION_END_ADDRESS - OTA_SESSION_START_ADDRESS + 1 ) / 2 )
+#define kOTASessionSlotsPerHalf       ( kOTASessionHalfSize / kOTASessionSlotSize )
+#define _session_half_start( half )   ( OTA_SESSION_START_ADDRESS + ( half ) * kOTASessionHalfSize )
+#endif
+
+/* One session in the system, _session is a copy of the current record */
+static ota_session_t  _session;
+static bool           _sessionLoaded = false;
+#ifdef OTA_SESSION_START_ADDRESS
+static uint32_t       _sessionHalf = 1;           // Half that holds the current record
+static uint32_t       _sessionWriteAddress = 0;   // Next blank slot in it, 0: erase the other half first
+#endif
+
+static uint32_t _crc32( const uint8_t *data, size_t len )
+{
+  uint32_t crc = 0xFFFFFFFF;
+  int bit;
+
+  while( len-- ){
+    crc ^= *data++;
+    for( bit = 0; bit < 8; bit++ )
+      crc = ( crc >> 1 ) ^ ( 0xEDB88320 & ( 0 - ( crc & 1 ) ) );
+  }
+  return ~crc;
+}
+
+static bool _session_is_valid( const ota_session_t *session )
+{
+  return session->magic == kOTASessionMagic &&
+         session->crc == _crc32( (const uint8_t *)session, offsetof( ota_session_t, crc ) );
+}
+
+#ifdef OTA_SESSION_START_ADDRESS
+static bool _session_slot_is_blank( const ota_session_t *slot )
+{
+  const uint8_t *p = (const uint8_t *)slot;
+  size_t i;
+
+  for( i = 0; i < sizeof( ota_session_t ); i++ )
+    if( p[i] != 0xFF ) return false;
+  return true;
+}
+#endif
+
+/* Find the current record, the flash is only read once after reset */
+static void _session_load( void )
+{
+#ifdef OTA_SESSION_START_ADDRESS
+  ota_session_t record;
+  volatile uint32_t address;
+  uint32_t half, slot, slotAddress, current = 0;
+  bool found = false;
+#endif
+
+  if( _sessionLoaded == true ) return;
+  memset( &_session, 0, sizeof( ota_session_t ) );
+
+#ifdef OTA_SESSION_START_ADDRESS
+  // Left initialized afterwards, like platform_init() does with the SPI flash
+  if( MicoFlashInitialize( MICO_FLASH_FOR_OTA_SESSION ) != kNoErr ) return;
+
+  for( half = 0; half < 2; half++ ){
+    for( slot = 0; slot < kOTASessionSlotsPerHalf; slot++ ){
+      address = _session_half_start( half ) + slot * kOTASessionSlotSize;
+      if( MicoFlashRead( MICO_FLASH_FOR_OTA_SESSION, &address, (uint8_t *)&record, sizeof( ota_session_t ) ) != kNoErr )
+        return;
+      if( _session_is_valid( &record ) == false ) continue;
+      if( found == false || record.sequence > _session.sequence ){
+        memcpy( &_session, &record, sizeof( ota_session_t ) );
+        _sessionHalf = half;
+        current = slot;
+        found = true;
+      }
+    }
+  }
+
+  // A reset while a record was written leaves a slot that is neither valid nor blank
+  _sessionWriteAddress = 0;
+  for( slot = current + 1; found == true && slot < kOTASessionSlotsPerHalf; slot++ ){
+    slotAddress = _session_half_start( _sessionHalf ) + slot * kOTASessionSlotSize;
+    address = slotAddress;
+    if( MicoFlashRead( MICO_FLASH_FOR_OTA_SESSION, &address, (uint8_t *)&record, sizeof( ota_session_t ) ) != kNoErr )
+      return;
+    if( _session_slot_is_blank( &record ) ){
+      _sessionWriteAddress = slotAddress;
+      break;
+    }
+  }
+#endif
+
+  _sessionLoaded = true;
+}
+
+/* image NULL saves a record that has no image */
+static OSStatus _session_save( const ota_image_id_t *image, uint32_t offset, uint32_t digests,
+                               const md5_context *md5, const SHA256Context *sha256 )
+{
+  OSStatus err = kNoErr;
+  ota_session_t record;
+#ifdef OTA_SESSION_START_ADDRESS
+  volatile uint32_t address;
+  uint32_t half;
+#endif
+
+  memset( &record, 0, sizeof( ota_session_t ) );
+  record.magic = kOTASessionMagic;
+  record.sequence = _session.sequence + 1;
+  if( image ){
+    memcpy( &record.image, image, sizeof( ota_image_id_t ) );
+    record.offset = offset;
+    record.digests = digests;
+    memcpy( &record.md5, md5, sizeof( md5_context ) );
+    memcpy( &record.sha256, sha256, sizeof( SHA256Context ) );
+  }
+  record.crc = _crc32( (const uint8_t *)&record, offsetof( ota_session_t, crc ) );
+
+#ifdef OTA_SESSION_START_ADDRESS
+  err = MicoFlashInitialize( MICO_FLASH_FOR_OTA_SESSION );
+  require_noerr( err, exit );
+
+  if( _sessionWriteAddress == 0 ){
+    half = 1 - _sessionHalf;
+    err = MicoFlashErase( MICO_FLASH_FOR_OTA_SESSION, _session_half_start( half ),
+                          _session_half_start( half ) + kOTASessionHalfSize - 1 );
+    require_noerr( err, exit );
+    _sessionHalf = half;
+    _sessionWriteAddress = _session_half_start( half );
+  }
+
+  address = _sessionWriteAddress;
+  err = MicoFlashWrite( MICO_FLASH_FOR_OTA_SESSION, &address, (uint8_t *)&record, sizeof( ota_session_t ) );
+  // The slot is used even if the write failed, it is not blank any more
+  _sessionWriteAddress += kOTASessionSlotSize;
+  if( _sessionWriteAddress + kOTASessionSlotSize > _session_half_start( _sessionHalf ) + kOTASessionHalfSize )
+    _sessionWriteAddress = 0;
+  require_noerr( err, exit );
+#endif
+
+  memcpy( &_session, &record, sizeof( ota_session_t ) );
+
+#ifdef OTA_SESSION_START_ADDRESS
+exit:
+#endif
+  return err;
+}
+
+static uint32_t _session_interval( ota_sink_t *sink )
+{
+  return ( kOTASessionInterval + sink->sectorSize - 1 ) / sink->sectorSize * sink->sectorSize;
+}
+
+/* Erase from erasedEnd up to and including the sector that holds lastAddress */
+static OSStatus _erase_through( ota_sink_t *sink, uint32_t lastAddress )
+{
+  OSStatus err = kNoErr;
+  uint32_t start = mico_get_time();
+  uint32_t sectorEnd;
+
+  while( sink->erasedEnd <= lastAddress ){
+    sectorEnd = sink->erasedEnd + sink->sectorSize - 1;
+    if( sectorEnd > sink->endAddress ) sectorEnd = sink->endAddress;
+    err = MicoFlashErase( sink->flash, sink->erasedEnd, sectorEnd );
+    require_noerr( err, exit );
+    sink->erasedEnd = sectorEnd + 1;
+    sink->statistics.sectorsErased++;
+  }
+
+exit:
+  sink->statistics.eraseTime += mico_get_time() - start;
+  return err;
+}
+
+static OSStatus _sink_open( ota_sink_t *sink, mico_flash_t flash, uint32_t startAddress, uint32_t endAddress,
+                            uint32_t sectorSize, uint32_t digests )
+{
+  OSStatus err = kParamErr;
+
+  require( sink, exit );
+  require( endAddress >= startAddress && endAddress != 0xFFFFFFFF, exit );
+  require( sectorSize == 0 || startAddress % sectorSize == 0, exit );
+
+  memset( sink, 0, sizeof( ota_sink_t ) );
+  sink->flash = flash;
+  sink->startAddress = startAddress;
+  sink->endAddress = endAddress;
+  sink->sectorSize = sectorSize;
+  sink->writeAddress = startAddress;
+  sink->erasedEnd = startAddress;
+  sink->digests = digests;
+  sink->statistics.startTime = mico_get_time();
+  sink->statistics.lastWriteTime = sink->statistics.startTime;
+
+  if( digests & kOTADigest_MD5 )
+    InitMd5( &sink->md5 );
+  if( digests & kOTADigest_SHA256 )
+    SHA256Reset( &sink->sha256 );
+
+  err = MicoFlashInitialize( flash );
+  require_noerr( err, exit );
+  sink->isOpen = true;
+
+  // The sector layout is unknown, erase everything now like before
+  if( sectorSize == 0 ){
+    sink->sectorSize = endAddress - startAddress + 1;
+    err = _erase_through( sink, endAddress );
+    require_noerr_action( err, exit, OTASinkAbort( sink ) );
+  }
+
+exit:
+  return err;
+}
+
+OSStatus OTASinkOpen( ota_sink_t *sink, mico_flash_t flash, uint32_t startAddress, uint32_t endAddress,
+                      uint32_t sectorSize, uint32_t digests )
+{
+  OSStatus err;
+
+  // Before the update area is touched, the saved session would not describe it any more
+  err = OTASessionClear( );
+  require_noerr( err, exit );
+  err = _sink_open( sink, flash, startAddress, endAddress, sectorSize, digests );
+
+exit:
+  return err;
+}
+
+OSStatus OTASinkOpenSession( ota_sink_t *sink, mico_flash_t flash, uint32_t startAddress, uint32_t endAddress,
+                             uint32_t sectorSize, uint32_t digests, const ota_image_id_t *image, uint32_t *outOffset )
+{
+  OSStatus err = kParamErr;
+  uint32_t offset = 0;
+
+  require( sink && image && image->length > 0 && outOffset && sectorSize != 0, exit );
+  err = _sink_open( sink, flash, startAddress, endAddress, sectorSize, digests );
+  require_noerr( err, exit );
+  require_action( image->length - 1 <= endAddress - startAddress, exit, OTASinkAbort( sink ); err = kNoSpaceErr );
+
+  sink->hasSession = true;
+  memcpy( &sink->image, image, sizeof( ota_image_id_t ) );
+
+  _session_load( );
+  if( _session.image.length == image->length && memcmp( _session.image.md5, image->md5, 16 ) == 0 &&
+      ( _session.digests & digests ) == digests && _session.offset % sectorSize == 0 && _session.offset <= image->length ){
+    offset = _session.offset;
+    memcpy( &sink->md5, &_session.md5, sizeof( md5_context ) );
+    memcpy( &sink->sha256, &_session.sha256, sizeof( SHA256Context ) );
+    ota_log( "Resume the image at %u of %u bytes", (unsigned int)offset, (unsigned int)image->length );
+  }else{
+    // Nothing is erased yet, the saved session of another image is replaced first
+    err = _session_save( image, 0, digests, &sink->md5, &sink->sha256 );
+    require_noerr_action( err, exit, OTASinkAbort( sink ) );
+  }
+
+  // The sectors after offset may hold bytes written after the record was saved
+  sink->writeAddress = startAddress + offset;
+  sink->erasedEnd = startAddress + offset;
+  sink->nextCheckpoint = sink->writeAddress + _session_interval( sink );
+  *outOffset = offset;
+
+exit:
+  return err;
+}
+
+uint32_t OTASessionGetOffset( const ota_image_id_t *image )
+{
+  _session_load( );
+  if( image && image->length > 0 && _session.image.length == image->length &&
+      memcmp( _session.image.md5, image->md5, 16 ) == 0 )
+    return _session.offset;
+  return 0;
+}
+
+OSStatus OTASessionClear( void )
+{
+  _session_load( );
+  if( _session.image.length == 0 ) return kNoErr;
+  return _session_save( NULL, 0, 0, NULL, NULL );
+}
+
+static OSStatus _sink_write( ota_sink_t *sink, const uint8_t *inData, size_t inLen )
+{
+  OSStatus err = kNoErr;
+  uint32_t start;
+
+  if( sink->erasedEnd <= sink->writeAddress + inLen - 1 ){
+    err = _erase_through( sink, sink->writeAddress + inLen - 1 );
+    require_noerr( err, exit );
+  }
+
+  start = mico_get_time();
+  err = MicoFlashWrite( sink->flash, &sink->writeAddress, (uint8_t *)inData, inLen );
+  sink->statistics.writeTime += mico_get_time() - start;
+  require_noerr( err, exit );
+
+  if( sink->digests & kOTADigest_MD5 )
+    Md5Update( &sink->md5, (unsigned char *)inData, (int)inLen );
+  if( sink->digests & kOTADigest_SHA256 )
+    SHA256Input( &sink->sha256, inData, (unsigned int)inLen );
+
+  sink->statistics.bytesWritten += inLen;
+  sink->statistics.lastWriteTime = mico_get_time();
+
+exit:
+  return err;
+}
+
+OSStatus OTASinkWrite( ota_sink_t *sink, const uint8_t *inData, size_t inLen )
+{
+  OSStatus err = kParamErr;
+  size_t len;
+
+  require( sink, exit );
+  require( inData || inLen == 0, exit );
+  require_action( sink->isOpen, exit, err = kStateErr );
+  err = kNoErr;
+  if( inLen == 0 ) goto exit;
+
+  require_action( inLen <= sink->endAddress + 1 - sink->writeAddress, exit, err = kNoSpaceErr );
+
+  // A record is saved right at a checkpoint, with the digests of the bytes before it
+  while( inLen > 0 ){
+    len = inLen;
+    if( sink->hasSession == true && len > sink->nextCheckpoint - sink->writeAddress )
+      len = sink->nextCheckpoint - sink->writeAddress;
+    err = _sink_write( sink, inData, len );
+    require_noerr( err, exit );
+    inData += len;
+    inLen -= len;
+
+    if( sink->hasSession == true && sink->writeAddress == sink->nextCheckpoint ){
+      // The previous record still describes the image, only the progress since then is lost
+      if( _session_save( &sink->image, sink->writeAddress - sink->startAddress, sink->digests, &sink->md5, &sink->sha256 ) != kNoErr )
+        ota_log( "WARNING: Cannot save the OTA session" );
+      sink->nextCheckpoint += _session_interval( sink );
+    }
+  }
+
+exit:
+  return err;
+}
+
+OSStatus OTASinkFinish( ota_sink_t *sink, const uint8_t *expectedMD5, const uint8_t *expectedSHA256 )
+{
+  OSStatus err = kParamErr;
+  uint32_t elapsed;
+
+  require( sink, exit );
+  require_action( sink->isOpen, exit, err = kStateErr );
+  require( expectedMD5 == NULL || ( sink->digests & kOTADigest_MD5 ), exit );
+  require( expectedSHA256 == NULL || ( sink->digests & kOTADigest_SHA256 ), exit );
+
+  if( sink->digests & kOTADigest_MD5 )
+    Md5Final( &sink->md5, sink->md5Digest );
+  if( sink->digests & kOTADigest_SHA256 )
+    SHA256Result( &sink->sha256, sink->sha256Digest );
+  // Complete or corrupt, the image is not resumed any more
+  if( sink->hasSession == true )
+    OTASessionClear( );
+  OTASinkAbort( sink );
+
+  elapsed = sink->statistics.lastWriteTime - sink->statistics.startTime;
+  ota_log( "%u bytes in %u ms, %u sectors erased in %u ms, written in %u ms",
+           (unsigned int)sink->statistics.bytesWritten, (unsigned int)elapsed,
+           (unsigned int)sink->statistics.sectorsErased, (unsigned int)sink->statistics.eraseTime,
+           (unsigned int)sink->statistics.writeTime );
+
+  err = kChecksumErr;
+  require_action( expectedMD5 == NULL || memcmp( expectedMD5, sink->md5Digest, 16 ) == 0, exit,
+                  ota_log( "ERROR: MD5 of the image does not match" ) );
+  require_action( expectedSHA256 == NULL || memcmp( expectedSHA256, sink->sha256Digest, SHA256HashSize ) == 0, exit,
+                  ota_log( "ERROR: SHA-256 of the image does not match" ) );
+  err = kNoErr;
+
+exit:
+  return err;
+}
+
+void OTASinkAbort( ota_sink_t *sink )
+{
+  if( sink && sink->isOpen ){
+    MicoFlashFinalize( sink->flash );
+    sink->isOpen = false;
+  }
+}
+
+uint32_t OTASinkLength( ota_sink_t *sink )
+{
+  return sink->writeAddress - sink->startAddress;
+}
+
+void OTASinkGetStatistics( ota_sink_t *sink, ota_sink_statistics_t *outStatistics )
+{
+  memcpy( outStatistics, &sink->statistics, sizeof( ota_sink_statistics_t ) );
+}
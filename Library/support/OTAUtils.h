@@ -0,0 +1,142 @@
+/**
+  ******************************************************************************
+  * @file    OTAUtils.h
+  * @author  William Xu
+  * @version V1.0.0
+  * @date    17-Oct-2026
+  * @brief   This header contains function prototypes of a streaming OTA sink,
+  *          it writes an image to flash as it is received
+  ******************************************************************************
+  * @attention
+  *
+  * THE PRESENT FIRMWARE WHICH IS FOR GUIDANCE ONLY AIMS AT PROVIDING CUSTOMERS
+  * WITH CODING INFORMATION REGARDING THEIR PRODUCTS IN ORDER FOR THEM TO SAVE
+  * TIME. AS A RESULT, MXCHIP Inc. SHALL NOT BE HELD LIABLE FOR ANY
+  * DIRECT, INDIRECT OR CONSEQUENTIAL DAMAGES WITH RESPECT TO ANY CLAIMS ARISING
+  * FROM THE CONTENT OF SUCH FIRMWARE AND/OR THE USE MADE BY CUSTOMERS OF THE
+  * CODING INFORMATION CONTAINED HEREIN IN CONNECTION WITH THEIR PRODUCTS.
+  *
+  * <h2><center>&copy; COPYRIGHT 2014 MXCHIP Inc.</center></h2>
+  ******************************************************************************
+  */
+
+#ifndef __OTAUtils_h__
+#define __OTAUtils_h__
+
+#include "Common.h"
+#include "MICO.h"
+#include "MicoPlatform.h"
+#include "platform_common_config.h"
+#include "SHAUtils/sha.h"
+
+/* A sector is erased only when the write cursor reaches it, so the receiver
+ * never stalls for the erase of the whole update area. The digests are
+ * updated with every write, OTASinkFinish() compares them with the expected
+ * ones before the caller touches the boot table.
+ *
+ * A sink opened by OTASinkOpenSession() saves a session record every
+ * kOTASessionInterval bytes: the image identity, the offset and the digest
+ * states at that offset. A transfer of the same image that stops, because the
+ * connection or the power is lost, resumes from the last record instead of
+ * from the start. Records are appended to the OTA_SESSION area when the
+ * platform has one, otherwise they only live until the next reset. There is
+ * one session, opening a sink for another image discards it.
+ */
+
+#define kOTADigest_MD5                (1<<0)
+#define kOTADigest_SHA256             (1<<1)
+
+#ifdef UPDATE_SECTOR_SIZE
+#define kOTAUpdateSectorSize          UPDATE_SECTOR_SIZE
+#else
+#define kOTAUpdateSectorSize          0       /**< Unknown, the update area is erased at once */
+#endif
+
+/* Rounded up to whole sectors: the sectors after a record are erased again
+ * when the transfer resumes, so a byte is never programmed twice.
+ */
+#define kOTASessionInterval           0x4000  /**< Image bytes between two session records */
+#define kOTASessionMagic              0x4F544153
+
+/* Identifies the image of a session, a resumed transfer has to name the same */
+typedef struct {
+  uint32_t  length;             //! Of the whole image, 0: no image.
+  uint8_t   md5[ 16 ];          //! Expected MD5 of the whole image.
+} ota_image_id_t;
+
+typedef struct {
+  uint32_t        magic;
+  uint32_t        sequence;     //! The valid record with the highest sequence is the current one.
+  ota_image_id_t  image;
+  uint32_t        offset;       //! Image bytes in flash, a multiple of the sector size.
+  uint32_t        digests;
+  md5_context     md5;          //! Digest states after offset bytes.
+  SHA256Context   sha256;
+  uint32_t        crc;          //! CRC-32 of the fields above.
+} ota_session_t;
+
+typedef struct {
+  uint32_t  bytesWritten;
+  uint32_t  sectorsErased;
+  uint32_t  eraseTime;          //! Spent in MicoFlashErase(), in ms.
+  uint32_t  writeTime;          //! Spent in MicoFlashWrite(), in ms.
+  uint32_t  startTime;          //! mico_get_time() of OTASinkOpen().
+  uint32_t  lastWriteTime;      //! mico_get_time() of the last OTASinkWrite().
+} ota_sink_statistics_t;
+
+typedef struct {
+  mico_flash_t            flash;
+  uint32_t                startAddress;
+  uint32_t                endAddress;         //! Last byte of the update area.
+  uint32_t                sectorSize;         //! 0: the whole area is erased by OTASinkOpen().
+  volatile uint32_t       writeAddress;
+  uint32_t                erasedEnd;          //! First address that is not erased yet.
+  bool                    isOpen;
+  uint32_t                digests;
+  md5_context             md5;
+  SHA256Context           sha256;
+  uint8_t                 md5Digest[ 16 ];    //! Valid after OTASinkFinish().
+  uint8_t                 sha256Digest[ SHA256HashSize ];
+  ota_sink_statistics_t   statistics;
+  bool                    hasSession;         //! Opened by OTASinkOpenSession().
+  ota_image_id_t          image;
+  uint32_t                nextCheckpoint;     //! Address where the next session record is saved.
+} ota_sink_t;
+
+/* Prepare the update area from startAddress to endAddress. startAddress must
+ * be sector aligned, digests is a combination of kOTADigest_xxx.
+ */
+OSStatus OTASinkOpen( ota_sink_t *sink, mico_flash_t flash, uint32_t startAddress, uint32_t endAddress,
+                      uint32_t sectorSize, uint32_t digests );
+
+/* Like OTASinkOpen(), and the progress of image is saved. If the saved session
+ * belongs to image, the sink continues after it, outOffset tells how many bytes
+ * of the image are already in flash. sectorSize must not be 0.
+ */
+OSStatus OTASinkOpenSession( ota_sink_t *sink, mico_flash_t flash, uint32_t startAddress, uint32_t endAddress,
+                             uint32_t sectorSize, uint32_t digests, const ota_image_id_t *image, uint32_t *outOffset );
+
+/* Bytes of image that a transfer does not need to send again, 0 if the saved
+ * session belongs to another image.
+ */
+uint32_t OTASessionGetOffset( const ota_image_id_t *image );
+
+/* Forget the saved session, OTASinkFinish() does it for its image */
+OSStatus OTASessionClear( void );
+
+/* Append data to the image, kNoSpaceErr if it does not fit the update area */
+OSStatus OTASinkWrite( ota_sink_t *sink, const uint8_t *inData, size_t inLen );
+
+/* Complete the digests and close the flash. expectedMD5 and expectedSHA256 can
+ * be NULL, kChecksumErr if a given one does not match the image.
+ */
+OSStatus OTASinkFinish( ota_sink_t *sink, const uint8_t *expectedMD5, const uint8_t *expectedSHA256 );
+
+/* Close the flash, the image is left incomplete */
+void OTASinkAbort( ota_sink_t *sink );
+
+uint32_t OTASinkLength( ota_sink_t *sink );
+
+void OTASinkGetStatistics( ota_sink_t *sink, ota_sink_statistics_t *outStatistics );
+
+#endif // __OTAUtils_h__
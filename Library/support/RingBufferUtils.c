@@ -26,6 +26,38 @@
 #define ring_buffer_utils_log(M, ...) custom_log("RingBufferUtils", M, ##__VA_ARGS__)
 #define ring_buffer_utils_log_trace() custom_log_trace("RingBufferUtils")
 
+/* Acquire/release access to the counters shared by the SPSC ring producer and
+   consumer. The MCUs are single core, so ISR and thread contexts only need the
+   compiler not to move data accesses across the counter access. */
+#if defined ( __GNUC__ )
+#define spsc_load_acquire( p )        __atomic_load_n( (p), __ATOMIC_ACQUIRE )
+#define spsc_store_release( p, v )    __atomic_store_n( (p), (v), __ATOMIC_RELEASE )
+#else
+#if defined ( __IAR_SYSTEMS_ICC__ )
+#include <intrinsics.h>
+#define spsc_barrier()                __DMB()
+#elif defined ( __CC_ARM )
+#define spsc_barrier()                __dmb( 0xF )
+#endif
+static inline uint32_t spsc_load_acquire( volatile uint32_t* p )
+{
+  uint32_t value = *p;
+  spsc_barrier();
+  return value;
+}
+static inline void spsc_store_release( volatile uint32_t* p, uint32_t value )
+{
+  spsc_barrier();
+  *p = value;
+}
+#endif
+
+/* Index arithmetic never exceeds twice the size, a compare replaces the division */
+static inline uint32_t ring_buffer_wrap( ring_buffer_t* ring_buffer, uint32_t index )
+{
+  return ( index >= ring_buffer->size ) ? index - ring_buffer->size : index;
+}
+
 OSStatus ring_buffer_init( ring_buffer_t* ring_buffer, uint8_t* buffer, uint32_t size )
 {
     ring_buffer->buffer     = (uint8_t*)buffer;
@@ -44,13 +76,13 @@ OSStatus ring_buffer_deinit( ring_buffer_t* ring_buffer )
 uint32_t ring_buffer_free_space( ring_buffer_t* ring_buffer )
 {
   uint32_t tail_to_end = ring_buffer->size - ring_buffer->tail;
-  return ((tail_to_end + ring_buffer->head) % ring_buffer->size);
+  return ring_buffer_wrap( ring_buffer, tail_to_end + ring_buffer->head );
 }
 
 uint32_t ring_buffer_used_space( ring_buffer_t* ring_buffer )
 {
   uint32_t head_to_end = ring_buffer->size - ring_buffer->head;
-  return ((head_to_end + ring_buffer->tail) % ring_buffer->size);
+  return ring_buffer_wrap( ring_buffer, head_to_end + ring_buffer->tail );
 }
 
 uint8_t ring_buffer_get_data( ring_buffer_t* ring_buffer, uint8_t** data, uint32_t* contiguous_bytes )
@@ -59,13 +91,13 @@ uint8_t ring_buffer_get_data( ring_buffer_t* ring_buffer, uint8_t** data, uint32
   
   *data = &(ring_buffer->buffer[ring_buffer->head]);
   
-  *contiguous_bytes = MIN(head_to_end, (head_to_end + ring_buffer->tail) % ring_buffer->size);
+  *contiguous_bytes = MIN(head_to_end, ring_buffer_wrap( ring_buffer, head_to_end + ring_buffer->tail ));
   return 0;
 }
 
 uint8_t ring_buffer_consume( ring_buffer_t* ring_buffer, uint32_t bytes_consumed )
 {
-  ring_buffer->head = (ring_buffer->head + bytes_consumed) % ring_buffer->size;
+  ring_buffer->head = ring_buffer_wrap( ring_buffer, ring_buffer->head + bytes_consumed );
   return 0;
 }
 
@@ -74,7 +106,7 @@ uint32_t ring_buffer_write( ring_buffer_t* ring_buffer, const uint8_t* data, uin
   uint32_t tail_to_end = ring_buffer->size - ring_buffer->tail;
   
   /* Calculate the maximum amount we can copy */
-  uint32_t amount_to_copy = MIN(data_length, (ring_buffer->tail == ring_buffer->head) ? ring_buffer->size : (tail_to_end + ring_buffer->head) % ring_buffer->size);
+  uint32_t amount_to_copy = MIN(data_length, (ring_buffer->tail == ring_buffer->head) ? ring_buffer->size : ring_buffer_wrap( ring_buffer, tail_to_end + ring_buffer->head ));
   
   /* Copy as much as we can until we fall off the end of the buffer */
   memcpy(&ring_buffer->buffer[ring_buffer->tail], data, MIN(amount_to_copy, tail_to_end));
@@ -86,7 +118,112 @@ uint32_t ring_buffer_write( ring_buffer_t* ring_buffer, const uint8_t* data, uin
   }
   
   /* Update the tail */
-  ring_buffer->tail = (ring_buffer->tail + amount_to_copy) % ring_buffer->size;
+  ring_buffer->tail = ring_buffer_wrap( ring_buffer, ring_buffer->tail + amount_to_copy );
   
   return amount_to_copy;
 }
+
+OSStatus spsc_ring_init( spsc_ring_t* ring, uint8_t* buffer, uint32_t size )
+{
+  if ( size == 0 || ( size & ( size - 1 ) ) != 0 )
+  {
+    ring_buffer_utils_log("SPSC ring size %u is not a power of two", (unsigned int)size);
+    return kParamErr;
+  }
+  ring->buffer = buffer;
+  ring->mask   = size - 1;
+  ring->head   = 0;
+  ring->tail   = 0;
+  return kNoErr;
+}
+
+uint32_t spsc_ring_used_space( spsc_ring_t* ring )
+{
+  return spsc_load_acquire( &ring->tail ) - spsc_load_acquire( &ring->head );
+}
+
+uint32_t spsc_ring_free_space( spsc_ring_t* ring )
+{
+  return ring->mask + 1 - spsc_ring_used_space( ring );
+}
+
+/* Splits length bytes from counter position into the part before the end of
+   the buffer and the part wrapped to the front */
+static uint32_t spsc_ring_spans( spsc_ring_t* ring, uint32_t position, uint32_t length, ring_buffer_span_t spans[2] )
+{
+  uint32_t index = position & ring->mask;
+  uint32_t to_end = ring->mask + 1 - index;
+
+  spans[0].data   = &ring->buffer[index];
+  spans[0].length = MIN( length, to_end );
+  spans[1].data   = ring->buffer;
+  spans[1].length = length - spans[0].length;
+  return length;
+}
+
+uint32_t spsc_ring_reserve( spsc_ring_t* ring, ring_buffer_span_t spans[2] )
+{
+  uint32_t tail = ring->tail;
+  uint32_t free_space = ring->mask + 1 - ( tail - spsc_load_acquire( &ring->head ) );
+
+  return spsc_ring_spans( ring, tail, free_space, spans );
+}
+
+OSStatus spsc_ring_publish( spsc_ring_t* ring, uint32_t bytes_written )
+{
+  uint32_t tail = ring->tail;
+
+  if ( bytes_written > ring->mask + 1 - ( tail - spsc_load_acquire( &ring->head ) ) )
+    return kParamErr;
+  spsc_store_release( &ring->tail, tail + bytes_written );
+  return kNoErr;
+}
+
+uint32_t spsc_ring_write( spsc_ring_t* ring, const uint8_t* data, uint32_t data_length )
+{
+  uint32_t tail = ring->tail;
+  uint32_t index = tail & ring->mask;
+  uint32_t amount_to_copy = MIN( data_length, ring->mask + 1 - ( tail - spsc_load_acquire( &ring->head ) ) );
+  uint32_t first = MIN( amount_to_copy, ring->mask + 1 - index );
+
+  memcpy( &ring->buffer[index], data, first );
+  if ( amount_to_copy > first )
+  {
+    memcpy( ring->buffer, data + first, amount_to_copy - first );
+  }
+  spsc_store_release( &ring->tail, tail + amount_to_copy );
+  return amount_to_copy;
+}
+
+uint32_t spsc_ring_peek( spsc_ring_t* ring, ring_buffer_span_t spans[2] )
+{
+  uint32_t head = ring->head;
+
+  return spsc_ring_spans( ring, head, spsc_load_acquire( &ring->tail ) - head, spans );
+}
+
+OSStatus spsc_ring_commit( spsc_ring_t* ring, uint32_t bytes_consumed )
+{
+  uint32_t head = ring->head;
+
+  if ( bytes_consumed > spsc_load_acquire( &ring->tail ) - head )
+    return kParamErr;
+  spsc_store_release( &ring->head, head + bytes_consumed );
+  return kNoErr;
+}
+
+uint32_t spsc_ring_read( spsc_ring_t* ring, uint8_t* data, uint32_t data_length )
+{
+  uint32_t head = ring->head;
+  uint32_t index = head & ring->mask;
+  uint32_t amount_to_copy = MIN( data_length, spsc_load_acquire( &ring->tail ) - head );
+  uint32_t first = MIN( amount_to_copy, ring->mask + 1 - index );
+
+  memcpy( data, &ring->buffer[index], first );
+  if ( amount_to_copy > first )
+  {
+    memcpy( data + first, ring->buffer, amount_to_copy - first );
+  }
+  spsc_store_release( &ring->head, head + amount_to_copy );
+  return amount_to_copy;
+}
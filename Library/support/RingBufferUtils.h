@@ -51,6 +51,53 @@ uint8_t ring_buffer_consume( ring_buffer_t* ring_buffer, uint32_t bytes_consumed
 
 uint32_t ring_buffer_write( ring_buffer_t* ring_buffer, const uint8_t* data, uint32_t data_length );
 
+/* Lock-free single producer/single consumer ring buffer.
+ *
+ * The size must be a power of two. head and tail are free running counters
+ * masked on access, so every byte of the buffer is usable and no division is
+ * needed. One context may produce (e.g. an ISR) while another one consumes,
+ * without a lock: each side only writes its own counter, the counter is
+ * published with release semantics after the data and read with acquire
+ * semantics before the data.
+ *
+ * spsc_ring_peek()/spsc_ring_commit() hand the readable bytes out in place,
+ * as up to two contiguous spans (before and after the buffer wraps), and
+ * spsc_ring_reserve()/spsc_ring_publish() do the same for the writable bytes.
+ */
+typedef struct
+{
+  uint32_t            mask;   /**< size - 1 */
+  volatile uint32_t   head;   /**< Bytes consumed, written by the consumer only */
+  volatile uint32_t   tail;   /**< Bytes produced, written by the producer only */
+  uint8_t*            buffer;
+} spsc_ring_t;
+
+typedef struct
+{
+  uint8_t*  data;
+  uint32_t  length;
+} ring_buffer_span_t;
+
+OSStatus spsc_ring_init( spsc_ring_t* ring, uint8_t* buffer, uint32_t size );
+
+uint32_t spsc_ring_used_space( spsc_ring_t* ring );
+
+uint32_t spsc_ring_free_space( spsc_ring_t* ring );
+
+/* Producer side */
+uint32_t spsc_ring_write( spsc_ring_t* ring, const uint8_t* data, uint32_t data_length );
+
+uint32_t spsc_ring_reserve( spsc_ring_t* ring, ring_buffer_span_t spans[2] );
+
+OSStatus spsc_ring_publish( spsc_ring_t* ring, uint32_t bytes_written );
+
+/* Consumer side */
+uint32_t spsc_ring_read( spsc_ring_t* ring, uint8_t* data, uint32_t data_length );
+
+uint32_t spsc_ring_peek( spsc_ring_t* ring, ring_buffer_span_t spans[2] );
+
+OSStatus spsc_ring_commit( spsc_ring_t* ring, uint32_t bytes_consumed );
+
 #endif // __RingBufferUtils_h__
 
 
@@ -0,0 +1,434 @@
+/**
+  ******************************************************************************
+  * @file    TCPServerUtils.c
+  * @author  William Xu
+  * @version V1.0.0
+  * @date    17-Oct-2026
+  * @brief   This file contains a single thread TCP server, listeners and
+  *          clients are multiplexed with select()
+  ******************************************************************************
+  * @attention
+  *
+  * THE PRESENT FIRMWARE WHICH IS FOR GUIDANCE ONLY AIMS AT PROVIDING CUSTOMERS
+  * WITH CODING INFORMATION REGARDING THEIR PRODUCTS IN ORDER FOR THEM TO SAVE
+  * TIME. AS A RESULT, MXCHIP Inc. SHALL NOT BE HELD LIABLE FOR ANY
+  * DIRECT, INDIRECT OR CONSEQUENTIAL DAMAGES WITH RESPECT TO ANY CLAIMS ARISING
+  * FROM THE CONTENT OF SUCH FIRMWARE AND/OR THE USE MADE BY CUSTOMERS OF THE
+  * CODING INFORMATION CONTAINED HEREIN IN CONNECTION WITH THEIR PRODUCTS.
+  *
+  * <h2><center>&copy; COPYRIGHT 2014 MXCHIP Inc.</center></h2>
+  ******************************************************************************
+  */
+
+#include "TCPServerUtils.h"
+#include "SocketUtils.h"
+#include "Debug.h"
+#include "MICO.h"
+
+#define tcp_server_log(M, ...) custom_log("TCPServer", M, ##__VA_ARGS__)
+#define tcp_server_log_trace() custom_log_trace("TCPServer")
+
+/* A closing connection that has no idle timeout gets this long to write its queued output */
+#define kTCPConnectionDrainTimeout    5000
+
+struct _tcp_write_block_t {
+  tcp_write_block_t  *next;
+  size_t              len;
+  size_t              offset;
+  uint8_t            *data;
+};
+
+struct _tcp_listener_t {
+  int                       fd;
+  uint16_t                  port;
+  int                       maxConnections;
+  int                       connectionCount;
+  uint32_t                  idleTimeout;
+  tcp_listener_callbacks_t  callbacks;
+  void                     *context;
+  tcp_listener_t           *next;
+};
+
+struct _tcp_server_t {
+  tcp_listener_t           *listeners;
+  tcp_connection_t         *connections;
+  int                       connectionCount;
+  volatile bool             running;
+};
+
+static uint32_t _time_left( uint32_t since, uint32_t limit, uint32_t now )
+{
+  uint32_t elapsed = now - since;
+  return ( elapsed >= limit ) ? 0 : limit - elapsed;
+}
+
+static uint32_t _connection_timeout( tcp_connection_t *connection )
+{
+  if( connection->state == eTCPConnection_Closing && connection->idleTimeout == 0 )
+    return kTCPConnectionDrainTimeout;
+  return connection->idleTimeout;
+}
+
+static void _connection_free( tcp_server_t *server, tcp_connection_t *connection, bool notify )
+{
+  tcp_connection_t **link;
+  tcp_write_block_t *block;
+  tcp_listener_t *listener = connection->listener;
+
+  for( link = &server->connections; *link != NULL; link = &(*link)->next ){
+    if( *link == connection ){
+      *link = connection->next;
+      break;
+    }
+  }
+  server->connectionCount--;
+  listener->connectionCount--;
+
+  if( notify && listener->callbacks.onClosed )
+    listener->callbacks.onClosed( connection, connection->closeReason, listener->context );
+
+  if( connection->fd != -1 )
+    SocketClose( &connection->fd );
+  while( connection->writeHead ){
+    block = connection->writeHead;
+    connection->writeHead = block->next;
+    free( block );
+  }
+  free( connection );
+}
+
+/* Drop the socket now, the connection is freed by the caller */
+static void _connection_abort( tcp_connection_t *connection, OSStatus reason )
+{
+  if( connection->state == eTCPConnection_Open )
+    connection->closeReason = reason;
+  connection->state = eTCPConnection_Closing;
+  if( connection->fd != -1 )
+    SocketClose( &connection->fd );
+}
+
+static void _connection_flush( tcp_connection_t *connection )
+{
+  tcp_write_block_t *block;
+  int len;
+
+  while( connection->writeHead ){
+    block = connection->writeHead;
+    len = send( connection->fd, block->data + block->offset, block->len - block->offset, 0 );
+    if( len <= 0 )
+      break;
+
+    connection->lastActivity = mico_get_time();
+    connection->writeQueued -= len;
+    block->offset += len;
+    if( block->offset < block->len )
+      break;
+
+    connection->writeHead = block->next;
+    if( connection->writeHead == NULL )
+      connection->writeTail = NULL;
+    free( block );
+  }
+}
+
+static void _listener_accept( tcp_server_t *server, tcp_listener_t *listener )
+{
+  OSStatus err;
+  struct sockaddr_t addr;
+  socklen_t addrLen = sizeof( addr );
+  tcp_connection_t *connection, *oldest = NULL;
+  int fd, nonBlock = 1;
+  char ip_address[16];
+
+  fd = accept( listener->fd, &addr, &addrLen );
+  if( fd < 0 )
+    return;
+
+  /* Like SocketAccept(), the least recently active client makes room for the new one */
+  if( listener->connectionCount >= listener->maxConnections ){
+    for( connection = server->connections; connection != NULL; connection = connection->next ){
+      if( connection->listener != listener || connection->fd == -1 )
+        continue;
+      if( oldest == NULL || (int32_t)( connection->lastActivity - oldest->lastActivity ) < 0 )
+        oldest = connection;
+    }
+    if( oldest == NULL ){
+      SocketClose( &fd );
+      return;
+    }
+    tcp_server_log( "Force close, fd: %d", oldest->fd );
+    /* Freed before the new socket is used, the descriptor may be the same */
+    oldest->closeReason = kNoResourcesErr;
+    _connection_free( server, oldest, true );
+  }
+
+  connection = calloc( 1, sizeof( tcp_connection_t ) );
+  if( connection == NULL ){
+    tcp_server_log( "No memory for a new client" );
+    SocketClose( &fd );
+    return;
+  }
+
+  setsockopt( fd, SOL_SOCKET, SO_BLOCKMODE, &nonBlock, sizeof( nonBlock ) );
+  connection->fd = fd;
+  connection->state = eTCPConnection_Open;
+  connection->peerIp = addr.s_ip;
+  connection->peerPort = addr.s_port;
+  connection->lastActivity = mico_get_time();
+  connection->idleTimeout = listener->idleTimeout;
+  connection->closeReason = kNoErr;
+  connection->maxWriteQueue = kTCPConnectionMaxWriteQueue;
+  connection->listener = listener;
+  connection->next = server->connections;
+  server->connections = connection;
+  server->connectionCount++;
+  listener->connectionCount++;
+
+  inet_ntoa( ip_address, addr.s_ip );
+  tcp_server_log( "Client %s:%d connected to port %d, fd: %d", ip_address, addr.s_port, listener->port, fd );
+
+  if( listener->callbacks.onAccepted ){
+    err = listener->callbacks.onAccepted( connection, listener->context );
+    if( err != kNoErr ){
+      tcp_server_log( "Client fd: %d rejected, err = %d", fd, err );
+      _connection_free( server, connection, false );
+    }
+  }
+}
+
+tcp_server_t *TCPServerCreate( void )
+{
+  return calloc( 1, sizeof( tcp_server_t ) );
+}
+
+OSStatus TCPServerListen( tcp_server_t *server, uint16_t port, int maxConnections, uint32_t idleTimeout,
+                          const tcp_listener_callbacks_t *callbacks, void *listenerContext )
+{
+  OSStatus err = kParamErr;
+  struct sockaddr_t addr;
+  tcp_listener_t *listener = NULL;
+  int reuse = 1;
+
+  require( server, exit );
+  require( callbacks, exit );
+  require( maxConnections > 0, exit );
+
+  listener = calloc( 1, sizeof( tcp_listener_t ) );
+  require_action( listener, exit, err = kNoMemoryErr );
+  listener->fd = -1;
+
+  /*Establish a TCP server fd that accept the tcp clients connections*/
+  listener->fd = socket( AF_INET, SOCK_STREAM, IPPROTO_TCP );
+  require_action( IsValidSocket( listener->fd ), exit, err = kNoResourcesErr );
+  setsockopt( listener->fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof( reuse ) );
+  addr.s_ip = INADDR_ANY;
+  addr.s_port = port;
+  err = bind( listener->fd, &addr, sizeof( addr ) );
+  require_noerr( err, exit );
+
+  err = listen( listener->fd, 0 );
+  require_noerr( err, exit );
+
+  listener->port = port;
+  listener->maxConnections = maxConnections;
+  listener->idleTimeout = idleTimeout;
+  listener->callbacks = *callbacks;
+  listener->context = listenerContext;
+  listener->next = server->listeners;
+  server->listeners = listener;
+  tcp_server_log( "Server established at port: %d, fd: %d", port, listener->fd );
+
+exit:
+  if( err != kNoErr && listener ){
+    if( listener->fd != -1 )
+      SocketClose( &listener->fd );
+    free( listener );
+  }
+  return err;
+}
+
+OSStatus TCPServerRunOnce( tcp_server_t *server, uint32_t timeout_ms )
+{
+  OSStatus err = kParamErr;
+  fd_set readfds, writefds;
+  struct timeval_t t;
+  tcp_listener_t *listener;
+  tcp_connection_t *connection, *next;
+  uint32_t now, left;
+  int maxFd = -1;
+  int selectResult;
+
+  require( server, exit );
+
+  FD_ZERO( &readfds );
+  FD_ZERO( &writefds );
+  now = mico_get_time();
+
+  for( listener = server->listeners; listener != NULL; listener = listener->next ){
+    FD_SET( listener->fd, &readfds );
+    if( listener->fd > maxFd ) maxFd = listener->fd;
+  }
+
+  for( connection = server->connections; connection != NULL; connection = connection->next ){
+    /* A client that does not read its responses is not read from either, until its queue drains */
+    if( connection->state == eTCPConnection_Open && connection->writeQueued < connection->maxWriteQueue / 2 )
+      FD_SET( connection->fd, &readfds );
+    if( connection->writeQueued )
+      FD_SET( connection->fd, &writefds );
+    if( connection->fd > maxFd ) maxFd = connection->fd;
+
+    if( _connection_timeout( connection ) ){
+      left = _time_left( connection->lastActivity, _connection_timeout( connection ), now );
+      if( left < timeout_ms ) timeout_ms = left;
+    }
+  }
+
+  t.tv_sec = timeout_ms / 1000;
+  t.tv_usec = ( timeout_ms % 1000 ) * 1000;
+  selectResult = select( maxFd + 1, &readfds, &writefds, NULL, &t );
+  err = kNoErr;
+
+  if( selectResult > 0 ){
+    for( listener = server->listeners; listener != NULL; listener = listener->next ){
+      if( FD_ISSET( listener->fd, &readfds ) )
+        _listener_accept( server, listener );
+    }
+
+    for( connection = server->connections; connection != NULL; connection = connection->next ){
+      if( connection->fd == -1 )
+        continue;
+
+      if( connection->writeQueued && FD_ISSET( connection->fd, &writefds ) )
+        _connection_flush( connection );
+
+      if( connection->state == eTCPConnection_Open && FD_ISSET( connection->fd, &readfds ) ){
+        connection->lastActivity = mico_get_time();
+        err = connection->listener->callbacks.onReadable( connection, connection->listener->context );
+        if( err != kNoErr )
+          TCPConnectionClose( connection, err );
+        err = kNoErr;
+      }
+    }
+  }
+
+  /* Idle clients are closed, closing clients that cannot write their output are dropped */
+  now = mico_get_time();
+  for( connection = server->connections; connection != NULL; connection = next ){
+    next = connection->next;
+    if( connection->fd != -1 && _connection_timeout( connection ) &&
+        _time_left( connection->lastActivity, _connection_timeout( connection ), now ) == 0 ){
+      if( connection->state == eTCPConnection_Open ){
+        TCPConnectionClose( connection, kTimeoutErr );
+      }else{
+        tcp_server_log( "Client fd: %d cannot write %d bytes, dropped", connection->fd, (int)connection->writeQueued );
+        _connection_abort( connection, kTimeoutErr );
+      }
+    }
+
+    if( connection->fd == -1 || ( connection->state == eTCPConnection_Closing && connection->writeQueued == 0 ) )
+      _connection_free( server, connection, true );
+  }
+
+exit:
+  return err;
+}
+
+OSStatus TCPServerRun( tcp_server_t *server )
+{
+  OSStatus err = kParamErr;
+  require( server, exit );
+
+  server->running = true;
+  while( server->running ){
+    err = TCPServerRunOnce( server, kTCPServerMaxWait );
+    require_noerr( err, exit );
+  }
+
+exit:
+  return err;
+}
+
+void TCPServerStop( tcp_server_t *server )
+{
+  if( server )
+    server->running = false;
+}
+
+void TCPServerDelete( tcp_server_t *server )
+{
+  tcp_listener_t *listener;
+
+  if( server == NULL )
+    return;
+
+  while( server->connections )
+    _connection_free( server, server->connections, true );
+
+  while( server->listeners ){
+    listener = server->listeners;
+    server->listeners = listener->next;
+    SocketClose( &listener->fd );
+    free( listener );
+  }
+  free( server );
+}
+
+int TCPServerConnectionCount( tcp_server_t *server )
+{
+  return server ? server->connectionCount : 0;
+}
+
+OSStatus TCPConnectionSend( tcp_connection_t *connection, const uint8_t *inBuf, size_t inBufLen )
+{
+  OSStatus err = kParamErr;
+  tcp_write_block_t *block;
+  int len = 0;
+
+  require( connection, exit );
+  require( inBuf, exit );
+  require_action( inBufLen, exit, err = kNoErr );
+  require_action( connection->fd != -1 && connection->state == eTCPConnection_Open, exit, err = kNotWritableErr );
+
+  /* A buffer is always taken when nothing is queued, so one response can exceed the limit */
+  require_action( connection->writeQueued == 0 || connection->writeQueued + inBufLen <= connection->maxWriteQueue,
+                  exit, err = kNoSpaceErr );
+
+  if( connection->writeQueued == 0 ){
+    len = send( connection->fd, inBuf, inBufLen, 0 );
+    if( len > 0 )
+      connection->lastActivity = mico_get_time();
+    else
+      len = 0;
+  }
+
+  if( (size_t)len < inBufLen ){
+    block = malloc( sizeof( tcp_write_block_t ) + inBufLen - len );
+    require_action( block, exit, err = kNoMemoryErr );
+    block->next = NULL;
+    block->len = inBufLen - len;
+    block->offset = 0;
+    block->data = (uint8_t *)( block + 1 );
+    memcpy( block->data, inBuf + len, block->len );
+
+    if( connection->writeTail )
+      connection->writeTail->next = block;
+    else
+      connection->writeHead = block;
+    connection->writeTail = block;
+    connection->writeQueued += block->len;
+  }
+  err = kNoErr;
+
+exit:
+  return err;
+}
+
+void TCPConnectionClose( tcp_connection_t *connection, OSStatus reason )
+{
+  if( connection == NULL || connection->state == eTCPConnection_Closing )
+    return;
+
+  connection->closeReason = reason;
+  connection->state = eTCPConnection_Closing;
+}
+
@@ -0,0 +1,107 @@
+/**
+  ******************************************************************************
+  * @file    TCPServerUtils.h
+  * @author  William Xu
+  * @version V1.0.0
+  * @date    17-Oct-2026
+  * @brief   This header contains function prototypes of a single thread TCP
+  *          server, it serves all listeners and clients with one select() loop
+  ******************************************************************************
+  * @attention
+  *
+  * THE PRESENT FIRMWARE WHICH IS FOR GUIDANCE ONLY AIMS AT PROVIDING CUSTOMERS
+  * WITH CODING INFORMATION REGARDING THEIR PRODUCTS IN ORDER FOR THEM TO SAVE
+  * TIME. AS A RESULT, MXCHIP Inc. SHALL NOT BE HELD LIABLE FOR ANY
+  * DIRECT, INDIRECT OR CONSEQUENTIAL DAMAGES WITH RESPECT TO ANY CLAIMS ARISING
+  * FROM THE CONTENT OF SUCH FIRMWARE AND/OR THE USE MADE BY CUSTOMERS OF THE
+  * CODING INFORMATION CONTAINED HEREIN IN CONNECTION WITH THEIR PRODUCTS.
+  *
+  * <h2><center>&copy; COPYRIGHT 2014 MXCHIP Inc.</center></h2>
+  ******************************************************************************
+  */
+
+#ifndef __TCPServerUtils_h__
+#define __TCPServerUtils_h__
+
+#include "Common.h"
+
+/* A connection costs one tcp_connection_t plus its queued output instead of
+ * a thread stack. Every callback runs on the thread that calls TCPServerRun(),
+ * so they must not block: a connection that cannot take more output gets it
+ * queued by TCPConnectionSend() and written once the socket is writable.
+ * A connection is not read while more than half of maxWriteQueue is queued,
+ * so a client that pipelines requests cannot make its responses overflow.
+ */
+
+#define kTCPServerMaxWait             1000    /**< Longest select() wait, TCPServerStop() is noticed within it, in ms */
+#define kTCPConnectionMaxWriteQueue   4096    /**< Default limit of the bytes queued on one connection */
+
+typedef struct _tcp_server_t     tcp_server_t;
+typedef struct _tcp_listener_t   tcp_listener_t;
+typedef struct _tcp_connection_t tcp_connection_t;
+typedef struct _tcp_write_block_t tcp_write_block_t;
+
+typedef enum {
+  eTCPConnection_Open,          /**< Reading and writing */
+  eTCPConnection_Closing,       /**< Close requested, the queued output is written before the socket is closed */
+} tcp_connection_state_t;
+
+typedef struct {
+  /* A new client is accepted, set connection->userContext here. Return an error to reject the client */
+  OSStatus (*onAccepted)( tcp_connection_t *connection, void *listenerContext );
+  /* The socket is readable, read what is available. Return an error to close the connection */
+  OSStatus (*onReadable)( tcp_connection_t *connection, void *listenerContext );
+  /* The connection is about to be freed, reason is kNoErr, kTimeoutErr or the error that closed it */
+  void     (*onClosed)( tcp_connection_t *connection, OSStatus reason, void *listenerContext );
+} tcp_listener_callbacks_t;
+
+struct _tcp_connection_t {
+  int                     fd;
+  tcp_connection_state_t  state;
+  uint32_t                peerIp;
+  uint16_t                peerPort;
+  uint32_t                lastActivity;   /**< mico_get_time() of the last read or write */
+  uint32_t                idleTimeout;    /**< Close after this long without traffic in ms, 0 never */
+  OSStatus                closeReason;
+  tcp_write_block_t      *writeHead;
+  tcp_write_block_t      *writeTail;
+  size_t                  writeQueued;    /**< Bytes waiting in the write queue */
+  size_t                  maxWriteQueue;
+  void                   *userContext;
+  tcp_listener_t         *listener;
+  tcp_connection_t       *next;
+};
+
+/* Create an empty server, NULL if out of memory */
+tcp_server_t *TCPServerCreate( void );
+
+/* Open a listening socket. When maxConnections clients are connected already,
+ * the least recently active one is closed to make room for a new one.
+ */
+OSStatus TCPServerListen( tcp_server_t *server, uint16_t port, int maxConnections, uint32_t idleTimeout,
+                          const tcp_listener_callbacks_t *callbacks, void *listenerContext );
+
+/* Wait up to timeout_ms for socket events and dispatch them once */
+OSStatus TCPServerRunOnce( tcp_server_t *server, uint32_t timeout_ms );
+
+/* Dispatch events until TCPServerStop() is called */
+OSStatus TCPServerRun( tcp_server_t *server );
+
+/* Can be called from any thread */
+void TCPServerStop( tcp_server_t *server );
+
+/* Close every connection and listener and free the server */
+void TCPServerDelete( tcp_server_t *server );
+
+int TCPServerConnectionCount( tcp_server_t *server );
+
+/* Write what the socket takes now and queue the rest, kNoSpaceErr if the
+ * queue limit would be exceeded.
+ */
+OSStatus TCPConnectionSend( tcp_connection_t *connection, const uint8_t *inBuf, size_t inBufLen );
+
+/* Close the connection once its queued output is written */
+void TCPConnectionClose( tcp_connection_t *connection, OSStatus reason );
+
+#endif // __TCPServerUtils_h__
+
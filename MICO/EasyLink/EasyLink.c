@@ -40,7 +40,7 @@
 #include "SocketUtils.h"
 
 #include "EasyLink.h"
-#include "SoftAp/EasyLinkSoftAP.h"
+#include "SoftAP/EasyLinkSoftAP.h"
   
 // EasyLink HTTP messages
 #define kEasyLinkURLAuth          "/auth-setup"
@@ -551,14 +551,14 @@ OSStatus _FTCRespondInComingMessage(int fd, HTTPHeader_t* inHeader, mico_Context
         else if(strnicmpx( value, valueSize, kMIMEType_MXCHIP_OTA ) == 0){
           easylink_log("Receive OTA data!");
           mico_rtos_lock_mutex(&inContext->flashContentInRam_mutex);
-          memset(&inContext->flashContentInRam.bootTable, 0, sizeof(boot_table_t));
-          inContext->flashContentInRam.bootTable.length = inHeader->contentLength;
-          inContext->flashContentInRam.bootTable.start_address = UPDATE_START_ADDRESS;
-          inContext->flashContentInRam.bootTable.type = 'A';
-          inContext->flashContentInRam.bootTable.upgrade_type = 'U';
-          inContext->flashContentInRam.micoSystemConfig.easyLinkByPass = EASYLINK_BYPASS;
-          MICOUpdateConfiguration(inContext);
+          err = MICOSetOTABootTable(inContext, inHeader->contentLength);
+          if(err == kNoErr){
+            inContext->flashContentInRam.micoSystemConfig.easyLinkByPass = EASYLINK_BYPASS;
+            MICOUpdateConfiguration(inContext);
+          }
           mico_rtos_unlock_mutex(&inContext->flashContentInRam_mutex);
+          /*The running image stays in use, the server connection is reopened*/
+          require_noerr_action(err, exit, easylink_log("ERROR: OTA image rejected, err = %d", err));
           SocketClose(&fd);
           inContext->micoStatus.sys_state = eState_Software_Reset;
           require(inContext->micoStatus.sys_state_change_sem, exit);
@@ -1,6 +1,7 @@
 #include "MICO.h"
 #include "MICODefine.h"
 #include "MICOCli.h"
+#include "MICONotificationCenter.h"
 #include "stdarg.h"
 
 #ifdef MICO_CLI_ENABLE
@@ -505,8 +506,38 @@ static void micodebug_Command(char *pcWriteBuffer, int xWriteBufferLen,int argc,
 	}
 }
 
-static const struct cli_command user_clis[1] = {
+static const char *notify_names[] = {
+	"WIFI_SCAN", "WIFI_STATUS", "WIFI_PARA", "DHCP", "EASYLINK_WPS", "EASYLINK_DATA", "TCP_CONNECTED",
+	"DNS_RESOLVE", "READ_APP_INFO", "POWER_OFF", "CONNECT_FAILED", "WIFI_SCAN_ADV", "WIFI_FATAL", "STACK_OVERFLOW",
+};
+
+static void notifystat_Command(char *pcWriteBuffer, int xWriteBufferLen,int argc, char **argv)
+{
+	mico_notify_stats_t stats;
+	unsigned int i, b;
+
+	if (argc > 1 && !strcasecmp(argv[1], "reset")) {
+		MICOResetNotificationStats();
+		cmd_printf("Notification statistics cleared\r\n");
+		return;
+	}
+
+	cmd_printf("type: sent called coalesced dropped, max latency/handler ms, calls by latency <1 1 2 4 ... 256+ ms\r\n");
+	for (i = 0; i < sizeof(notify_names) / sizeof(notify_names[0]); i++) {
+		if (MICOGetNotificationStats((mico_notify_types_t)i, &stats) != kNoErr || stats.raised == 0)
+			continue;
+		cmd_printf("%s: %u %u %u %u, %u/%u:", notify_names[i], (unsigned int)stats.raised,
+			 (unsigned int)stats.delivered, (unsigned int)stats.coalesced, (unsigned int)stats.dropped,
+			 (unsigned int)stats.max_latency, (unsigned int)stats.max_handler_time);
+		for (b = 0; b < MICO_NOTIFY_LATENCY_BUCKETS; b++)
+			cmd_printf(" %u", (unsigned int)stats.latency[b]);
+		cmd_printf("\r\n");
+	}
+}
+
+static const struct cli_command user_clis[2] = {
 	{"micodebug", "micodebug on/off", micodebug_Command},
+	{"notifystat", "notification latency, notifystat reset", notifystat_Command},
 };
 #endif
 
@@ -539,7 +570,7 @@ int MicoCliInit(void)
     }
 
 #if (DEBUG)
-    cli_register_commands(user_clis, 1);
+    cli_register_commands(user_clis, sizeof(user_clis) / sizeof(struct cli_command));
 #endif
 
 	ret = mico_rtos_create_thread(NULL, MICO_DEFAULT_WORKER_PRIORITY, "cli", cli_main, 4096, 0);
@@ -32,9 +32,12 @@
 #include "MICO.h"
 #include "MICODefine.h"
 #include "SocketUtils.h"
-#include "Platform.h"
-#include "Platform_common_config.h"
+#include "TCPServerUtils.h"
+#include "platform.h"
+#include "platform_common_config.h"
 #include "HTTPUtils.h"
+#include "HTTPParserUtils.h"
+#include "OTAUtils.h"
 #include "MICONotificationCenter.h"
 #include "StringUtils.h"
 
@@ -48,332 +51,567 @@
 
 #define kMIMEType_MXCHIP_OTA    "application/ota-stream"
 
+/* Optional header or trailer fields of an OTA request, hex digests of the image */
+#define kCONFIGFieldOTAMD5      "X-OTA-MD5"
+#define kCONFIGFieldOTASHA256   "X-OTA-SHA256"
+
+/* An image named by X-OTA-MD5 in the header can be sent in several requests,
+ * the device keeps the progress in its OTA session:
+ *   GET /OTA with X-OTA-MD5 and X-OTA-Length is answered with X-OTA-Offset,
+ *   the number of bytes of that image the device has already.
+ *   POST /OTA with "Content-Range: bytes <first>-<last>/<length>" continues
+ *   the image, the bytes before X-OTA-Offset are not written again. A first
+ *   byte after it is answered by 416 and X-OTA-Offset. An image that is not
+ *   complete yet is answered by 200 and X-OTA-Offset.
+ * The progress is saved in steps of kOTASessionInterval, X-OTA-Offset is
+ * where the next request has to start.
+ */
+#define kCONFIGFieldOTALength   "X-OTA-Length"
+#define kCONFIGFieldOTAOffset   "X-OTA-Offset"
+
+/* The response to /config-write-uap has this long to reach the client before the soft AP goes down, in ms */
+#define kCONFIGSoftAPSuspendDelay   1000
+
 typedef struct _configContext_t{
-  uint32_t flashStorageAddress;
-  bool     isFlashLocked;
+  ota_sink_t  *otaSink;     //! Allocated while an OTA image is received.
+  bool        ownsOTA;      //! This connection writes the update area.
+  uint64_t    otaSkip;      //! Body bytes the device has already.
 } configContext_t;
 
 extern OSStatus     ConfigIncommingJsonMessage( const char *input, mico_Context_t * const inContext );
 extern OSStatus     ConfigIncommingJsonMessageUAP( const char *input, mico_Context_t * const inContext );
 extern json_object* ConfigCreateReportJsonMessage( mico_Context_t * const inContext );
 
-static void localConfiglistener_thread(void *inContext);
-static void localConfig_thread(void *inFd);
+/*One per client, kept for all the requests sent on its connection*/
+typedef struct _configConnection_t{
+  http_parser_t     parser;
+  char              headerArena[CONFIG_SERVICE_HEADER_SIZE];
+  uint8_t           *body;          //! Reused by every request, grows up to CONFIG_SERVICE_MAX_BODY.
+  size_t            bodySize;
+  size_t            bodyLen;
+  bool              isOTA;          //! The body is written to flash instead of body.
+  bool              suspendSoftAP;  //! Once the response is written, connect to the AP of the new configuration.
+  configContext_t   httpContext;
+  tcp_connection_t  *connection;
+} configConnection_t;
+
+/*Only the server thread uses them, a request is parsed and answered before the next read*/
+static uint8_t configReadBuffer[1024];
+static char    configResponseHeader[200];
+static bool    configOTAInProgress = false;   //! One OTA image is received at a time, by any connection.
+
+static mico_timer_t configSoftAPTimer;
+static bool         configSoftAPTimerInitialized = false;
+
+static void localConfigServer_thread(void *inContext);
+static OSStatus localConfigAccepted(tcp_connection_t *connection, void *inContext);
+static OSStatus localConfigReadable(tcp_connection_t *connection, void *inContext);
+static void localConfigClosed(tcp_connection_t *connection, OSStatus reason, void *inContext);
 static mico_Context_t *Context;
-static OSStatus _LocalConfigRespondInComingMessage(int fd, HTTPHeader_t* inHeader, mico_Context_t * const inContext);
+static OSStatus _LocalConfigRespondInComingMessage(configConnection_t *client, mico_Context_t * const inContext);
 static void _easylinkConnectWiFi( mico_Context_t * const inContext);
-static OSStatus onReceivedData(struct _HTTPHeader_t * httpHeader, uint32_t pos, uint8_t * data, size_t len, void * userContext );
-static void onClearHTTPHeader(struct _HTTPHeader_t * httpHeader, void * userContext );
+static OSStatus onHTTPEvent(http_parser_t *parser, http_parser_event_t event, const uint8_t *data, size_t len, void *userContext);
+static OSStatus onReceivedOTAData(configContext_t *context, uint64_t inPos, const uint8_t *inData, size_t inLen);
+static void onOTAEnd(configContext_t *context);
+static OSStatus _LocalConfigStartOTA(configConnection_t *client);
+static void _LocalConfigSoftAPTimeout(void *inContext);
+
+static const tcp_listener_callbacks_t localConfigCallbacks = {
+  localConfigAccepted,
+  localConfigReadable,
+  localConfigClosed,
+};
 
 OSStatus MICOStartConfigServer ( mico_Context_t * const inContext )
 {
-  return mico_rtos_create_thread(NULL, MICO_APPLICATION_PRIORITY, "Config Server", localConfiglistener_thread, STACK_SIZE_LOCAL_CONFIG_SERVER_THREAD, (void*)inContext );
+  return mico_rtos_create_thread(NULL, MICO_APPLICATION_PRIORITY, "Config Server", localConfigServer_thread, STACK_SIZE_LOCAL_CONFIG_SERVER_THREAD, (void*)inContext );
 }
 
-void localConfiglistener_thread(void *inContext)
+/*All config clients are served by this thread, a client costs a configConnection_t instead of a thread*/
+void localConfigServer_thread(void *inContext)
 {
   config_log_trace();
   OSStatus err = kUnknownErr;
-  int j;
+  tcp_server_t *server = NULL;
   Context = inContext;
-  struct sockaddr_t addr;
-  int sockaddr_t_size;
-  fd_set readfds;
-  char ip_address[16];
-  
-  int localConfiglistener_fd = -1;
-
-  /*Establish a TCP server fd that accept the tcp clients connections*/ 
-  localConfiglistener_fd = socket( AF_INET, SOCK_STREAM, IPPROTO_TCP );
-  require_action(IsValidSocket( localConfiglistener_fd ), exit, err = kNoResourcesErr );
-  addr.s_ip = INADDR_ANY;
-  addr.s_port = CONFIG_SERVICE_PORT;
-  err = bind(localConfiglistener_fd, &addr, sizeof(addr));
-  require_noerr( err, exit );
 
-  err = listen(localConfiglistener_fd, 0);
+  server = TCPServerCreate();
+  require_action(server, exit, err = kNoMemoryErr);
+
+  err = TCPServerListen(server, CONFIG_SERVICE_PORT, CONFIG_SERVICE_MAX_CLIENTS, CONFIG_SERVICE_IDLE_TIMEOUT, &localConfigCallbacks, Context);
   require_noerr( err, exit );
 
-  config_log("Config Server established at port: %d, fd: %d", CONFIG_SERVICE_PORT, localConfiglistener_fd);
-  
-  while(1){
-    FD_ZERO(&readfds);
-    FD_SET(localConfiglistener_fd, &readfds);
-    select(1, &readfds, NULL, NULL, NULL);
-
-    /*Check tcp connection requests */
-    if(FD_ISSET(localConfiglistener_fd, &readfds)){
-      sockaddr_t_size = sizeof(struct sockaddr_t);
-      j = accept(localConfiglistener_fd, &addr, &sockaddr_t_size);
-      if (j > 0) {
-        inet_ntoa(ip_address, addr.s_ip );
-        config_log("Config Client %s:%d connected, fd: %d", ip_address, addr.s_port, j);
-        err = mico_rtos_create_thread(NULL, MICO_APPLICATION_PRIORITY, "Config Clients", localConfig_thread, STACK_SIZE_LOCAL_CONFIG_CLIENT_THREAD, &j);  
-      }
-    }
-   }
+  config_log("Config Server established at port: %d", CONFIG_SERVICE_PORT);
+  err = TCPServerRun(server);
 
 exit:
     config_log("Exit: Local controller exit with err = %d", err);
+    TCPServerDelete(server);
     mico_rtos_delete_thread(NULL);
     return;
 }
 
-void localConfig_thread(void *inFd)
+static OSStatus localConfigAccepted(tcp_connection_t *connection, void *inContext)
 {
-  OSStatus err;
-  int clientFd = *(int *)inFd;
-  int clientFdIsSet;
-  fd_set readfds;
-  struct timeval_t t;
-  HTTPHeader_t *httpHeader = NULL;
-  configContext_t httpContext = {0, false};
+  OSStatus err = kNoErr;
+  configConnection_t *client;
+  UNUSED_PARAMETER(inContext);
 
-  config_log_trace();
-  httpHeader = HTTPHeaderCreateWithCallback(onReceivedData, onClearHTTPHeader, &httpContext);
-  require_action( httpHeader, exit, err = kNoMemoryErr );
-  HTTPHeaderClear( httpHeader );
+  client = calloc(1, sizeof(configConnection_t));
+  require_action( client, exit, err = kNoMemoryErr );
+
+  err = HTTPParserInit(&client->parser, client->headerArena, sizeof(client->headerArena), onHTTPEvent, client);
+  require_noerr( err, exit );
+  client->connection = connection;
+  connection->userContext = client;
 
-  t.tv_sec = 60;
-  t.tv_usec = 0;
   config_log("Free memory %d bytes", MicoGetMemoryInfo()->free_memory) ; 
 
-  while(1){
-    FD_ZERO(&readfds);
-    FD_SET(clientFd, &readfds);
-    clientFdIsSet = 0;
+exit:
+  if(err != kNoErr && client) free(client);
+  return err;
+}
+
+/*Answer a request that cannot be served and close the connection*/
+static OSStatus _LocalConfigRespondError(configConnection_t *client, int status, OSStatus reason)
+{
+  size_t len;
+
+  if(CreateHTTPRespondHeader(status, NULL, 0, false, configResponseHeader, sizeof(configResponseHeader), &len) == kNoErr)
+    TCPConnectionSend(client->connection, (uint8_t *)configResponseHeader, len);
+  return reason;
+}
+
+static OSStatus localConfigReadable(tcp_connection_t *connection, void *inContext)
+{
+  OSStatus err = kNoErr;
+  configConnection_t *client = connection->userContext;
+  size_t offset, used;
+  int len;
+  UNUSED_PARAMETER(inContext);
+
+  len = read(connection->fd, configReadBuffer, sizeof(configReadBuffer));
+  if(len <= 0){
+    // A request that is still incomplete is lost
+    err = HTTPParserFinish(&client->parser);
+    if(err == kNoErr) err = kConnectionErr;
+    goto exit;
+  }
 
-    if(httpHeader->len == 0){
-      require(select(1, &readfds, NULL, NULL, &t) >= 0, exit);
-      clientFdIsSet = FD_ISSET(clientFd, &readfds);
+  // Pipelined requests: a request can complete in the middle of the buffer, the parser goes on with the next one
+  for(offset = 0; offset < (size_t)len; offset += used){
+    err = HTTPParserExecute(&client->parser, configReadBuffer + offset, len - offset, &used);
+    if(err == kMalformedErr){
+      config_log("ERROR: Malformed HTTP request.");
+      err = _LocalConfigRespondError(client, kStatusBadRequest, err);
+    }else if(err == kNoSpaceErr){
+      config_log("ERROR: Cannot fit HTTP request.");
+      err = _LocalConfigRespondError(client, kStatusPayloadTooLarge, err);
     }
-  
-    if(clientFdIsSet||httpHeader->len){
-      err = SocketReadHTTPHeader( clientFd, httpHeader );
-
-      switch ( err )
-      {
-        case kNoErr:
-          // Read the rest of the HTTP body if necessary
-          //do{
-          err = SocketReadHTTPBody( clientFd, httpHeader );
-          
-          if(httpHeader->dataEndedbyClose == true){
-            err = _LocalConfigRespondInComingMessage( clientFd, httpHeader, Context );
-            require_noerr(err, exit);
-            err = kConnectionErr;
-            goto exit;
-          }else{
-            require_noerr(err, exit);
-            err = _LocalConfigRespondInComingMessage( clientFd, httpHeader, Context );
-            require_noerr(err, exit);
-          }
-          
-
-
-          //  if(httpHeader->contentLength == 0)
-          //    break;
-          //} while( httpHeader->chunkedData == true || httpHeader->dataEndedbyClose == true);
-
-          // Call the HTTPServer owner back with the acquired HTTP header
-          //err = _LocalConfigRespondInComingMessage( clientFd, httpHeader, Context );
-          //
-          //Exit if connection is closed
-          //require_noerr(err, exit); 
-      
-          // Reuse HTTPHeader
-          HTTPHeaderClear( httpHeader );
-        break;
+    require_noerr_quiet( err, exit );
+  }
 
-        case EWOULDBLOCK:
-            // NO-OP, keep reading
-        break;
+exit:
+  return err;
+}
 
-        case kNoSpaceErr:
-          config_log("ERROR: Cannot fit HTTPHeader.");
-          goto exit;
-        
-        case kConnectionErr:
-          // NOTE: kConnectionErr from SocketReadHTTPHeader means it's closed
-          config_log("ERROR: Connection closed.");
-          goto exit;
-
-        default:
-          config_log("ERROR: HTTP Header parse internal error: %d", err);
-          goto exit;
+static void localConfigClosed(tcp_connection_t *connection, OSStatus reason, void *inContext)
+{
+  configConnection_t *client = connection->userContext;
+  UNUSED_PARAMETER(inContext);
+
+  config_log("Exit: Client exit with err = %d", reason);
+  onOTAEnd(&client->httpContext);
+  // The response is written, the socket closes once this returns
+  if(client->suspendSoftAP == true){
+    if(configSoftAPTimerInitialized == false &&
+       mico_init_timer(&configSoftAPTimer, kCONFIGSoftAPSuspendDelay, _LocalConfigSoftAPTimeout, Context) == kNoErr)
+      configSoftAPTimerInitialized = true;
+    if(configSoftAPTimerInitialized == true)
+      mico_start_timer(&configSoftAPTimer);
+    else
+      _LocalConfigSoftAPTimeout(Context);
+  }
+  if(client->body) free(client->body);
+  free(client);
+}
+
+static OSStatus onHTTPEvent(http_parser_t *parser, http_parser_event_t event, const uint8_t *data, size_t len, void *userContext)
+{
+  OSStatus err = kNoErr;
+  configConnection_t *client = userContext;
+  const char *value;
+  size_t valueSize;
+  uint8_t *body;
+
+  switch(event){
+    case kHTTPParserEvent_Header:
+      client->bodyLen = 0;
+      client->isOTA = HTTPParserGetField(parser, "Content-Type", &value, &valueSize) == kNoErr &&
+                      strnicmpx(value, valueSize, kMIMEType_MXCHIP_OTA) == 0 &&
+                      HTTPParserMatchURL(parser, kCONFIGURLOTA) == kNoErr;
+      if(client->isOTA == true){
+        err = _LocalConfigStartOTA(client);
+      }else if(parser->hasContentLength && parser->contentLength > CONFIG_SERVICE_MAX_BODY){
+        config_log("ERROR: Request body of %lld bytes is too large.", (long long)parser->contentLength);
+        err = kNoSpaceErr;
       }
-    }
+      break;
+
+    case kHTTPParserEvent_Body:
+      if(client->isOTA == true){
+        err = onReceivedOTAData(&client->httpContext, parser->bodyLength - len, data, len);
+        break;
+      }
+      require_action(client->bodyLen + len <= CONFIG_SERVICE_MAX_BODY, exit, err = kNoSpaceErr);
+      // The buffer is kept for the next request, it only grows
+      if(client->bodyLen + len + 1 > client->bodySize){
+        body = realloc(client->body, client->bodyLen + len + 1);
+        require_action(body, exit, err = kNoMemoryErr);
+        client->body = body;
+        client->bodySize = client->bodyLen + len + 1;
+      }
+      memcpy(client->body + client->bodyLen, data, len);
+      client->bodyLen += len;
+      break;
+
+    case kHTTPParserEvent_Complete:
+      if(client->body) client->body[client->bodyLen] = 0x0;
+      err = _LocalConfigRespondInComingMessage(client, Context);
+      onOTAEnd(&client->httpContext);
+      break;
+
+    default:
+      break;
   }
 
 exit:
-  config_log("Exit: Client exit with err = %d", err);
-  SocketClose(&clientFd);
-  if(httpHeader) {
-    HTTPHeaderClear( httpHeader );
-    free(httpHeader);
+  return err;
+}
+
+static OSStatus onReceivedOTAData(configContext_t *context, uint64_t inPos, const uint8_t *inData, size_t inLen)
+{
+  OSStatus err = kStateErr;
+  size_t skip;
+
+  require(context->otaSink, exit);
+  // The bytes the device has already are not written again
+  if(inPos < context->otaSkip){
+    skip = context->otaSkip - inPos < inLen ? (size_t)(context->otaSkip - inPos) : inLen;
+    inData += skip;
+    inLen -= skip;
   }
-  mico_rtos_delete_thread(NULL);
-  return;
+  err = OTASinkWrite(context->otaSink, inData, inLen);
+  require_noerr(err, exit);
+
+exit:
+  return err;
 }
 
-static OSStatus onReceivedData(struct _HTTPHeader_t * inHeader, uint32_t inPos, uint8_t * inData, size_t inLen, void * inUserContext )
+/*The OTA request is complete or the client is gone, another connection can send an image*/
+static void onOTAEnd(configContext_t *context)
 {
-  OSStatus err = kUnknownErr;
-  const char *    value;
-  size_t          valueSize;
-  configContext_t *context = (configContext_t *)inUserContext;
-
-  err = HTTPGetHeaderField( inHeader->buf, inHeader->len, "Content-Type", NULL, NULL, &value, &valueSize, NULL );
-  if(err == kNoErr && strnicmpx( value, valueSize, kMIMEType_MXCHIP_OTA ) == 0){
-    config_log("OTA data %d, %d to: %x", inPos, inLen, context->flashStorageAddress);
-#ifdef MICO_FLASH_FOR_UPDATE  
-    if(inPos == 0){
-      context->flashStorageAddress = UPDATE_START_ADDRESS;
-      mico_rtos_lock_mutex(&Context->flashContentInRam_mutex); //We are write the Flash content, no other write is possiable
-      context->isFlashLocked = true;
-      err = MicoFlashInitialize( MICO_FLASH_FOR_UPDATE );
-      require_noerr(err, flashErrExit);
-      err = MicoFlashErase(MICO_FLASH_FOR_UPDATE, UPDATE_START_ADDRESS, UPDATE_END_ADDRESS);
-      require_noerr(err, flashErrExit);
-      err = MicoFlashWrite(MICO_FLASH_FOR_UPDATE, &context->flashStorageAddress, (uint8_t *)inData, inLen);
-      require_noerr(err, flashErrExit);
-    }else{
-      err = MicoFlashWrite(MICO_FLASH_FOR_UPDATE, &context->flashStorageAddress, (uint8_t *)inData, inLen);
-      require_noerr(err, flashErrExit);
-    }
-#else
-    config_log("OTA storage is not exist");
-    return kUnsupportedErr;
-#endif
+  if(context->otaSink){
+    OTASinkAbort(context->otaSink);
+    free(context->otaSink);
+    context->otaSink = NULL;
   }
-  else if(inHeader->chunkedData == true){
-    config_log("ChunkedData: %d, %d:", inPos, inLen);
-    for(uint32_t i = 0; i<inLen; i++)
-      printf("%c", inData[i]);
-    printf("\r\n");
+  context->otaSkip = 0;
+  if(context->ownsOTA == true){
+    configOTAInProgress = false;
+    context->ownsOTA = false;
   }
-  else{
-    return kUnsupportedErr;
+}
+
+/*Runs in the timer thread, the config server goes on serving the other clients*/
+static void _LocalConfigSoftAPTimeout(void *inContext)
+{
+  if(configSoftAPTimerInitialized == true)
+    mico_stop_timer(&configSoftAPTimer);
+  micoWlanSuspendSoftAP();
+  _easylinkConnectWiFi(inContext);
+}
+
+/*kNotFoundErr if the field is absent, kMalformedErr if it is not digestLen bytes in hex*/
+static OSStatus _LocalConfigGetDigest(http_parser_t *parser, const char *name, uint8_t *outDigest, size_t digestLen)
+{
+  OSStatus err = kNotFoundErr;
+  const char *value;
+  size_t valueLen, i;
+  char c;
+  uint8_t nibble;
+
+  require_noerr_quiet(HTTPParserGetField(parser, name, &value, &valueLen), exit);
+  err = kMalformedErr;
+  require(valueLen == digestLen * 2, exit);
+  for(i = 0; i < valueLen; i++){
+    c = value[i];
+    if(c >= '0' && c <= '9')      nibble = c - '0';
+    else if(c >= 'a' && c <= 'f') nibble = c - 'a' + 10;
+    else if(c >= 'A' && c <= 'F') nibble = c - 'A' + 10;
+    else goto exit;
+    outDigest[i/2] = (i % 2) ? (outDigest[i/2] | nibble) : (nibble << 4);
   }
+  err = kNoErr;
 
-  if(err!=kNoErr)  config_log("onReceivedData");
+exit:
   return err;
+}
 
-flashErrExit:
-  MicoFlashFinalize(MICO_FLASH_FOR_UPDATE);
-  mico_rtos_unlock_mutex(&Context->flashContentInRam_mutex);
+/*Decimal digits at *p, *p is moved after them. kMalformedErr if there is none or the value exceeds 32 bits*/
+static OSStatus _LocalConfigParseNumber(const char **p, const char *end, uint32_t *outValue)
+{
+  const char *start = *p;
+  uint64_t value = 0;
+
+  while(*p < end && **p >= '0' && **p <= '9' && value <= 0xFFFFFFFF){
+    value = value * 10 + (**p - '0');
+    (*p)++;
+  }
+  if(*p == start || value > 0xFFFFFFFF) return kMalformedErr;
+  *outValue = (uint32_t)value;
+  return kNoErr;
+}
+
+/*kNotFoundErr if the field is absent, kMalformedErr if it is not a decimal number*/
+static OSStatus _LocalConfigGetNumber(http_parser_t *parser, const char *name, uint32_t *outValue)
+{
+  OSStatus err = kNotFoundErr;
+  const char *value, *end;
+  size_t valueLen;
+
+  require_noerr_quiet(HTTPParserGetField(parser, name, &value, &valueLen), exit);
+  end = value + valueLen;
+  err = _LocalConfigParseNumber(&value, end, outValue);
+  require_noerr(err, exit);
+  require_action(value == end, exit, err = kMalformedErr);
+
+exit:
   return err;
 }
 
-static void onClearHTTPHeader(struct _HTTPHeader_t * inHeader, void * inUserContext )
+/*"Content-Range: bytes <first>-<last>/<length>", kNotFoundErr if absent*/
+static OSStatus _LocalConfigGetContentRange(http_parser_t *parser, uint32_t *outFirst, uint32_t *outLast, uint32_t *outLength)
 {
-  UNUSED_PARAMETER(inHeader);
-  configContext_t *context = (configContext_t *)inUserContext;
+  OSStatus err = kNotFoundErr;
+  const char *value, *end;
+  size_t valueLen;
+
+  require_noerr_quiet(HTTPParserGetField(parser, "Content-Range", &value, &valueLen), exit);
+  end = value + valueLen;
+  err = kMalformedErr;
+  require(valueLen > 6 && strncmp(value, "bytes ", 6) == 0, exit);
+  value += 6;
+  require_noerr(_LocalConfigParseNumber(&value, end, outFirst), exit);
+  require(value < end && *value++ == '-', exit);
+  require_noerr(_LocalConfigParseNumber(&value, end, outLast), exit);
+  require(value < end && *value++ == '/', exit);
+  require_noerr(_LocalConfigParseNumber(&value, end, outLength), exit);
+  require(value == end && *outFirst <= *outLast && *outLast < *outLength, exit);
+  err = kNoErr;
 
-  if(context->isFlashLocked == true){
-    mico_rtos_unlock_mutex(&Context->flashContentInRam_mutex);
-    context->isFlashLocked = false;
-  }
- }
+exit:
+  return err;
+}
+
+/*An empty response that tells how many bytes of the image the device has*/
+static OSStatus _LocalConfigRespondOTAOffset(configConnection_t *client, int status, uint32_t offset, bool persistent)
+{
+  OSStatus err;
+  size_t len;
+  int fieldLen;
+
+  err = CreateHTTPRespondHeader(status, NULL, 0, persistent, configResponseHeader, sizeof(configResponseHeader), &len);
+  require_noerr(err, exit);
+  // The field goes before the empty line that ends the header
+  len -= 2;
+  fieldLen = snprintf(configResponseHeader + len, sizeof(configResponseHeader) - len, "%s: %u\r\n\r\n",
+                      kCONFIGFieldOTAOffset, (unsigned int)offset);
+  require_action(fieldLen > 0 && (size_t)fieldLen < sizeof(configResponseHeader) - len, exit, err = kNoSpaceErr);
+  err = TCPConnectionSend(client->connection, (uint8_t *)configResponseHeader, len + fieldLen);
+
+exit:
+  return err;
+}
 
+/*The header of an OTA request is complete, open the sink. A request that names its image continues the saved progress*/
+static OSStatus _LocalConfigStartOTA(configConnection_t *client)
+{
+#ifdef MICO_FLASH_FOR_UPDATE
+  OSStatus err = kNoErr;
+  http_parser_t *parser = &client->parser;
+  configContext_t *context = &client->httpContext;
+  ota_image_id_t image;
+  uint32_t first = 0, last, offset = 0;
+  OSStatus rangeErr;
+  mico_flash_t flash;
+  uint32_t start, end;
+
+  require_action(context->otaSink == NULL, exit, err = kStateErr);
+  // Only one image fits in the update area
+  require_action(configOTAInProgress == false, exit, err = _LocalConfigRespondError(client, kStatusServiceUnavailable, kAlreadyInUseErr));
+  memset(&image, 0, sizeof(ota_image_id_t));
+  rangeErr = _LocalConfigGetContentRange(parser, &first, &last, &image.length);
+  require_action(rangeErr != kMalformedErr, exit, err = _LocalConfigRespondError(client, kStatusBadRequest, kParamErr));
+  if(rangeErr == kNoErr)
+    require_action(parser->hasContentLength && parser->contentLength == (uint64_t)last - first + 1, exit,
+                   err = _LocalConfigRespondError(client, kStatusBadRequest, kParamErr));
+  else if(parser->hasContentLength && parser->contentLength <= 0xFFFFFFFF)
+    image.length = (uint32_t)parser->contentLength;
+  if(_LocalConfigGetDigest(parser, kCONFIGFieldOTAMD5, image.md5, sizeof(image.md5)) != kNoErr)
+    image.length = 0;
+  require_action(rangeErr != kNoErr || image.length > 0, exit, err = _LocalConfigRespondError(client, kStatusBadRequest, kParamErr));
+
+  context->otaSink = calloc(1, sizeof(ota_sink_t));
+  require_action(context->otaSink, exit, err = kNoMemoryErr);
+  configOTAInProgress = true;
+  context->ownsOTA = true;
+  mico_rtos_lock_mutex(&Context->flashContentInRam_mutex);
+  MICOGetOTATarget(Context, &flash, &start, &end);
+  mico_rtos_unlock_mutex(&Context->flashContentInRam_mutex);
+  // Sectors are erased as the image reaches them, the client is not stalled by the erase of the whole area
+  if(image.length > 0 && kOTAUpdateSectorSize > 0)
+    err = OTASinkOpenSession(context->otaSink, flash, start, end,
+                             kOTAUpdateSectorSize, kOTADigest_MD5 | kOTADigest_SHA256, &image, &offset);
+  else
+    err = OTASinkOpen(context->otaSink, flash, start, end,
+                      kOTAUpdateSectorSize, kOTADigest_MD5 | kOTADigest_SHA256);
+  require_noerr(err, exit);
+
+  // A gap between the image in flash and the body cannot be filled
+  require_action(first <= offset, exit, _LocalConfigRespondOTAOffset(client, kStatusRangeNotSatisfiable, offset, false); err = kRangeErr);
+  context->otaSkip = offset - first;
 
+exit:
+  return err;
+#else
+  UNUSED_PARAMETER(client);
+  config_log("OTA storage is not exist");
+  return kUnsupportedErr;
+#endif
+}
 
-OSStatus _LocalConfigRespondInComingMessage(int fd, HTTPHeader_t* inHeader, mico_Context_t * const inContext)
+/*Returns kNoErr to keep the connection for the next request*/
+OSStatus _LocalConfigRespondInComingMessage(configConnection_t *client, mico_Context_t * const inContext)
 {
   OSStatus err = kUnknownErr;
+  http_parser_t *inHeader = &client->parser;
   const char *  json_str;
-  uint8_t *httpResponse = NULL;
   size_t httpResponseLen = 0;
   json_object* report = NULL;
+  bool persistent = inHeader->persistent;
+#ifdef MICO_FLASH_FOR_UPDATE
+  uint8_t md5[16], sha256[SHA256HashSize];
+  OSStatus md5Err, sha256Err;
+  ota_image_id_t image;
+  ota_sink_t *sink;
+#endif
   config_log_trace();
 
-  if(HTTPHeaderMatchURL( inHeader, kCONFIGURLRead ) == kNoErr){    
+  if(HTTPParserMatchURL( inHeader, kCONFIGURLRead ) == kNoErr){    
     report = ConfigCreateReportJsonMessage( inContext );
     require( report, exit );
     json_str = json_object_to_json_string(report);
     require_action( json_str, exit, err = kNoMemoryErr );
     config_log("Send config object=%s", json_str);
-    err =  CreateSimpleHTTPMessageNoCopy( kMIMEType_JSON, strlen(json_str), &httpResponse, &httpResponseLen );
+    err = CreateHTTPRespondHeader( kStatusOK, kMIMEType_JSON, strlen(json_str), persistent, configResponseHeader, sizeof(configResponseHeader), &httpResponseLen );
     require_noerr( err, exit );
-    require( httpResponse, exit );
-    err = SocketSend( fd, httpResponse, httpResponseLen );
+    err = TCPConnectionSend( client->connection, (uint8_t *)configResponseHeader, httpResponseLen );
     require_noerr( err, exit );
-    err = SocketSend( fd, (uint8_t *)json_str, strlen(json_str) );
+    err = TCPConnectionSend( client->connection, (uint8_t *)json_str, strlen(json_str) );
     require_noerr( err, exit );
     config_log("Current configuration sent");
     goto exit;
   }
-  else if(HTTPHeaderMatchURL( inHeader, kCONFIGURLWrite ) == kNoErr){
-    if(inHeader->contentLength > 0){
-      config_log("Recv new configuration, apply and reset");
-      err = ConfigIncommingJsonMessage( inHeader->extraDataPtr, inContext);
-      require_noerr( err, exit );
-      inContext->flashContentInRam.micoSystemConfig.configured = allConfigured;
-      MICOUpdateConfiguration(inContext);
+  else if(HTTPParserMatchURL( inHeader, kCONFIGURLWrite ) == kNoErr){
+    require_action( client->bodyLen > 0, exit, err = _LocalConfigRespondError(client, kStatusBadRequest, kParamErr) );
+    config_log("Recv new configuration, apply and reset");
+    err = ConfigIncommingJsonMessage( (const char *)client->body, inContext);
+    require_noerr( err, exit );
+    inContext->flashContentInRam.micoSystemConfig.configured = allConfigured;
+    MICOScheduleConfigurationSave(inContext); //Saved before the reset by the main thread
 
-      err =  CreateSimpleHTTPOKMessage( &httpResponse, &httpResponseLen );
-      require_noerr( err, exit );
-      require( httpResponse, exit );
-      err = SocketSend( fd, httpResponse, httpResponseLen );
-      SocketClose(&fd);
-      inContext->micoStatus.sys_state = eState_Software_Reset;
-      if(inContext->micoStatus.sys_state_change_sem != NULL );
-        mico_rtos_set_semaphore(&inContext->micoStatus.sys_state_change_sem);
-      mico_thread_sleep(MICO_WAIT_FOREVER);
-    }
+    persistent = false; //Close the socket once the response is written, the device is being reset
+    err = CreateHTTPRespondHeader( kStatusOK, NULL, 0, persistent, configResponseHeader, sizeof(configResponseHeader), &httpResponseLen );
+    require_noerr( err, exit );
+    TCPConnectionSend( client->connection, (uint8_t *)configResponseHeader, httpResponseLen );
+    inContext->micoStatus.sys_state = eState_Software_Reset;
+    if(inContext->micoStatus.sys_state_change_sem != NULL )
+      mico_rtos_set_semaphore(&inContext->micoStatus.sys_state_change_sem);
     goto exit;
   }
-else if(HTTPHeaderMatchURL( inHeader, kCONFIGURLWriteByUAP ) == kNoErr){
-    if(inHeader->contentLength > 0){
-      config_log("Recv new configuration from uAP, apply and connect to AP");
-      err = ConfigIncommingJsonMessageUAP( inHeader->extraDataPtr, inContext);
-      require_noerr( err, exit );
-      MICOUpdateConfiguration(inContext);
-
-      err =  CreateSimpleHTTPOKMessage( &httpResponse, &httpResponseLen );
-      require_noerr( err, exit );
-      require( httpResponse, exit );
-
-      err = SocketSend( fd, httpResponse, httpResponseLen );
-      require_noerr( err, exit );
-      sleep(1);
-
-      micoWlanSuspendSoftAP();
-      _easylinkConnectWiFi( inContext );
+  else if(HTTPParserMatchURL( inHeader, kCONFIGURLWriteByUAP ) == kNoErr){
+    require_action( client->bodyLen > 0, exit, err = _LocalConfigRespondError(client, kStatusBadRequest, kParamErr) );
+    config_log("Recv new configuration from uAP, apply and connect to AP");
+    err = ConfigIncommingJsonMessageUAP( (const char *)client->body, inContext);
+    require_noerr( err, exit );
+    MICOScheduleConfigurationSave(inContext);
 
-      err = kConnectionErr; //Return an err to close socket and exit the current thread
-    }
+    persistent = false; //The soft AP goes down, so does the connection
+    err = CreateHTTPRespondHeader( kStatusOK, NULL, 0, persistent, configResponseHeader, sizeof(configResponseHeader), &httpResponseLen );
+    require_noerr( err, exit );
+    err = TCPConnectionSend( client->connection, (uint8_t *)configResponseHeader, httpResponseLen );
+    require_noerr( err, exit );
+    client->suspendSoftAP = true; //In localConfigClosed, once the response is written
     goto exit;
   }
 #ifdef MICO_FLASH_FOR_UPDATE
-  else if(HTTPHeaderMatchURL( inHeader, kCONFIGURLOTA ) == kNoErr){
-    if(inHeader->contentLength > 0){
-      config_log("Receive OTA data!");
-      memset(&inContext->flashContentInRam.bootTable, 0, sizeof(boot_table_t));
-      inContext->flashContentInRam.bootTable.length = inHeader->contentLength;
-      inContext->flashContentInRam.bootTable.start_address = UPDATE_START_ADDRESS;
-      inContext->flashContentInRam.bootTable.type = 'A';
-      inContext->flashContentInRam.bootTable.upgrade_type = 'U';
-      if(inContext->flashContentInRam.micoSystemConfig.configured != allConfigured)
-        inContext->flashContentInRam.micoSystemConfig.easyLinkByPass = EASYLINK_SOFT_AP_BYPASS;
-      MICOUpdateConfiguration(inContext);
-      SocketClose(&fd);
-      inContext->micoStatus.sys_state = eState_Software_Reset;
-      if(inContext->micoStatus.sys_state_change_sem != NULL );
-        mico_rtos_set_semaphore(&inContext->micoStatus.sys_state_change_sem);
-      mico_thread_sleep(MICO_WAIT_FOREVER);
+  else if(HTTPParserMatchURL( inHeader, kCONFIGURLOTA ) == kNoErr && HTTPParserMatchMethod( inHeader, "GET" ) == kNoErr){
+    memset(&image, 0, sizeof(ota_image_id_t));
+    require_action( _LocalConfigGetDigest( inHeader, kCONFIGFieldOTAMD5, image.md5, sizeof(image.md5) ) == kNoErr &&
+                    _LocalConfigGetNumber( inHeader, kCONFIGFieldOTALength, &image.length ) == kNoErr,
+                    exit, err = _LocalConfigRespondError(client, kStatusBadRequest, kParamErr) );
+    err = _LocalConfigRespondOTAOffset( client, kStatusOK, OTASessionGetOffset( &image ), persistent );
+    require_noerr( err, exit );
+    goto exit;
+  }
+  else if(HTTPParserMatchURL( inHeader, kCONFIGURLOTA ) == kNoErr){
+    require_action( client->isOTA == true && client->httpContext.otaSink, exit, err = _LocalConfigRespondError(client, kStatusBadRequest, kParamErr) );
+    sink = client->httpContext.otaSink;
+    if( sink->hasSession == true && OTASinkLength( sink ) < sink->image.length ){
+      config_log("Receive OTA data, %u of %u bytes", (unsigned int)OTASinkLength( sink ), (unsigned int)sink->image.length);
+      err = _LocalConfigRespondOTAOffset( client, kStatusOK, OTASessionGetOffset( &sink->image ), persistent );
+      require_noerr( err, exit );
+      goto exit;
     }
+    config_log("Receive OTA data!");
+    // A corrupt image is rejected here, before the boot table points to it
+    md5Err = _LocalConfigGetDigest( inHeader, kCONFIGFieldOTAMD5, md5, sizeof(md5) );
+    sha256Err = _LocalConfigGetDigest( inHeader, kCONFIGFieldOTASHA256, sha256, sizeof(sha256) );
+    require_action( md5Err != kMalformedErr && sha256Err != kMalformedErr, exit, err = _LocalConfigRespondError(client, kStatusBadRequest, kMalformedErr) );
+    err = OTASinkFinish( client->httpContext.otaSink, md5Err == kNoErr ? md5 : NULL, sha256Err == kNoErr ? sha256 : NULL );
+    require_noerr_action( err, exit, err = _LocalConfigRespondError(client, kStatusBadRequest, err) );
+
+    // With two application slots the image is checked to be linked for the slot it is in
+    mico_rtos_lock_mutex( &inContext->flashContentInRam_mutex );
+    err = MICOSetOTABootTable( inContext, OTASinkLength( client->httpContext.otaSink ) );
+    if( err == kNoErr && inContext->flashContentInRam.micoSystemConfig.configured != allConfigured )
+      inContext->flashContentInRam.micoSystemConfig.easyLinkByPass = EASYLINK_SOFT_AP_BYPASS;
+    mico_rtos_unlock_mutex( &inContext->flashContentInRam_mutex );
+    require_noerr_action( err, exit, err = _LocalConfigRespondError(client, kStatusBadRequest, err) );
+    onOTAEnd(&client->httpContext); //The image is written, release the update flash before the parameters are saved
+    MICOUpdateConfiguration(inContext);
+
+    persistent = false; //Close the socket once the response is written, the device is being reset
+    err = CreateHTTPRespondHeader( kStatusOK, NULL, 0, persistent, configResponseHeader, sizeof(configResponseHeader), &httpResponseLen );
+    require_noerr( err, exit );
+    TCPConnectionSend( client->connection, (uint8_t *)configResponseHeader, httpResponseLen );
+    inContext->micoStatus.sys_state = eState_Software_Reset;
+    if(inContext->micoStatus.sys_state_change_sem != NULL )
+      mico_rtos_set_semaphore(&inContext->micoStatus.sys_state_change_sem);
     goto exit;
   }
 #endif
   else{
-    return kNotFoundErr;
+    err = CreateHTTPRespondHeader( kStatusNotFound, NULL, 0, persistent, configResponseHeader, sizeof(configResponseHeader), &httpResponseLen );
+    require_noerr( err, exit );
+    err = TCPConnectionSend( client->connection, (uint8_t *)configResponseHeader, httpResponseLen );
+    require_noerr( err, exit );
   };
 
  exit:
-  if(inHeader->persistent == false)  //Return an err to close socket and exit the current thread
+  if(persistent == false && err == kNoErr)  //Return an err to close the socket once the response is written
     err = kConnectionErr;
-  if(httpResponse)  free(httpResponse);
   if(report)        json_object_put(report);
 
   return err;
@@ -56,18 +56,27 @@
 
 /* Define MICO service thread stack size */
 #ifdef DEBUG
-  #define STACK_SIZE_LOCAL_CONFIG_SERVER_THREAD   0x300
-  #define STACK_SIZE_LOCAL_CONFIG_CLIENT_THREAD   0x420
+  #define STACK_SIZE_LOCAL_CONFIG_SERVER_THREAD   0x480
   #define STACK_SIZE_NTP_CLIENT_THREAD            0x400
   #define STACK_SIZE_MICO_SYSTEM_MONITOR_THREAD   0x300
+  #define STACK_SIZE_CONFIG_SAVE_THREAD           0x500
+  #define STACK_SIZE_NOTIFICATION_THREAD          0x500
 #else
-  #define STACK_SIZE_LOCAL_CONFIG_SERVER_THREAD   0x180
-  #define STACK_SIZE_LOCAL_CONFIG_CLIENT_THREAD   0x3C0
+  #define STACK_SIZE_LOCAL_CONFIG_SERVER_THREAD   0x400
   #define STACK_SIZE_NTP_CLIENT_THREAD            0x3A0
   #define STACK_SIZE_MICO_SYSTEM_MONITOR_THREAD   0x120
+  #define STACK_SIZE_CONFIG_SAVE_THREAD           0x400
+  #define STACK_SIZE_NOTIFICATION_THREAD          0x400
 #endif
 
 #define CONFIG_SERVICE_PORT     8000
+#define CONFIG_SERVICE_MAX_CLIENTS    4
+#define CONFIG_SERVICE_IDLE_TIMEOUT   60000 /**< Config clients are closed after 60 seconds without traffic */
+#define CONFIG_SERVICE_HEADER_SIZE    512   /**< Request line and header fields of one request */
+#define CONFIG_SERVICE_MAX_BODY       2048  /**< Largest request body, OTA data is written to flash instead */
+
+#define CONFIG_SAVE_DELAY             2000  /**< A scheduled save waits this long for more changes, in ms */
+#define CONFIG_SAVE_MAX_DELAY         10000 /**< but no longer than this after the first change, in ms */
 
 #define APPLICATION_WATCHDOG_TIMEOUT_SECONDS  5 /**< Watch-dog enabled by MICO's main thread:
                                                      5 seconds to reload. */
@@ -105,16 +114,39 @@ typedef enum
 } SYS_State_t;
 
 
+/* With two application slots (APPLICATION_B_START_ADDRESS) an image is written to
+ * the slot that is not running, and the boot table selects it: nothing is copied
+ * at boot. The bootloader clears a bit of trial_boots in place before each boot of
+ * an unconfirmed slot and starts the other slot again when none is left, until
+ * MICOConfirmBootSlot() is called.
+ */
+#define BOOT_TRIAL_BOOTS                        0x0F /**< Three trial boots of a new slot */
+
 /* Upgrade iamge should save this table to flash */
 typedef struct  _boot_table_t {
   uint32_t start_address; // the address of the bin saved on flash.
   uint32_t length; // file real length
   uint8_t version[8];
   uint8_t type; // B:bootloader, P:boot_table, A:application, D: 8782 driver
-  uint8_t upgrade_type; //u:upgrade, 
-  uint8_t reserved[6];
+  uint8_t upgrade_type; //u:upgrade, S:start an application slot
+  uint8_t slot; // S: A or B, the application slot holding the image
+  uint8_t trial_boots; // S: a set bit for each trial boot left, 0: rolled back, 0xFF: confirmed
+  uint32_t crc; // S: CRC-32 of the image
 }boot_table_t;
 
+/* With application slots the boot table is kept in boot records instead, which are
+ * never erased together with the configuration. A change is appended to EX_PARA with
+ * the next seq, PARA keeps a copy of the newest record at its end while a full EX_PARA
+ * is erased. The bootloader starts the newest valid record, a power cut while one is
+ * written leaves the one before. crc does not cover trial_boots, its bits are cleared
+ * in place.
+ */
+typedef struct  _boot_record_t {
+  boot_table_t table;
+  uint32_t seq; // 1 for the first record, 0xFFFFFFFF: erased
+  uint32_t crc; // CRC-32 of table and seq, trial_boots counted as 0xFF
+}boot_record_t;
+
 typedef struct _mico_sys_config_t
 {
   /*Device identification*/
@@ -187,6 +219,15 @@ typedef struct _mico_Context_t
   current_app_status_t      appStatus;
 } mico_Context_t;
 
+typedef struct {
+  uint32_t  requests;       //! Saves requested by MICOUpdateConfiguration(), MICOScheduleConfigurationSave() and restores.
+  uint32_t  saves;          //! Configurations written to flash.
+  uint32_t  unchanged;      //! Saves not written because flash held the same configuration.
+  uint32_t  coalesced;      //! Scheduled saves merged into a save that was pending already.
+  uint32_t  erases;         //! PARA rewrites, key-value store and boot record sector erases.
+  uint32_t  erasesAvoided;  //! Requests that did not cost an erase, each rewrote PARA before.
+} mico_config_stats_t;
+
 #define CONFIG_DATA_SIZE (sizeof(application_config_t)-sizeof(uint32_t))
 
 OSStatus MICOStartBonjourService        ( WiFi_Interface interface, mico_Context_t * const inContext );
@@ -197,6 +238,21 @@ OSStatus MICOStartApplication           ( mico_Context_t * const inContext );
 OSStatus MICORestoreDefault             ( mico_Context_t * const inContext );
 OSStatus MICOReadConfiguration          ( mico_Context_t * const inContext );
 OSStatus MICOUpdateConfiguration        ( mico_Context_t * const inContext );
+/* Save flashContentInRam once it has not changed for CONFIG_SAVE_DELAY ms, on a thread of its own.
+ * Nothing is written if it equals the configuration in flash. Call it where MICOUpdateConfiguration()
+ * would be called, MICOUpdateConfiguration() saves a pending change at once. */
+OSStatus MICOScheduleConfigurationSave  ( mico_Context_t * const inContext );
+/* Save a scheduled change now, before a reset or a power down */
+OSStatus MICOFlushConfiguration         ( mico_Context_t * const inContext );
+void     MICOGetConfigurationStats      ( mico_config_stats_t *outStats );
+
+/* Where OTA writes a new application: the update area, or the slot that is not running */
+void     MICOGetOTATarget               ( mico_Context_t * const inContext, mico_flash_t *outFlash, uint32_t *outStart, uint32_t *outEnd );
+/* Set bootTable for an image of length bytes written to the OTA target, save it with MICOUpdateConfiguration().
+ * With application slots the boot record is written at once. */
+OSStatus MICOSetOTABootTable            ( mico_Context_t * const inContext, uint32_t length );
+/* The running slot works, stop its trial boots. MICO calls it once the application is started and the station got an address */
+OSStatus MICOConfirmBootSlot            ( mico_Context_t * const inContext );
 #ifdef MFG_MODE_AUTO
 OSStatus MICORestoreMFG                 ( mico_Context_t * const inContext );
 #endif
@@ -38,7 +38,7 @@
 
 #include "MICONotificationCenter.h"
 #include "MICOSystemMonitor.h"
-#include "MicoCli.h"
+#include "MICOCli.h"
 #include "EasyLink/EasyLink.h"
 #include "SoftAP/EasyLinkSoftAP.h"
 #include "WPS/WPS.h"
@@ -154,6 +154,8 @@ void micoNotify_WifiStatusHandler(WiFiEvent event, mico_Context_t * const inCont
 void micoNotify_DHCPCompleteHandler(IPStatusTypedef *pnet, mico_Context_t * const inContext)
 {
   mico_log_trace();
+  static bool bootSlotConfirmed = false;
+  OSStatus err;
   require(inContext, exit);
   mico_rtos_lock_mutex(&inContext->flashContentInRam_mutex);
   strcpy((char *)inContext->micoStatus.localIp, pnet->ip);
@@ -161,6 +163,13 @@ void micoNotify_DHCPCompleteHandler(IPStatusTypedef *pnet, mico_Context_t * cons
   strcpy((char *)inContext->micoStatus.gateWay, pnet->gate);
   strcpy((char *)inContext->micoStatus.dnsServer, pnet->dns);
   mico_rtos_unlock_mutex(&inContext->flashContentInRam_mutex);
+
+  /*The application is started and the station has an address, a new application slot is kept*/
+  if(bootSlotConfirmed == false){
+    err = MICOConfirmBootSlot(inContext);
+    if(err == kNoErr) bootSlotConfirmed = true;
+    else mico_log("WARNING: Unable to confirm the application slot, err = %d", err);
+  }
 exit:
   return;
 }
@@ -201,8 +210,9 @@ void micoNotify_WiFIParaChangedHandler(apinfo_adv_t *ap_info, char *key, int key
     _needsUpdate = true;
   }
 
+  /* Reconnects and roaming report the same AP again, only changes are written */
   if(_needsUpdate== true)  
-    MICOUpdateConfiguration(inContext);
+    MICOScheduleConfigurationSave(inContext);
   mico_rtos_unlock_mutex(&inContext->flashContentInRam_mutex);
   
 exit:
@@ -439,17 +449,20 @@ int application_start(void)
       case eState_Normal:
         break;
       case eState_Software_Reset:
+        MICOFlushConfiguration(context);
         sendNotifySYSWillPowerOff();
         mico_thread_msleep(500);
         MicoSystemReboot();
         break;
       case eState_Wlan_Powerdown:
+        MICOFlushConfiguration(context);
         sendNotifySYSWillPowerOff();
         mico_thread_msleep(500);
         micoWlanPowerOff();
         break;
       case eState_Standby:
         mico_log("Enter standby mode");
+        MICOFlushConfiguration(context);
         sendNotifySYSWillPowerOff();
         mico_thread_msleep(200);
         micoWlanPowerOff();
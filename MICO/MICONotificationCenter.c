@@ -30,18 +30,163 @@
 ******************************************************************************
 */
 
-
 #include "MICONotificationCenter.h"
 
-typedef struct _Notify_list{
-  void  *function;
-  struct _Notify_list *next;
-  void  *contex;
-} _Notify_list_t;
+#ifndef MICO_NOTIFY_QUEUE_LENGTH
+#define MICO_NOTIFY_QUEUE_LENGTH        (8)     /* Notifications waiting for one thread */
+#endif
+
+#ifndef MICO_NOTIFY_EVENT_POOL_SIZE
+#define MICO_NOTIFY_EVENT_POOL_SIZE     (12)    /* Copies of queued arguments, shared by the threads */
+#endif
+
+#ifndef MICO_NOTIFY_MAX_HANDLERS
+#define MICO_NOTIFY_MAX_HANDLERS        (32)    /* Of all notifications, with the ones just removed */
+#endif
+
+#define MICO_NOTIFY_TYPES               (20)
+
+#define kNotifyNone                     0xFF    /* No handler slot, the end of a list */
+
+/* Notification type flags */
+#define kNotifyQueueable                0x01    /* The arguments can be copied, to be delivered later */
+#define kNotifyCoalesce                 0x02    /* Not queued again while the same one waits */
+
+/* Handler slot states */
+enum {
+  kNotifySlotFree,
+  kNotifySlotLive,
+  kNotifySlotRetired,                           /* Removed, a dispatch may still be on it */
+};
+
+/* Handlers are added and removed with notify_mutex locked, and dispatch walks
+ * the lists of handlers without it. A slot is filled before it is linked to
+ * a list, and a removed slot keeps its link to the next one, so a dispatch
+ * on it goes on. A dispatch counts itself in notify_readers[] of the parity
+ * of the epoch it starts in, and the epoch only advances once every dispatch
+ * of the epoch before has ended: a slot removed in epoch E is reused from
+ * epoch E + 2. Nothing waits for a dispatch to end, so a handler can remove
+ * itself or other handlers.
+ */
+#if defined ( __GNUC__ )
+#define notify_load( p )                __atomic_load_n( (p), __ATOMIC_SEQ_CST )
+#define notify_store( p, v )            __atomic_store_n( (p), (v), __ATOMIC_SEQ_CST )
+#define notify_add( p, v )              __atomic_add_fetch( (p), (v), __ATOMIC_SEQ_CST )
+#else
+#if defined ( __IAR_SYSTEMS_ICC__ )
+#include <intrinsics.h>
+#define notify_barrier()                __DMB()
+#define notify_ldrex( p )               __LDREX( (unsigned long *)(p) )
+#define notify_strex( v, p )            __STREX( (v), (unsigned long *)(p) )
+#elif defined ( __CC_ARM )
+#define notify_barrier()                __dmb( 0xF )
+#define notify_ldrex( p )               __ldrex( p )
+#define notify_strex( v, p )            __strex( (v), (p) )
+#endif
+static inline uint32_t notify_load( volatile uint32_t *p )
+{
+  uint32_t value;
+  notify_barrier();
+  value = *p;
+  notify_barrier();
+  return value;
+}
+static inline void notify_store( volatile uint32_t *p, uint32_t value )
+{
+  notify_barrier();
+  *p = value;
+  notify_barrier();
+}
+static inline uint32_t notify_add( volatile uint32_t *p, int32_t delta )
+{
+  uint32_t value;
+  notify_barrier();
+  do{
+    value = notify_ldrex( p ) + delta;
+  }while( notify_strex( value, p ) );
+  notify_barrier();
+  return value;
+}
+#endif
+
+/* Arguments of a notification, as its handlers take them */
+typedef struct {
+  void      *pointer;
+  char      *string;
+  int       value;
+  uint32_t  ip;
+} notify_args_t;
+
+typedef struct {
+  mico_notify_types_t   type;
+  uint32_t              time;           // Sent at, by mico_get_time()
+  notify_args_t         args;
+  union {
+    IPStatusTypedef         net;
+    network_InitTypeDef_st  nwkpara;
+    struct {
+      apinfo_adv_t          ap_info;
+      char                  key[64];
+    } para;
+  } copy;                               // What the args of a queued event point to
+  uint8_t               refs;           // Queue entries holding it, 0 if it is free
+} notify_event_t;
+
+typedef struct {
+  notify_event_t *      event;
+  uint8_t               priority;
+} notify_entry_t;
+
+typedef struct {
+  mico_semaphore_t      sem;
+  notify_entry_t        pending[ MICO_NOTIFY_QUEUE_LENGTH ];  // Oldest first
+  uint8_t               count;
+  bool                  quit;
+} notify_worker_t;
+
+typedef struct {
+  void *                function;
+  notify_worker_t *     worker;         // NULL if it is called by the sender
+  uint32_t              next;           // Next handler of the type, read by dispatch
+  uint32_t              state;          // Read by dispatch
+  uint32_t              retired;        // Epoch it was removed in
+  uint16_t              generation;     // Of its handles
+  uint8_t               type;
+  uint8_t               priority;
+  uint8_t               prev;           // Previous handler of the type
+  uint8_t               link;           // Next slot of the free or the retired list
+} notify_slot_t;
 
 static mico_Context_t * _Context;
 
-_Notify_list_t* Notify_list[20] = {NULL};
+static mico_mutex_t notify_mutex = NULL;
+static notify_worker_t notify_shared_worker;
+static bool notify_shared_worker_started = false;
+static notify_event_t notify_events[ MICO_NOTIFY_EVENT_POOL_SIZE ];
+static mico_notify_stats_t notify_stats[ MICO_NOTIFY_TYPES ];
+
+static notify_slot_t notify_slots[ MICO_NOTIFY_MAX_HANDLERS ];
+static uint32_t notify_heads[ MICO_NOTIFY_TYPES ];       // First handler of each type, highest priority first
+static uint8_t notify_free = kNotifyNone;
+static uint8_t notify_retired = kNotifyNone;              // Oldest first
+static uint8_t notify_retired_last = kNotifyNone;
+static uint32_t notify_epoch = 0;
+static uint32_t notify_readers[ 2 ];
+
+static const uint8_t notify_flags[ MICO_NOTIFY_TYPES ] = {
+  [mico_notify_WIFI_STATUS_CHANGED]     = kNotifyQueueable | kNotifyCoalesce,
+  [mico_notify_WiFI_PARA_CHANGED]       = kNotifyQueueable,
+  [mico_notify_DHCP_COMPLETED]          = kNotifyQueueable | kNotifyCoalesce,
+  [mico_notify_EASYLINK_WPS_COMPLETED]  = kNotifyQueueable,
+  [mico_notify_TCP_CLIENT_CONNECTED]    = kNotifyQueueable,
+  [mico_notify_WIFI_CONNECT_FAILED]     = kNotifyQueueable | kNotifyCoalesce,
+  [mico_notify_WIFI_Fatal_ERROR]        = kNotifyQueueable | kNotifyCoalesce,
+};
+
+/* Of a dedicated thread, by mico_notify_priority_t */
+static const uint8_t notify_thread_priority[] = {
+  MICO_DEFAULT_WORKER_PRIORITY - 1, MICO_DEFAULT_WORKER_PRIORITY, MICO_APPLICATION_PRIORITY
+};
 
 /* MICO system defined notifications */
 typedef void (*mico_notify_WIFI_SCAN_COMPLETE_function)           ( ScanResult *pApList, mico_Context_t * inContext );
@@ -61,219 +206,541 @@ typedef void (*mico_notify_STACK_OVERFLOW_ERROR_function)         ( char *taskna
 
 /* User defined notifications */
 
-void ApListCallback(ScanResult *pApList)
+static uint32_t _notify_read_lock( void )
 {
-  _Notify_list_t *temp =  Notify_list[mico_notify_WIFI_SCAN_COMPLETED];
-  if(temp == NULL)
-    return;
-  else{
-    do{
-      ((mico_notify_WIFI_SCAN_COMPLETE_function)(temp->function))(pApList, _Context);
-      temp = temp->next;
-    }while(temp!=NULL);
+  uint32_t epoch;
+
+  for( ;; ){
+    epoch = notify_load( &notify_epoch );
+    notify_add( &notify_readers[ epoch & 1 ], 1 );
+    // The epoch may have advanced before it was counted
+    if( notify_load( &notify_epoch ) == epoch ) return epoch;
+    notify_add( &notify_readers[ epoch & 1 ], -1 );
   }
 }
 
-void ApListAdvCallback(ScanResult_adv *pApAdvList)
+static void _notify_read_unlock( uint32_t epoch )
 {
-  _Notify_list_t *temp =  Notify_list[mico_notify_WIFI_SCAN_ADV_COMPLETED];
-  if(temp == NULL)
-    return;
-  else{
-    do{
-      ((mico_notify_WIFI_SCAN_ADV_COMPLETE_function)(temp->function))(pApAdvList, _Context);
-      temp = temp->next;
-    }while(temp!=NULL);
+  notify_add( &notify_readers[ epoch & 1 ], -1 );
+}
+
+/* Advance the epoch as far as the dispatches under way allow, then free the
+ * slots no dispatch can reach any more. Called with notify_mutex locked.
+ */
+static void _notify_reclaim( void )
+{
+  notify_slot_t *slot;
+  uint8_t index;
+  int i;
+
+  for( i = 0; i < 2 && notify_retired != kNotifyNone; i++ ){
+    if( notify_load( &notify_readers[ ( notify_epoch + 1 ) & 1 ] ) != 0 ) break;
+    notify_store( &notify_epoch, notify_epoch + 1 );
+  }
+
+  while( notify_retired != kNotifyNone && notify_epoch - notify_slots[ notify_retired ].retired >= 2 ){
+    index = notify_retired;
+    slot = &notify_slots[ index ];
+    notify_retired = slot->link;
+    if( notify_retired == kNotifyNone ) notify_retired_last = kNotifyNone;
+    notify_store( &slot->state, kNotifySlotFree );
+    slot->link = notify_free;
+    notify_free = index;
   }
 }
 
-void WifiStatusHandler(WiFiEvent status)
+static mico_notify_handle_t _notify_handle( uint8_t index )
 {
-  _Notify_list_t *temp =  Notify_list[mico_notify_WIFI_STATUS_CHANGED];
-  if(temp == NULL)
-    return;
-  else{
-    do{
-      ((mico_notify_WIFI_STATUS_CHANGED_function)(temp->function))(status, _Context);
-      temp = temp->next;
-    }while(temp!=NULL);
+  return ( (uint32_t)notify_slots[ index ].generation << 8 ) | ( index + 1 );
+}
+
+/* Slot of a handle, kNotifyNone once it is removed */
+static uint8_t _notify_slot_of( mico_notify_handle_t handle )
+{
+  uint32_t index = ( handle & 0xFF ) - 1;
+
+  if( index >= MICO_NOTIFY_MAX_HANDLERS ) return kNotifyNone;
+  if( notify_slots[ index ].generation != ( handle >> 8 ) || notify_slots[ index ].state != kNotifySlotLive )
+    return kNotifyNone;
+  return index;
+}
+
+/* Unlink a handler, the slot is reused once no dispatch can be on it.
+ * Called with notify_mutex locked.
+ */
+static void _notify_remove( uint8_t index )
+{
+  notify_slot_t *slot = &notify_slots[ index ];
+
+  notify_store( ( slot->prev == kNotifyNone ) ? &notify_heads[ slot->type ] : &notify_slots[ slot->prev ].next, slot->next );
+  if( slot->next != kNotifyNone ) notify_slots[ slot->next ].prev = slot->prev;
+  notify_store( &slot->state, kNotifySlotRetired );
+
+  if( slot->worker != NULL && slot->worker != &notify_shared_worker ){
+    // The thread ends once the handler it may be running returns
+    slot->worker->quit = true;
+    mico_rtos_set_semaphore( &slot->worker->sem );
   }
+
+  slot->retired = notify_epoch;
+  slot->link = kNotifyNone;
+  if( notify_retired == kNotifyNone )
+    notify_retired = index;
+  else
+    notify_slots[ notify_retired_last ].link = index;
+  notify_retired_last = index;
+  _notify_reclaim( );
 }
 
-void connected_ap_info(apinfo_adv_t *ap_info, char *key, int key_len)
+static void _notify_call( const notify_event_t *event, void *function )
 {
-  _Notify_list_t *temp =  Notify_list[mico_notify_WiFI_PARA_CHANGED];
-  if(temp == NULL)
-    return;
-  else{
-    do{
-      ((mico_notify_WiFI_PARA_CHANGED_function)(temp->function))(ap_info, key, key_len, _Context);
-      temp = temp->next;
-    }while(temp!=NULL);
+  const notify_args_t *args = &event->args;
+  mico_notify_stats_t *stats = &notify_stats[ event->type ];
+  uint32_t start = mico_get_time( ), latency, duration;
+  int bucket;
+
+  switch( event->type ){
+    case mico_notify_WIFI_SCAN_COMPLETED:
+      ((mico_notify_WIFI_SCAN_COMPLETE_function)function)( args->pointer, _Context );
+      break;
+    case mico_notify_WIFI_SCAN_ADV_COMPLETED:
+      ((mico_notify_WIFI_SCAN_ADV_COMPLETE_function)function)( args->pointer, _Context );
+      break;
+    case mico_notify_WIFI_STATUS_CHANGED:
+      ((mico_notify_WIFI_STATUS_CHANGED_function)function)( (WiFiEvent)args->value, _Context );
+      break;
+    case mico_notify_WiFI_PARA_CHANGED:
+      ((mico_notify_WiFI_PARA_CHANGED_function)function)( args->pointer, args->string, args->value, _Context );
+      break;
+    case mico_notify_DHCP_COMPLETED:
+      ((mico_notify_DHCP_COMPLETE_function)function)( args->pointer, _Context );
+      break;
+    case mico_notify_EASYLINK_WPS_COMPLETED:
+      ((mico_notify_EASYLINK_COMPLETE_function)function)( args->pointer, _Context );
+      break;
+    case mico_notify_EASYLINK_GET_EXTRA_DATA:
+      ((mico_notify_EASYLINK_GET_EXTRA_DATA_function)function)( args->value, args->string, _Context );
+      break;
+    case mico_notify_TCP_CLIENT_CONNECTED:
+      ((mico_notify_TCP_CLIENT_CONNECTED_function)function)( args->value, _Context );
+      break;
+    case mico_notify_DNS_RESOLVE_COMPLETED:
+      ((mico_notify_DNS_RESOLVE_COMPLETED_function)function)( args->pointer, args->ip, _Context );
+      break;
+    case mico_notify_READ_APP_INFO:
+      ((mico_notify_READ_APP_INFO_function)function)( args->string, args->value, _Context );
+      break;
+    case mico_notify_SYS_WILL_POWER_OFF:
+      ((mico_notify_SYS_WILL_POWER_OFF_function)function)( _Context );
+      break;
+    case mico_notify_WIFI_CONNECT_FAILED:
+      ((mico_notify_WIFI_CONNECT_FAILED_function)function)( (OSStatus)args->value, _Context );
+      break;
+    case mico_notify_WIFI_Fatal_ERROR:
+      ((mico_notify_WIFI_FATAL_ERROR_function)function)( _Context );
+      break;
+    case mico_notify_Stack_Overflow_ERROR:
+      ((mico_notify_STACK_OVERFLOW_ERROR_function)function)( args->string, _Context );
+      break;
+    default:
+      break;
   }
+
+  duration = mico_get_time( ) - start;
+  latency = start - event->time;
+  for( bucket = 0; bucket < MICO_NOTIFY_LATENCY_BUCKETS - 1 && ( latency >> bucket ) != 0; bucket++ );
+
+  notify_add( &stats->delivered, 1 );
+  notify_add( &stats->latency[ bucket ], 1 );
+  // A call ending at the same time may lower a maximum, it is only a statistic
+  if( latency > notify_load( &stats->max_latency ) ) notify_store( &stats->max_latency, latency );
+  if( duration > notify_load( &stats->max_handler_time ) ) notify_store( &stats->max_handler_time, duration );
 }
 
-void NetCallback(IPStatusTypedef *pnet)
+/* Whether a queued event has the same arguments as the ones sent */
+static bool _notify_same( const notify_event_t *event, const notify_args_t *args )
 {
-  _Notify_list_t *temp =  Notify_list[mico_notify_DHCP_COMPLETED];
-  if(temp == NULL)
-    return;
-  else{
-    do{
-      ((mico_notify_DHCP_COMPLETE_function)(temp->function))(pnet, _Context);
-      temp = temp->next;
-    }while(temp!=NULL);
+  switch( event->type ){
+    case mico_notify_DHCP_COMPLETED:
+      if( event->args.pointer == NULL || args->pointer == NULL ) return event->args.pointer == args->pointer;
+      return memcmp( event->args.pointer, args->pointer, sizeof( IPStatusTypedef ) ) == 0;
+    default:
+      return event->args.value == args->value;
   }
 }
 
-void RptConfigmodeRslt(network_InitTypeDef_st *nwkpara)
+/* A copy of the sent event that stays valid once the sender returns, NULL if
+ * none is free. Called with notify_mutex locked.
+ */
+static notify_event_t *_notify_copy( const notify_event_t *sent )
 {
-  _Notify_list_t *temp =  Notify_list[mico_notify_EASYLINK_WPS_COMPLETED];
-  if(temp == NULL)
+  notify_event_t *event = NULL;
+  int i;
+
+  for( i = 0; i < MICO_NOTIFY_EVENT_POOL_SIZE && event == NULL; i++ )
+    if( notify_events[i].refs == 0 ) event = &notify_events[i];
+  if( event == NULL ) return NULL;
+
+  event->type = sent->type;
+  event->time = sent->time;
+  event->args = sent->args;
+  switch( sent->type ){
+    case mico_notify_WiFI_PARA_CHANGED:
+      if( sent->args.pointer ){
+        memcpy( &event->copy.para.ap_info, sent->args.pointer, sizeof( apinfo_adv_t ) );
+        event->args.pointer = &event->copy.para.ap_info;
+      }
+      if( sent->args.string ){
+        event->args.value = Min( Max( sent->args.value, 0 ), (int)sizeof( event->copy.para.key ) );
+        memcpy( event->copy.para.key, sent->args.string, event->args.value );
+        event->args.string = event->copy.para.key;
+      }
+      break;
+    case mico_notify_DHCP_COMPLETED:
+      if( sent->args.pointer ){
+        memcpy( &event->copy.net, sent->args.pointer, sizeof( IPStatusTypedef ) );
+        event->args.pointer = &event->copy.net;
+      }
+      break;
+    case mico_notify_EASYLINK_WPS_COMPLETED:
+      if( sent->args.pointer ){
+        memcpy( &event->copy.nwkpara, sent->args.pointer, sizeof( network_InitTypeDef_st ) );
+        event->args.pointer = &event->copy.nwkpara;
+      }
+      break;
+    default:
+      break;
+  }
+  return event;
+}
+
+/* Queue the sent event for the handlers of a priority on a thread, *queued is
+ * its copy, made by the first thread that needs one. A full queue drops its
+ * oldest event of the lowest priority, or this one if it is the least urgent.
+ * Called with notify_mutex locked.
+ */
+static void _notify_post( notify_worker_t *worker, const notify_event_t *sent, notify_event_t **queued, uint8_t priority )
+{
+  mico_notify_stats_t *stats = &notify_stats[ sent->type ];
+  notify_entry_t *entry;
+  int i, victim = 0;
+
+  if( notify_flags[ sent->type ] & kNotifyCoalesce ){
+    for( i = worker->count - 1; i >= 0; i-- ){
+      entry = &worker->pending[i];
+      if( entry->event->type != sent->type || entry->priority != priority ) continue;
+      if( _notify_same( entry->event, &sent->args ) ){
+        notify_add( &stats->coalesced, 1 );
+        return;
+      }
+      break;
+    }
+  }
+
+  if( *queued == NULL ) *queued = _notify_copy( sent );
+  if( *queued == NULL ){
+    notify_add( &stats->dropped, 1 );
     return;
-  else{
-    do{
-      ((mico_notify_EASYLINK_COMPLETE_function)(temp->function))(nwkpara, _Context);
-      temp = temp->next;
-    }while(temp!=NULL);
   }
+
+  if( worker->count == MICO_NOTIFY_QUEUE_LENGTH ){
+    for( i = 1; i < worker->count; i++ )
+      if( worker->pending[i].priority > worker->pending[victim].priority ) victim = i;
+    if( worker->pending[victim].priority < priority ){
+      notify_add( &stats->dropped, 1 );
+      return;
+    }
+    entry = &worker->pending[victim];
+    notify_add( &notify_stats[ entry->event->type ].dropped, 1 );
+    entry->event->refs--;
+    memmove( entry, entry + 1, ( worker->count - victim - 1 ) * sizeof( notify_entry_t ) );
+    worker->count--;
+  }
+
+  entry = &worker->pending[ worker->count++ ];
+  entry->event = *queued;
+  entry->priority = priority;
+  (*queued)->refs++;
+  mico_rtos_set_semaphore( &worker->sem );
+}
+
+/* Queue the event for the handlers called by a thread, then call the others */
+static void _notify_send( mico_notify_types_t type, const notify_args_t *args )
+{
+  notify_event_t sent, *queued = NULL;
+  notify_slot_t *slot;
+  uint32_t epoch, index;
+  uint8_t sharedPriorities = 0;
+  bool locked = false;
+
+  if( notify_mutex == NULL ) return;
+  sent.type = type;
+  sent.time = mico_get_time( );
+  sent.args = *args;
+  notify_add( &notify_stats[ type ].raised, 1 );
+
+  epoch = _notify_read_lock( );
+  for( index = notify_load( &notify_heads[ type ] ); index != kNotifyNone; index = notify_load( &slot->next ) ){
+    slot = &notify_slots[ index ];
+    if( slot->worker == NULL ) continue;
+    if( locked == false ){
+      mico_rtos_lock_mutex( &notify_mutex );
+      locked = true;
+    }
+    // Its thread may be gone once it is removed
+    if( notify_load( &slot->state ) != kNotifySlotLive ) continue;
+    if( slot->worker != &notify_shared_worker ){
+      _notify_post( slot->worker, &sent, &queued, slot->priority );
+    }else if( ( sharedPriorities & ( 1 << slot->priority ) ) == 0 ){
+      // One entry for every handler of this priority
+      sharedPriorities |= 1 << slot->priority;
+      _notify_post( slot->worker, &sent, &queued, slot->priority );
+    }
+  }
+  if( locked ) mico_rtos_unlock_mutex( &notify_mutex );
+
+  for( index = notify_load( &notify_heads[ type ] ); index != kNotifyNone; index = notify_load( &slot->next ) ){
+    slot = &notify_slots[ index ];
+    if( slot->worker == NULL && notify_load( &slot->state ) == kNotifySlotLive )
+      _notify_call( &sent, slot->function );
+  }
+  _notify_read_unlock( epoch );
+}
+
+static void _notify_worker_thread( void *arg )
+{
+  notify_worker_t *worker = arg;
+  notify_event_t *event;
+  notify_slot_t *slot;
+  uint32_t epoch, index;
+  uint8_t priority;
+  int i, next;
+
+  for( ;; ){
+    mico_rtos_get_semaphore( &worker->sem, MICO_WAIT_FOREVER );
+    for( ;; ){
+      mico_rtos_lock_mutex( &notify_mutex );
+      if( worker->quit || worker->count == 0 ) break;
+
+      // The oldest of the highest priority
+      for( next = 0, i = 1; i < worker->count; i++ )
+        if( worker->pending[i].priority < worker->pending[next].priority ) next = i;
+      event = worker->pending[next].event;
+      priority = worker->pending[next].priority;
+      memmove( &worker->pending[next], &worker->pending[next + 1], ( worker->count - next - 1 ) * sizeof( notify_entry_t ) );
+      worker->count--;
+      mico_rtos_unlock_mutex( &notify_mutex );
+
+      epoch = _notify_read_lock( );
+      for( index = notify_load( &notify_heads[ event->type ] ); index != kNotifyNone; index = notify_load( &slot->next ) ){
+        slot = &notify_slots[ index ];
+        if( slot->worker == worker && slot->priority == priority && notify_load( &slot->state ) == kNotifySlotLive )
+          _notify_call( event, slot->function );
+      }
+      _notify_read_unlock( epoch );
+
+      mico_rtos_lock_mutex( &notify_mutex );
+      event->refs--;
+      mico_rtos_unlock_mutex( &notify_mutex );
+    }
+    if( worker->quit ) break;
+    mico_rtos_unlock_mutex( &notify_mutex );
+  }
+
+  /* The handler of this dedicated thread was removed */
+  for( i = 0; i < worker->count; i++ )
+    worker->pending[i].event->refs--;
+  mico_rtos_unlock_mutex( &notify_mutex );
+  mico_rtos_deinit_semaphore( &worker->sem );
+  free( worker );
+  mico_rtos_delete_thread( NULL );
+}
+
+static OSStatus _notify_start_worker( notify_worker_t *worker, uint8_t priority )
+{
+  OSStatus err = kNoErr;
+
+  worker->count = 0;
+  worker->quit = false;
+  err = mico_rtos_init_semaphore( &worker->sem, 1 );
+  require_noerr( err, exit );
+  err = mico_rtos_create_thread( NULL, priority, "Notify", _notify_worker_thread, STACK_SIZE_NOTIFICATION_THREAD, worker );
+  require_noerr_action( err, exit, mico_rtos_deinit_semaphore( &worker->sem ) );
+exit:
+  return err;
+}
+
+void ApListCallback(ScanResult *pApList)
+{
+  notify_args_t args = { .pointer = pApList };
+  _notify_send( mico_notify_WIFI_SCAN_COMPLETED, &args );
+}
+
+void ApListAdvCallback(ScanResult_adv *pApAdvList)
+{
+  notify_args_t args = { .pointer = pApAdvList };
+  _notify_send( mico_notify_WIFI_SCAN_ADV_COMPLETED, &args );
+}
+
+void WifiStatusHandler(WiFiEvent status)
+{
+  notify_args_t args = { .value = status };
+  _notify_send( mico_notify_WIFI_STATUS_CHANGED, &args );
+}
+
+void connected_ap_info(apinfo_adv_t *ap_info, char *key, int key_len)
+{
+  notify_args_t args = { .pointer = ap_info, .string = key, .value = key_len };
+  _notify_send( mico_notify_WiFI_PARA_CHANGED, &args );
+}
+
+void NetCallback(IPStatusTypedef *pnet)
+{
+  notify_args_t args = { .pointer = pnet };
+  _notify_send( mico_notify_DHCP_COMPLETED, &args );
+}
+
+void RptConfigmodeRslt(network_InitTypeDef_st *nwkpara)
+{
+  notify_args_t args = { .pointer = nwkpara };
+  _notify_send( mico_notify_EASYLINK_WPS_COMPLETED, &args );
 }
 
 void easylink_user_data_result(int datalen, char*data)
 {
-  _Notify_list_t *temp =  Notify_list[mico_notify_EASYLINK_GET_EXTRA_DATA];
-  if(temp == NULL)
-    return;
-  else{
-    do{
-      ((mico_notify_EASYLINK_GET_EXTRA_DATA_function)(temp->function))(datalen, data, _Context);
-      temp = temp->next;
-    }while(temp!=NULL);
-  }  
+  notify_args_t args = { .string = data, .value = datalen };
+  _notify_send( mico_notify_EASYLINK_GET_EXTRA_DATA, &args );
 }
 
 void socket_connected(int fd)
 {
-  _Notify_list_t *temp =  Notify_list[mico_notify_TCP_CLIENT_CONNECTED];
-  if(temp == NULL)
-    return;
-  else{
-    do{
-      ((mico_notify_TCP_CLIENT_CONNECTED_function)(temp->function))(fd, _Context);
-      temp = temp->next;
-    }while(temp!=NULL);
-  }    
+  notify_args_t args = { .value = fd };
+  _notify_send( mico_notify_TCP_CLIENT_CONNECTED, &args );
 }
 
 void dns_ip_set(uint8_t *hostname, uint32_t ip)
 {
-  _Notify_list_t *temp =  Notify_list[mico_notify_DNS_RESOLVE_COMPLETED];
-  if(temp == NULL)
-    return;
-  else{
-    do{
-      ((mico_notify_DNS_RESOLVE_COMPLETED_function)(temp->function))(hostname, ip, _Context);
-      temp = temp->next;
-    }while(temp!=NULL);
-  }    
+  notify_args_t args = { .pointer = hostname, .ip = ip };
+  _notify_send( mico_notify_DNS_RESOLVE_COMPLETED, &args );
 }
 
-
-void system_version(char *str, int len){
-  _Notify_list_t *temp =  Notify_list[mico_notify_READ_APP_INFO];
-  if(Notify_list[mico_notify_READ_APP_INFO] == NULL)
-    return;
-  else{
-    do{
-      ((mico_notify_READ_APP_INFO_function)(temp->function))(str, len, _Context);
-      temp = temp->next;
-    }while(temp!=NULL);
-  }
+void system_version(char *str, int len)
+{
+  notify_args_t args = { .string = str, .value = len };
+  _notify_send( mico_notify_READ_APP_INFO, &args );
 }
 
 void sendNotifySYSWillPowerOff(void)
 {
-  _Notify_list_t *temp =  Notify_list[mico_notify_SYS_WILL_POWER_OFF];
-  if(temp == NULL)
-    return;
-  else{
-    do{
-      ((mico_notify_SYS_WILL_POWER_OFF_function)(temp->function))(_Context);
-      temp = temp->next;
-    }while(temp!=NULL);
-  }    
+  notify_args_t args = { .pointer = NULL };
+  _notify_send( mico_notify_SYS_WILL_POWER_OFF, &args );
 }
 
 void join_fail(OSStatus err)
 {
-  _Notify_list_t *temp =  Notify_list[mico_notify_WIFI_CONNECT_FAILED];
-  if(temp == NULL)
-    return;
-  else{
-    do{
-      ((mico_notify_WIFI_CONNECT_FAILED_function)(temp->function))(err, _Context);
-      temp = temp->next;
-    }while(temp!=NULL);
-  }    
+  notify_args_t args = { .value = err };
+  _notify_send( mico_notify_WIFI_CONNECT_FAILED, &args );
 }
 
 void wifi_reboot_event(void)
 {
-  _Notify_list_t *temp =  Notify_list[mico_notify_WIFI_Fatal_ERROR];
-  if(temp == NULL)
-    return;
-  else{
-    do{
-      ((mico_notify_WIFI_FATAL_ERROR_function)(temp->function))(_Context);
-      temp = temp->next;
-    }while(temp!=NULL);
-  }    
+  notify_args_t args = { .pointer = NULL };
+  _notify_send( mico_notify_WIFI_Fatal_ERROR, &args );
 }
 
 void mico_rtos_stack_overflow(char *taskname)
 {
-  _Notify_list_t *temp =  Notify_list[mico_notify_Stack_Overflow_ERROR];
-  if(temp == NULL)
-    return;
-  else{
-    do{
-      ((mico_notify_STACK_OVERFLOW_ERROR_function)(temp->function))(taskname, _Context);
-      temp = temp->next;
-    }while(temp!=NULL);
-  }    
+  notify_args_t args = { .string = taskname };
+  _notify_send( mico_notify_Stack_Overflow_ERROR, &args );
 }
 
 
 OSStatus MICOInitNotificationCenter  ( void * const inContext )
 {
   OSStatus err = kNoErr;
+  int i;
+
   require_action(inContext, exit, err = kParamErr);
   _Context = inContext;
+  if( notify_mutex == NULL ){
+    for( i = 0; i < MICO_NOTIFY_TYPES; i++ )
+      notify_heads[i] = kNotifyNone;
+    for( i = MICO_NOTIFY_MAX_HANDLERS - 1; i >= 0; i-- ){
+      notify_slots[i].link = notify_free;
+      notify_free = i;
+    }
+    err = mico_rtos_init_mutex( &notify_mutex );
+    require_noerr( err, exit );
+  }
 exit:
   return err;
 }
 
 OSStatus MICOAddNotification( mico_notify_types_t notify_type, void *functionAddress )
+{
+  return MICOAddNotificationWithOptions( notify_type, functionAddress, mico_notify_priority_normal, mico_notify_delivery_sync, NULL );
+}
+
+OSStatus MICOAddNotificationWithOptions( mico_notify_types_t notify_type, void *functionAddress,
+                                         mico_notify_priority_t priority, mico_notify_delivery_t delivery,
+                                         mico_notify_handle_t *outHandle )
 {
   OSStatus err = kNoErr;
-  _Notify_list_t *temp =  Notify_list[notify_type];
-  _Notify_list_t *notify = (_Notify_list_t *)malloc(sizeof(_Notify_list_t));
-  require_action(notify, exit, err = kNoMemoryErr);
-  notify->function = functionAddress;
-  notify->next = NULL;
-  if(Notify_list[notify_type] == NULL){
-    Notify_list[notify_type] = notify;
-    notify->next = NULL;
-  }else{
-    if(temp->function == functionAddress)
-        return kNoErr;   //Nodify already exist
-    while(temp->next!=NULL){
-      temp = temp->next;
-      if(temp->function == functionAddress)
-        return kNoErr;   //Nodify already exist
+  notify_slot_t *slot;
+  uint32_t index, after = kNotifyNone;
+
+  require_action( (unsigned)notify_type < MICO_NOTIFY_TYPES && functionAddress, exit, err = kParamErr );
+  require_action( priority <= mico_notify_priority_low && delivery <= mico_notify_delivery_dedicated, exit, err = kParamErr );
+  require_action( delivery == mico_notify_delivery_sync || ( notify_flags[ notify_type ] & kNotifyQueueable ), exit, err = kUnsupportedErr );
+  require_action( notify_mutex, exit, err = kNotInitializedErr );
+  if( outHandle ) *outHandle = 0;
+
+  mico_rtos_lock_mutex( &notify_mutex );
+  _notify_reclaim( );
+
+  // After the handlers of the same priority
+  for( index = notify_heads[ notify_type ]; index != kNotifyNone; index = notify_slots[ index ].next ){
+    if( notify_slots[ index ].function == functionAddress ){
+      if( outHandle ) *outHandle = _notify_handle( index );
+      goto unlock;   //Nodify already exist
+    }
+    if( notify_slots[ index ].priority <= priority ) after = index;
+  }
+
+  require_action_quiet( notify_free != kNotifyNone, unlock, err = kNoResourcesErr );
+  index = notify_free;
+  slot = &notify_slots[ index ];
+  slot->function = functionAddress;
+  slot->type = notify_type;
+  slot->priority = priority;
+  slot->worker = NULL;
+
+  if( delivery == mico_notify_delivery_async ){
+    if( notify_shared_worker_started == false ){
+      err = _notify_start_worker( &notify_shared_worker, MICO_DEFAULT_WORKER_PRIORITY );
+      require_noerr( err, unlock );
+      notify_shared_worker_started = true;
     }
-    temp->next = notify;
+    slot->worker = &notify_shared_worker;
+  }else if( delivery == mico_notify_delivery_dedicated ){
+    slot->worker = (notify_worker_t *)calloc( 1, sizeof(notify_worker_t) );
+    require_action( slot->worker, unlock, err = kNoMemoryErr );
+    err = _notify_start_worker( slot->worker, notify_thread_priority[ priority ] );
+    require_noerr_action( err, unlock, free( slot->worker ) );
   }
+
+  notify_free = slot->link;
+  slot->generation++;
+  slot->prev = after;
+  notify_store( &slot->next, ( after == kNotifyNone ) ? notify_heads[ notify_type ] : notify_slots[ after ].next );
+  if( slot->next != kNotifyNone ) notify_slots[ slot->next ].prev = index;
+  notify_store( &slot->state, kNotifySlotLive );
+  // Dispatch sees it from now on
+  notify_store( ( after == kNotifyNone ) ? &notify_heads[ notify_type ] : &notify_slots[ after ].next, index );
+  if( outHandle ) *outHandle = _notify_handle( index );
+
+unlock:
+  mico_rtos_unlock_mutex( &notify_mutex );
 exit:
   return err;
 }
@@ -281,29 +748,68 @@ exit:
 OSStatus MICORemoveNotification( mico_notify_types_t notify_type, void *functionAddress )
 {
   OSStatus err = kNoErr;
-  _Notify_list_t *temp2;
-  _Notify_list_t *temp = Notify_list[notify_type];
-  require_action(Notify_list[notify_type], exit, err = kDeletedErr);
-  do{
-    if(temp->function == functionAddress){
-      if(temp == Notify_list[notify_type]){  //first element
-        Notify_list[notify_type] = Notify_list[notify_type]->next;
-        free(temp);
-      }else{
-        temp2->next = temp->next;
-        free(temp);
-      }
-       break;
-    }
-    require_action(temp->next!=NULL, exit, err = kNotFoundErr);
-    temp2 = temp;
-    temp = temp->next;
-  }while(temp != NULL);
+  uint32_t index;
+
+  require_action( (unsigned)notify_type < MICO_NOTIFY_TYPES, exit, err = kParamErr );
+  require_action( notify_mutex, exit, err = kNotInitializedErr );
+
+  mico_rtos_lock_mutex( &notify_mutex );
+  require_action( notify_heads[ notify_type ] != kNotifyNone, unlock, err = kDeletedErr );
+  for( index = notify_heads[ notify_type ]; index != kNotifyNone && notify_slots[ index ].function != functionAddress;
+       index = notify_slots[ index ].next );
+  require_action( index != kNotifyNone, unlock, err = kNotFoundErr );
+  _notify_remove( index );
+
+unlock:
+  mico_rtos_unlock_mutex( &notify_mutex );
+exit:
+  return err;
+}
+
+OSStatus MICORemoveNotificationHandle( mico_notify_handle_t handle )
+{
+  OSStatus err = kNoErr;
+  uint8_t index;
+
+  require_action( notify_mutex, exit, err = kNotInitializedErr );
+
+  mico_rtos_lock_mutex( &notify_mutex );
+  index = _notify_slot_of( handle );
+  require_action_quiet( index != kNotifyNone, unlock, err = kNotFoundErr );
+  _notify_remove( index );
+
+unlock:
+  mico_rtos_unlock_mutex( &notify_mutex );
+exit:
+  return err;
+}
+
+OSStatus MICOGetNotificationStats( mico_notify_types_t notify_type, mico_notify_stats_t *outStats )
+{
+  OSStatus err = kNoErr;
+  uint32_t *from, *to;
+  size_t i;
+
+  require_action( (unsigned)notify_type < MICO_NOTIFY_TYPES && outStats, exit, err = kParamErr );
+  require_action( notify_mutex, exit, err = kNotInitializedErr );
 
+  from = (uint32_t *)&notify_stats[notify_type];
+  to = (uint32_t *)outStats;
+  for( i = 0; i < sizeof(mico_notify_stats_t) / sizeof(uint32_t); i++ )
+    to[i] = notify_load( &from[i] );
 exit:
   return err;
 }
 
+void MICOResetNotificationStats( void )
+{
+  uint32_t *counter = (uint32_t *)notify_stats;
+  size_t i;
+
+  for( i = 0; i < MICO_NOTIFY_TYPES * sizeof(mico_notify_stats_t) / sizeof(uint32_t); i++ )
+    notify_store( &counter[i], 0 );
+}
+
 
 
 
@@ -65,12 +65,71 @@ typedef enum{
 
 } mico_notify_types_t;
 
+/* Handlers of one notification are called in priority order, a handler of
+ * the same priority after the ones added before it.
+ */
+typedef enum {
+  mico_notify_priority_high,
+  mico_notify_priority_normal,
+  mico_notify_priority_low,
+} mico_notify_priority_t;
+
+typedef enum {
+  mico_notify_delivery_sync,        /**< Called by the thread that sends the notification, e.g. the Wi-Fi driver */
+  mico_notify_delivery_async,       /**< Queued, and called by the notification center thread */
+  mico_notify_delivery_dedicated,   /**< Queued, and called by a thread of the handler's own */
+} mico_notify_delivery_t;
+
+#define MICO_NOTIFY_LATENCY_BUCKETS   10
+
+typedef struct {
+  uint32_t  raised;                 /**< Notifications sent */
+  uint32_t  delivered;              /**< Handler calls */
+  uint32_t  coalesced;              /**< Queued notifications dropped as a repeat of the previous one still queued */
+  uint32_t  dropped;                /**< Queued notifications lost to a full queue */
+  uint32_t  latency[ MICO_NOTIFY_LATENCY_BUCKETS ]; /**< Handler calls by the delay between the notification and
+                                                         the call, latency[0] under 1 ms, then latency[n] from
+                                                         2^(n-1) to 2^n - 1 ms, the last one anything longer */
+  uint32_t  max_latency;            /**< In ms */
+  uint32_t  max_handler_time;       /**< In ms, the longest a handler took to return */
+} mico_notify_stats_t;
+
+/* Identifies one handler, 0 is none */
+typedef uint32_t mico_notify_handle_t;
+
 OSStatus MICOInitNotificationCenter   ( void * const inContext );
 
+/* A synchronous handler of normal priority */
 OSStatus MICOAddNotification          ( mico_notify_types_t notify_type, void *functionAddress );
 
+/* Only notifications whose arguments can be copied are queued:
+ * mico_notify_WIFI_STATUS_CHANGED, mico_notify_WiFI_PARA_CHANGED,
+ * mico_notify_DHCP_COMPLETED, mico_notify_EASYLINK_WPS_COMPLETED,
+ * mico_notify_TCP_CLIENT_CONNECTED, mico_notify_WIFI_CONNECT_FAILED and
+ * mico_notify_WIFI_Fatal_ERROR, kUnsupportedErr for the others. A queued
+ * handler gets pointers to a copy of the arguments, valid until it returns.
+ * A repeat of WIFI_STATUS_CHANGED, DHCP_COMPLETED, WIFI_CONNECT_FAILED or
+ * WIFI_Fatal_ERROR is not queued again while the previous one waits. A full
+ * queue drops its oldest notification of the lowest priority.
+ */
+OSStatus MICOAddNotificationWithOptions ( mico_notify_types_t notify_type, void *functionAddress,
+                                          mico_notify_priority_t priority, mico_notify_delivery_t delivery,
+                                          mico_notify_handle_t *outHandle );
+
+/* A handler can be removed at any time, also by itself or another handler of
+ * a notification being delivered. It is not called by deliveries that start
+ * after it is removed, one already under way in another thread may still be
+ * running it.
+ */
 OSStatus MICORemoveNotification       ( mico_notify_types_t notify_type, void *functionAddress );
 
+/* kNotFoundErr if it was already removed */
+OSStatus MICORemoveNotificationHandle ( mico_notify_handle_t handle );
+
+OSStatus MICOGetNotificationStats     ( mico_notify_types_t notify_type, mico_notify_stats_t *outStats );
+
+void MICOResetNotificationStats       ( void );
+
 void sendNotifySYSWillPowerOff(void);
 void system_version(char *str, int len);
 
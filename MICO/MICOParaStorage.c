@@ -34,10 +34,252 @@
 #include "MICO.h"
 #include "platform_common_config.h"
 #include "MicoPlatform.h"
+#include "LZUtils.h"
+#include "DeltaUtils.h"
+#include "KVStoreUtils.h"
+
+/* The configuration as it is in flash. A save that would write the same
+ * is skipped, and a scheduled save waits until flashContentInRam has not
+ * changed for CONFIG_SAVE_DELAY, so a burst of changes is written once.
+ * configSaveMutex guards the pending save and the counters, it is taken
+ * after flashContentInRam_mutex.
+ */
+static flash_content_t configSaved;
+static mico_mutex_t configSaveMutex = NULL;
+static bool configSavePending = false;
+static bool configSaveThreadRunning = false;
+static uint32_t configSaveDue, configSaveDeadline;
+static mico_config_stats_t configStats;
 
 /* Update seed number every time*/
 static int32_t seedNum = 0;
 
+#ifdef APPLICATION_B_START_ADDRESS
+#ifndef EX_PARA_START_ADDRESS
+#error "The boot records of the application slots are kept in EX_PARA"
+#endif
+/* The newest boot record, seq is 0 before the first one. The first
+ * bootRecordCount records of EX_PARA are written. */
+#define kBootRecordParaAddress      (PARA_END_ADDRESS + 1 - sizeof(boot_record_t))
+#define kBootRecordLogSize          (EX_PARA_FLASH_SIZE / sizeof(boot_record_t))
+
+static boot_record_t bootRecord;
+static uint32_t bootRecordCount = 0;
+
+static void _ReadBootRecord(mico_Context_t *inContext);
+#endif
+
+#ifdef KV_START_ADDRESS
+/* The system and the application configuration are saved to the key-value
+ * store of the KV area, in chunks of kConfigChunkSize bytes. A save writes
+ * the chunks that changed as one commit, nothing is erased until a sector of
+ * the store is full. PARA keeps the whole flash_content_t as before, because
+ * the bootloader reads and clears bootTable there: it is written when
+ * bootTable changes or the default configuration is restored. An erased or
+ * invalid PARA still restores the default configuration. The first boot
+ * with the store copies the configuration from PARA into it.
+ */
+#define kConfigChunkSize            32
+#define kConfigKey_System           0x0100
+#define kConfigKey_Application      0x0200
+#define kConfigSystemChunks         ((sizeof(mico_sys_config_t) + kConfigChunkSize - 1) / kConfigChunkSize)
+#define kConfigApplicationChunks    ((sizeof(application_config_t) + kConfigChunkSize - 1) / kConfigChunkSize)
+#define kConfigIndexSize            (kConfigSystemChunks + kConfigApplicationChunks + 8)
+
+static kv_store_t configStore;
+static kv_index_entry_t configIndex[kConfigIndexSize];
+static bool configStoreOpened = false;
+
+static bool _IsConfigKey(uint16_t key)
+{
+  return (key >= kConfigKey_System && key < kConfigKey_System + kConfigSystemChunks) ||
+         (key >= kConfigKey_Application && key < kConfigKey_Application + kConfigApplicationChunks);
+}
+
+static int _ConfigItems(flash_content_t *content, kv_item_t *items)
+{
+  uint32_t i;
+  int n = 0;
+
+  for(i = 0; i < kConfigSystemChunks; i++, n++){
+    items[n].key = kConfigKey_System + i;
+    items[n].value = (uint8_t *)&content->micoSystemConfig + i * kConfigChunkSize;
+    items[n].len = Min(kConfigChunkSize, sizeof(mico_sys_config_t) - i * kConfigChunkSize);
+  }
+  for(i = 0; i < kConfigApplicationChunks; i++, n++){
+    items[n].key = kConfigKey_Application + i;
+    items[n].value = (uint8_t *)&content->appConfig + i * kConfigChunkSize;
+    items[n].len = Min(kConfigChunkSize, sizeof(application_config_t) - i * kConfigChunkSize);
+  }
+  return n;
+}
+
+static OSStatus _OpenConfigStore(void)
+{
+  OSStatus err = kNoErr;
+
+  if(configStoreOpened) return kNoErr;
+  err = KVStoreOpen(&configStore, MICO_FLASH_FOR_KV, KV_START_ADDRESS, KV_SECTOR_SIZE,
+                    (KV_END_ADDRESS - KV_START_ADDRESS + 1) / KV_SECTOR_SIZE, configIndex, kConfigIndexSize);
+  /* Not a store of this configuration, it is copied from PARA again */
+  if(err == kNoSpaceErr)
+    err = KVStoreFormat(&configStore);
+  require_noerr(err, exit);
+  configStoreOpened = true;
+
+exit:
+  return err;
+}
+
+static OSStatus _SaveConfigStore(mico_Context_t *inContext)
+{
+  kv_item_t items[kConfigIndexSize];
+  int n = _ConfigItems(&inContext->flashContentInRam, items);
+  uint16_t i;
+
+  /* Chunks of a longer configuration of a previous firmware */
+  for(i = 0; i < configStore.indexCount && n < (int)kConfigIndexSize; i++){
+    if(_IsConfigKey(configStore.index[i].key)) continue;
+    items[n].key = configStore.index[i].key;
+    items[n].len = 0;
+    items[n].value = NULL;
+    n++;
+  }
+  return KVStoreSetMultiple(&configStore, items, n);
+}
+
+/* Chunks that are not in the store keep their value from PARA */
+static void _LoadConfigStore(mico_Context_t *inContext)
+{
+  kv_item_t items[kConfigIndexSize];
+  int i, n = _ConfigItems(&inContext->flashContentInRam, items);
+  size_t len;
+
+  for(i = 0; i < n; i++)
+    KVStoreGet(&configStore, items[i].key, (void *)items[i].value, items[i].len, &len);
+}
+
+static bool _BootTableChanged(mico_Context_t *inContext)
+{
+  boot_table_t bootTable;
+  uint32_t address = PARA_START_ADDRESS;
+
+  if(MicoFlashRead(MICO_FLASH_FOR_PARA, &address, (uint8_t *)&bootTable, sizeof(boot_table_t)) != kNoErr)
+    return true;
+  return memcmp(&bootTable, &inContext->flashContentInRam.bootTable, sizeof(boot_table_t)) != 0;
+}
+#endif
+
+static OSStatus _WritePara(flash_content_t *content)
+{
+  OSStatus err = kNoErr;
+  uint32_t paraStartAddress = PARA_START_ADDRESS;
+
+  err = MicoFlashInitialize(MICO_FLASH_FOR_PARA);
+  require_noerr(err, exit);
+  configStats.erases++;
+  err = MicoFlashErase(MICO_FLASH_FOR_PARA, PARA_START_ADDRESS, PARA_END_ADDRESS);
+  require_noerr(err, exit);
+  err = MicoFlashWrite(MICO_FLASH_FOR_PARA, &paraStartAddress, (uint8_t *)content, sizeof(flash_content_t));
+  require_noerr(err, exit);
+#ifdef APPLICATION_B_START_ADDRESS
+  if(bootRecord.seq != 0){
+    paraStartAddress = kBootRecordParaAddress;
+    err = MicoFlashWrite(MICO_FLASH_FOR_PARA, &paraStartAddress, (uint8_t *)&bootRecord, sizeof(boot_record_t));
+    require_noerr(err, exit);
+  }
+#endif
+  err = MicoFlashFinalize(MICO_FLASH_FOR_PARA);
+  require_noerr(err, exit);
+
+exit:
+  return err;
+}
+
+/* Save flashContentInRam, to PARA as well if writePara is set */
+static OSStatus _SaveConfiguration(mico_Context_t *inContext, bool writePara)
+{
+  OSStatus err = kNoErr;
+#ifdef KV_START_ADDRESS
+  uint32_t erases;
+
+  err = _OpenConfigStore();
+  if(err == kNoErr){
+    erases = configStore.stats.erases;
+    err = _SaveConfigStore(inContext);
+    /* Older chunks in the store would hide the configuration in PARA */
+    if(err != kNoErr)
+      KVStoreFormat(&configStore);
+    configStats.erases += configStore.stats.erases - erases;
+  }
+  if(err != kNoErr || writePara || _BootTableChanged(inContext))
+    err = _WritePara(&inContext->flashContentInRam);
+#else
+  err = _WritePara(&inContext->flashContentInRam);
+#endif
+  if(err == kNoErr){
+    configStats.saves++;
+    memcpy(&configSaved, &inContext->flashContentInRam, sizeof(flash_content_t));
+  }
+  return err;
+}
+
+/* Save flashContentInRam with a new seed if it differs from flash, with configSaveMutex taken */
+static OSStatus _CommitConfiguration(mico_Context_t *inContext)
+{
+  configSavePending = false;
+  if(memcmp(&inContext->flashContentInRam, &configSaved, sizeof(flash_content_t)) == 0){
+    configStats.unchanged++;
+    return kNoErr;
+  }
+  inContext->flashContentInRam.micoSystemConfig.seed = ++seedNum;
+  return _SaveConfiguration(inContext, false);
+}
+
+/* ms until the pending save is due, 0 if it is due or nothing is pending */
+static uint32_t _ConfigSaveWait(void)
+{
+  int32_t wait = (int32_t)(configSaveDue - mico_get_time());
+
+  if(!configSavePending || wait <= 0) return 0;
+  return (uint32_t)wait;
+}
+
+static void _ConfigSave_thread(void *inContext)
+{
+  mico_Context_t *context = inContext;
+  uint32_t wait;
+
+  while(1){
+    mico_rtos_lock_mutex(&context->flashContentInRam_mutex);
+    mico_rtos_lock_mutex(&configSaveMutex);
+    wait = _ConfigSaveWait();
+    if(wait == 0){
+      if(configSavePending)
+        _CommitConfiguration(context);
+      configSaveThreadRunning = false;
+    }
+    mico_rtos_unlock_mutex(&configSaveMutex);
+    mico_rtos_unlock_mutex(&context->flashContentInRam_mutex);
+    if(wait == 0) break;
+    mico_thread_msleep(wait);
+  }
+  mico_rtos_delete_thread(NULL);
+}
+
+/* A restored configuration is written to PARA and the store at once */
+static OSStatus _RestoreConfiguration(mico_Context_t *inContext)
+{
+  OSStatus err = kNoErr;
+
+  mico_rtos_lock_mutex(&configSaveMutex);
+  configStats.requests++;
+  configSavePending = false;
+  err = _SaveConfiguration(inContext, true);
+  mico_rtos_unlock_mutex(&configSaveMutex);
+  return err;
+}
+
 __weak void appRestoreDefault_callback(mico_Context_t *inContext)
 {
 
@@ -45,12 +287,6 @@ __weak void appRestoreDefault_callback(mico_Context_t *inContext)
 
 OSStatus MICORestoreDefault(mico_Context_t *inContext)
 { 
-  OSStatus err = kNoErr;
-  uint32_t paraStartAddress, paraEndAddress;
- 
-  paraStartAddress = PARA_START_ADDRESS;
-  paraEndAddress = PARA_END_ADDRESS;
-
   /*wlan configration is not need to change to a default state, use easylink to do that*/
   sprintf(inContext->flashContentInRam.micoSystemConfig.name, DEFAULT_NAME);
   inContext->flashContentInRam.micoSystemConfig.configured = unConfigured;
@@ -64,28 +300,12 @@ OSStatus MICORestoreDefault(mico_Context_t *inContext)
   /*Application's default configuration*/
   appRestoreDefault_callback(inContext);
 
-  err = MicoFlashInitialize(MICO_FLASH_FOR_PARA);
-  require_noerr(err, exit);
-  err = MicoFlashErase(MICO_FLASH_FOR_PARA, paraStartAddress, paraEndAddress);
-  require_noerr(err, exit);
-  err = MicoFlashWrite(MICO_FLASH_FOR_PARA, &paraStartAddress, (void *)inContext, sizeof(flash_content_t));
-  require_noerr(err, exit);
-  err = MicoFlashFinalize(MICO_FLASH_FOR_PARA);
-  require_noerr(err, exit);
-
-exit:
-  return err;
+  return _RestoreConfiguration(inContext);
 }
 
 #ifdef MFG_MODE_AUTO
 OSStatus MICORestoreMFG(mico_Context_t *inContext)
 { 
-  OSStatus err = kNoErr;
-  uint32_t paraStartAddress, paraEndAddress;
- 
-  paraStartAddress = PARA_START_ADDRESS;
-  paraEndAddress = PARA_END_ADDRESS;
-
   /*wlan configration is not need to change to a default state, use easylink to do that*/
   sprintf(inContext->flashContentInRam.micoSystemConfig.name, DEFAULT_NAME);
   inContext->flashContentInRam.micoSystemConfig.configured = mfgConfigured;
@@ -93,17 +313,7 @@ OSStatus MICORestoreMFG(mico_Context_t *inContext)
   /*Application's default configuration*/
   appRestoreDefault_callback(inContext);
 
-  err = MicoFlashInitialize(MICO_FLASH_FOR_PARA);
-  require_noerr(err, exit);
-  err = MicoFlashErase(MICO_FLASH_FOR_PARA, paraStartAddress, paraEndAddress);
-  require_noerr(err, exit);
-  err = MicoFlashWrite(MICO_FLASH_FOR_PARA, &paraStartAddress, (void *)inContext, sizeof(flash_content_t));
-  require_noerr(err, exit);
-  err = MicoFlashFinalize(MICO_FLASH_FOR_PARA);
-  require_noerr(err, exit);
-
-exit:
-  return err;
+  return _RestoreConfiguration(inContext);
 }
 #endif
 
@@ -113,8 +323,22 @@ OSStatus MICOReadConfiguration(mico_Context_t *inContext)
 {
   uint32_t configInFlash;
   OSStatus err = kNoErr;
+  if(configSaveMutex == NULL)
+    mico_rtos_init_mutex(&configSaveMutex);
   configInFlash = PARA_START_ADDRESS;
   err = MicoFlashRead(MICO_FLASH_FOR_PARA, &configInFlash, (uint8_t *)&inContext->flashContentInRam, sizeof(flash_content_t));
+#ifdef KV_START_ADDRESS
+  if(inContext->flashContentInRam.appConfig.configDataVer == CONFIGURATION_VERSION && _OpenConfigStore() == kNoErr){
+    if(configStore.indexCount == 0)
+      _SaveConfigStore(inContext);
+    else
+      _LoadConfigStore(inContext);
+  }
+#endif
+  memcpy(&configSaved, &inContext->flashContentInRam, sizeof(flash_content_t));
+#ifdef APPLICATION_B_START_ADDRESS
+  _ReadBootRecord(inContext);
+#endif
   seedNum = inContext->flashContentInRam.micoSystemConfig.seed;
   if(seedNum == -1) seedNum = 0;
 
@@ -143,22 +367,353 @@ exit:
 OSStatus MICOUpdateConfiguration(mico_Context_t *inContext)
 {
   OSStatus err = kNoErr;
-  uint32_t paraStartAddress, paraEndAddress;
- 
-  paraStartAddress = PARA_START_ADDRESS;
-  paraEndAddress = PARA_END_ADDRESS;
 
-  inContext->flashContentInRam.micoSystemConfig.seed = ++seedNum;
-  err = MicoFlashInitialize(MICO_FLASH_FOR_PARA);
+  mico_rtos_lock_mutex(&configSaveMutex);
+  configStats.requests++;
+  err = _CommitConfiguration(inContext);
+  mico_rtos_unlock_mutex(&configSaveMutex);
+  return err;
+}
+
+OSStatus MICOScheduleConfigurationSave(mico_Context_t * const inContext)
+{
+  OSStatus err = kNoErr;
+  uint32_t now = mico_get_time();
+
+  mico_rtos_lock_mutex(&configSaveMutex);
+  configStats.requests++;
+  if(configSavePending){
+    configStats.coalesced++;
+    configSaveDue = now + CONFIG_SAVE_DELAY;
+    if((int32_t)(configSaveDeadline - configSaveDue) < 0)
+      configSaveDue = configSaveDeadline;
+  }else if(memcmp(&inContext->flashContentInRam, &configSaved, sizeof(flash_content_t)) == 0){
+    configStats.unchanged++;
+    goto exit;
+  }else{
+    configSavePending = true;
+    configSaveDue = now + CONFIG_SAVE_DELAY;
+    configSaveDeadline = now + CONFIG_SAVE_MAX_DELAY;
+  }
+
+  if(!configSaveThreadRunning){
+    err = mico_rtos_create_thread(NULL, MICO_APPLICATION_PRIORITY, "Config Save", _ConfigSave_thread, STACK_SIZE_CONFIG_SAVE_THREAD, (void*)inContext );
+    if(err == kNoErr)
+      configSaveThreadRunning = true;
+    else
+      err = _CommitConfiguration(inContext);
+  }
+
+exit:
+  mico_rtos_unlock_mutex(&configSaveMutex);
+  return err;
+}
+
+OSStatus MICOFlushConfiguration(mico_Context_t * const inContext)
+{
+  OSStatus err = kNoErr;
+
+  mico_rtos_lock_mutex(&configSaveMutex);
+  if(configSavePending)
+    err = _CommitConfiguration(inContext);
+  mico_rtos_unlock_mutex(&configSaveMutex);
+  return err;
+}
+
+void MICOGetConfigurationStats(mico_config_stats_t *outStats)
+{
+  mico_rtos_lock_mutex(&configSaveMutex);
+  *outStats = configStats;
+  mico_rtos_unlock_mutex(&configSaveMutex);
+  outStats->erasesAvoided = (outStats->requests > outStats->erases)? outStats->requests - outStats->erases : 0;
+}
+
+#ifdef APPLICATION_B_START_ADDRESS
+/* Slot of the running image, the one it is linked for. bootTable may name the
+ * other slot: the bootloader starts it when a trial boot cannot be counted. */
+static uint8_t _RunningSlot(void)
+{
+  uintptr_t address = (uintptr_t)&_RunningSlot;
+
+  return (address >= APPLICATION_B_START_ADDRESS && address <= APPLICATION_B_END_ADDRESS)? 'B' : 'A';
+}
+
+static uint32_t _BootRecordCrc(boot_record_t *record)
+{
+  boot_record_t counted = *record;
+
+  counted.table.trial_boots = 0xFF;
+  return LZCrc32Update(0xFFFFFFFF, (uint8_t *)&counted, offsetof(boot_record_t, crc)) ^ 0xFFFFFFFF;
+}
+
+static bool _BootRecordIsValid(boot_record_t *record)
+{
+  return record->seq != 0xFFFFFFFF && record->crc == _BootRecordCrc(record);
+}
+
+static bool _BootRecordIsErased(boot_record_t *record)
+{
+  uint32_t i;
+
+  for(i = 0; i < sizeof(boot_record_t); i++){
+    if(((uint8_t *)record)[i] != 0xFF)
+      return false;
+  }
+  return true;
+}
+
+/* Append table as the newest record. PARA gets the record before a full
+ * EX_PARA is erased, with the configuration that is in flash. */
+static OSStatus _AppendBootRecord(boot_table_t *table)
+{
+  OSStatus err = kNoErr;
+  boot_record_t record, written;
+  uint32_t address, readAddress;
+
+  record.table = *table;
+  record.seq = bootRecord.seq + 1;
+  record.crc = _BootRecordCrc(&record);
+
+  if(bootRecordCount >= kBootRecordLogSize){
+    mico_rtos_lock_mutex(&configSaveMutex);
+    err = _WritePara(&configSaved);
+    mico_rtos_unlock_mutex(&configSaveMutex);
+    require_noerr(err, exit);
+    err = MicoFlashInitialize(MICO_FLASH_FOR_EX_PARA);
+    require_noerr(err, exit);
+    configStats.erases++;
+    err = MicoFlashErase(MICO_FLASH_FOR_EX_PARA, EX_PARA_START_ADDRESS, EX_PARA_END_ADDRESS);
+    require_noerr(err, exit);
+    bootRecordCount = 0;
+  }
+
+  address = EX_PARA_START_ADDRESS + bootRecordCount * sizeof(boot_record_t);
+  readAddress = address;
+  bootRecordCount++;
+  err = MicoFlashInitialize(MICO_FLASH_FOR_EX_PARA);
   require_noerr(err, exit);
-  err = MicoFlashErase(MICO_FLASH_FOR_PARA, paraStartAddress, paraEndAddress);
+  err = MicoFlashWrite(MICO_FLASH_FOR_EX_PARA, &address, (uint8_t *)&record, sizeof(boot_record_t));
   require_noerr(err, exit);
-  err = MicoFlashWrite(MICO_FLASH_FOR_PARA, &paraStartAddress, (uint8_t *)&inContext->flashContentInRam, sizeof(flash_content_t));
+  err = MicoFlashRead(MICO_FLASH_FOR_EX_PARA, &readAddress, (uint8_t *)&written, sizeof(boot_record_t));
   require_noerr(err, exit);
-  err = MicoFlashFinalize(MICO_FLASH_FOR_PARA);
+  require_action(memcmp(&record, &written, sizeof(boot_record_t)) == 0, exit, err = kWriteErr);
+  bootRecord = record;
+
+exit:
+  MicoFlashFinalize(MICO_FLASH_FOR_EX_PARA);
+  return err;
+}
+
+/* The newest valid record of EX_PARA and PARA. One found in PARA only, the
+ * log was being erased, is appended again; so is a boot table of the
+ * configuration that was written before the boot records. */
+static void _ReadBootRecord(mico_Context_t *inContext)
+{
+  boot_record_t record;
+  uint32_t address, i;
+  bool inLog = false;
+
+  memset(&bootRecord, 0x0, sizeof(boot_record_t));
+  bootRecordCount = 0;
+  for(i = 0; i < kBootRecordLogSize; i++){
+    address = EX_PARA_START_ADDRESS + i * sizeof(boot_record_t);
+    if(MicoFlashRead(MICO_FLASH_FOR_EX_PARA, &address, (uint8_t *)&record, sizeof(boot_record_t)) != kNoErr)
+      break;
+    if(_BootRecordIsErased(&record) == false)
+      bootRecordCount = i + 1;
+    if(_BootRecordIsValid(&record) && record.seq > bootRecord.seq){
+      bootRecord = record;
+      inLog = true;
+    }
+  }
+
+  address = kBootRecordParaAddress;
+  if(MicoFlashRead(MICO_FLASH_FOR_PARA, &address, (uint8_t *)&record, sizeof(boot_record_t)) == kNoErr &&
+     _BootRecordIsValid(&record) && record.seq > bootRecord.seq){
+    bootRecord = record;
+    inLog = false;
+  }
+
+  if(inLog == true)
+    return;
+  if(bootRecord.seq == 0){
+    if(inContext->flashContentInRam.bootTable.upgrade_type != 'S')
+      return;
+    bootRecord.table = inContext->flashContentInRam.bootTable;
+  }
+  _AppendBootRecord(&bootRecord.table);
+}
+#endif
+
+#if defined(MICO_FLASH_FOR_UPDATE) && !defined(APPLICATION_B_START_ADDRESS)
+static OSStatus _DiscardOutput(const uint8_t *data, size_t len, void *context)
+{
+  return kNoErr;
+}
+
+static OSStatus _ReadApplication(uint32_t offset, uint8_t *buf, size_t len, void *context)
+{
+  uint32_t address = APPLICATION_START_ADDRESS + offset;
+  return MicoFlashRead(MICO_FLASH_FOR_APPLICATION, &address, buf, len);
+}
+#endif
+
+#ifdef MICO_FLASH_FOR_UPDATE
+void MICOGetOTATarget(mico_Context_t * const inContext, mico_flash_t *outFlash, uint32_t *outStart, uint32_t *outEnd)
+{
+#ifdef APPLICATION_B_START_ADDRESS
+  if(_RunningSlot() == 'A'){
+    *outFlash = MICO_FLASH_FOR_APPLICATION_B;
+    *outStart = APPLICATION_B_START_ADDRESS;
+    *outEnd = APPLICATION_B_END_ADDRESS;
+  }else{
+    *outFlash = MICO_FLASH_FOR_APPLICATION;
+    *outStart = APPLICATION_START_ADDRESS;
+    *outEnd = APPLICATION_END_ADDRESS;
+  }
+#else
+  *outFlash = MICO_FLASH_FOR_UPDATE;
+  *outStart = UPDATE_START_ADDRESS;
+  *outEnd = UPDATE_END_ADDRESS;
+#endif
+}
+
+OSStatus MICOSetOTABootTable(mico_Context_t * const inContext, uint32_t length)
+{
+  OSStatus err = kNoErr;
+  mico_flash_t flash;
+  uint32_t start, end, address, i, size;
+  uint8_t buf[128];
+#ifdef APPLICATION_B_START_ADDRESS
+  boot_table_t bootTable;
+  uint8_t slot = (_RunningSlot() == 'A')? 'B' : 'A';
+  uint32_t vectors[2];
+  uint32_t crc = 0xFFFFFFFF;
+#else
+  boot_table_t *bootTable = &inContext->flashContentInRam.bootTable;
+  lz_image_header_t lzHeader;
+  lz_decoder_t lzDecoder;
+  delta_patch_header_t deltaHeader;
+  delta_patcher_t *patcher = NULL;
+  uint8_t *lzWindow = NULL;
+  uint8_t *deltaBlock = NULL;
+#endif
+
+  MICOGetOTATarget(inContext, &flash, &start, &end);
+  require_action(length <= end - start + 1, exit, err = kSizeErr);
+
+#ifdef APPLICATION_B_START_ADDRESS
+  /* The image runs where it is, so it must be linked for this slot */
+  require_action(length >= sizeof(vectors), exit, err = kSizeErr);
+  address = start;
+  err = MicoFlashRead(flash, &address, (uint8_t *)vectors, sizeof(vectors));
+  require_noerr(err, exit);
+  require_action((vectors[0] & 0x2FFE0000) == 0x20000000 && vectors[1] >= start && vectors[1] <= end, exit, err = kUnsupportedErr);
+
+  address = start;
+  for(i = 0; i < length; i += size){
+    size = (length - i < sizeof(buf))? length - i : sizeof(buf);
+    err = MicoFlashRead(flash, &address, buf, size);
+    require_noerr(err, exit);
+    crc = LZCrc32Update(crc, buf, size);
+  }
+
+  memset(&bootTable, 0, sizeof(boot_table_t));
+  bootTable.start_address = start;
+  bootTable.length = length;
+  bootTable.type = 'A';
+  bootTable.upgrade_type = 'S';
+  bootTable.slot = slot;
+  bootTable.trial_boots = BOOT_TRIAL_BOOTS;
+  bootTable.crc = crc ^ 0xFFFFFFFF;
+  err = _AppendBootRecord(&bootTable);
+#else
+  /* A compressed image or a patch is decoded once here, the bootloader only
+     erases the application for an image that it can decode */
+  address = start;
+  err = MicoFlashRead(flash, &address, buf, kDeltaPatchHeaderSize);
   require_noerr(err, exit);
+  if(length > kDeltaPatchHeaderSize && DeltaPatchGetHeader(buf, kDeltaPatchHeaderSize, &deltaHeader) == kNoErr){
+#ifdef UPDATE_SECTOR_SIZE
+    /* The bootloader rebuilds the image in the sectors after the patch */
+    i = start + (length + UPDATE_SECTOR_SIZE - 1) / UPDATE_SECTOR_SIZE * UPDATE_SECTOR_SIZE;
+    require_action(deltaHeader.newLength <= APPLICATION_FLASH_SIZE, exit, err = kSizeErr);
+    require_action(i <= end && deltaHeader.newLength <= end - i + 1, exit, err = kNoSpaceErr);
+    err = DeltaPatchCheckSource(&deltaHeader, _ReadApplication, NULL, buf, sizeof(buf));
+    require_noerr(err, exit);
+
+    lzWindow = malloc(1<<kLZDefaultWindowBits);
+    deltaBlock = malloc(kDeltaDefaultBlockSize);
+    patcher = malloc(sizeof(delta_patcher_t));
+    require_action(lzWindow && deltaBlock && patcher, exit, err = kNoMemoryErr);
+    err = DeltaPatcherInit(patcher, &deltaHeader, lzWindow, 1<<kLZDefaultWindowBits, deltaBlock, kDeltaDefaultBlockSize,
+                           _ReadApplication, _DiscardOutput, NULL);
+    require_noerr(err, exit);
+    address = start + kDeltaPatchHeaderSize;
+    for(i = kDeltaPatchHeaderSize; i < length; i += size){
+      size = (length - i < sizeof(buf))? length - i : sizeof(buf);
+      err = MicoFlashRead(flash, &address, buf, size);
+      require_noerr(err, exit);
+      err = DeltaPatcherExecute(patcher, buf, size);
+      require_noerr(err, exit);
+    }
+    require_action(DeltaPatcherIsComplete(patcher), exit, err = kUnderrunErr);
+#else
+    err = kUnsupportedErr;
+    goto exit;
+#endif
+  }
+  else if(length > kLZImageHeaderSize && LZImageGetHeader(buf, kLZImageHeaderSize, &lzHeader) == kNoErr){
+    require_action(lzHeader.rawLength <= APPLICATION_FLASH_SIZE, exit, err = kSizeErr);
+    lzWindow = malloc(1<<kLZDefaultWindowBits);
+    require_action(lzWindow, exit, err = kNoMemoryErr);
+    err = LZDecoderInit(&lzDecoder, &lzHeader, lzWindow, 1<<kLZDefaultWindowBits, _DiscardOutput, NULL);
+    require_noerr(err, exit);
+    address = start + kLZImageHeaderSize;
+    for(i = kLZImageHeaderSize; i < length; i += size){
+      size = (length - i < sizeof(buf))? length - i : sizeof(buf);
+      err = MicoFlashRead(flash, &address, buf, size);
+      require_noerr(err, exit);
+      err = LZDecoderExecute(&lzDecoder, buf, size);
+      require_noerr(err, exit);
+    }
+    require_action(LZDecoderIsComplete(&lzDecoder), exit, err = kUnderrunErr);
+  }
+
+  memset(bootTable, 0, sizeof(boot_table_t));
+  bootTable->length = length;
+  bootTable->start_address = start;
+  bootTable->type = 'A';
+  bootTable->upgrade_type = 'U';
+#endif
 
 exit:
+#ifndef APPLICATION_B_START_ADDRESS
+  if(lzWindow) free(lzWindow);
+  if(deltaBlock) free(deltaBlock);
+  if(patcher) free(patcher);
+#endif
+  return err;
+}
+#endif
+
+OSStatus MICOConfirmBootSlot(mico_Context_t * const inContext)
+{
+  OSStatus err = kNoErr;
+#ifdef APPLICATION_B_START_ADDRESS
+  boot_table_t bootTable;
+  uint8_t slot = _RunningSlot();
+
+  mico_rtos_lock_mutex(&inContext->flashContentInRam_mutex);
+  bootTable = bootRecord.table;
+  if(bootTable.upgrade_type == 'S' && (bootTable.trial_boots != 0xFF || bootTable.slot != slot)){
+    /* After a rollback this keeps the slot that was started instead */
+    bootTable.slot = slot;
+    bootTable.trial_boots = 0xFF;
+    err = _AppendBootRecord(&bootTable);
+  }
+  mico_rtos_unlock_mutex(&inContext->flashContentInRam_mutex);
+#endif
   return err;
 }
 
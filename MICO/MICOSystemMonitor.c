@@ -31,7 +31,7 @@
 */
 
 #include "MICO.h"
-#include "MicoSystemMonitor.h"
+#include "MICOSystemMonitor.h"
 #include "MicoPlatform.h"
 
 
@@ -185,6 +185,18 @@ int sflash_platform_send_recv_byte( void* platform_peripheral, unsigned char MOS
   return 0;
 }
 
+int sflash_platform_send_recv( void* platform_peripheral, const void* MOSI_data, void* MISO_data, unsigned int size, unsigned char data_lines )
+{
+  const uint8_t *tx_buf = MOSI_data;
+  uint8_t *rx_buf = MISO_data;
+
+  if(data_lines != 1)
+    return -1;
+  while(size-- > 0)
+    sflash_platform_send_recv_byte(platform_peripheral, (tx_buf != 0x00000000) ? *tx_buf++ : 0xFF, (rx_buf != 0x00000000) ? rx_buf++ : 0x00000000);
+  return 0;
+}
+
 int sflash_platform_chip_select( void* platform_peripheral )
 {
   Chip_GPIO_SetPinState(LPC_GPIO, 0, 8 , 0);
@@ -43,7 +43,14 @@
 *                    Constants
 ******************************************************/
 
+/* Frame boundaries (line idle events) kept until MicoUartRecvFrame() reads them */
+#define UART_RX_FRAME_QUEUE_LEN   (8)
 
+/* Requests queued by MicoUartSendAsync(), the TX DMA is chained through them */
+#define UART_TX_QUEUE_LEN         (8)
+
+/* Largest DMA transfer, NDTR is a 16 bit register */
+#define UART_TX_DMA_MAX_SIZE      (0xFFFF)
 
 /******************************************************
 *                   Enumerations
@@ -57,6 +64,14 @@
 *                    Structures
 ******************************************************/
 
+typedef struct
+{
+  const uint8_t*            data;
+  uint32_t                  size;
+  mico_uart_tx_callback_t   callback;
+  void*                     arg;
+} uart_tx_request_t;
+
 typedef struct
 {
   uint32_t            rx_size;
@@ -64,6 +79,7 @@ typedef struct
 #ifndef NO_MICO_RTOS
   mico_semaphore_t    rx_complete;
   mico_semaphore_t    tx_complete;
+  mico_mutex_t        tx_sync_mutex;  /* Held by MicoUartSend, tx_complete has one waiter at a time */
 #else
   volatile bool       rx_complete;
   volatile bool       tx_complete;
@@ -71,6 +87,22 @@ typedef struct
   mico_semaphore_t    sem_wakeup;
   OSStatus            tx_dma_result;
   OSStatus            rx_dma_result;
+  /* Frame tracking in ring buffer mode. rx_received and rx_consumed count bytes
+     since initialisation, rx_frame_ends holds rx_received at each line idle. */
+  volatile uint32_t   rx_received;
+  uint32_t            rx_consumed;
+  volatile bool       rx_frame_wait;
+  uint32_t            rx_frame_ends[UART_RX_FRAME_QUEUE_LEN];
+  volatile uint8_t    rx_frame_head;
+  volatile uint8_t    rx_frame_tail;
+  /* Transmit queue. Requests from tx_queue_head to tx_queue_next are in the
+     running DMA transfer (tx_dma_count of them, 0 when idle), the ones up to
+     tx_queue_tail are pending. */
+  uart_tx_request_t   tx_queue[UART_TX_QUEUE_LEN];
+  volatile uint8_t    tx_queue_head;
+  volatile uint8_t    tx_queue_next;
+  volatile uint8_t    tx_queue_tail;
+  volatile uint8_t    tx_dma_count;
 } uart_interface_t;
 
 /******************************************************
@@ -89,6 +121,14 @@ static mico_uart_t current_uart;
 
 static OSStatus internal_uart_init ( mico_uart_t uart, const mico_uart_config_t* config, ring_buffer_t* optional_rx_buffer );
 static OSStatus platform_uart_receive_bytes( mico_uart_t uart, void* data, uint32_t size, uint32_t timeout );
+static OSStatus uart_rx_wait( mico_uart_t uart, uint32_t threshold, bool wait_frame, uint32_t timeout );
+static uint32_t uart_rx_copy( mico_uart_t uart, uint8_t* data, uint32_t size );
+static void uart_rx_event( mico_uart_t uart, bool line_idle );
+static void uart_rx_update_tail( mico_uart_t uart );
+static void uart_tx_start( mico_uart_t uart );
+static void uart_tx_complete( mico_uart_t uart, uint8_t count, OSStatus result );
+static void uart_tx_event( mico_uart_t uart );
+static void uart_tx_sync_callback( mico_uart_t uart, const void* data, uint32_t size, OSStatus result, void* arg );
 
 
 
@@ -142,10 +182,15 @@ OSStatus internal_uart_init( mico_uart_t uart, const mico_uart_config_t* config,
 #ifndef NO_MICO_RTOS
   mico_rtos_init_semaphore(&uart_interfaces[uart].tx_complete, 1);
   mico_rtos_init_semaphore(&uart_interfaces[uart].rx_complete, 1);
+  mico_rtos_init_mutex(&uart_interfaces[uart].tx_sync_mutex);
 #else
   uart_interfaces[uart].tx_complete = false;
   uart_interfaces[uart].rx_complete = false;
 #endif
+  uart_interfaces[uart].tx_queue_head = 0;
+  uart_interfaces[uart].tx_queue_next = 0;
+  uart_interfaces[uart].tx_queue_tail = 0;
+  uart_interfaces[uart].tx_dma_count  = 0;
   
   MicoMcuPowerSaveConfig(false);
   
@@ -343,23 +388,32 @@ OSStatus internal_uart_init( mico_uart_t uart, const mico_uart_config_t* config,
   uart_mapping[uart].usart->CR1 |= USART_CR1_TE;
   uart_mapping[uart].usart->CR1 |= USART_CR1_RE;
   
+  /* Configure RX DMA interrupt on Cortex-M3 */
+  nvic_init_structure.NVIC_IRQChannel                   = uart_mapping[uart].rx_dma_irq;
+  nvic_init_structure.NVIC_IRQChannelPreemptionPriority = (uint8_t) 0x5;
+  nvic_init_structure.NVIC_IRQChannelSubPriority        = 0x8;
+  nvic_init_structure.NVIC_IRQChannelCmd                = ENABLE;
+  NVIC_Init( &nvic_init_structure );
+  
   /* Setup ring buffer */
   if (optional_rx_buffer != NULL)
   {
     /* Note that the ring_buffer should've been initialised first */
-    uart_interfaces[uart].rx_buffer = optional_rx_buffer;
-    uart_interfaces[uart].rx_size   = 0;
+    uart_interfaces[uart].rx_buffer     = optional_rx_buffer;
+    uart_interfaces[uart].rx_size       = 0;
+    uart_interfaces[uart].rx_received   = 0;
+    uart_interfaces[uart].rx_consumed   = 0;
+    uart_interfaces[uart].rx_frame_wait = false;
+    uart_interfaces[uart].rx_frame_head = 0;
+    uart_interfaces[uart].rx_frame_tail = 0;
+    
+    /* Half and full transfer interrupts bound the latency of a long burst, the
+       line idle interrupt ends a burst. There is no interrupt per byte. */
+    DMA_ITConfig( uart_mapping[uart].rx_dma_stream, DMA_IT_HT | DMA_IT_TC | DMA_IT_TE | DMA_IT_DME | DMA_IT_FE, ENABLE );
     platform_uart_receive_bytes( uart, optional_rx_buffer->buffer, optional_rx_buffer->size, 0 );
   }
   else
   {
-    /* Not using ring buffer. Configure RX DMA interrupt on Cortex-M3 */
-    nvic_init_structure.NVIC_IRQChannel                   = uart_mapping[uart].rx_dma_irq;
-    nvic_init_structure.NVIC_IRQChannelPreemptionPriority = (uint8_t) 0x5;
-    nvic_init_structure.NVIC_IRQChannelSubPriority        = 0x8;
-    nvic_init_structure.NVIC_IRQChannelCmd                = ENABLE;
-    NVIC_Init( &nvic_init_structure );
-    
     /* Enable TC (transfer complete) and TE (transfer error) interrupts on source */
     DMA_ITConfig( uart_mapping[uart].rx_dma_stream, DMA_IT_TC | DMA_IT_TE | DMA_IT_DME | DMA_IT_FE, ENABLE );
   }
@@ -391,6 +445,14 @@ OSStatus MicoUartFinalize( mico_uart_t uart )
   
   /* Disable TC (transfer complete) interrupt at the source */
   DMA_ITConfig( uart_mapping[uart].tx_dma_stream, DMA_IT_TC | DMA_IT_TE, DISABLE );
+  DMA_ITConfig( uart_mapping[uart].rx_dma_stream, DMA_IT_HT | DMA_IT_TC | DMA_IT_TE, DISABLE );
+  
+  /* Disable receive DMA interrupt at Cortex-M3 */
+  nvic_init_structure.NVIC_IRQChannel                   = uart_mapping[uart].rx_dma_irq;
+  nvic_init_structure.NVIC_IRQChannelPreemptionPriority = (uint8_t) 0x5;
+  nvic_init_structure.NVIC_IRQChannelSubPriority        = 0x8;
+  nvic_init_structure.NVIC_IRQChannelCmd                = DISABLE;
+  NVIC_Init( &nvic_init_structure );
   
   /* Disable transmit DMA interrupt at Cortex-M3 */
   nvic_init_structure.NVIC_IRQChannel                   = uart_mapping[uart].tx_dma_irq;
@@ -407,7 +469,7 @@ OSStatus MicoUartFinalize( mico_uart_t uart )
   * De-initialise STM32 USART interrupt
   **************************************************************************/
   
-  USART_ITConfig( uart_mapping[uart].usart, USART_IT_RXNE, DISABLE );
+  USART_ITConfig( uart_mapping[uart].usart, USART_IT_IDLE, DISABLE );
   
   /* Disable UART interrupt vector on Cortex-M3 */
   nvic_init_structure.NVIC_IRQChannel                   = uart_mapping[uart].usart_irq;
@@ -419,11 +481,19 @@ OSStatus MicoUartFinalize( mico_uart_t uart )
   /* Disable registers clocks */
   uart_mapping[uart].usart_peripheral_clock_func( uart_mapping[uart].usart_peripheral_clock, DISABLE );
   
+  /* Requests still queued are completed with an error */
+  uart_interfaces[uart].tx_dma_count  = 0;
+  uart_interfaces[uart].tx_queue_next = uart_interfaces[uart].tx_queue_tail;
+  uart_tx_complete( uart, (uint8_t)( uart_interfaces[uart].tx_queue_tail - uart_interfaces[uart].tx_queue_head ), kGeneralErr );
+  
 #ifndef NO_MICO_RTOS
   mico_rtos_deinit_semaphore(&uart_interfaces[uart].rx_complete);
   mico_rtos_deinit_semaphore(&uart_interfaces[uart].tx_complete);
+  mico_rtos_deinit_mutex(&uart_interfaces[uart].tx_sync_mutex);
 #endif
   
+  uart_interfaces[uart].rx_buffer = NULL;
+  
   MicoMcuPowerSaveConfig(true);
   
   return kNoErr;
@@ -431,37 +501,89 @@ OSStatus MicoUartFinalize( mico_uart_t uart )
 
 OSStatus MicoUartSend( mico_uart_t uart, const void* data, uint32_t size )
 {
-  /* Reset DMA transmission result. The result is assigned in interrupt handler */
-  uart_interfaces[uart].tx_dma_result = kGeneralErr;
-  
-  MicoMcuPowerSaveConfig(false);  
-  
-  uart_mapping[uart].tx_dma_stream->CR  &= ~(uint32_t) DMA_SxCR_CIRC;
-  uart_mapping[uart].tx_dma_stream->NDTR = size;
-  uart_mapping[uart].tx_dma_stream->M0AR = (uint32_t)data;
-  
-  USART_DMACmd( uart_mapping[uart].usart, USART_DMAReq_Tx, ENABLE );
-  USART_ClearFlag( uart_mapping[uart].usart, USART_FLAG_TC );
-  DMA_Cmd( uart_mapping[uart].tx_dma_stream, ENABLE );
+  /* Assigned by uart_tx_sync_callback in the TX DMA interrupt */
+  volatile OSStatus result = kNoErr;
+  uint32_t transfer_size;
   
 #ifndef NO_MICO_RTOS
-  mico_rtos_get_semaphore( &uart_interfaces[ uart ].tx_complete, MICO_NEVER_TIMEOUT );
+  mico_rtos_lock_mutex( &uart_interfaces[ uart ].tx_sync_mutex );
+#endif
+  while ( size != 0 && result == kNoErr )
+  {
+    transfer_size = MIN( size, UART_TX_DMA_MAX_SIZE );
+    result = kInProgressErr;
+    
+    /* Sent after the asynchronous requests already queued */
+    while ( MicoUartSendAsync( uart, data, transfer_size, uart_tx_sync_callback, (void*) &result ) == kNoResourcesErr )
+    {
+#ifndef NO_MICO_RTOS
+      mico_thread_msleep( 1 );
+#endif
+    }
+    
+#ifndef NO_MICO_RTOS
+    while ( result == kInProgressErr )
+    {
+      mico_rtos_get_semaphore( &uart_interfaces[ uart ].tx_complete, MICO_NEVER_TIMEOUT );
+    }
 #else 
-  while(uart_interfaces[ uart ].tx_complete == false);
-  uart_interfaces[ uart ].tx_complete = false;
+    while( result == kInProgressErr );
+    uart_interfaces[ uart ].tx_complete = false;
 #endif
+    
+    data = (const uint8_t*) data + transfer_size;
+    size -= transfer_size;
+  }
   
-  while ( ( uart_mapping[ uart ].usart->SR & USART_SR_TC ) == 0 )
+  /* Return when the last byte has left the shift register, unless more data follows */
+  while ( uart_interfaces[ uart ].tx_dma_count == 0 && ( uart_mapping[ uart ].usart->SR & USART_SR_TC ) == 0 )
   {
   }
+#ifndef NO_MICO_RTOS
+  mico_rtos_unlock_mutex( &uart_interfaces[ uart ].tx_sync_mutex );
+#endif
   
-  DMA_Cmd( uart_mapping[uart].tx_dma_stream, DISABLE );
-  USART_DMACmd( uart_mapping[uart].usart, USART_DMAReq_Tx, DISABLE );
+  return result;
+}
+
+OSStatus MicoUartSendAsync( mico_uart_t uart, const void* data, uint32_t size, mico_uart_tx_callback_t callback, void* arg )
+{
+  uart_interface_t* interface = &uart_interfaces[uart];
+  uart_tx_request_t* request;
   
-  MicoMcuPowerSaveConfig(true);
+  if ( data == NULL || size == 0 || size > UART_TX_DMA_MAX_SIZE )
+  {
+    return kSizeErr;
+  }
+  
+  /* Keep the clocks until the request is sent, released in uart_tx_complete */
+  MicoMcuPowerSaveConfig(false);
+  
+  DISABLE_INTERRUPTS;
+  
+  if ( (uint8_t)( interface->tx_queue_tail - interface->tx_queue_head ) >= UART_TX_QUEUE_LEN )
+  {
+    ENABLE_INTERRUPTS;
+    MicoMcuPowerSaveConfig(true);
+    return kNoResourcesErr;
+  }
+  
+  request = &interface->tx_queue[ interface->tx_queue_tail % UART_TX_QUEUE_LEN ];
+  request->data     = data;
+  request->size     = size;
+  request->callback = callback;
+  request->arg      = arg;
+  interface->tx_queue_tail++;
   
-  return uart_interfaces[uart].tx_dma_result;
-  //#endif
+  /* A running transfer chains to this request from its interrupt */
+  if ( interface->tx_dma_count == 0 )
+  {
+    uart_tx_start( uart );
+  }
+  
+  ENABLE_INTERRUPTS;
+  
+  return kNoErr;
 }
 
 OSStatus MicoUartRecv( mico_uart_t uart, void* data, uint32_t size, uint32_t timeout )
@@ -472,63 +594,134 @@ OSStatus MicoUartRecv( mico_uart_t uart, void* data, uint32_t size, uint32_t tim
     {
       uint32_t transfer_size = MIN(uart_interfaces[uart].rx_buffer->size / 2, size);
       
-      /* Check if ring buffer already contains the required amount of data. */
-      if ( transfer_size > ring_buffer_used_space( uart_interfaces[uart].rx_buffer ) )
+      /* Wait in rx_complete semaphore until data reaches transfer_size or timeout occurs */
+      while ( transfer_size > ring_buffer_used_space( uart_interfaces[uart].rx_buffer ) )
       {
-        /* Set rx_size and wait in rx_complete semaphore until data reaches rx_size or timeout occurs */
-        uart_interfaces[uart].rx_size = transfer_size;
-        
-#ifndef NO_MICO_RTOS
-        if ( mico_rtos_get_semaphore( &uart_interfaces[uart].rx_complete, timeout) != kNoErr )
+        if ( uart_rx_wait( uart, transfer_size, false, timeout ) != kNoErr )
         {
-          uart_interfaces[uart].rx_size = 0;
           return kTimeoutErr;
         }
-#else
-        uart_interfaces[uart].rx_complete = false;
-        int delay_start = mico_get_time_no_os();
-        while(uart_interfaces[uart].rx_complete == false){
-          if(mico_get_time_no_os() >= delay_start + timeout && timeout != MICO_NEVER_TIMEOUT){
-            uart_interfaces[uart].rx_size = 0;
-            return kTimeoutErr;
-          }
-        }
-#endif
-        
-        /* Reset rx_size to prevent semaphore being set while nothing waits for the data */
-        uart_interfaces[uart].rx_size = 0;
       }
       
       size -= transfer_size;
       
       // Grab data from the buffer
-      do
-      {
-        uint8_t* available_data;
-        uint32_t bytes_available;
-        
-        ring_buffer_get_data( uart_interfaces[uart].rx_buffer, &available_data, &bytes_available );
-        bytes_available = MIN( bytes_available, transfer_size );
-        memcpy( data, available_data, bytes_available );
-        transfer_size -= bytes_available;
-        data = ( (uint8_t*) data + bytes_available );
-        ring_buffer_consume( uart_interfaces[uart].rx_buffer, bytes_available );
-      } while ( transfer_size != 0 );
+      data = ( (uint8_t*) data + uart_rx_copy( uart, data, transfer_size ) );
     }
     
-    if ( size != 0 )
+    return kNoErr;
+  }
+  else
+  {
+    return platform_uart_receive_bytes( uart, data, size, timeout );
+  }
+}
+
+OSStatus MicoUartRecvFrame( mico_uart_t uart, void* data, uint32_t size, uint32_t* received_size, uint32_t timeout )
+{
+  uart_interface_t* interface = &uart_interfaces[uart];
+  uint32_t frame_size;
+  uint32_t threshold;
+  
+  *received_size = 0;
+  if ( interface->rx_buffer == NULL || size == 0 )
+  {
+    return kUnsupportedErr;
+  }
+  
+  /* A burst longer than half of the ring buffer is returned in pieces before it ends */
+  threshold = MIN( interface->rx_buffer->size / 2, size );
+  
+  while ( 1 )
+  {
+    if ( interface->rx_frame_head != interface->rx_frame_tail )
     {
-      return kGeneralErr;
+      frame_size = interface->rx_frame_ends[ interface->rx_frame_head % UART_RX_FRAME_QUEUE_LEN ] - interface->rx_consumed;
+      break;
     }
-    else
+    
+    frame_size = ring_buffer_used_space( interface->rx_buffer );
+    if ( frame_size >= threshold )
     {
-      return kNoErr;
+      break;
+    }
+    
+    if ( uart_rx_wait( uart, threshold, true, timeout ) != kNoErr )
+    {
+      return kTimeoutErr;
     }
   }
-  else
+  
+  *received_size = uart_rx_copy( uart, data, MIN( frame_size, size ) );
+  return kNoErr;
+}
+
+/* Waits until the ring buffer holds threshold bytes or, if wait_frame is set, a burst ends */
+static OSStatus uart_rx_wait( mico_uart_t uart, uint32_t threshold, bool wait_frame, uint32_t timeout )
+{
+  OSStatus err = kNoErr;
+  
+  /* Set rx_size and wait in rx_complete semaphore until data reaches rx_size or timeout occurs */
+  uart_interfaces[uart].rx_frame_wait = wait_frame;
+  uart_interfaces[uart].rx_size = threshold;
+
+  /* Data or the end of a burst may have arrived between the check of the caller and
+     arming the wait above, the interrupt has seen no waiter then */
+  if ( ring_buffer_used_space( uart_interfaces[uart].rx_buffer ) >= threshold ||
+      ( wait_frame == true && uart_interfaces[uart].rx_frame_head != uart_interfaces[uart].rx_frame_tail ) )
   {
-    return platform_uart_receive_bytes( uart, data, size, timeout );
+    uart_interfaces[uart].rx_size = 0;
+    uart_interfaces[uart].rx_frame_wait = false;
+    return kNoErr;
+  }
+  
+#ifndef NO_MICO_RTOS
+  if ( mico_rtos_get_semaphore( &uart_interfaces[uart].rx_complete, timeout) != kNoErr )
+  {
+    err = kTimeoutErr;
+  }
+#else
+  uart_interfaces[uart].rx_complete = false;
+  int delay_start = mico_get_time_no_os();
+  while(uart_interfaces[uart].rx_complete == false){
+    if(mico_get_time_no_os() >= delay_start + timeout && timeout != MICO_NEVER_TIMEOUT){
+      err = kTimeoutErr;
+      break;
+    }
+  }
+#endif
+  
+  /* Reset rx_size to prevent semaphore being set while nothing waits for the data */
+  uart_interfaces[uart].rx_size = 0;
+  uart_interfaces[uart].rx_frame_wait = false;
+  return err;
+}
+
+/* Copies up to size bytes out of the ring buffer and drops the frame boundaries passed */
+static uint32_t uart_rx_copy( mico_uart_t uart, uint8_t* data, uint32_t size )
+{
+  uart_interface_t* interface = &uart_interfaces[uart];
+  uint32_t copied = 0;
+  uint8_t* available_data;
+  uint32_t bytes_available;
+  
+  size = MIN( size, ring_buffer_used_space( interface->rx_buffer ) );
+  while ( copied < size )
+  {
+    ring_buffer_get_data( interface->rx_buffer, &available_data, &bytes_available );
+    bytes_available = MIN( bytes_available, size - copied );
+    memcpy( data + copied, available_data, bytes_available );
+    copied += bytes_available;
+    ring_buffer_consume( interface->rx_buffer, bytes_available );
   }
+  
+  interface->rx_consumed += copied;
+  while ( interface->rx_frame_head != interface->rx_frame_tail &&
+         (int32_t)( interface->rx_frame_ends[ interface->rx_frame_head % UART_RX_FRAME_QUEUE_LEN ] - interface->rx_consumed ) <= 0 )
+  {
+    interface->rx_frame_head++;
+  }
+  return copied;
 }
 
 static OSStatus platform_uart_receive_bytes( mico_uart_t uart, void* data, uint32_t size, uint32_t timeout )
@@ -537,8 +730,8 @@ static OSStatus platform_uart_receive_bytes( mico_uart_t uart, void* data, uint3
   {
     uart_mapping[uart].rx_dma_stream->CR |= DMA_SxCR_CIRC;
     
-    // Enabled individual byte interrupts so progress can be updated
-    USART_ITConfig( uart_mapping[uart].usart, USART_IT_RXNE, ENABLE );
+    // Enable line idle interrupt so the end of each burst is reported
+    USART_ITConfig( uart_mapping[uart].usart, USART_IT_IDLE, ENABLE );
   }
   else
   {
@@ -575,6 +768,10 @@ static OSStatus platform_uart_receive_bytes( mico_uart_t uart, void* data, uint3
 
 uint32_t MicoUartGetLengthInBuffer( mico_uart_t uart )
 {
+  /* The tail only follows the DMA on line idle and half/full transfer, catch up in a burst */
+  DISABLE_INTERRUPTS;
+  uart_rx_update_tail( uart );
+  ENABLE_INTERRUPTS;
   return ring_buffer_used_space( uart_interfaces[uart].rx_buffer );
 }
 
@@ -595,6 +792,161 @@ static void thread_wakeup(void *arg)
 /******************************************************
 *            Interrupt Service Routines
 ******************************************************/
+
+/* Moves the ring buffer tail to where the RX DMA has written. Called with
+ * interrupts disabled or from the UART and RX DMA interrupts. */
+static void uart_rx_update_tail( mico_uart_t uart )
+{
+  uart_interface_t* interface = &uart_interfaces[ uart ];
+  ring_buffer_t* rx_buffer = interface->rx_buffer;
+  uint32_t tail;
+  
+  if ( rx_buffer == NULL )
+    return;
+  
+  tail = rx_buffer->size - uart_mapping[ uart ].rx_dma_stream->NDTR;
+  if ( tail == rx_buffer->size )
+    tail = 0;
+  interface->rx_received += ( tail >= rx_buffer->tail ) ? tail - rx_buffer->tail : tail + rx_buffer->size - rx_buffer->tail;
+  rx_buffer->tail = tail;
+}
+
+/* Called on line idle and on RX DMA half/full transfer in ring buffer mode */
+static void uart_rx_event( mico_uart_t uart, bool line_idle )
+{
+  uart_interface_t* interface = &uart_interfaces[ uart ];
+  ring_buffer_t* rx_buffer = interface->rx_buffer;
+  
+  if ( rx_buffer == NULL )
+    return;
+  
+  uart_rx_update_tail( uart );
+  
+  // Record the end of the burst, it is merged into the next one if the queue is full
+  if ( line_idle == true &&
+      (uint8_t)( interface->rx_frame_tail - interface->rx_frame_head ) < UART_RX_FRAME_QUEUE_LEN &&
+      interface->rx_received != interface->rx_consumed &&
+      ( interface->rx_frame_tail == interface->rx_frame_head ||
+        interface->rx_frame_ends[ (uint8_t)( interface->rx_frame_tail - 1 ) % UART_RX_FRAME_QUEUE_LEN ] != interface->rx_received ) )
+  {
+    interface->rx_frame_ends[ interface->rx_frame_tail % UART_RX_FRAME_QUEUE_LEN ] = interface->rx_received;
+    interface->rx_frame_tail++;
+  }
+  
+  // Notify thread if sufficient data are available or the burst it waits for ended
+  if ( ( interface->rx_size > 0 ) &&
+      ( ( ring_buffer_used_space( rx_buffer ) >= interface->rx_size ) ||
+        ( line_idle == true && interface->rx_frame_wait == true ) ) )
+  {
+#ifndef NO_MICO_RTOS
+    mico_rtos_set_semaphore( &interface->rx_complete );
+#else
+    interface->rx_complete = true;
+#endif
+    interface->rx_size = 0;
+  }
+}
+
+/* Starts the TX DMA on the first pending request. The requests that follow it
+ * in memory, e.g. a message queued in pieces, are gathered into the same
+ * transfer. Called with interrupts disabled or from the TX DMA interrupt. */
+static void uart_tx_start( mico_uart_t uart )
+{
+  uart_interface_t* interface = &uart_interfaces[uart];
+  const uart_tx_request_t* request = &interface->tx_queue[ interface->tx_queue_next % UART_TX_QUEUE_LEN ];
+  const uint8_t* data = request->data;
+  uint32_t size = request->size;
+  uint8_t count = 1;
+  
+  while ( (uint8_t)( interface->tx_queue_next + count ) != interface->tx_queue_tail )
+  {
+    request = &interface->tx_queue[ (uint8_t)( interface->tx_queue_next + count ) % UART_TX_QUEUE_LEN ];
+    if ( request->data != data + size || size + request->size > UART_TX_DMA_MAX_SIZE )
+    {
+      break;
+    }
+    size += request->size;
+    count++;
+  }
+  
+  interface->tx_queue_next += count;
+  interface->tx_dma_count = count;
+  
+  /* Reset DMA transmission result. The result is assigned in interrupt handler */
+  interface->tx_dma_result = kGeneralErr;
+  
+  DMA_Cmd( uart_mapping[uart].tx_dma_stream, DISABLE );
+  uart_mapping[uart].tx_dma_stream->CR  &= ~(uint32_t) DMA_SxCR_CIRC;
+  uart_mapping[uart].tx_dma_stream->NDTR = size;
+  uart_mapping[uart].tx_dma_stream->M0AR = (uint32_t)data;
+  
+  USART_DMACmd( uart_mapping[uart].usart, USART_DMAReq_Tx, ENABLE );
+  USART_ClearFlag( uart_mapping[uart].usart, USART_FLAG_TC );
+  DMA_Cmd( uart_mapping[uart].tx_dma_stream, ENABLE );
+}
+
+/* Releases the count oldest requests and calls their callbacks */
+static void uart_tx_complete( mico_uart_t uart, uint8_t count, OSStatus result )
+{
+  uart_interface_t* interface = &uart_interfaces[uart];
+  uart_tx_request_t request;
+  
+  for ( ; count > 0; count-- )
+  {
+    /* The descriptor is free before the callback, which may queue the next request */
+    request = interface->tx_queue[ interface->tx_queue_head % UART_TX_QUEUE_LEN ];
+    interface->tx_queue_head++;
+    MicoMcuPowerSaveConfig(true);
+    
+    if ( request.callback != NULL )
+    {
+      request.callback( uart, request.data, request.size, result, request.arg );
+    }
+  }
+}
+
+/* The TX DMA transfer ended: the next pending requests go out back to back, then
+ * the sent ones are completed */
+static void uart_tx_event( mico_uart_t uart )
+{
+  uart_interface_t* interface = &uart_interfaces[uart];
+  uint8_t sent = interface->tx_dma_count;
+  /* uart_tx_start() resets it for the next transfer */
+  OSStatus result = interface->tx_dma_result;
+  
+  if ( sent == 0 )
+  {
+    return;
+  }
+  
+  DISABLE_INTERRUPTS;
+  if ( interface->tx_queue_next != interface->tx_queue_tail )
+  {
+    uart_tx_start( uart );
+  }
+  else
+  {
+    interface->tx_dma_count = 0;
+    USART_DMACmd( uart_mapping[uart].usart, USART_DMAReq_Tx, DISABLE );
+  }
+  ENABLE_INTERRUPTS;
+  
+  uart_tx_complete( uart, sent, result );
+}
+
+/* Completion of a MicoUartSend request, arg points to the result it waits for */
+static void uart_tx_sync_callback( mico_uart_t uart, const void* data, uint32_t size, OSStatus result, void* arg )
+{
+  UNUSED_PARAMETER( data );
+  UNUSED_PARAMETER( size );
+  
+  *(volatile OSStatus*) arg = result;
+#ifndef NO_MICO_RTOS
+  mico_rtos_set_semaphore( &uart_interfaces[ uart ].tx_complete );
+#else
+  uart_interfaces[ uart ].tx_complete = true;
+#endif
+}
 #ifndef NO_MICO_RTOS
 void RX_PIN_WAKEUP_handler(void *arg)
 {
@@ -614,22 +966,11 @@ void RX_PIN_WAKEUP_handler(void *arg)
 
 void USART1_IRQHandler( void )
 {
-  // Clear all interrupts. It's safe to do so because only RXNE interrupt is enabled
-  USART1->SR = (uint16_t) (USART1->SR | 0xffff);
-  
-  // Update tail
-  uart_interfaces[ STM32_UART_1 ].rx_buffer->tail = uart_interfaces[ STM32_UART_1 ].rx_buffer->size - uart_mapping[ STM32_UART_1 ].rx_dma_stream->NDTR;
-  
-  // Notify thread if sufficient data are available
-  if ( ( uart_interfaces[ STM32_UART_1 ].rx_size > 0 ) &&
-      ( ring_buffer_used_space( uart_interfaces[ STM32_UART_1 ].rx_buffer ) >= uart_interfaces[STM32_UART_1].rx_size ) )
+  // Only the IDLE interrupt is enabled, it is cleared by reading SR then DR
+  if ( ( USART1->SR & USART_SR_IDLE ) != 0 )
   {
-#ifndef NO_MICO_RTOS
-    mico_rtos_set_semaphore( &uart_interfaces[ STM32_UART_1 ].rx_complete );
-#else
-    uart_interfaces[ STM32_UART_1 ].rx_complete = true;
-#endif
-    uart_interfaces[ STM32_UART_1 ].rx_size = 0;
+    (void) USART1->DR;
+    uart_rx_event( STM32_UART_1, true );
   }
   
 #ifndef NO_MICO_RTOS
@@ -640,22 +981,11 @@ void USART1_IRQHandler( void )
 
 void USART2_IRQHandler( void )
 {
-  // Clear all interrupts. It's safe to do so because only RXNE interrupt is enabled
-  USART2->SR = (uint16_t) (USART2->SR | 0xffff);
-  
-  // Update tail
-  uart_interfaces[ STM32_UART_2 ].rx_buffer->tail = uart_interfaces[ STM32_UART_2 ].rx_buffer->size - uart_mapping[ STM32_UART_2 ].rx_dma_stream->NDTR;
-  
-  // Notify thread if sufficient data are available
-  if ( ( uart_interfaces[ STM32_UART_2 ].rx_size > 0 ) &&
-      ( ring_buffer_used_space( uart_interfaces[ STM32_UART_2 ].rx_buffer ) >= uart_interfaces[STM32_UART_2].rx_size ) )
+  // Only the IDLE interrupt is enabled, it is cleared by reading SR then DR
+  if ( ( USART2->SR & USART_SR_IDLE ) != 0 )
   {
-#ifndef NO_MICO_RTOS
-    mico_rtos_set_semaphore( &uart_interfaces[ STM32_UART_2 ].rx_complete );
-#else
-    uart_interfaces[ STM32_UART_2 ].rx_complete = true;
-#endif
-    uart_interfaces[ STM32_UART_2 ].rx_size = 0;
+    (void) USART2->DR;
+    uart_rx_event( STM32_UART_2, true );
   }
   
 #ifndef NO_MICO_RTOS
@@ -666,22 +996,11 @@ void USART2_IRQHandler( void )
 
 void USART6_IRQHandler( void )
 {
-  // Clear all interrupts. It's safe to do so because only RXNE interrupt is enabled
-  USART6->SR = (uint16_t) (USART6->SR | 0xffff);
-  
-  // Update tail
-  uart_interfaces[ STM32_UART_6 ].rx_buffer->tail = uart_interfaces[ STM32_UART_6 ].rx_buffer->size - uart_mapping[ STM32_UART_6 ].rx_dma_stream->NDTR;
-  
-  // Notify thread if sufficient data are available
-  if ( ( uart_interfaces[ STM32_UART_6 ].rx_size > 0 ) &&
-      ( ring_buffer_used_space( uart_interfaces[ STM32_UART_6 ].rx_buffer ) >= uart_interfaces[ STM32_UART_6 ].rx_size ) )
+  // Only the IDLE interrupt is enabled, it is cleared by reading SR then DR
+  if ( ( USART6->SR & USART_SR_IDLE ) != 0 )
   {
-#ifndef NO_MICO_RTOS
-    mico_rtos_set_semaphore( &uart_interfaces[ STM32_UART_6 ].rx_complete );
-#else
-    uart_interfaces[ STM32_UART_1 ].rx_complete = true;
-#endif
-    uart_interfaces[ STM32_UART_6 ].rx_size = 0;
+    (void) USART6->DR;
+    uart_rx_event( STM32_UART_6, true );
   }
   
 #ifndef NO_MICO_RTOS
@@ -715,12 +1034,8 @@ void DMA2_Stream7_IRQHandler( void )
     }
   }
   
-#ifndef NO_MICO_RTOS
-  /* Set semaphore regardless of result to prevent waiting thread from locking up */
-  mico_rtos_set_semaphore( &uart_interfaces[ STM32_UART_1 ].tx_complete);
-#else
-  uart_interfaces[ STM32_UART_1 ].tx_complete = true;
-#endif
+  /* Complete the requests regardless of result to prevent waiting threads from locking up */
+  uart_tx_event( STM32_UART_1 );
 }
 
 //usart2_tx_dma_irq
@@ -748,12 +1063,8 @@ void DMA1_Stream6_IRQHandler( void )
     }
   }
   
-#ifndef NO_MICO_RTOS
-  /* Set semaphore regardless of result to prevent waiting thread from locking up */
-  mico_rtos_set_semaphore( &uart_interfaces[ STM32_UART_2 ].tx_complete);
-#else
-  uart_interfaces[ STM32_UART_2 ].tx_complete = true;
-#endif
+  /* Complete the requests regardless of result to prevent waiting threads from locking up */
+  uart_tx_event( STM32_UART_2 );
 }
 
 //usart6_tx_dma_irq
@@ -780,22 +1091,21 @@ void DMA2_Stream6_IRQHandler( void )
     }
   }
   
-#ifndef NO_MICO_RTOS
-  /* Set semaphore regardless of result to prevent waiting thread from locking up */
-  mico_rtos_set_semaphore( &uart_interfaces[ STM32_UART_6 ].tx_complete);
-#else
-  uart_interfaces[ STM32_UART_6 ].tx_complete = true;
-#endif
+  /* Complete the requests regardless of result to prevent waiting threads from locking up */
+  uart_tx_event( STM32_UART_6 );
   
 }
 
 //usart1_rx_dma_irq
 void DMA2_Stream2_IRQHandler( void )
 {
-  if ( ( DMA2->LISR & DMA_LISR_TCIF2 ) != 0 )
+  bool transfer_event = false;
+  
+  if ( ( DMA2->LISR & ( DMA_LISR_TCIF2 | DMA_LISR_HTIF2 ) ) != 0 )
   {
-    DMA2->LIFCR |= DMA_LISR_TCIF2;
+    DMA2->LIFCR |= ( DMA_LISR_TCIF2 | DMA_LISR_HTIF2 );
     uart_interfaces[ STM32_UART_1 ].rx_dma_result = kNoErr;
+    transfer_event = true;
   }
   
   /* RX DMA error */
@@ -805,6 +1115,15 @@ void DMA2_Stream2_IRQHandler( void )
     DMA2->LIFCR |= ( DMA_LISR_TEIF2 | DMA_LISR_DMEIF2 | DMA_LISR_FEIF2 );
     uart_interfaces[ STM32_UART_1 ].rx_dma_result = kGeneralErr;
   }
+  
+  /* Circular reception into the ring buffer: half and full transfer are progress events */
+  if ( uart_interfaces[ STM32_UART_1 ].rx_buffer != NULL )
+  {
+    if ( transfer_event == true )
+      uart_rx_event( STM32_UART_1, false );
+    return;
+  }
+  
 #ifndef NO_MICO_RTOS
   mico_rtos_set_semaphore( &uart_interfaces[ STM32_UART_1 ].rx_complete );
 #else
@@ -815,19 +1134,31 @@ void DMA2_Stream2_IRQHandler( void )
 //usart2_rx_dma_irq
 void DMA1_Stream5_IRQHandler( void )
 {
-  if ( ( DMA1->HISR & DMA_HISR_TCIF5 ) != 0 )
+  bool transfer_event = false;
+  
+  if ( ( DMA1->HISR & ( DMA_HISR_TCIF5 | DMA_HISR_HTIF5 ) ) != 0 )
   {
-    DMA1->LIFCR |= DMA_HISR_TCIF5;
+    DMA1->HIFCR |= ( DMA_HISR_TCIF5 | DMA_HISR_HTIF5 );
     uart_interfaces[ STM32_UART_2 ].rx_dma_result = kNoErr;
+    transfer_event = true;
   }
   
   /* RX DMA error */
   if ( ( DMA1->HISR & ( DMA_HISR_TEIF5 | DMA_HISR_DMEIF5 | DMA_HISR_FEIF5 ) ) != 0 )
   {
     /* Clear interrupt */
-    DMA1->LIFCR |= ( DMA_HISR_TEIF5 | DMA_HISR_DMEIF5 | DMA_HISR_FEIF5 );
+    DMA1->HIFCR |= ( DMA_HISR_TEIF5 | DMA_HISR_DMEIF5 | DMA_HISR_FEIF5 );
     uart_interfaces[ STM32_UART_2 ].rx_dma_result = kGeneralErr;
   }
+  
+  /* Circular reception into the ring buffer: half and full transfer are progress events */
+  if ( uart_interfaces[ STM32_UART_2 ].rx_buffer != NULL )
+  {
+    if ( transfer_event == true )
+      uart_rx_event( STM32_UART_2, false );
+    return;
+  }
+  
 #ifndef NO_MICO_RTOS
   mico_rtos_set_semaphore( &uart_interfaces[ STM32_UART_2 ].rx_complete );
 #else
@@ -838,14 +1169,16 @@ void DMA1_Stream5_IRQHandler( void )
 //usart6_rx_dma_irq
 void DMA2_Stream1_IRQHandler( void )
 {
-  if ( ( DMA2->LISR & DMA_LISR_TCIF1 ) != 0 )
+  bool transfer_event = false;
+  
+  if ( ( DMA2->LISR & ( DMA_LISR_TCIF1 | DMA_LISR_HTIF1 ) ) != 0 )
   {
-    DMA2->LIFCR |= DMA_LISR_TCIF1;
+    DMA2->LIFCR |= ( DMA_LISR_TCIF1 | DMA_LISR_HTIF1 );
     uart_interfaces[ STM32_UART_6 ].rx_dma_result = kNoErr;
-    
+    transfer_event = true;
   }
   
-  /* TX DMA error */
+  /* RX DMA error */
   if ( ( DMA2->LISR & ( DMA_LISR_TEIF1 | DMA_LISR_DMEIF1 | DMA_LISR_FEIF1 ) ) != 0 )
   {
     /* Clear interrupt */
@@ -853,6 +1186,14 @@ void DMA2_Stream1_IRQHandler( void )
     uart_interfaces[ STM32_UART_6 ].rx_dma_result = kGeneralErr;
   }
   
+  /* Circular reception into the ring buffer: half and full transfer are progress events */
+  if ( uart_interfaces[ STM32_UART_6 ].rx_buffer != NULL )
+  {
+    if ( transfer_event == true )
+      uart_rx_event( STM32_UART_6, false );
+    return;
+  }
+  
 #ifndef NO_MICO_RTOS
   mico_rtos_set_semaphore( &uart_interfaces[ STM32_UART_6 ].rx_complete );
 #else
@@ -167,6 +167,17 @@
 /  should be added to the disk_ioctl() function. */
 
 
+#define _DISK_CACHE_SETS     4 /* 0:Disable or number of sets */
+#define _DISK_CACHE_WAYS     2 /* Sectors of each set */
+#define _DISK_READ_AHEAD     4 /* Sectors read at once by sequential reads */
+/* diskio.c caches _DISK_CACHE_SETS * _DISK_CACHE_WAYS sectors of each volume,
+/  the sectors of the FAT longer than the others. Single sector writes stay in
+/  the cache until f_sync() or f_close(), or until a dirty sector is replaced,
+/  and consecutive ones are written back in one disk_write(). The cache takes
+/  about _DISK_CACHE_SETS * _DISK_CACHE_WAYS + _DISK_READ_AHEAD sectors of RAM
+/  for each volume. */
+
+
 #define _FS_NOFSINFO    0 /* 0 or 1 */
 /* If you need to know the correct free space on the FAT32 volume, set this
 /  option to 1 and f_getfree() function at first time after volume mount will
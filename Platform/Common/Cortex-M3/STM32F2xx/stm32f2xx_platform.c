@@ -36,6 +36,7 @@
 #include "platform_common_config.h"
 #include "MicoPlatform.h"
 #include "PlatformLogging.h"
+#include "PlatformInternal.h"
 #include "rtc.h"
 #include <string.h> // For memcmp
 #include "crt0.h"
@@ -152,7 +153,12 @@ static void __asm __jump_to( uint32_t addr )
 /*Boot to mico application form APPLICATION_START_ADDRESS defined in platform_common_config.h */
 void startApplication(void)
 {
-  uint32_t text_addr = APPLICATION_START_ADDRESS;
+  startApplicationFromAddress(APPLICATION_START_ADDRESS);
+}
+
+/*Boot to a mico application linked at text_addr, e.g. APPLICATION_B_START_ADDRESS */
+void startApplicationFromAddress(uint32_t text_addr)
+{
   uint32_t* stack_ptr;
   uint32_t* start_ptr;
   SysTick->CTRL &= ~SysTick_CTRL_ENABLE_Msk;
@@ -36,6 +36,7 @@
 #include "platform_common_config.h"
 #include "MicoPlatform.h"
 #include "PlatformLogging.h"
+#include "PlatformInternal.h"
 #include "rtc.h"
 #include <string.h> // For memcmp
 #include "crt0.h"
@@ -151,8 +152,12 @@ __attribute__( ( always_inline ) ) static __INLINE void __jump_to( uint32_t addr
 /*Boot to mico application form APPLICATION_START_ADDRESS defined in platform_common_config.h */
 void startApplication(void)
 {
-  uint32_t text_addr = APPLICATION_START_ADDRESS;
-  
+  startApplicationFromAddress(APPLICATION_START_ADDRESS);
+}
+
+/*Boot to a mico application linked at text_addr, e.g. APPLICATION_B_START_ADDRESS */
+void startApplicationFromAddress(uint32_t text_addr)
+{
   if(((*(volatile uint32_t*)text_addr) & 0x2FFE0000 ) != 0x20000000)
     text_addr += 0x200;
   /* Test if user code is programmed starting from address "ApplicationAddress" */
@@ -7,6 +7,7 @@
  * or duplicated in any form, in whole or in part, without the prior
  * written permission of Broadcom Corporation.
  */
+#include <stddef.h>
 #include "spi_flash_platform_interface.h"
 #include "stm32f4xx.h"
 
@@ -36,6 +37,14 @@
 #define SFLASH_CS_PORT                       GPIOA
 #define SFLASH_CS_CLK                        RCC_AHB1Periph_GPIOA
 
+#define SFLASH_DMA_CLK                       RCC_AHB1Periph_DMA2
+#define SFLASH_DMA_CHANNEL                   DMA_Channel_3
+#define SFLASH_DMA_RX_STREAM                 DMA2_Stream0
+#define SFLASH_DMA_RX_FLAG_TC                DMA_FLAG_TCIF0
+#define SFLASH_DMA_TX_STREAM                 DMA2_Stream5
+#define SFLASH_DMA_MAX_SIZE                  ( 0xFFFF )
+#define SFLASH_DMA_MIN_SIZE                  ( 16 )  /* Shorter transfers are polled */
+
 
 int sflash_platform_init( int peripheral_id, void** platform_peripheral_out )
 {
@@ -48,7 +57,7 @@ int sflash_platform_init( int peripheral_id, void** platform_peripheral_out )
     SFLASH_SPI_CLK_INIT( SFLASH_SPI_CLK, ENABLE );
 
     RCC_AHB1PeriphClockCmd( SFLASH_SPI_SCK_GPIO_CLK  | SFLASH_SPI_MISO_GPIO_CLK |
-                            SFLASH_SPI_MOSI_GPIO_CLK | SFLASH_CS_CLK, ENABLE      );
+                            SFLASH_SPI_MOSI_GPIO_CLK | SFLASH_CS_CLK | SFLASH_DMA_CLK, ENABLE );
 
 
     /* Use Alternate Functions for SPI pins */
@@ -139,3 +148,91 @@ int sflash_platform_chip_deselect( void* platform_peripheral )
     return 0;
 }
 
+/* Bytes of one DMA transfer, TX and RX streams run together */
+static void sflash_platform_dma_transfer( const unsigned char* MOSI_data, unsigned char* MISO_data, unsigned int size )
+{
+    static const unsigned char dummy_MOSI = 0xFF;
+    static unsigned char dummy_MISO;
+    DMA_InitTypeDef DMA_InitStructure;
+
+    DMA_DeInit( SFLASH_DMA_RX_STREAM );
+    DMA_DeInit( SFLASH_DMA_TX_STREAM );
+
+    DMA_InitStructure.DMA_Channel            = SFLASH_DMA_CHANNEL;
+    DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t) &SFLASH_SPI->DR;
+    DMA_InitStructure.DMA_PeripheralInc      = DMA_PeripheralInc_Disable;
+    DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Byte;
+    DMA_InitStructure.DMA_MemoryDataSize     = DMA_MemoryDataSize_Byte;
+    DMA_InitStructure.DMA_BufferSize         = size;
+    DMA_InitStructure.DMA_Mode               = DMA_Mode_Normal;
+    DMA_InitStructure.DMA_Priority           = DMA_Priority_VeryHigh;
+    DMA_InitStructure.DMA_FIFOMode           = DMA_FIFOMode_Disable;
+    DMA_InitStructure.DMA_FIFOThreshold      = DMA_FIFOThreshold_Full;
+    DMA_InitStructure.DMA_MemoryBurst        = DMA_MemoryBurst_Single;
+    DMA_InitStructure.DMA_PeripheralBurst    = DMA_PeripheralBurst_Single;
+
+    /* Without a buffer the bytes come from or go to one static byte */
+    DMA_InitStructure.DMA_DIR                = DMA_DIR_PeripheralToMemory;
+    DMA_InitStructure.DMA_Memory0BaseAddr    = (uint32_t) ( ( MISO_data != NULL )? MISO_data : &dummy_MISO );
+    DMA_InitStructure.DMA_MemoryInc          = ( MISO_data != NULL )? DMA_MemoryInc_Enable : DMA_MemoryInc_Disable;
+    DMA_Init( SFLASH_DMA_RX_STREAM, &DMA_InitStructure );
+
+    DMA_InitStructure.DMA_DIR                = DMA_DIR_MemoryToPeripheral;
+    DMA_InitStructure.DMA_Memory0BaseAddr    = (uint32_t) ( ( MOSI_data != NULL )? MOSI_data : &dummy_MOSI );
+    DMA_InitStructure.DMA_MemoryInc          = ( MOSI_data != NULL )? DMA_MemoryInc_Enable : DMA_MemoryInc_Disable;
+    DMA_Init( SFLASH_DMA_TX_STREAM, &DMA_InitStructure );
+
+    DMA_Cmd( SFLASH_DMA_RX_STREAM, ENABLE );
+    DMA_Cmd( SFLASH_DMA_TX_STREAM, ENABLE );
+    SPI_I2S_DMACmd( SFLASH_SPI, SPI_I2S_DMAReq_Rx | SPI_I2S_DMAReq_Tx, ENABLE );
+
+    /* The last byte is received after it is sent */
+    while ( DMA_GetFlagStatus( SFLASH_DMA_RX_STREAM, SFLASH_DMA_RX_FLAG_TC ) == RESET )
+    {
+        /* wait */
+    }
+
+    SPI_I2S_DMACmd( SFLASH_SPI, SPI_I2S_DMAReq_Rx | SPI_I2S_DMAReq_Tx, DISABLE );
+    DMA_Cmd( SFLASH_DMA_TX_STREAM, DISABLE );
+    DMA_Cmd( SFLASH_DMA_RX_STREAM, DISABLE );
+}
+
+int sflash_platform_send_recv( void* platform_peripheral, const void* MOSI_data, void* MISO_data, unsigned int size, unsigned char data_lines )
+{
+    const unsigned char* MOSI_ptr = (const unsigned char*) MOSI_data;
+    unsigned char* MISO_ptr = (unsigned char*) MISO_data;
+    unsigned char dummy_MISO;
+    unsigned int transfer_size;
+
+    /* The SPI has one data line each way */
+    if ( data_lines != 1 )
+    {
+        return -1;
+    }
+
+    if ( size < SFLASH_DMA_MIN_SIZE )
+    {
+        while ( size-- > 0 )
+        {
+            sflash_platform_send_recv_byte( platform_peripheral, ( MOSI_ptr != NULL )? *MOSI_ptr++ : 0xFF, ( MISO_ptr != NULL )? MISO_ptr++ : &dummy_MISO );
+        }
+        return 0;
+    }
+
+    while ( size > 0 )
+    {
+        transfer_size = ( size > SFLASH_DMA_MAX_SIZE )? SFLASH_DMA_MAX_SIZE : size;
+        sflash_platform_dma_transfer( MOSI_ptr, MISO_ptr, transfer_size );
+        if ( MOSI_ptr != NULL )
+        {
+            MOSI_ptr += transfer_size;
+        }
+        if ( MISO_ptr != NULL )
+        {
+            MISO_ptr += transfer_size;
+        }
+        size -= transfer_size;
+    }
+    return 0;
+}
+
@@ -0,0 +1,433 @@
+/**
+******************************************************************************
+* @file    LinuxHost.c
+* @author  William Xu
+* @version V1.0.0
+* @date    16-Oct-2026
+* @brief   This file provides the SPI flash platform interface of the Linux
+*          host. The SPI bus is connected to a simulated JEDEC serial NOR
+*          chip, the chip memory is a file mapped by posix_host_map_image().
+******************************************************************************
+*
+*  The MIT License
+*  Copyright (c) 2014 MXCHIP Inc.
+*
+*  Permission is hereby granted, free of charge, to any person obtaining a copy
+*  of this software and associated documentation files (the "Software"), to deal
+*  in the Software without restriction, including without limitation the rights
+*  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+*  copies of the Software, and to permit persons to whom the Software is furnished
+*  to do so, subject to the following conditions:
+*
+*  The above copyright notice and this permission notice shall be included in
+*  all copies or substantial portions of the Software.
+*
+*  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+*  WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR
+*  IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+******************************************************************************
+*/
+
+#include "PlatformLogging.h"
+#include "platform.h"
+#include "platform_common_config.h"
+#include "spi_flash_internal.h"
+#include "spi_flash_platform_interface.h"
+#include "posix_platform.h"
+
+/******************************************************
+*                    Constants
+******************************************************/
+
+#define SFLASH_IMAGE                "mico_flash_spi.bin"
+#define SFLASH_PAGE_SIZE            (256)
+#define SFLASH_SECTOR_SIZE          (0x1000)
+#define SFLASH_BLOCK_SIZE_MID       (0x8000)
+#define SFLASH_BLOCK_SIZE_LARGE     (0x10000)
+#define SFLASH_DMA_MIN_SIZE         (16)      /**< As the STM32 platforms, shorter transfers are polled */
+
+#define SFLASH_WRITABLE_STATUS_BITS ( SFLASH_STATUS_REGISTER_BLOCK_PROTECTED_0 | SFLASH_STATUS_REGISTER_BLOCK_PROTECTED_1 | \
+                                      SFLASH_STATUS_REGISTER_BLOCK_PROTECTED_2 | SFLASH_STATUS_REGISTER_BLOCK_PROTECTED_3 )
+
+/******************************************************
+*                    Structures
+******************************************************/
+
+typedef struct
+{
+  const char*   name;         /**< Value of the MICO_SFLASH_CHIP environment variable */
+  uint32_t      jedec_id;
+  uint32_t      page_size;    /**< Bytes programmed by one page program command, 1 for SST */
+  uint8_t       read_lines;   /**< 2: DREAD, 4: QREAD as well once QE is set */
+} sflash_chip_model_t;
+
+typedef struct
+{
+  const sflash_chip_model_t* model;
+  uint8_t*      memory;
+  uint32_t      size;
+  uint8_t       status;
+  uint8_t       status2;               /**< Winbond W25Q only */
+  bool          write_status_enabled;  /**< SST needs EWSR before WRSR */
+  bool          aai_mode;              /**< SST AAI programming in progress */
+  uint32_t      aai_address;
+
+  /* Current transaction, reset by chip select */
+  uint8_t       command;
+  uint32_t      byte_index;
+  uint32_t      address;
+  uint32_t      page_offset;
+  uint8_t       data_lines;            /**< Lines of the current transfer */
+} sflash_chip_t;
+
+/******************************************************
+*               Variables Definitions
+******************************************************/
+
+static const sflash_chip_model_t sflash_chip_models[] =
+{
+  { "MX25L", SFLASH_ID_MX25L8006E,  SFLASH_PAGE_SIZE, 2 },
+  { "W25X",  SFLASH_ID_W25X80AVSIG, SFLASH_PAGE_SIZE, 2 },
+  { "SST25", SFLASH_ID_SST25VF080B, 1,                1 },
+  { "W25Q",  SFLASH_ID_W25Q16,      SFLASH_PAGE_SIZE, 4 },
+};
+
+static sflash_chip_t sflash_chip;
+
+/******************************************************
+*               Function Definitions
+******************************************************/
+
+static bool _is_sst( void )
+{
+  return SFLASH_MANUFACTURER( sflash_chip.model->jedec_id ) == SFLASH_MANUFACTURER_SST;
+}
+
+static void _program_byte( uint32_t address, uint8_t value )
+{
+  uint8_t* cell = &sflash_chip.memory[address % sflash_chip.size];
+
+  /* NOR flash programming can only clear bits */
+  if ( ( *cell & value ) != value )
+    posix_flash_statistics[MICO_SPI_FLASH].program_errors++;
+  *cell &= value;
+  posix_flash_statistics[MICO_SPI_FLASH].bytes_written++;
+}
+
+static void _erase( uint32_t address, uint32_t erase_size )
+{
+  address = ( address % sflash_chip.size ) & ~( erase_size - 1 );
+  memset( &sflash_chip.memory[address], 0xFF, erase_size );
+  posix_flash_statistics[MICO_SPI_FLASH].erase_count++;
+}
+
+static uint8_t _read_byte( void )
+{
+  uint8_t value;
+
+  /* Data of a multi line read clocked on the wrong lines is garbage */
+  if ( ( sflash_chip.command == SFLASH_DUAL_OUTPUT_READ && sflash_chip.data_lines != 2 ) ||
+       ( sflash_chip.command == SFLASH_QUAD_OUTPUT_READ && sflash_chip.data_lines != 4 ) ||
+       ( sflash_chip.command != SFLASH_DUAL_OUTPUT_READ && sflash_chip.command != SFLASH_QUAD_OUTPUT_READ && sflash_chip.data_lines != 1 ) )
+    return 0xFF;
+
+  value = sflash_chip.memory[sflash_chip.address % sflash_chip.size];
+  sflash_chip.address++;
+  posix_flash_statistics[MICO_SPI_FLASH].bytes_read++;
+  return value;
+}
+
+/* Commands that complete on the command byte */
+static void _command_start( uint8_t command )
+{
+  switch ( command )
+  {
+    case SFLASH_WRITE_ENABLE:
+      sflash_chip.status |= SFLASH_STATUS_REGISTER_WRITE_ENABLED;
+      break;
+
+    case SFLASH_WRITE_DISABLE:
+      sflash_chip.status &= ~SFLASH_STATUS_REGISTER_WRITE_ENABLED;
+      sflash_chip.aai_mode = false;
+      break;
+
+    case SFLASH_ENABLE_WRITE_STATUS_REGISTER:
+      sflash_chip.write_status_enabled = true;
+      break;
+
+    case SFLASH_CHIP_ERASE1:
+    case SFLASH_CHIP_ERASE2:
+      if ( sflash_chip.status & SFLASH_STATUS_REGISTER_WRITE_ENABLED )
+      {
+        memset( sflash_chip.memory, 0xFF, sflash_chip.size );
+        posix_flash_statistics[MICO_SPI_FLASH].erase_count++;
+      }
+      break;
+
+    case SFLASH_READ:
+    case SFLASH_FAST_READ:
+    case SFLASH_DUAL_OUTPUT_READ:
+    case SFLASH_QUAD_OUTPUT_READ:
+      posix_flash_statistics[MICO_SPI_FLASH].read_count++;
+      break;
+
+    default:
+      break;
+  }
+}
+
+/* Bytes that follow the command byte, returns the byte shifted out on MISO */
+static uint8_t _command_data( uint8_t mosi )
+{
+  uint32_t index = sflash_chip.byte_index++;
+  bool write_enabled = ( sflash_chip.status & SFLASH_STATUS_REGISTER_WRITE_ENABLED ) ? true : false;
+
+  switch ( sflash_chip.command )
+  {
+    case SFLASH_READ_JEDEC_ID:
+      return ( index < 3 ) ? (uint8_t)( sflash_chip.model->jedec_id >> ( 16 - 8 * index ) ) : 0xFF;
+
+    case SFLASH_READ_STATUS_REGISTER:
+      return sflash_chip.status;
+
+    case SFLASH_READ_STATUS_REGISTER2:
+      return ( sflash_chip.model->read_lines == 4 ) ? sflash_chip.status2 : 0xFF;
+
+    case SFLASH_WRITE_STATUS_REGISTER:
+      if ( index == 0 && ( write_enabled || ( _is_sst( ) && sflash_chip.write_status_enabled ) ) )
+        sflash_chip.status = ( sflash_chip.status & ~SFLASH_WRITABLE_STATUS_BITS ) | ( mosi & SFLASH_WRITABLE_STATUS_BITS );
+      /* The second byte is the second status register, W25Q only */
+      if ( index == 1 && write_enabled && sflash_chip.model->read_lines == 4 )
+        sflash_chip.status2 = mosi & SFLASH_STATUS_REGISTER2_QUAD_ENABLE;
+      return 0xFF;
+
+    case SFLASH_READ:
+      if ( index < 3 )
+      {
+        sflash_chip.address = ( sflash_chip.address << 8 ) | mosi;
+        return 0xFF;
+      }
+      return _read_byte( );
+
+    case SFLASH_DUAL_OUTPUT_READ:
+    case SFLASH_QUAD_OUTPUT_READ:
+      /* Not a command of the part, or IO2 and IO3 are still WP# and HOLD# */
+      if ( ( sflash_chip.command == SFLASH_DUAL_OUTPUT_READ && sflash_chip.model->read_lines < 2 ) ||
+           ( sflash_chip.command == SFLASH_QUAD_OUTPUT_READ &&
+             ( sflash_chip.model->read_lines < 4 || !( sflash_chip.status2 & SFLASH_STATUS_REGISTER2_QUAD_ENABLE ) ) ) )
+        return 0xFF;
+      /* fall through */
+    case SFLASH_FAST_READ:
+      if ( index < 3 )
+      {
+        sflash_chip.address = ( sflash_chip.address << 8 ) | mosi;
+        return 0xFF;
+      }
+      if ( index == 3 ) /* Dummy byte */
+        return 0xFF;
+      return _read_byte( );
+
+    case SFLASH_WRITE:
+      if ( index < 3 )
+      {
+        sflash_chip.address = ( sflash_chip.address << 8 ) | mosi;
+        if ( index == 2 )
+          sflash_chip.page_offset = sflash_chip.address % SFLASH_PAGE_SIZE;
+        return 0xFF;
+      }
+      if ( write_enabled && ( index - 3 ) < sflash_chip.model->page_size )
+      {
+        /* Page program wraps around inside the page */
+        _program_byte( ( sflash_chip.address & ~( SFLASH_PAGE_SIZE - 1 ) ) + sflash_chip.page_offset, mosi );
+        sflash_chip.page_offset = ( sflash_chip.page_offset + 1 ) % SFLASH_PAGE_SIZE;
+      }
+      return 0xFF;
+
+    case SFLASH_SST_AAI_WORD_PROGRAM:
+      if ( !_is_sst( ) || !write_enabled )
+        return 0xFF;
+      /* The first AAI command carries the address, the following ones two data bytes only */
+      if ( sflash_chip.aai_mode == false )
+      {
+        if ( index < 3 )
+        {
+          sflash_chip.aai_address = ( sflash_chip.aai_address << 8 ) | mosi;
+          return 0xFF;
+        }
+        index -= 3;
+      }
+      if ( index < 2 )
+        _program_byte( sflash_chip.aai_address++, mosi );
+      return 0xFF;
+
+    case SFLASH_SECTOR_ERASE:
+    case SFLASH_BLOCK_ERASE_MID:
+    case SFLASH_BLOCK_ERASE_LARGE:
+      if ( index < 3 )
+        sflash_chip.address = ( sflash_chip.address << 8 ) | mosi;
+      return 0xFF;
+
+    default:
+      return 0xFF;
+  }
+}
+
+/* Commands that take effect when chip select goes high */
+static void _command_end( void )
+{
+  bool write_enabled = ( sflash_chip.status & SFLASH_STATUS_REGISTER_WRITE_ENABLED ) ? true : false;
+
+  switch ( sflash_chip.command )
+  {
+    case SFLASH_SECTOR_ERASE:
+      if ( write_enabled && sflash_chip.byte_index >= 3 )
+        _erase( sflash_chip.address, SFLASH_SECTOR_SIZE );
+      break;
+
+    case SFLASH_BLOCK_ERASE_MID:
+      if ( write_enabled && sflash_chip.byte_index >= 3 )
+        _erase( sflash_chip.address, SFLASH_BLOCK_SIZE_MID );
+      break;
+
+    case SFLASH_BLOCK_ERASE_LARGE:
+      if ( write_enabled && sflash_chip.byte_index >= 3 )
+        _erase( sflash_chip.address, SFLASH_BLOCK_SIZE_LARGE );
+      break;
+
+    case SFLASH_WRITE:
+      if ( write_enabled && sflash_chip.byte_index > 3 )
+        posix_flash_statistics[MICO_SPI_FLASH].write_count++;
+      break;
+
+    case SFLASH_SST_AAI_WORD_PROGRAM:
+      /* AAI keeps the write enable latch until WRDI */
+      if ( _is_sst( ) && write_enabled )
+      {
+        sflash_chip.aai_mode = true;
+        posix_flash_statistics[MICO_SPI_FLASH].write_count++;
+      }
+      return;
+
+    case SFLASH_WRITE_STATUS_REGISTER:
+      sflash_chip.write_status_enabled = false;
+      break;
+
+    default:
+      return;
+  }
+
+  /* Program, erase and write status commands clear the write enable latch */
+  sflash_chip.status &= ~SFLASH_STATUS_REGISTER_WRITE_ENABLED;
+}
+
+int sflash_platform_init( int peripheral_id, void** platform_peripheral_out )
+{
+  const char* chip_name = posix_host_getenv( POSIX_ENV_SFLASH_CHIP );
+  uint32_t i;
+
+  (void) peripheral_id; /* Unused due to single SPI Flash */
+
+  if ( sflash_chip.memory == NULL )
+  {
+    sflash_chip.model = &sflash_chip_models[0];
+    for ( i = 0; chip_name != NULL && i < sizeof( sflash_chip_models ) / sizeof( sflash_chip_models[0] ); i++ )
+    {
+      if ( strcmp( chip_name, sflash_chip_models[i].name ) == 0 )
+        sflash_chip.model = &sflash_chip_models[i];
+    }
+
+    sflash_chip.size   = SPI_FLASH_SIZE;
+    sflash_chip.memory = posix_host_map_image( SFLASH_IMAGE, sflash_chip.size );
+    if ( sflash_chip.memory == NULL )
+    {
+      platform_log( "Cannot map %s", SFLASH_IMAGE );
+      return -1;
+    }
+    platform_log( "SPI flash simulates %s, JEDEC ID %06X", sflash_chip.model->name, (unsigned int)sflash_chip.model->jedec_id );
+  }
+
+  *platform_peripheral_out = &sflash_chip;
+  return 0;
+}
+
+static uint8_t _shift_byte( uint8_t mosi )
+{
+  if ( sflash_chip.byte_index == 0 && sflash_chip.command == 0 )
+  {
+    sflash_chip.command = mosi;
+    _command_start( mosi );
+    return 0xFF;
+  }
+  return _command_data( mosi );
+}
+
+int sflash_platform_send_recv_byte( void* platform_peripheral, unsigned char MOSI_val, void* MISO_addr )
+{
+  uint8_t miso;
+
+  (void) platform_peripheral;
+
+  posix_flash_statistics[MICO_SPI_FLASH].bus_bytes++;
+  posix_flash_statistics[MICO_SPI_FLASH].bus_clocks += 8;
+  sflash_chip.data_lines = 1;
+  miso = _shift_byte( MOSI_val );
+
+  /* The command and parameter bytes are sent without a receive buffer */
+  if ( MISO_addr != NULL )
+  {
+    *( (unsigned char*) MISO_addr ) = miso;
+  }
+  return 0;
+}
+
+/* A byte takes 8 / data_lines clocks, transfers that the STM32 platforms
+ * move by DMA are counted as such.
+ */
+int sflash_platform_send_recv( void* platform_peripheral, const void* MOSI_data, void* MISO_data, unsigned int size, unsigned char data_lines )
+{
+  const uint8_t* mosi = MOSI_data;
+  uint8_t* miso = MISO_data;
+  uint8_t value;
+
+  (void) platform_peripheral;
+
+  if ( data_lines != 1 && data_lines != 2 && data_lines != 4 )
+    return -1;
+
+  posix_flash_statistics[MICO_SPI_FLASH].bus_bytes += size;
+  posix_flash_statistics[MICO_SPI_FLASH].bus_clocks += (uint64_t) size * 8 / data_lines;
+  if ( size >= SFLASH_DMA_MIN_SIZE )
+    posix_flash_statistics[MICO_SPI_FLASH].dma_bytes += size;
+
+  sflash_chip.data_lines = data_lines;
+  while ( size-- > 0 )
+  {
+    value = _shift_byte( ( mosi != NULL ) ? *mosi++ : 0xFF );
+    if ( miso != NULL )
+      *miso++ = value;
+  }
+  return 0;
+}
+
+int sflash_platform_chip_select( void* platform_peripheral )
+{
+  (void) platform_peripheral;
+  sflash_chip.command     = 0;
+  sflash_chip.byte_index  = 0;
+  sflash_chip.address     = 0;
+  sflash_chip.page_offset = 0;
+  sflash_chip.data_lines  = 1;
+  return 0;
+}
+
+int sflash_platform_chip_deselect( void* platform_peripheral )
+{
+  (void) platform_peripheral;
+  _command_end( );
+  sflash_chip.command = 0;
+  return 0;
+}
+
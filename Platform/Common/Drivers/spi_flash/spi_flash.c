@@ -7,7 +7,7 @@
  * or duplicated in any form, in whole or in part, without the prior
  * written permission of Broadcom Corporation.
  */
-#include "platformLogging.h"
+#include "PlatformLogging.h"
 #include "platform.h"
 #include "spi_flash.h"
 #include "spi_flash_internal.h"
@@ -16,6 +16,34 @@
 
 #define sFLASH_SPI_PAGESIZE       0x100
 
+/* Platforms that can read on two or four data lines define it in platform.h */
+#ifndef SFLASH_PLATFORM_DATA_LINES
+#define SFLASH_PLATFORM_DATA_LINES  ( 1 )
+#endif
+
+typedef struct
+{
+    uint32_t           device_id;
+    sflash_read_mode_t read_mode; /* Fastest read command of the part */
+} sflash_read_capability_t;
+
+/* Parts that are not listed are read with READ, the slowest clock of all */
+static const sflash_read_capability_t sflash_read_capabilities[] =
+{
+#ifdef SFLASH_SUPPORT_MACRONIX_PARTS
+    { SFLASH_ID_MX25L8006E,  SFLASH_READ_DUAL },
+    { SFLASH_ID_MX25L1606E,  SFLASH_READ_DUAL },
+#endif /* ifdef SFLASH_SUPPORT_MACRONIX_PARTS */
+#ifdef SFLASH_SUPPORT_WINBOND_PARTS
+    { SFLASH_ID_W25X80AVSIG, SFLASH_READ_DUAL },
+    { SFLASH_ID_W25Q16,      SFLASH_READ_QUAD },
+#endif /* ifdef SFLASH_SUPPORT_WINBOND_PARTS */
+#ifdef SFLASH_SUPPORT_SST_PARTS
+    { SFLASH_ID_SST25VF080B, SFLASH_READ_FAST },
+#endif /* ifdef SFLASH_SUPPORT_SST_PARTS */
+    { 0, SFLASH_READ_NORMAL }
+};
+
 int sflash_read_ID( const sflash_handle_t* const handle, void* const data_addr )
 {
     return generic_sflash_command( handle, SFLASH_READ_JEDEC_ID, 0, NULL, 3, NULL, data_addr );
@@ -97,13 +125,45 @@ int sflash_read_status_register( const sflash_handle_t* const handle, void* cons
 
 
 
+/* The command, address and dummy byte go out on one line, the data comes in on data_lines */
+static int sflash_read_multi_line( const sflash_handle_t* const handle, sflash_command_t cmd, const char* parameter_bytes, void* const data_addr, unsigned int size, unsigned char data_lines )
+{
+    int status;
+
+    sflash_platform_chip_select( handle->platform_peripheral );
+
+    if ( ( 0 == ( status = sflash_platform_send_recv_byte( handle->platform_peripheral, cmd, NULL ) ) ) &&
+         ( 0 == ( status = sflash_platform_send_recv( handle->platform_peripheral, parameter_bytes, NULL, 4, 1 ) ) ) )
+    {
+        status = sflash_platform_send_recv( handle->platform_peripheral, NULL, data_addr, size, data_lines );
+    }
+
+    sflash_platform_chip_deselect( handle->platform_peripheral );
+    return status;
+}
+
 int sflash_read( const sflash_handle_t* const handle, unsigned long device_address, void* const data_addr, unsigned int size )
 {
-    char device_address_array[3] =  { ( ( device_address & 0x00FF0000 ) >> 16 ),
+    char device_address_array[4] =  { ( ( device_address & 0x00FF0000 ) >> 16 ),
                                       ( ( device_address & 0x0000FF00 ) >>  8 ),
-                                      ( ( device_address & 0x000000FF ) >>  0 ) };
+                                      ( ( device_address & 0x000000FF ) >>  0 ),
+                                      SFLASH_DUMMY_BYTE };
+
+    switch ( handle->read_mode )
+    {
+        case SFLASH_READ_FAST:
+            return generic_sflash_command( handle, SFLASH_FAST_READ, 4, device_address_array, size, NULL, data_addr );
 
-    return generic_sflash_command( handle, SFLASH_READ, 3, device_address_array, size, NULL, data_addr );
+        case SFLASH_READ_DUAL:
+            return sflash_read_multi_line( handle, SFLASH_DUAL_OUTPUT_READ, device_address_array, data_addr, size, 2 );
+
+        case SFLASH_READ_QUAD:
+            return sflash_read_multi_line( handle, SFLASH_QUAD_OUTPUT_READ, device_address_array, data_addr, size, 4 );
+
+        case SFLASH_READ_NORMAL:
+        default:
+            return generic_sflash_command( handle, SFLASH_READ, 3, device_address_array, size, NULL, data_addr );
+    }
 }
 
 
@@ -118,11 +178,22 @@ int sflash_get_size( const sflash_handle_t* const handle, unsigned long* const s
     }
 #endif /* ifdef SFLASH_SUPPORT_MACRONIX_PARTS */
 
+#ifdef SFLASH_SUPPORT_MACRONIX_PARTS
+    if ( handle->device_id == SFLASH_ID_MX25L1606E )
+    {
+        *size = 0x200000; /* 2MByte */
+    }
+#endif /* ifdef SFLASH_SUPPORT_MACRONIX_PARTS */
+
 #ifdef SFLASH_SUPPORT_WINBOND_PARTS
     if ( handle->device_id == SFLASH_ID_W25X80AVSIG )
     {
         *size = 0x100000; /* 1MByte */
     }
+    if ( handle->device_id == SFLASH_ID_W25Q16 )
+    {
+        *size = 0x200000; /* 2MByte */
+    }
 #endif /* ifdef SFLASH_SUPPORT_MACRONIX_PARTS */
 
 #ifdef SFLASH_SUPPORT_SST_PARTS
@@ -151,12 +222,15 @@ int sflash_write_page( const sflash_handle_t* const handle, unsigned long device
         return -1;
     }
 
-    /* Some manufacturers support programming an entire page in one command. */
+    /* Some manufacturers support programming an entire page in one command.
+     * The caller keeps a write inside one page, a page program that crosses
+     * the end of the page wraps around to its start.
+     */
 
 #ifdef SFLASH_SUPPORT_MACRONIX_PARTS
     if ( SFLASH_MANUFACTURER( handle->device_id ) == SFLASH_MANUFACTURER_MACRONIX )
     {
-        max_write_size = 1;  /* TODO: this should be 256, but that causes write errors */
+        max_write_size = sFLASH_SPI_PAGESIZE;
         enable_before_every_write = 1;
     }
 #endif /* ifdef SFLASH_SUPPORT_MACRONIX_PARTS */
@@ -164,15 +238,15 @@ int sflash_write_page( const sflash_handle_t* const handle, unsigned long device
 #ifdef SFLASH_SUPPORT_WINBOND_PARTS
     if ( SFLASH_MANUFACTURER( handle->device_id ) == SFLASH_MANUFACTURER_WINBOND )
     {
-        max_write_size = 256;  /* TODO: this should be 256, but that causes write errors */
+        max_write_size = sFLASH_SPI_PAGESIZE;
         enable_before_every_write = 1;
     }
-#endif /* ifdef SFLASH_SUPPORT_MACRONIX_PARTS */
+#endif /* ifdef SFLASH_SUPPORT_WINBOND_PARTS */
 
 #ifdef SFLASH_SUPPORT_SST_PARTS
     if ( SFLASH_MANUFACTURER( handle->device_id ) == SFLASH_MANUFACTURER_SST )
     {
-        max_write_size = 1;
+        max_write_size = 1; /* Byte program, sflash_write() uses AAI for more */
         enable_before_every_write = 1;
     }
 #endif /* ifdef SFLASH_SUPPORT_SST_PARTS */
@@ -213,6 +287,73 @@ int sflash_write_page( const sflash_handle_t* const handle, unsigned long device
     return 0;
 }
 
+#ifdef SFLASH_SUPPORT_SST_PARTS
+/* SST parts have no page program. An AAI command programs two bytes, only the
+ * first one carries the address and the chip stays in AAI mode until WRDI.
+ * AAI starts at an even address, an odd first or last byte is programmed
+ * by itself.
+ */
+static int sflash_write_aai( const sflash_handle_t* const handle, unsigned long device_address, const unsigned char* data_addr_ptr, unsigned long size )
+{
+    int status;
+    int end_status;
+    unsigned char curr_device_address[3];
+
+    if ( ( ( device_address & 1 ) != 0 ) && ( size > 0 ) )
+    {
+        if ( 0 != ( status = sflash_write_page( handle, device_address, data_addr_ptr, 1 ) ) )
+        {
+            return status;
+        }
+        data_addr_ptr++;
+        device_address++;
+        size--;
+    }
+
+    if ( size >= 2 )
+    {
+        curr_device_address[0] = ( ( device_address & 0x00FF0000 ) >> 16 );
+        curr_device_address[1] = ( ( device_address & 0x0000FF00 ) >>  8 );
+        curr_device_address[2] = ( ( device_address & 0x000000FF ) >>  0 );
+
+        if ( 0 != ( status = sflash_write_enable( handle ) ) )
+        {
+            return status;
+        }
+
+        status = generic_sflash_command( handle, SFLASH_SST_AAI_WORD_PROGRAM, 3, curr_device_address, 2, data_addr_ptr, NULL );
+        data_addr_ptr += 2;
+        device_address += 2;
+        size -= 2;
+
+        while ( ( status == 0 ) && ( size >= 2 ) )
+        {
+            status = generic_sflash_command( handle, SFLASH_SST_AAI_WORD_PROGRAM, 0, NULL, 2, data_addr_ptr, NULL );
+            data_addr_ptr += 2;
+            device_address += 2;
+            size -= 2;
+        }
+
+        /* Leave AAI mode after an error too */
+        end_status = generic_sflash_command( handle, SFLASH_WRITE_DISABLE, 0, NULL, 0, NULL, NULL );
+        if ( status == 0 )
+        {
+            status = end_status;
+        }
+        if ( status != 0 )
+        {
+            return status;
+        }
+    }
+
+    if ( size == 1 )
+    {
+        return sflash_write_page( handle, device_address, data_addr_ptr, 1 );
+    }
+    return 0;
+}
+#endif /* ifdef SFLASH_SUPPORT_SST_PARTS */
+
 /**
   * @brief  Writes block of data to the FLASH. In this function, the number of
   *         WRITE cycles are reduced, using Page WRITE sequence.
@@ -220,86 +361,37 @@ int sflash_write_page( const sflash_handle_t* const handle, unsigned long device
   *         to the FLASH.
   * @param  WriteAddr: FLASH's internal address to write to.
   * @param  NumByteToWrite: number of bytes to write to the FLASH.
-  * @retval None
+  * @retval 0 on success, the error of the first write that failed otherwise
   */
 int sflash_write( const sflash_handle_t* const handle, unsigned long device_address, const void* const data_addr, int size )
 {
-  int status;
-  uint8_t NumOfPage = 0, NumOfSingle = 0, Addr = 0, count = 0, temp = 0;
-  unsigned char* data_addr_ptr = (unsigned char*) data_addr;
-
-  Addr = device_address % sFLASH_SPI_PAGESIZE;
-  count = sFLASH_SPI_PAGESIZE - Addr;
-  NumOfPage =  size / sFLASH_SPI_PAGESIZE;
-  NumOfSingle = size % sFLASH_SPI_PAGESIZE;
-
-  if (Addr == 0) /*!< WriteAddr is sFLASH_PAGESIZE aligned  */
-  {
-    if (NumOfPage == 0) /*!< NumByteToWrite < sFLASH_PAGESIZE */
-    {
-      status = sflash_write_page( handle, device_address, data_addr_ptr, size );
-      //sFLASH_WritePage(pBuffer, WriteAddr, NumByteToWrite);
-    }
-    else /*!< NumByteToWrite > sFLASH_PAGESIZE */
-    {
-      while (NumOfPage--)
-      {
-        status = sflash_write_page( handle, device_address, data_addr_ptr, sFLASH_SPI_PAGESIZE );
-        //sFLASH_WritePage(pBuffer, WriteAddr, sFLASH_SPI_PAGESIZE);
-        device_address +=  sFLASH_SPI_PAGESIZE;
-        data_addr_ptr += sFLASH_SPI_PAGESIZE;
-      }
-
-      status = sflash_write_page( handle, device_address, data_addr_ptr, NumOfSingle);
-    }
-  }
-  else /*!< WriteAddr is not sFLASH_PAGESIZE aligned  */
-  {
-    if (NumOfPage == 0) /*!< NumByteToWrite < sFLASH_PAGESIZE */
-    {
-      if (NumOfSingle > count) /*!< (NumByteToWrite + WriteAddr) > sFLASH_PAGESIZE */
-      {
-        temp = NumOfSingle - count;
-
-        status = sflash_write_page( handle, device_address, data_addr_ptr, count );
-        //sFLASH_WritePage(pBuffer, WriteAddr, count);
-        device_address +=  count;
-        data_addr_ptr += count;
-
-        status = sflash_write_page( handle, device_address, data_addr_ptr, temp);
-      }
-      else
-      {
-        status = sflash_write_page(handle, device_address, data_addr_ptr, size);
-      }
-    }
-    else /*!< NumByteToWrite > sFLASH_PAGESIZE */
-    {
-      size -= count;
-      NumOfPage =  size / sFLASH_SPI_PAGESIZE;
-      NumOfSingle = size % sFLASH_SPI_PAGESIZE;
-
-      status = sflash_write_page( handle, device_address, data_addr_ptr, count );
-      //sFLASH_WritePage(pBuffer, WriteAddr, count);
-      device_address +=  count;
-      data_addr_ptr += count;
-
-      while (NumOfPage--)
-      {
-        status = sflash_write_page( handle, device_address, data_addr_ptr, sFLASH_SPI_PAGESIZE );
-        //sFLASH_WritePage(pBuffer, WriteAddr, sFLASH_SPI_PAGESIZE);
-        device_address +=  sFLASH_SPI_PAGESIZE;
-        data_addr_ptr += sFLASH_SPI_PAGESIZE;
-      }
-
-      if (NumOfSingle != 0)
-      {
-        status = sflash_write_page( handle, device_address, data_addr_ptr, NumOfSingle );
-        //sFLASH_WritePage(pBuffer, WriteAddr, NumOfSingle);
-      }
-    }
-  }
-  return status;
+    int status = 0;
+    unsigned long write_size;
+    unsigned long remaining = ( size > 0 )? (unsigned long) size : 0;
+    const unsigned char* data_addr_ptr = (const unsigned char*) data_addr;
+
+#ifdef SFLASH_SUPPORT_SST_PARTS
+    if ( SFLASH_MANUFACTURER( handle->device_id ) == SFLASH_MANUFACTURER_SST )
+    {
+        return sflash_write_aai( handle, device_address, data_addr_ptr, remaining );
+    }
+#endif /* ifdef SFLASH_SUPPORT_SST_PARTS */
+
+    /* Up to the end of the page, then whole pages and what is left */
+    while ( ( remaining > 0 ) && ( status == 0 ) )
+    {
+        write_size = sFLASH_SPI_PAGESIZE - ( device_address % sFLASH_SPI_PAGESIZE );
+        if ( write_size > remaining )
+        {
+            write_size = remaining;
+        }
+
+        status = sflash_write_page( handle, device_address, data_addr_ptr, (int) write_size );
+        device_address += write_size;
+        data_addr_ptr += write_size;
+        remaining -= write_size;
+    }
+    return status;
 }
 
 
@@ -308,7 +400,8 @@ int sflash_write( const sflash_handle_t* const handle, unsigned long device_addr
 
 int sflash_write_status_register( const sflash_handle_t* const handle, char value )
 {
-    char status_register_val = value;
+    /* Quad reads need QE in the second status register, WRSR writes both */
+    char status_register_val[2] = { value, SFLASH_STATUS_REGISTER2_QUAD_ENABLE };
 #ifdef SFLASH_SUPPORT_SST_PARTS
     /* SST parts require enabling writing to the status register */
     if ( SFLASH_MANUFACTURER( handle->device_id ) == SFLASH_MANUFACTURER_SST )
@@ -321,7 +414,59 @@ int sflash_write_status_register( const sflash_handle_t* const handle, char valu
     }
 #endif /* ifdef SFLASH_SUPPORT_SST_PARTS */
 
-    return generic_sflash_command( handle, SFLASH_WRITE_STATUS_REGISTER, 0, NULL, 1, &status_register_val, NULL );
+    return generic_sflash_command( handle, SFLASH_WRITE_STATUS_REGISTER, 0, NULL, ( handle->read_mode == SFLASH_READ_QUAD )? 2 : 1, status_register_val, NULL );
+}
+
+static sflash_read_mode_t sflash_get_read_mode( uint32_t device_id )
+{
+    const sflash_read_capability_t* capability = sflash_read_capabilities;
+    sflash_read_mode_t read_mode;
+
+    while ( ( capability->device_id != 0 ) && ( capability->device_id != device_id ) )
+    {
+        capability++;
+    }
+    read_mode = capability->read_mode;
+
+    /* What the platform cannot do */
+    if ( ( read_mode == SFLASH_READ_QUAD ) && ( SFLASH_PLATFORM_DATA_LINES < 4 ) )
+    {
+        read_mode = SFLASH_READ_DUAL;
+    }
+    if ( ( read_mode == SFLASH_READ_DUAL ) && ( SFLASH_PLATFORM_DATA_LINES < 2 ) )
+    {
+        read_mode = SFLASH_READ_FAST;
+    }
+    return read_mode;
+}
+
+/* The data lines IO2 and IO3 are WP# and HOLD# until QE is set */
+static int sflash_enable_quad( const sflash_handle_t* const handle )
+{
+    int status;
+    unsigned char status_register2;
+
+    if ( 0 != ( status = generic_sflash_command( handle, SFLASH_READ_STATUS_REGISTER2, 0, NULL, 1, NULL, &status_register2 ) ) )
+    {
+        return status;
+    }
+    if ( ( status_register2 & SFLASH_STATUS_REGISTER2_QUAD_ENABLE ) != 0 )
+    {
+        return 0;
+    }
+
+    /* QE is non-volatile, it is set once by a handle that may write */
+    if ( handle->write_allowed != SFLASH_WRITE_ALLOWED )
+    {
+        return -1;
+    }
+    if ( ( 0 != ( status = sflash_write_enable( handle ) ) ) ||
+         ( 0 != ( status = sflash_write_status_register( handle, 0 ) ) ) ||
+         ( 0 != ( status = generic_sflash_command( handle, SFLASH_READ_STATUS_REGISTER2, 0, NULL, 1, NULL, &status_register2 ) ) ) )
+    {
+        return status;
+    }
+    return ( ( status_register2 & SFLASH_STATUS_REGISTER2_QUAD_ENABLE ) != 0 )? 0 : -1;
 }
 
 
@@ -346,6 +491,7 @@ int init_sflash( sflash_handle_t* const handle, int peripheral_id, sflash_write_
                         ( ((uint32_t) tmp_device_id[2]) <<  0 );
 
     handle->write_allowed = write_allowed_in;
+    handle->read_mode = sflash_get_read_mode( handle->device_id );
 
     if ( write_allowed_in == SFLASH_WRITE_ALLOWED )
     {
@@ -356,6 +502,12 @@ int init_sflash( sflash_handle_t* const handle, int peripheral_id, sflash_write_
         }
     }
 
+    /* Without QE the part is read on two lines */
+    if ( ( handle->read_mode == SFLASH_READ_QUAD ) && ( 0 != sflash_enable_quad( handle ) ) )
+    {
+        handle->read_mode = SFLASH_READ_DUAL;
+    }
+
     return 0;
 }
 
@@ -365,10 +517,10 @@ int init_sflash( sflash_handle_t* const handle, int peripheral_id, sflash_write_
 int generic_sflash_command( const sflash_handle_t* const handle, sflash_command_t cmd, unsigned int num_initial_parameter_bytes, const void* const parameter_bytes, int num_data_bytes, const void* const data_MOSI, void* const data_MISO )
 {
     int status;
-    unsigned char* data_MISO_ptr = (unsigned char*) data_MISO;
-    unsigned char* data_MOSI_ptr = (unsigned char*) data_MOSI;
     unsigned char* parameter_bytes_ptr = (unsigned char*) parameter_bytes;
     char is_write_command = ( ( cmd == SFLASH_WRITE ) ||
+            ( cmd == SFLASH_SST_AAI_WORD_PROGRAM ) ||
+            ( cmd == SFLASH_WRITE_STATUS_REGISTER ) ||
             ( cmd == SFLASH_CHIP_ERASE1 ) ||
             ( cmd == SFLASH_CHIP_ERASE2 ) ||
             ( cmd == SFLASH_SECTOR_ERASE ) ||
@@ -394,22 +546,11 @@ int generic_sflash_command( const sflash_handle_t* const handle, sflash_command_
     }
 
 
-    while ( num_data_bytes > 0 )
+    /* The data in one transfer, the platform may move it by DMA */
+    if ( ( num_data_bytes > 0 ) &&
+         ( 0 != ( status = sflash_platform_send_recv( handle->platform_peripheral, data_MOSI, data_MISO, (unsigned int) num_data_bytes, 1 ) ) ) )
     {
-        unsigned char dummy_dest;
-        if ( 0 != ( status = sflash_platform_send_recv_byte( handle->platform_peripheral, ( data_MOSI == NULL )? SFLASH_DUMMY_BYTE : *data_MOSI_ptr, ( data_MISO == NULL )? &dummy_dest : data_MISO_ptr ) ) )
-        {
-            return status;
-        }
-        if ( data_MOSI != NULL )
-        {
-            data_MOSI_ptr++;
-        }
-        if ( data_MISO != NULL )
-        {
-            data_MISO_ptr++;
-        }
-        num_data_bytes--;
+        return status;
     }
 
 
@@ -23,11 +23,21 @@ typedef enum
 
 } sflash_write_allowed_t;
 
+typedef enum
+{
+    SFLASH_READ_NORMAL = 0, /* READ                                      */
+    SFLASH_READ_FAST   = 1, /* FAST_READ, a dummy byte after the address */
+    SFLASH_READ_DUAL   = 2, /* Fast read with the data on two lines      */
+    SFLASH_READ_QUAD   = 3, /* Fast read with the data on four lines     */
+
+} sflash_read_mode_t;
+
 typedef struct
 {
     uint32_t device_id;
     void * platform_peripheral;
     sflash_write_allowed_t write_allowed;
+    sflash_read_mode_t read_mode; /* Fastest read of the chip and the platform, set by init_sflash() */
 } sflash_handle_t;
 
 
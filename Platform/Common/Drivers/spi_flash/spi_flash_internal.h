@@ -27,6 +27,7 @@
 #define SFLASH_STATUS_REGISTER_BLOCK_PROTECTED_3             ( 0x20 ) /* SST Only */
 #define SFLASH_STATUS_REGISTER_AUTO_ADDRESS_INCREMENT        ( 0x40 ) /* SST Only */
 #define SFLASH_STATUS_REGISTER_BLOCK_PROTECT_BITS_READ_ONLY  ( 0x80 ) /* SST Only */
+#define SFLASH_STATUS_REGISTER2_QUAD_ENABLE                  ( 0x02 ) /* Winbond W25Q Only */
 
 
 /* Command definitions */
@@ -40,6 +41,9 @@ typedef enum
     SFLASH_READ_STATUS_REGISTER         = 0x05, /* RDSR                   */
     SFLASH_WRITE_ENABLE                 = 0x06, /* WREN                   */
     SFLASH_FAST_READ                    = 0x0B,
+    SFLASH_DUAL_OUTPUT_READ             = 0x3B, /* DREAD                  */
+    SFLASH_QUAD_OUTPUT_READ             = 0x6B, /* QREAD  - Winbond W25Q  */
+    SFLASH_READ_STATUS_REGISTER2        = 0x35, /* RDSR2  - Winbond W25Q  */
     SFLASH_SECTOR_ERASE                 = 0x20, /* SE                     */
     SFLASH_BLOCK_ERASE_MID              = 0x52, /* SE                     */
     SFLASH_BLOCK_ERASE_LARGE            = 0xD8, /* SE                     */
@@ -55,6 +59,7 @@ typedef enum
     SFLASH_EXIT_SECURED_OTP             = 0xC1, /* EXSO   - Macronix only */
     SFLASH_DEEP_POWER_DOWN              = 0xB9, /* DP     - Macronix only */
     SFLASH_RELEASE_DEEP_POWER_DOWN      = 0xAB, /* RDP    - Macronix only */
+    SFLASH_SST_AAI_WORD_PROGRAM         = 0xAD, /* AAI    - SST only      */
 
 
 } sflash_command_t;
@@ -71,12 +76,15 @@ typedef enum
 #define SFLASH_MANUFACTURER_WINBOND    ( 0xEF )
 
 #define SFLASH_ID_W25X80AVSIG          ( 0xEF3014 )
+#define SFLASH_ID_W25Q16               ( 0xEF4015 )
 #define SFLASH_ID_MX25L8006E           ( 0xC22014 )
+#define SFLASH_ID_MX25L1606E           ( 0xC22015 )
 #define SFLASH_ID_SST25VF080B          ( 0xBF258E )
 
 int sflash_read_ID              ( const sflash_handle_t* handle, void* data_addr );
 int sflash_read_status_register ( const sflash_handle_t* handle, void* dest_addr );
 int sflash_write_status_register( const sflash_handle_t* handle, char value );
+int sflash_write_enable         ( const sflash_handle_t* handle );
 int generic_sflash_command      ( const sflash_handle_t* handle, sflash_command_t cmd, unsigned int num_initial_parameter_bytes, const void* parameter_bytes, int num_data_bytes, const void* const data_MOSI, void* const data_MISO );
 
 
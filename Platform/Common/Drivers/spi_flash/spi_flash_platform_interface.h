@@ -19,6 +19,12 @@ extern int sflash_platform_send_recv_byte( void* platform_peripheral, unsigned c
 extern int sflash_platform_chip_select   ( void* platform_peripheral );
 extern int sflash_platform_chip_deselect ( void* platform_peripheral );
 
+/* Shifts size bytes out of MOSI_data and into MISO_data, either can be NULL.
+ * With data_lines 2 or 4 the bytes are only received, on that many lines,
+ * a platform that has them defines SFLASH_PLATFORM_DATA_LINES.
+ */
+extern int sflash_platform_send_recv     ( void* platform_peripheral, const void* MOSI_data, void* MISO_data, unsigned int size, unsigned char data_lines );
+
 
 #ifdef __cplusplus
 }
@@ -163,6 +163,11 @@ Note: the 1st sector 0x08000000-0x08003FFF is reserved for the IAP code */
 #define UPDATE_START_ADDRESS        (uint32_t)0x08060000  /* Optional */
 #define UPDATE_END_ADDRESS          (uint32_t)0x080BFFFF  /* Optional */
 #define UPDATE_FLASH_SIZE           (UPDATE_END_ADDRESS - UPDATE_START_ADDRESS + 1) /* 384k bytes, optional*/
+#define UPDATE_SECTOR_SIZE          (uint32_t)0x00020000 /* Erase unit of the update area, 128k sectors, optional */
+
+#define MICO_FLASH_FOR_APPLICATION_B  MICO_INTERNAL_FLASH  /* Second application slot in the update area, optional */
+#define APPLICATION_B_START_ADDRESS   UPDATE_START_ADDRESS /* Link with micoLinkerForIAR_SlotB.icf, optional */
+#define APPLICATION_B_END_ADDRESS     UPDATE_END_ADDRESS   /* Optional */
 
 #define MICO_FLASH_FOR_BOOT         MICO_INTERNAL_FLASH
 #define BOOT_START_ADDRESS          (uint32_t)0x08000000 
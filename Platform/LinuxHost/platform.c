@@ -0,0 +1,221 @@
+/**
+******************************************************************************
+* @file    platform.c
+* @author  William Xu
+* @version V1.0.0
+* @date    16-Oct-2026
+* @brief   This file provides all MICO Peripherals mapping table and platform
+*          specific functions of the Linux host.
+******************************************************************************
+*
+*  The MIT License
+*  Copyright (c) 2014 MXCHIP Inc.
+*
+*  Permission is hereby granted, free of charge, to any person obtaining a copy
+*  of this software and associated documentation files (the "Software"), to deal
+*  in the Software without restriction, including without limitation the rights
+*  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+*  copies of the Software, and to permit persons to whom the Software is furnished
+*  to do so, subject to the following conditions:
+*
+*  The above copyright notice and this permission notice shall be included in
+*  all copies or substantial portions of the Software.
+*
+*  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+*  WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR
+*  IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+******************************************************************************
+*/
+
+#include "stdio.h"
+#include "string.h"
+
+#include "MicoPlatform.h"
+#include "platform.h"
+#include "platform_common_config.h"
+#include "PlatformLogging.h"
+#include "posix_platform.h"
+
+/******************************************************
+*                      Macros
+******************************************************/
+
+/******************************************************
+*                    Constants
+******************************************************/
+
+/******************************************************
+*                   Enumerations
+******************************************************/
+
+/******************************************************
+*                 Type Definitions
+******************************************************/
+
+/******************************************************
+*                    Structures
+******************************************************/
+
+/******************************************************
+*               Function Declarations
+******************************************************/
+extern WEAK void PlatformEasyLinkButtonClickedCallback(void);
+extern WEAK void PlatformStandbyButtonClickedCallback(void);
+extern WEAK void PlatformEasyLinkButtonLongPressedCallback(void);
+extern WEAK void bootloader_start(void);
+
+/******************************************************
+*               Variables Definitions
+******************************************************/
+
+/* There are no pin, ADC, PWM, SPI, UART or I2C mapping tables on the host, the
+ * drivers in Platform/vendor/posix/Linux simulate the peripherals by enum ID.
+ */
+
+static uint32_t _default_start_time = 0;
+static mico_timer_t _button_EL_timer;
+
+/******************************************************
+*               Function Definitions
+******************************************************/
+
+static void _button_EL_irq_handler( void* arg )
+{
+  (void)(arg);
+  int interval = -1;
+
+  if ( MicoGpioInputGet( (mico_gpio_t)EasyLink_BUTTON ) == 0 ) {
+    _default_start_time = mico_get_time()+1;
+    mico_start_timer(&_button_EL_timer);
+  } else {
+    interval = mico_get_time() + 1 - _default_start_time;
+    if ( (_default_start_time != 0) && interval > 50 && interval < RestoreDefault_TimeOut){
+      /* EasyLink button clicked once */
+      PlatformEasyLinkButtonClickedCallback();
+    }
+    mico_stop_timer(&_button_EL_timer);
+    _default_start_time = 0;
+  }
+}
+
+static void _button_STANDBY_irq_handler( void* arg )
+{
+  (void)(arg);
+  PlatformStandbyButtonClickedCallback();
+}
+
+static void _button_EL_Timeout_handler( void* arg )
+{
+  (void)(arg);
+  _default_start_time = 0;
+  PlatformEasyLinkButtonLongPressedCallback();
+}
+
+/* A watchdog reset restarts the process, there is no reset flag to read */
+bool watchdog_check_last_reset( void )
+{
+  return false;
+}
+
+OSStatus mico_platform_init( void )
+{
+#ifdef DEBUG
+#if defined(__clang__)
+  platform_log("Build by Clang");
+#elif defined (__GNUC__)
+  platform_log("Build by GCC");
+#endif
+#endif
+  platform_log( "Platform initialised" );
+
+  if ( true == watchdog_check_last_reset() )
+  {
+    platform_log( "WARNING: Watchdog reset occured previously. Please see watchdog.c for debugging instructions." );
+  }
+
+  return kNoErr;
+}
+
+void init_platform( void )
+{
+  MicoGpioInitialize( (mico_gpio_t)MICO_SYS_LED, OUTPUT_PUSH_PULL );
+  MicoGpioOutputLow( (mico_gpio_t)MICO_SYS_LED );
+  MicoGpioInitialize( (mico_gpio_t)MICO_RF_LED, OUTPUT_OPEN_DRAIN_NO_PULL );
+  MicoGpioOutputHigh( (mico_gpio_t)MICO_RF_LED );
+
+  //  Initialise EasyLink buttons
+  MicoGpioInitialize( (mico_gpio_t)EasyLink_BUTTON, INPUT_PULL_UP );
+  mico_init_timer(&_button_EL_timer, RestoreDefault_TimeOut, _button_EL_Timeout_handler, NULL);
+  MicoGpioEnableIRQ( (mico_gpio_t)EasyLink_BUTTON, IRQ_TRIGGER_BOTH_EDGES, _button_EL_irq_handler, NULL );
+
+  //  Initialise Standby/wakeup switcher
+  MicoGpioInitialize( (mico_gpio_t)Standby_SEL, INPUT_PULL_UP );
+  MicoGpioEnableIRQ( (mico_gpio_t)Standby_SEL , IRQ_TRIGGER_FALLING_EDGE, _button_STANDBY_irq_handler, NULL);
+}
+
+void init_platform_bootloader( void )
+{
+  MicoGpioInitialize( (mico_gpio_t)MICO_SYS_LED, OUTPUT_PUSH_PULL );
+  MicoGpioOutputLow( (mico_gpio_t)MICO_SYS_LED );
+  MicoGpioInitialize( (mico_gpio_t)MICO_RF_LED, OUTPUT_OPEN_DRAIN_NO_PULL );
+  MicoGpioOutputHigh( (mico_gpio_t)MICO_RF_LED );
+
+  MicoGpioInitialize((mico_gpio_t)BOOT_SEL, INPUT_PULL_UP);
+  MicoGpioInitialize((mico_gpio_t)MFG_SEL, INPUT_HIGH_IMPEDANCE);
+}
+
+/* No WLAN module on the host, the reset and power pins are only simulated */
+void host_platform_reset_wifi( bool reset_asserted )
+{
+  if ( reset_asserted == true )
+  {
+    MicoGpioOutputLow( (mico_gpio_t)WL_RESET );
+  }
+  else
+  {
+    MicoGpioOutputHigh( (mico_gpio_t)WL_RESET );
+  }
+}
+
+void host_platform_power_wifi( bool power_enabled )
+{
+  UNUSED_PARAMETER( power_enabled );
+}
+
+void MicoSysLed(bool onoff)
+{
+    if (onoff) {
+        MicoGpioOutputHigh( (mico_gpio_t)MICO_SYS_LED );
+    } else {
+        MicoGpioOutputLow( (mico_gpio_t)MICO_SYS_LED );
+    }
+}
+
+void MicoRfLed(bool onoff)
+{
+    if (onoff) {
+        MicoGpioOutputLow( (mico_gpio_t)MICO_RF_LED );
+    } else {
+        MicoGpioOutputHigh( (mico_gpio_t)MICO_RF_LED );
+    }
+}
+
+bool MicoShouldEnterMFGMode(void)
+{
+  if(MicoGpioInputGet((mico_gpio_t)BOOT_SEL)==false && MicoGpioInputGet((mico_gpio_t)MFG_SEL)==false)
+    return true;
+  else
+    return false;
+}
+
+bool MicoShouldEnterBootloader(void)
+{
+  if(MicoGpioInputGet((mico_gpio_t)BOOT_SEL)==false && MicoGpioInputGet((mico_gpio_t)MFG_SEL)==true)
+    return true;
+  else
+    return false;
+}
+
@@ -0,0 +1,145 @@
+/**
+******************************************************************************
+* @file    platform.h
+* @author  William Xu
+* @version V1.0.0
+* @date    16-Oct-2026
+* @brief   This file provides all MICO Peripherals defined for the Linux host
+*          platform.
+******************************************************************************
+*
+*  The MIT License
+*  Copyright (c) 2014 MXCHIP Inc.
+*
+*  Permission is hereby granted, free of charge, to any person obtaining a copy
+*  of this software and associated documentation files (the "Software"), to deal
+*  in the Software without restriction, including without limitation the rights
+*  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+*  copies of the Software, and to permit persons to whom the Software is furnished
+*  to do so, subject to the following conditions:
+*
+*  The above copyright notice and this permission notice shall be included in
+*  all copies or substantial portions of the Software.
+*
+*  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+*  WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR
+*  IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+******************************************************************************
+*/
+
+#include "platform_common_config.h"
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/******************************************************
+ *                      Macros
+ ******************************************************/
+
+/******************************************************
+ *                    Constants
+ ******************************************************/
+
+#define HARDWARE_REVISION   "LinuxHost"
+#define DEFAULT_NAME        "MICO Linux Host"
+#define MODEL               "LinuxHost"
+
+/******************************************************
+ *                   Enumerations
+ ******************************************************/
+
+/*
+Linux host platform peripheral definitions ...
++-------------------------------------------------------------------------+
+| Enum ID       | Host implementation                                     |
+|---------------+---------------------------------------------------------|
+| MICO_GPIO_x   | Level kept in memory, inputs driven by                  |
+|               | posix_gpio_set_input()                                  |
+|---------------+---------------------------------------------------------|
+| MICO_UART_1   | Pseudo terminal, the slave name is printed at init      |
+|---------------+---------------------------------------------------------|
+| MICO_UART_2   | Process stdin/stdout (STDIO_UART)                       |
+|---------------+---------------------------------------------------------|
+| MICO_SPI_FLASH| Simulated JEDEC serial NOR in $MICO_FLASH_DIR/          |
+|               | mico_flash_spi.bin                                      |
+|---------------+---------------------------------------------------------|
+| MICO_INTERNAL_| NOR memory in $MICO_FLASH_DIR/mico_flash_internal.bin   |
+| FLASH         |                                                         |
++---------------+---------------------------------------------------------+
+*/
+
+typedef enum
+{
+    MICO_GPIO_1 = MICO_COMMON_GPIO_MAX,
+    MICO_GPIO_2,
+    MICO_GPIO_3,
+    MICO_GPIO_4,
+    MICO_GPIO_5,
+    MICO_GPIO_6,
+    MICO_GPIO_7,
+    MICO_GPIO_8,
+    MICO_GPIO_MAX, /* Denotes the total number of GPIO port aliases. Not a valid GPIO alias */
+} mico_gpio_t;
+
+typedef enum
+{
+    MICO_SPI_1,
+    MICO_SPI_MAX, /* Denotes the total number of SPI port aliases. Not a valid SPI alias */
+} mico_spi_t;
+
+typedef enum
+{
+    MICO_I2C_1,
+    MICO_I2C_MAX, /* Denotes the total number of I2C port aliases. Not a valid I2C alias */
+} mico_i2c_t;
+
+typedef enum
+{
+    MICO_PWM_1 = MICO_COMMON_PWM_MAX,
+    MICO_PWM_MAX, /* Denotes the total number of PWM port aliases. Not a valid PWM alias */
+} mico_pwm_t;
+
+typedef enum
+{
+    MICO_ADC_1,
+    MICO_ADC_MAX, /* Denotes the total number of ADC port aliases. Not a valid ADC alias */
+} mico_adc_t;
+
+typedef enum
+{
+    MICO_UART_1,
+    MICO_UART_2,
+    MICO_UART_MAX, /* Denotes the total number of UART port aliases. Not a valid UART alias */
+} mico_uart_t;
+
+typedef enum
+{
+  MICO_SPI_FLASH,
+  MICO_INTERNAL_FLASH,
+  MICO_FLASH_MAX,
+} mico_flash_t;
+
+/* The SPI flash driver is compiled with all simulated chip models */
+#define USE_MICO_SPI_FLASH
+#define SFLASH_SUPPORT_MACRONIX_PARTS
+#define SFLASH_SUPPORT_WINBOND_PARTS
+#define SFLASH_SUPPORT_SST_PARTS
+#define SFLASH_PLATFORM_DATA_LINES      (4)   /**< The simulated bus has quad I/O */
+
+/* I/O connection <-> Peripheral Connections */
+#define MICO_I2C_CP         (MICO_I2C_1)
+
+#define RestoreDefault_TimeOut          3000  /**< Restore default and start easylink after
+                                                   press down EasyLink button for 3 seconds. */
+
+#ifdef __cplusplus
+} /*extern "C" */
+#endif
+
@@ -0,0 +1,184 @@
+/**
+******************************************************************************
+* @file    platform_common_config.h
+* @author  William Xu
+* @version V1.0.0
+* @date    16-Oct-2026
+* @brief   This file provides common configuration for the Linux host platform.
+******************************************************************************
+*
+*  The MIT License
+*  Copyright (c) 2014 MXCHIP Inc.
+*
+*  Permission is hereby granted, free of charge, to any person obtaining a copy
+*  of this software and associated documentation files (the "Software"), to deal
+*  in the Software without restriction, including without limitation the rights
+*  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+*  copies of the Software, and to permit persons to whom the Software is furnished
+*  to do so, subject to the following conditions:
+*
+*  The above copyright notice and this permission notice shall be included in
+*  all copies or substantial portions of the Software.
+*
+*  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+*  WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR
+*  IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+******************************************************************************
+*/
+
+#pragma once
+
+/******************************************************
+*                      Macros
+******************************************************/
+
+/******************************************************
+*                    Constants
+******************************************************/
+
+/* MICO RTOS tick rate in Hz */
+#define MICO_DEFAULT_TICK_RATE_HZ                   (1000)
+
+/************************************************************************
+ * Uncomment to disable watchdog. For debugging only */
+//#define MICO_DISABLE_WATCHDOG
+
+/************************************************************************
+ * Uncomment to disable standard IO, i.e. printf(), etc. */
+//#define MICO_DISABLE_STDIO
+
+/************************************************************************
+ * Uncomment to disable MCU powersave API functions */
+#define MICO_DISABLE_MCU_POWERSAVE
+
+/************************************************************************
+ * Uncomment to enable MCU real time clock */
+#define MICO_ENABLE_MCU_RTC
+
+
+/* These are internal platform connections only */
+typedef enum
+{
+  MICO_GPIO_UNUSED = -1,
+
+  WL_GPIO0 = 0,
+  WL_GPIO1,
+  WL_RESET,
+  MICO_SYS_LED,
+  MICO_RF_LED,
+  BOOT_SEL,
+  MFG_SEL,
+  Standby_SEL,
+  EasyLink_BUTTON,
+  STDIO_UART_RX,
+  STDIO_UART_TX,
+  MICO_COMMON_GPIO_MAX,
+} mico_common_gpio_t;
+
+#define MICO_GPIO_WLAN_POWERSAVE_CLOCK MICO_GPIO_UNUSED
+#define WL_REG MICO_GPIO_UNUSED
+
+/* How the wlan's powersave clock is connected */
+typedef enum
+{
+  MICO_PWM_WLAN_POWERSAVE_CLOCK,
+  MICO_COMMON_PWM_MAX,
+} mico_common_pwm_t;
+
+/* WLAN Powersave Clock Source
+ * There is no WLAN module on the Linux host, so there is no sleep clock to drive.
+ */
+#define MICO_WLAN_POWERSAVE_CLOCK_SOURCE MICO_WLAN_POWERSAVE_CLOCK_IS_NOT_EXIST
+
+#define MICO_WLAN_POWERSAVE_CLOCK_IS_NOT_EXIST  0
+#define MICO_WLAN_POWERSAVE_CLOCK_IS_PWM        1
+#define MICO_WLAN_POWERSAVE_CLOCK_IS_MCO        2
+
+
+#define WLAN_POWERSAVE_CLOCK_FREQUENCY 32768 /* 32768Hz        */
+#define WLAN_POWERSAVE_CLOCK_DUTY_CYCLE   50 /* 50% duty-cycle */
+
+/* The number of UART interfaces this hardware platform has */
+#define NUMBER_OF_UART_INTERFACES  2
+
+#define UART_FOR_APP     MICO_UART_1
+#define STDIO_UART       MICO_UART_2
+#define MFG_TEST         MICO_UART_2
+#define CLI_UART         MICO_UART_2
+
+/* Memory map, the same layout as EMW3165. Each flash is a file in $MICO_FLASH_DIR */
+#define INTERNAL_FLASH_START_ADDRESS    (uint32_t)0x08000000
+#define INTERNAL_FLASH_END_ADDRESS      (uint32_t)0x0807FFFF
+#define INTERNAL_FLASH_SIZE             (INTERNAL_FLASH_END_ADDRESS - INTERNAL_FLASH_START_ADDRESS + 1) /* 512k bytes*/
+
+#define SPI_FLASH_START_ADDRESS         (uint32_t)0x00000000
+#define SPI_FLASH_END_ADDRESS           (uint32_t)0x001FFFFF
+#define SPI_FLASH_SIZE                  (SPI_FLASH_END_ADDRESS - SPI_FLASH_START_ADDRESS + 1) /* 2M bytes*/
+
+#define MICO_FLASH_FOR_APPLICATION  MICO_INTERNAL_FLASH
+#define APPLICATION_START_ADDRESS   (uint32_t)0x0800C000
+#define APPLICATION_END_ADDRESS     (uint32_t)0x0807FFFF
+#define APPLICATION_FLASH_SIZE      (APPLICATION_END_ADDRESS - APPLICATION_START_ADDRESS + 1) /* 480 bytes*/
+
+#define MICO_FLASH_FOR_UPDATE       MICO_SPI_FLASH  /* Optional */
+#define UPDATE_START_ADDRESS        (uint32_t)0x00040000 /* Optional */
+#define UPDATE_END_ADDRESS          (uint32_t)0x0009FFFF /* Optional */
+#define UPDATE_FLASH_SIZE           (UPDATE_END_ADDRESS - UPDATE_START_ADDRESS + 1) /* 256k bytes, optional*/
+#define UPDATE_SECTOR_SIZE          (uint32_t)0x00001000 /* Erase unit of the update area, 4k sectors, optional */
+
+#define MICO_FLASH_FOR_OTA_SESSION  MICO_SPI_FLASH  /* Optional */
+#define OTA_SESSION_START_ADDRESS   (uint32_t)0x000A0000 /* Progress of an OTA transfer, two 4k sectors, optional */
+#define OTA_SESSION_END_ADDRESS     (uint32_t)0x000A1FFF /* Optional */
+
+#define MICO_FLASH_FOR_KV           MICO_SPI_FLASH  /* Optional */
+#define KV_START_ADDRESS            (uint32_t)0x000A2000 /* Key-value store of the configuration, optional */
+#define KV_END_ADDRESS              (uint32_t)0x000A7FFF /* Optional */
+#define KV_SECTOR_SIZE              (uint32_t)0x00001000 /* Six 4k sectors, optional */
+
+#define MICO_FLASH_FOR_FS           MICO_SPI_FLASH  /* Optional */
+#define FS_START_ADDRESS            (uint32_t)0x000A8000 /* FAT file system of sflash_diskio, optional */
+#define FS_END_ADDRESS              (uint32_t)0x001FFFFF /* Optional */
+#define FS_BLOCK_SIZE               (uint32_t)0x00001000 /* Erase unit, 1376k bytes in 4k sectors, optional */
+
+#define MICO_FLASH_FOR_BOOT         MICO_INTERNAL_FLASH
+#define BOOT_START_ADDRESS          (uint32_t)0x08000000
+#define BOOT_END_ADDRESS            (uint32_t)0x08007FFF
+#define BOOT_FLASH_SIZE             (BOOT_END_ADDRESS - BOOT_START_ADDRESS + 1) /* 16k bytes*/
+
+#define MICO_FLASH_FOR_DRIVER       MICO_SPI_FLASH
+#define DRIVER_START_ADDRESS        (uint32_t)0x00002000
+#define DRIVER_END_ADDRESS          (uint32_t)0x0003FFFF
+#define DRIVER_FLASH_SIZE           (DRIVER_END_ADDRESS - DRIVER_START_ADDRESS + 1) /* 248k bytes*/
+
+#define MICO_FLASH_FOR_PARA         MICO_SPI_FLASH
+#define PARA_START_ADDRESS          (uint32_t)0x00000000
+#define PARA_END_ADDRESS            (uint32_t)0x00000FFF
+#define PARA_FLASH_SIZE             (PARA_END_ADDRESS - PARA_START_ADDRESS + 1)   /* 4k bytes*/
+
+#define MICO_FLASH_FOR_EX_PARA      MICO_SPI_FLASH
+#define EX_PARA_START_ADDRESS       (uint32_t)0x00001000
+#define EX_PARA_END_ADDRESS         (uint32_t)0x00001FFF
+#define EX_PARA_FLASH_SIZE          (EX_PARA_END_ADDRESS - EX_PARA_START_ADDRESS + 1)   /* 4k bytes*/
+
+/******************************************************
+*                   Enumerations
+******************************************************/
+
+/******************************************************
+*                 Type Definitions
+******************************************************/
+
+/******************************************************
+*                    Structures
+******************************************************/
+
+/******************************************************
+*                 Global Variables
+******************************************************/
+
+/******************************************************
+*               Function Declarations
+******************************************************/
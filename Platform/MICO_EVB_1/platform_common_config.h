@@ -185,6 +185,21 @@ typedef enum
 #define UPDATE_START_ADDRESS        (uint32_t)0x00040000 /* Optional */
 #define UPDATE_END_ADDRESS          (uint32_t)0x0009FFFF /* Optional */
 #define UPDATE_FLASH_SIZE           (UPDATE_END_ADDRESS - UPDATE_START_ADDRESS + 1) /* 384k bytes, optional*/
+#define UPDATE_SECTOR_SIZE          (uint32_t)0x00001000 /* Erase unit of the update area, 4k sectors, optional */
+
+#define MICO_FLASH_FOR_OTA_SESSION  MICO_SPI_FLASH  /* Optional */
+#define OTA_SESSION_START_ADDRESS   (uint32_t)0x000A0000 /* Progress of an OTA transfer, two 4k sectors, optional */
+#define OTA_SESSION_END_ADDRESS     (uint32_t)0x000A1FFF /* Optional */
+
+#define MICO_FLASH_FOR_KV           MICO_SPI_FLASH  /* Optional */
+#define KV_START_ADDRESS            (uint32_t)0x000A2000 /* Key-value store of the configuration, optional */
+#define KV_END_ADDRESS              (uint32_t)0x000A7FFF /* Optional */
+#define KV_SECTOR_SIZE              (uint32_t)0x00001000 /* Six 4k sectors, optional */
+
+#define MICO_FLASH_FOR_FS           MICO_SPI_FLASH  /* Optional */
+#define FS_START_ADDRESS            (uint32_t)0x000A8000 /* FAT file system of sflash_diskio, optional */
+#define FS_END_ADDRESS              (uint32_t)0x000FFFFF /* Optional */
+#define FS_BLOCK_SIZE               (uint32_t)0x00001000 /* Erase unit, 352k bytes in 4k sectors, optional */
 
 #define MICO_FLASH_FOR_BOOT         MICO_INTERNAL_FLASH
 #define BOOT_START_ADDRESS          (uint32_t)0x08000000
@@ -33,7 +33,7 @@
 #define __MICODRIVERI2C_H__
 
 #pragma once
-#include "common.h"
+#include "Common.h"
 #include "platform.h"
 
 /** @addtogroup MICO_PLATFORM
@@ -99,6 +99,16 @@ typedef enum
  *                 Type Definitions
  ******************************************************/
 
+/** Called when an asynchronous transmission has completed, from interrupt context
+ *
+ * @param  uart     : the UART interface
+ * @param  data     : the data given to MicoUartSendAsync, it can be reused
+ * @param  size     : number of bytes given to MicoUartSendAsync
+ * @param  result   : kNoErr when the data is sent, an error code otherwise
+ * @param  arg      : the argument given to MicoUartSendAsync
+ */
+typedef void (*mico_uart_tx_callback_t)( mico_uart_t uart, const void* data, uint32_t size, OSStatus result, void* arg );
+
 /******************************************************
  *                 Function Declarations
  ******************************************************/
@@ -158,6 +168,28 @@ OSStatus MicoUartFinalize( mico_uart_t uart );
 OSStatus MicoUartSend( mico_uart_t uart, const void* data, uint32_t size );
 
 
+/** Queue data for transmission on a UART interface without waiting
+ *
+ * The request is added to a bounded queue. The driver sends queued requests
+ * back to back, requests that follow each other in memory go out in one DMA
+ * transfer. MicoUartSend is queued behind the pending requests.
+ *
+ * @note  data must stay valid until callback is called. The callback runs in
+ *        interrupt context and may queue the next request.
+ *
+ * @param  uart     : the UART interface
+ * @param  data     : pointer to the start of data
+ * @param  size     : number of bytes to transmit, 65535 at most
+ * @param  callback : called when the data is sent, can be NULL
+ * @param  arg      : argument passed to callback
+ *
+ * @return    kNoErr          : on success.
+ * @return    kNoResourcesErr : if the transmit queue is full
+ * @return    kSizeErr        : if size is 0 or too large
+ */
+OSStatus MicoUartSendAsync( mico_uart_t uart, const void* data, uint32_t size, mico_uart_tx_callback_t callback, void* arg );
+
+
 /** Receive data on a UART interface
  *
  * @param  uart     : the UART interface
@@ -170,6 +202,28 @@ OSStatus MicoUartSend( mico_uart_t uart, const void* data, uint32_t size );
  */
 OSStatus MicoUartRecv( mico_uart_t uart, void* data, uint32_t size, uint32_t timeout );
 
+
+/** Receive one frame on a UART interface
+ *
+ * A frame is a burst of bytes ended by an idle line. The driver receives into
+ * the RX ring buffer by DMA and interrupts once per burst (line idle) and at
+ * half and full buffer, instead of once per byte.
+ *
+ * @note  Requires the RX ring buffer given to MicoUartInitialize. A frame larger
+ *        than size, or than half of the ring buffer, is returned in pieces.
+ *
+ * @param  uart     : the UART interface
+ * @param  data     : pointer to the buffer which will store the frame
+ * @param  size     : size of the buffer
+ * @param  received_size : number of bytes stored in data
+ * @param  timeout  : timeout in milisecond
+ *
+ * @return    kNoErr        : on success.
+ * @return    kTimeoutErr   : if no frame is received before timeout
+ * @return    kUnsupportedErr : if the UART has no RX ring buffer
+ */
+OSStatus MicoUartRecvFrame( mico_uart_t uart, void* data, uint32_t size, uint32_t* received_size, uint32_t timeout );
+
 /** Read the length of the data that is already recived by uart driver and stored in buffer
  *
  * @param  uart     : the UART interface